@@ -0,0 +1,233 @@
+/* This file is part of the Transient Recorder Framework.
+ * It is subject to the license terms in the LICENSE.txt file found in the
+ * top-level directory of this distribution and at
+ * https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. No part
+ * of the Transient Recorder Framework, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ */
+
+#include "TRAllocAudit.h"
+
+#ifdef TR_ALLOC_AUDIT
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <new>
+
+#include <epicsAtomic.h>
+#include <epicsThread.h>
+
+// Audit category of each thread, stored as category+1 (NULL if not audited).
+static epicsThreadPrivateId s_thread_category = epicsThreadPrivateCreate();
+
+// Number of read threads in steady state, used for worker threads.
+static int s_num_steady = 0;
+
+// Counters of audited allocations (size_t for atomic access, which is
+// 64-bit on 64-bit hosts).
+static size_t s_counts[TRNumAllocAuditCategories];
+static size_t s_pool_growth_count = 0;
+
+// Configuration from the environment.
+static int readWarmupBursts ()
+{
+    char const *value = getenv("TR_ALLOC_AUDIT_WARMUP");
+    return (value != NULL) ? atoi(value) : 1;
+}
+static int s_warmup_bursts = readWarmupBursts();
+
+static bool readAbort ()
+{
+    char const *value = getenv("TR_ALLOC_AUDIT_ABORT");
+    return value != NULL && strcmp(value, "YES") == 0;
+}
+static bool s_abort = readAbort();
+
+// Names of the categories after the phases.
+static char const * const CategoryNames[] = {
+    "waitForPreconditions",
+    "checkSettings",
+    "startAcquisition",
+    "readBurst",
+    "checkOverflow",
+    "processBurstData",
+    "interruptReading",
+    "stopAcquisition",
+    "onDisarmed",
+    "readLoop",
+    "workerThread"
+};
+
+static int getCategory ()
+{
+    if (s_thread_category == NULL) {
+        return -1;
+    }
+    return (int)(intptr_t)epicsThreadPrivateGet(s_thread_category) - 1;
+}
+
+static void setCategory (int category)
+{
+    epicsThreadPrivateSet(s_thread_category, (void *)(intptr_t)(category + 1));
+}
+
+// Called for each allocation using operator new.
+static void auditAllocation (size_t size)
+{
+    int category = getCategory();
+    if (category < 0) {
+        return;
+    }
+    if (category == TRAllocAuditWorkerThread && epicsAtomicGetIntT(&s_num_steady) == 0) {
+        return;
+    }
+
+    epicsAtomicIncrSizeT(&s_counts[category]);
+
+    if (s_abort) {
+        // Avoid errlog which may itself allocate.
+        fprintf(stderr, "TRAllocAudit: Allocation of %u bytes in %s, aborting.\n",
+                (unsigned int)size, CategoryNames[category]);
+        abort();
+    }
+}
+
+void TRAllocAudit::enterSteadyState ()
+{
+    if (getCategory() < 0) {
+        setCategory(TRAllocAuditReadLoop);
+        epicsAtomicIncrIntT(&s_num_steady);
+    }
+}
+
+void TRAllocAudit::leaveSteadyState ()
+{
+    if (getCategory() >= 0) {
+        setCategory(-1);
+        epicsAtomicDecrIntT(&s_num_steady);
+    }
+}
+
+void TRAllocAudit::setWorkerThread ()
+{
+    setCategory(TRAllocAuditWorkerThread);
+}
+
+int TRAllocAudit::setThreadCategory (int category)
+{
+    int prev_category = getCategory();
+    if (prev_category >= 0) {
+        setCategory(category);
+    }
+    return prev_category;
+}
+
+void TRAllocAudit::countPoolGrowth ()
+{
+    if (getCategory() >= 0) {
+        epicsAtomicIncrSizeT(&s_pool_growth_count);
+    }
+}
+
+int TRAllocAudit::warmupBursts ()
+{
+    return s_warmup_bursts;
+}
+
+size_t TRAllocAudit::getCount (int category)
+{
+    return epicsAtomicGetSizeT(&s_counts[category]);
+}
+
+size_t TRAllocAudit::getPoolGrowthCount ()
+{
+    return epicsAtomicGetSizeT(&s_pool_growth_count);
+}
+
+void TRAllocAudit::reset ()
+{
+    for (int i = 0; i < TRNumAllocAuditCategories; i++) {
+        epicsAtomicSetSizeT(&s_counts[i], 0);
+    }
+    epicsAtomicSetSizeT(&s_pool_growth_count, 0);
+}
+
+char const * TRAllocAudit::categoryName (int category)
+{
+    return CategoryNames[category];
+}
+
+// Replacements of the global operator new and delete. Dynamic exception
+// specifications are not allowed since C++17, so new has none and delete
+// is noexcept where supported (throw() before C++11).
+
+#if __cplusplus >= 201103L
+#define TR_ALLOC_AUDIT_NOEXCEPT noexcept
+#else
+#define TR_ALLOC_AUDIT_NOEXCEPT throw ()
+#endif
+
+void * operator new (size_t size)
+{
+    auditAllocation(size);
+    void *ptr = malloc((size == 0) ? 1 : size);
+    if (ptr == NULL) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void * operator new[] (size_t size)
+{
+    return operator new(size);
+}
+
+void * operator new (size_t size, std::nothrow_t const &) TR_ALLOC_AUDIT_NOEXCEPT
+{
+    auditAllocation(size);
+    return malloc((size == 0) ? 1 : size);
+}
+
+void * operator new[] (size_t size, std::nothrow_t const &nt) TR_ALLOC_AUDIT_NOEXCEPT
+{
+    return operator new(size, nt);
+}
+
+void operator delete (void *ptr) TR_ALLOC_AUDIT_NOEXCEPT
+{
+    free(ptr);
+}
+
+void operator delete[] (void *ptr) TR_ALLOC_AUDIT_NOEXCEPT
+{
+    free(ptr);
+}
+
+#if __cpp_sized_deallocation >= 201309L
+void operator delete (void *ptr, size_t) TR_ALLOC_AUDIT_NOEXCEPT
+{
+    free(ptr);
+}
+
+void operator delete[] (void *ptr, size_t) TR_ALLOC_AUDIT_NOEXCEPT
+{
+    free(ptr);
+}
+#endif
+
+void operator delete (void *ptr, std::nothrow_t const &) TR_ALLOC_AUDIT_NOEXCEPT
+{
+    free(ptr);
+}
+
+void operator delete[] (void *ptr, std::nothrow_t const &) TR_ALLOC_AUDIT_NOEXCEPT
+{
+    free(ptr);
+}
+
+#endif
@@ -0,0 +1,114 @@
+/* This file is part of the Transient Recorder Framework.
+ * It is subject to the license terms in the LICENSE.txt file found in the
+ * top-level directory of this distribution and at
+ * https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. No part
+ * of the Transient Recorder Framework, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ */
+
+/**
+ * @file
+ *
+ * Defines the TRAllocAudit class, which counts heap allocations made
+ * in the read loop when the framework is built with allocation auditing.
+ */
+
+#ifndef TRANSREC_ALLOC_AUDIT_H
+#define TRANSREC_ALLOC_AUDIT_H
+
+#include <stddef.h>
+
+#include "TRNonCopyable.h"
+#include "TRPerfStatsDriver.h"
+
+/**
+ * Categories of audited allocations.
+ *
+ * Values below TRNumPerfPhases are the phases (@ref TRPerfPhase) in
+ * which the allocation was made by the read thread.
+ */
+enum TRAllocAuditCategory {
+    // Read thread in the read loop but outside of driver functions.
+    TRAllocAuditReadLoop = TRNumPerfPhases,
+    // TRWorkerThread tasks while any read loop is in steady state.
+    TRAllocAuditWorkerThread,
+    TRNumAllocAuditCategories
+};
+
+/**
+ * Heap allocation auditing for the read loop.
+ *
+ * When the framework is built with `TR_ALLOC_AUDIT=YES` (which defines
+ * the TR_ALLOC_AUDIT macro), the global operator new and delete are
+ * replaced so that allocations made by the read thread in the steady
+ * state of the read loop (after a number of warm-up bursts) and by
+ * worker threads during that time are counted per category. Growth of
+ * the NDArray pool is counted separately. The counts are process-wide,
+ * reset at the start of each arming and included in the arming summary.
+ *
+ * The following environment variables are read once at startup:
+ * - `TR_ALLOC_AUDIT_WARMUP`: Number of bursts after which the read loop
+ *   is considered to be in steady state (default 1).
+ * - `TR_ALLOC_AUDIT_ABORT`: If `YES`, abort the IOC on the first audited
+ *   allocation, so that a core dump shows where it was made.
+ *
+ * Only allocations using operator new are counted (including nothrow new
+ * and those of standard containers and strings), not malloc.
+ *
+ * Without TR_ALLOC_AUDIT, all functions are inline no-ops.
+ */
+class TRAllocAudit {
+public:
+#ifdef TR_ALLOC_AUDIT
+    static bool enabled () { return true; }
+    static void enterSteadyState ();
+    static void leaveSteadyState ();
+    static void setWorkerThread ();
+    static int setThreadCategory (int category);
+    static void countPoolGrowth ();
+    static int warmupBursts ();
+    static size_t getCount (int category);
+    static size_t getPoolGrowthCount ();
+    static void reset ();
+    static char const * categoryName (int category);
+#else
+    static bool enabled () { return false; }
+    static void enterSteadyState () {}
+    static void leaveSteadyState () {}
+    static void setWorkerThread () {}
+    static int setThreadCategory (int) { return -1; }
+    static void countPoolGrowth () {}
+    static int warmupBursts () { return 0; }
+    static size_t getCount (int) { return 0; }
+    static size_t getPoolGrowthCount () { return 0; }
+    static void reset () {}
+    static char const * categoryName (int) { return ""; }
+#endif
+};
+
+/**
+ * Sets the audit category of the current thread for the lifetime of
+ * the object, if the thread is currently being audited.
+ */
+class TRAllocAuditScope :
+    private TRNonCopyable
+{
+public:
+    inline TRAllocAuditScope (int category)
+    : m_prev_category(TRAllocAudit::setThreadCategory(category))
+    {
+    }
+
+    inline ~TRAllocAuditScope ()
+    {
+        if (m_prev_category >= 0) {
+            TRAllocAudit::setThreadCategory(m_prev_category);
+        }
+    }
+
+private:
+    int m_prev_category;
+};
+
+#endif
@@ -16,7 +16,12 @@
 #ifndef TRANSREC_ARM_INFO_H
 #define TRANSREC_ARM_INFO_H
 
+#include <stddef.h>
+
 #include <cmath>
+#include <vector>
+
+#include <NDArray.h>
 
 #include "TRNonCopyable.h"
 
@@ -34,11 +39,17 @@ class TRArmInfo :
     friend class TRBaseDriver;
     
 private:
-    inline TRArmInfo ()
+    inline TRArmInfo (int num_channels)
     : rate_for_display(NAN),
       custom_time_array_calc_inputs(false),
       custom_time_array_num_pre_samples(0),
-      custom_time_array_num_post_samples(0)
+      custom_time_array_num_post_samples(0),
+      scratch_size(0),
+      burst_memory(0),
+      expected_burst_rate(NAN),
+      channel_decimation(num_channels, 1),
+      sample_size(0),
+      process_input_data_type(NDInt16)
     {
     }
     
@@ -75,6 +86,89 @@ public:
      * @ref custom_time_array_calc_inputs is true.
      */
     int custom_time_array_num_post_samples;
+    
+    /**
+     * Size of the scratch arena needed for this arming (bytes).
+     * 
+     * Temporary buffers can be allocated from the scratch arena using
+     * TRBaseDriver::allocScratch from startAcquisition until the end of
+     * the arming (see TRScratchArena). The size should include padding
+     * for alignment (up to 63 bytes per allocation). The default is zero.
+     */
+    size_t scratch_size;
+    
+    /**
+     * Memory of the NDArrays submitted for one burst, for all channels (bytes).
+     * 
+     * This is used for automatic sizing of the NDArray pool (see the
+     * POOL_AUTO_SIZE parameter). The default is zero, in which case the
+     * amount observed in the previous arming is used.
+     */
+    size_t burst_memory;
+    
+    /**
+     * Expected rate of bursts (Hz).
+     * 
+     * This is used for automatic sizing of the NDArray pool (see the
+     * POOL_AUTO_SIZE parameter). The default is NAN, in which case the
+     * rate observed in the previous arming is used.
+     */
+    double expected_burst_rate;
+    
+    /**
+     * Decimation ratio of each channel.
+     * 
+     * This is intended for hardware where some channels are sampled at a
+     * fraction of the rate of other channels. The driver may set the ratio
+     * of a channel to D (D >= 1) if the channel has one sample for every D
+     * samples at @ref rate_for_display, with samples aligned to the trigger.
+     * The number of samples of the channel is then as given by
+     * @ref decimateSampleCounts (see also TRBaseDriver::getChannelSampleCounts),
+     * and the time array, the READ_SAMPLE_RATE attribute of NDArrays and
+     * automatic pool sizing account for it.
+     * 
+     * The vector has one element for each channel, all of which are 1 by
+     * default. The driver must not change the size of the vector.
+     */
+    std::vector<int> channel_decimation;
+    
+    /**
+     * Size of a sample in the NDArrays submitted by the driver (bytes).
+     * 
+     * If this is set and @ref burst_memory is not, the memory of a burst
+     * for automatic sizing of the NDArray pool is computed from the number
+     * of samples of each channel. The default is zero (not set).
+     */
+    size_t sample_size;
+    
+    /**
+     * Data type of the inputs given to TRBaseDriver::submitProcessedBurst.
+     * 
+     * Processing chains support NDInt16 and NDFloat64 inputs; arming fails
+     * if a channel has a chain and the type is not supported. The default
+     * is NDInt16.
+     */
+    NDDataType_t process_input_data_type;
+    
+    /**
+     * Calculate the number of samples of a decimated channel.
+     * 
+     * Samples of the channel are those samples at the full rate whose index
+     * relative to the trigger is a multiple of the decimation ratio, so the
+     * sample at the trigger is always included.
+     * 
+     * @param decimation The decimation ratio (at least 1).
+     * @param num_pre The number of pre-trigger samples at the full rate.
+     * @param num_post The number of post-trigger samples at the full rate.
+     * @param dec_num_pre Set to the number of pre-trigger samples of the channel.
+     * @param dec_num_post Set to the number of post-trigger samples of the channel.
+     */
+    static inline void decimateSampleCounts (int decimation, int num_pre, int num_post,
+                                             int *dec_num_pre, int *dec_num_post)
+    {
+        *dec_num_pre = num_pre / decimation;
+        *dec_num_post = num_post / decimation + (num_post % decimation != 0);
+    }
 };
 
 #endif
@@ -45,8 +45,16 @@ public:
       read_thread_stack_size(0),
       max_ad_buffers(0),
       max_ad_memory(0),
+      ad_memory_reservation(0),
       supports_pre_samples(false),
-      update_arrays(true)
+      update_arrays(true),
+      elide_unused_arrays(false),
+      num_perf_entries(0),
+      num_copy_threads(0),
+      num_read_streams(1),
+      num_trigger_sources(1),
+      process_graph(false),
+      load_injection(false)
     {
     }
     
@@ -130,6 +138,15 @@ public:
      */
     size_t max_ad_memory;
     
+    /**
+     * Memory reserved for NDArrays of the channels port in the global
+     * memory budget (see TRMemoryBudget).
+     * 
+     * This has no effect if the global budget is not configured.
+     * The default is 0 (no reservation, only shared memory is used).
+     */
+    size_t ad_memory_reservation;
+    
     /**
      * Whether the driver supports samples before the trigger event.
      * 
@@ -145,6 +162,83 @@ public:
      */
     bool update_arrays;
     
+    /**
+     * Whether arrays without consumers are elided.
+     * 
+     * If true, TRChannelDataSubmit::allocateArray does not allocate an array
+     * for a channels port address which has no consumers (see
+     * TRBaseDriver::hasArrayConsumers), so the driver MUST check
+     * TRChannelDataSubmit::data for NULL and should then skip reading,
+     * converting or processing the data of the channel. Elided arrays are
+     * counted in the arming statistics. The default is false.
+     */
+    bool elide_unused_arrays;
+    
+    /**
+     * Number of performance statistics entries registered by the driver.
+     * 
+     * This MUST be greater than or equal to the number of entries that
+     * the derived class will register using TRBaseDriver::registerPerfEntry.
+     * The default is 0.
+     */
+    int num_perf_entries;
+    
+    /**
+     * Number of helper threads for copying and converting large bursts.
+     * 
+     * These are used by TRParallelCopy (see TRBaseDriver::getParallelCopy
+     * and TRChannelDataSubmit::copyData) and by the processing graph (see
+     * @ref process_graph), and run at the read thread priority.
+     * The default is 0 (no helper threads).
+     */
+    int num_copy_threads;
+    
+    /**
+     * Number of read streams.
+     * 
+     * With more than one stream, each stream has its own read loop thread
+     * (at the read thread priority) calling TRBaseDriver::readStreamBurst,
+     * TRBaseDriver::checkStreamOverflow and TRBaseDriver::processStreamBurstData
+     * for the stream, so that hardware with independent DMA engines can be
+     * read concurrently. The performance statistics entries of these phases
+     * are shared by the streams, while stalls are detected for each stream.
+     * The default is 1 (the single read loop).
+     */
+    int num_read_streams;
+    
+    /**
+     * Number of trigger sources.
+     * 
+     * The driver tags each burst with its trigger source using
+     * TRBaseDriver::routeBurst, and the arrays of each source are submitted
+     * to a separate range of addresses of the channels port: channel c of
+     * source s is at address s*num_channels+c. This allows consumers of
+     * different sources (e.g. beam and calibration triggers) to be connected
+     * to different addresses, so that they do not receive arrays of other
+     * sources. Each source also has counters and a rate limit in the trigger
+     * port (see TRTriggerDriver). The default is 1 (all bursts from source 0).
+     */
+    int num_trigger_sources;
+    
+    /**
+     * Whether to create the processing graph (see TRProcessGraph).
+     * 
+     * This allows the driver to submit raw data using
+     * TRBaseDriver::submitProcessedBurst, so that each channel is processed
+     * by the chain of stages configured for it in the `_proc` port, on the
+     * num_copy_threads helper threads. The default is false.
+     */
+    bool process_graph;
+    
+    /**
+     * Whether to create the load injection port (see TRLoadInjectDriver).
+     * 
+     * This is intended for testing the behavior under load; without it,
+     * the injection points in the data path are a single pointer check.
+     * The default is false.
+     */
+    bool load_injection;
+    
     /**
      * Helper function for setting parameters using chaining.
      * 
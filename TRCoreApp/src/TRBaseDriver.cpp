@@ -7,16 +7,28 @@
  * contained in the LICENSE.txt file.
  */
 
+#include <stdarg.h>
+#include <stdio.h>
+
 #include <cmath>
 #include <string>
 #include <algorithm>
 
 #include <epicsThread.h>
 #include <epicsGuard.h>
+#include <epicsAtomic.h>
 #include <epicsAssert.h>
 #include <errlog.h>
 
 #include "TRBaseDriver.h"
+#include "TRAllocAudit.h"
+#include "TRInt64Param.h"
+
+// Period of the watchdog checks (s).
+static double const WatchdogPeriod = 0.1;
+
+// How many times the watchdog calls interruptReading before giving up.
+static int const WatchdogMaxInterruptRetries = 2;
 
 TRBaseDriver::TRBaseDriver (TRBaseConfig const &cfg)
 :
@@ -24,55 +36,194 @@ TRBaseDriver::TRBaseDriver (TRBaseConfig const &cfg)
         cfg.port_name.c_str(),
         1, // maxAddr
         NUM_BASE_ASYN_PARAMS + cfg.num_asyn_params + 2 * (NumBaseConfigParams + cfg.num_config_params),
-        cfg.interface_mask|asynInt32Mask|asynFloat64Mask|asynOctetMask|asynDrvUserMask, // interfaceMask
-        cfg.interrupt_mask|asynInt32Mask|asynFloat64Mask|asynOctetMask, // interruptMask
+        cfg.interface_mask|asynInt32Mask|asynFloat64Mask|asynOctetMask|asynDrvUserMask|TRInt64Mask, // interfaceMask
+        cfg.interrupt_mask|asynInt32Mask|asynFloat64Mask|asynOctetMask|TRInt64Mask, // interruptMask
         0, // asynFlags (no ASYN_CANBLOCK - we don't block)
         1, // autoConnect
         0, // priority (ignored with no ASYN_CANBLOCK)
         0  // stackSize (ignored witn no ASYN_CANBLOCK)
     ),
     m_num_channels(cfg.num_channels),
+    m_num_trigger_sources(std::max(1, cfg.num_trigger_sources)),
     m_supports_pre_samples(cfg.supports_pre_samples),
     m_update_arrays(cfg.update_arrays),
+    m_elide_unused_arrays(cfg.elide_unused_arrays),
     m_init_completed(false),
     m_allowing_data(false),
     m_max_ad_buffers(cfg.max_ad_buffers),
     m_max_ad_memory(cfg.max_ad_memory),
+    m_ad_memory_reservation(cfg.ad_memory_reservation),
+    m_observed_burst_bytes(0.0),
+    m_observed_arrays_per_burst(0.0),
+    m_observed_burst_rate(0.0),
     m_num_config_params(NumBaseConfigParams + cfg.num_config_params),
     m_arm_state(ArmStateDisarm),
     m_armed(false),
     m_rate_for_display(0.0),
-    m_time_array_driver(cfg.port_name)
+    m_channel_input_decimation(cfg.num_channels, 1),
+    m_channel_decimation(cfg.num_channels, 1),
+    m_arm_num_pre(0),
+    m_arm_num_post(0),
+    m_time_array_driver(cfg.port_name, cfg.num_channels),
+    m_perf_driver(cfg.port_name, cfg.num_perf_entries, cfg.num_read_streams),
+    m_trigger_driver(cfg.port_name, cfg.num_trigger_sources, cfg.num_channels),
+    m_parallel_copy(cfg.port_name, cfg.num_copy_threads, (unsigned int)cfg.read_thread_prio),
+    m_arm_request_time(NAN),
+    m_arm_request_is_rearm(false),
+    m_disarm_request_time(NAN),
+    m_watchdog_interrupt_retries(0),
+    m_watchdog_gave_up(false),
+    m_read_loop_stalled(false),
+    m_num_streams_running(0),
+    m_stream_failed(false)
 {
     // Reserve space in m_config_params for efficiency.
     m_config_params.reserve(m_num_config_params);
     
+    // Create the read streams (at least one).
+    int num_streams = std::max(1, cfg.num_read_streams);
+    for (int i = 0; i < num_streams; i++) {
+        ReadStream *rs = new ReadStream();
+        rs->driver = this;
+        rs->index = i;
+        rs->remaining_bursts = 0;
+        rs->num_bursts = 0;
+        rs->num_overflows = 0;
+        rs->trigger_valid = false;
+        rs->trigger_id = 0;
+        m_streams.push_back(rs);
+    }
+    
+    // Create the processing graph if enabled.
+    if (cfg.process_graph) {
+        m_process_graph.reset(new TRProcessGraph(cfg.port_name, cfg.num_channels));
+    }
+    
+    // Create the load injection port if enabled.
+    if (cfg.load_injection) {
+        m_inject_driver.reset(new TRLoadInjectDriver(cfg.port_name));
+    }
+    
     // Create regular asyn parameters.
     createParam("ARM_REQUEST",           asynParamInt32,   &m_asyn_params[ARM_REQUEST]);
     createParam("ARM_STATE",             asynParamInt32,   &m_asyn_params[ARM_STATE]);
     createParam("EFFECTIVE_SAMPLE_RATE", asynParamFloat64, &m_asyn_params[EFFECTIVE_SAMPLE_RATE]);
     createParam("BURST_ID",              asynParamInt32,   &m_asyn_params[BURST_ID]);
+    createParam("BURST_ID64",            TRInt64ParamType, &m_asyn_params[BURST_ID64]);
     createParam("BURST_TIME_BURST",      asynParamFloat64, &m_asyn_params[BURST_TIME_BURST]);
     createParam("BURST_TIME_READ",       asynParamFloat64, &m_asyn_params[BURST_TIME_READ]);
     createParam("BURST_TIME_PROCESS",    asynParamFloat64, &m_asyn_params[BURST_TIME_PROCESS]);
     createParam("SLEEP_AFTER_BURST",     asynParamFloat64, &m_asyn_params[SLEEP_AFTER_BURST]);
     createParam("DIGITIZER_NAME",        asynParamOctet,   &m_asyn_params[DIGITIZER_NAME]);
     createParam("TIME_ARRAY_UNIT_INV",   asynParamFloat64, &m_asyn_params[TIME_ARRAY_UNIT_INV]);
+    createParam("ARMING_NUM_BURSTS",     TRInt64ParamType, &m_asyn_params[ARMING_NUM_BURSTS]);
+    createParam("ARMING_NUM_OVERFLOWS",  TRInt64ParamType, &m_asyn_params[ARMING_NUM_OVERFLOWS]);
+    createParam("ARMING_NUM_DROPPED",    TRInt64ParamType, &m_asyn_params[ARMING_NUM_DROPPED]);
+    createParam("ARMING_NUM_ELIDED",     TRInt64ParamType, &m_asyn_params[ARMING_NUM_ELIDED]);
+    createParam("ARMING_BURST_RATE",     asynParamFloat64, &m_asyn_params[ARMING_BURST_RATE]);
+    createParam("ARMING_DATA_RATE",      asynParamFloat64, &m_asyn_params[ARMING_DATA_RATE]);
+    createParam("ARMING_SUMMARY_LOG",    asynParamInt32,   &m_asyn_params[ARMING_SUMMARY_LOG]);
+    createParam("ARM_LATENCY",           asynParamFloat64, &m_asyn_params[ARM_LATENCY]);
+    createParam("DISARM_LATENCY",        asynParamFloat64, &m_asyn_params[DISARM_LATENCY]);
+    createParam("WATCHDOG_DISARM_TIMEOUT", asynParamFloat64, &m_asyn_params[WATCHDOG_DISARM_TIMEOUT]);
+    createParam("READ_LOOP_STALLED",     asynParamInt32,   &m_asyn_params[READ_LOOP_STALLED]);
+    createParam("BURST_DEADLINE",        asynParamFloat64, &m_asyn_params[BURST_DEADLINE]);
+    createParam("BURST_LATENCY",         asynParamFloat64, &m_asyn_params[BURST_LATENCY]);
+    createParam("BURST_DEADLINE_MISSES", TRInt64ParamType, &m_asyn_params[BURST_DEADLINE_MISSES]);
+    createParam("WORST_BURST_ID",        asynParamInt32,   &m_asyn_params[WORST_BURST_ID]);
+    createParam("WORST_BURST_ID64",      TRInt64ParamType, &m_asyn_params[WORST_BURST_ID64]);
+    createParam("WORST_BURST_LATENCY",   asynParamFloat64, &m_asyn_params[WORST_BURST_LATENCY]);
+    createParam("WORST_BURST_TIME_READ", asynParamFloat64, &m_asyn_params[WORST_BURST_TIME_READ]);
+    createParam("WORST_BURST_TIME_CHECK", asynParamFloat64, &m_asyn_params[WORST_BURST_TIME_CHECK]);
+    createParam("WORST_BURST_TIME_PROCESS", asynParamFloat64, &m_asyn_params[WORST_BURST_TIME_PROCESS]);
+    createParam("SCRATCH_SIZE",          asynParamFloat64, &m_asyn_params[SCRATCH_SIZE]);
+    createParam("SCRATCH_PEAK_USED",     asynParamFloat64, &m_asyn_params[SCRATCH_PEAK_USED]);
+    createParam("SCRATCH_FAILED",        asynParamInt32,   &m_asyn_params[SCRATCH_FAILED]);
+    createParam("POOL_TRIM_MODE",        asynParamInt32,   &m_asyn_params[POOL_TRIM_MODE]);
+    createParam("POOL_TRIM_KEEP_ARRAYS", asynParamInt32,   &m_asyn_params[POOL_TRIM_KEEP_ARRAYS]);
+    createParam("POOL_TRIM_KEEP_MEMORY", asynParamFloat64, &m_asyn_params[POOL_TRIM_KEEP_MEMORY]);
+    createParam("POOL_BUFFERS",          asynParamInt32,   &m_asyn_params[POOL_BUFFERS]);
+    createParam("POOL_FREE_BUFFERS",     asynParamInt32,   &m_asyn_params[POOL_FREE_BUFFERS]);
+    createParam("POOL_MEMORY",           asynParamFloat64, &m_asyn_params[POOL_MEMORY]);
+    createParam("POOL_BUDGET_DENIED",    asynParamInt32,   &m_asyn_params[POOL_BUDGET_DENIED]);
+    createParam("MEMORY_BUDGET_TOTAL",   asynParamFloat64, &m_asyn_params[MEMORY_BUDGET_TOTAL]);
+    createParam("MEMORY_BUDGET_USED",    asynParamFloat64, &m_asyn_params[MEMORY_BUDGET_USED]);
+    createParam("POOL_AUTO_SIZE",        asynParamInt32,   &m_asyn_params[POOL_AUTO_SIZE]);
+    createParam("POOL_AUTO_SIZE_CAP",    asynParamFloat64, &m_asyn_params[POOL_AUTO_SIZE_CAP]);
+    createParam("POOL_CONSUMER_LATENCY", asynParamFloat64, &m_asyn_params[POOL_CONSUMER_LATENCY]);
+    createParam("POOL_RECOMMENDED_BUFFERS", asynParamInt32, &m_asyn_params[POOL_RECOMMENDED_BUFFERS]);
+    createParam("POOL_RECOMMENDED_MEMORY", asynParamFloat64, &m_asyn_params[POOL_RECOMMENDED_MEMORY]);
+    createParam("POOL_LIMIT",            asynParamFloat64, &m_asyn_params[POOL_LIMIT]);
     
     // Register write-protected parameters.
     addProtectedParam(m_asyn_params[ARM_STATE]);
     addProtectedParam(m_asyn_params[EFFECTIVE_SAMPLE_RATE]);
     addProtectedParam(m_asyn_params[BURST_ID]);
+    addProtectedParam(m_asyn_params[BURST_ID64]);
     addProtectedParam(m_asyn_params[BURST_TIME_BURST]);
     addProtectedParam(m_asyn_params[BURST_TIME_READ]);
     addProtectedParam(m_asyn_params[BURST_TIME_PROCESS]);
     addProtectedParam(m_asyn_params[DIGITIZER_NAME]);
+    addProtectedParam(m_asyn_params[ARMING_NUM_BURSTS]);
+    addProtectedParam(m_asyn_params[ARMING_NUM_OVERFLOWS]);
+    addProtectedParam(m_asyn_params[ARMING_NUM_DROPPED]);
+    addProtectedParam(m_asyn_params[ARMING_NUM_ELIDED]);
+    addProtectedParam(m_asyn_params[ARMING_BURST_RATE]);
+    addProtectedParam(m_asyn_params[ARMING_DATA_RATE]);
+    addProtectedParam(m_asyn_params[ARM_LATENCY]);
+    addProtectedParam(m_asyn_params[DISARM_LATENCY]);
+    addProtectedParam(m_asyn_params[READ_LOOP_STALLED]);
+    addProtectedParam(m_asyn_params[BURST_LATENCY]);
+    addProtectedParam(m_asyn_params[BURST_DEADLINE_MISSES]);
+    addProtectedParam(m_asyn_params[WORST_BURST_ID]);
+    addProtectedParam(m_asyn_params[WORST_BURST_ID64]);
+    addProtectedParam(m_asyn_params[WORST_BURST_LATENCY]);
+    addProtectedParam(m_asyn_params[WORST_BURST_TIME_READ]);
+    addProtectedParam(m_asyn_params[WORST_BURST_TIME_CHECK]);
+    addProtectedParam(m_asyn_params[WORST_BURST_TIME_PROCESS]);
+    addProtectedParam(m_asyn_params[SCRATCH_SIZE]);
+    addProtectedParam(m_asyn_params[SCRATCH_PEAK_USED]);
+    addProtectedParam(m_asyn_params[SCRATCH_FAILED]);
+    addProtectedParam(m_asyn_params[POOL_BUFFERS]);
+    addProtectedParam(m_asyn_params[POOL_FREE_BUFFERS]);
+    addProtectedParam(m_asyn_params[POOL_MEMORY]);
+    addProtectedParam(m_asyn_params[POOL_BUDGET_DENIED]);
+    addProtectedParam(m_asyn_params[MEMORY_BUDGET_TOTAL]);
+    addProtectedParam(m_asyn_params[MEMORY_BUDGET_USED]);
+    addProtectedParam(m_asyn_params[POOL_RECOMMENDED_BUFFERS]);
+    addProtectedParam(m_asyn_params[POOL_RECOMMENDED_MEMORY]);
+    addProtectedParam(m_asyn_params[POOL_LIMIT]);
 
     // Set initial parameter values.
     setIntegerParam(m_asyn_params[ARM_REQUEST],          ArmStateDisarm);
     setIntegerParam(m_asyn_params[ARM_STATE],            m_arm_state);
     setDoubleParam(m_asyn_params[EFFECTIVE_SAMPLE_RATE], NAN);
     setStringParam(m_asyn_params[DIGITIZER_NAME],        cfg.port_name.c_str());
+    setIntegerParam(m_asyn_params[ARMING_SUMMARY_LOG],   0);
+    setDoubleParam(m_asyn_params[ARM_LATENCY],           NAN);
+    setDoubleParam(m_asyn_params[DISARM_LATENCY],        NAN);
+    setDoubleParam(m_asyn_params[WATCHDOG_DISARM_TIMEOUT], 0.0);
+    setIntegerParam(m_asyn_params[READ_LOOP_STALLED],    0);
+    setDoubleParam(m_asyn_params[BURST_DEADLINE],        0.0);
+    setDoubleParam(m_asyn_params[BURST_LATENCY],         NAN);
+    setIntegerParam(m_asyn_params[POOL_TRIM_MODE],       TRPoolTrimNone);
+    setIntegerParam(m_asyn_params[POOL_TRIM_KEEP_ARRAYS], 0);
+    setDoubleParam(m_asyn_params[POOL_TRIM_KEEP_MEMORY], 0.0);
+    setIntegerParam(m_asyn_params[POOL_BUFFERS],         0);
+    setIntegerParam(m_asyn_params[POOL_FREE_BUFFERS],    0);
+    setDoubleParam(m_asyn_params[POOL_MEMORY],           0.0);
+    setIntegerParam(m_asyn_params[POOL_BUDGET_DENIED],   0);
+    setDoubleParam(m_asyn_params[MEMORY_BUDGET_TOTAL],   0.0);
+    setDoubleParam(m_asyn_params[MEMORY_BUDGET_USED],    0.0);
+    setIntegerParam(m_asyn_params[POOL_AUTO_SIZE],       TRPoolAutoSizeOff);
+    setDoubleParam(m_asyn_params[POOL_AUTO_SIZE_CAP],    0.0);
+    setDoubleParam(m_asyn_params[POOL_CONSUMER_LATENCY], 0.0);
+    setIntegerParam(m_asyn_params[POOL_RECOMMENDED_BUFFERS], 0);
+    setDoubleParam(m_asyn_params[POOL_RECOMMENDED_MEMORY], NAN);
+    setDoubleParam(m_asyn_params[POOL_LIMIT],            0.0);
+    
+    // Initialize the arming statistics.
+    resetArmingStats();
     
     // Initialize configuration parameters
     initConfigParam(m_param_num_bursts,               "NUM_BURSTS",             (double)NAN);
@@ -87,6 +238,18 @@ TRBaseDriver::TRBaseDriver (TRBaseConfig const &cfg)
         (unsigned int)cfg.read_thread_prio,
         cfg.read_thread_stack_size>0 ? cfg.read_thread_stack_size : epicsThreadGetStackSize(epicsThreadStackMedium),
         readThreadTrampoline, this);
+    
+    // With multiple read streams, start a thread for each stream.
+    if (m_streams.size() > 1) {
+        for (size_t i = 0; i < m_streams.size(); i++) {
+            char name[32];
+            snprintf(name, sizeof(name), "TRread%d:", (int)i);
+            epicsThreadMustCreate((name + cfg.port_name).c_str(),
+                (unsigned int)cfg.read_thread_prio,
+                cfg.read_thread_stack_size>0 ? cfg.read_thread_stack_size : epicsThreadGetStackSize(epicsThreadStackMedium),
+                streamThreadTrampoline, m_streams[i]);
+        }
+    }
 }
 
 void TRBaseDriver::completeInit ()
@@ -96,8 +259,30 @@ void TRBaseDriver::completeInit ()
     TRChannelsDriver *ch_driver = createChannelsDriver();
     assert(ch_driver != NULL);
     
-    m_channels_driver.reset(ch_driver);
-    m_init_completed = true;
+    {
+        epicsGuard<asynPortDriver> lock(*this);
+        
+        m_channels_driver.reset(ch_driver);
+        m_init_completed = true;
+    }
+    
+    // Start the watchdog thread, now that the channels port exists. It only
+    // does periodic bookkeeping, so it does not compete with acquisition.
+    epicsThreadMustCreate(
+        (std::string("TRwdog:") + portName).c_str(),
+        epicsThreadPriorityLow,
+        epicsThreadGetStackSize(epicsThreadStackSmall),
+        watchdogThreadTrampoline, this);
+}
+
+int TRBaseDriver::registerPerfEntry (char const *name, TRPerfEntryType type)
+{
+    int index = m_perf_driver.registerEntry(name, type);
+    if (index < 0) {
+        errlogSevPrintf(errlogMajor, "TRBaseDriver Error: Cannot register perf entry %s, "
+            "num_perf_entries in TRBaseConfig is too small.\n", name);
+    }
+    return index;
 }
 
 void TRBaseDriver::setDigitizerName (char const *name)
@@ -130,14 +315,47 @@ void TRBaseDriver::publishBurstMetaInfo (TRBurstMetaInfo const &info)
 {
     epicsGuard<asynPortDriver> lock(*this);
     
-    setIntegerParam(m_asyn_params[BURST_ID],          info.burst_id);
+    setBurstIdParams(BURST_ID, BURST_ID64, (epicsInt64)info.burst_id);
     setDoubleParam(m_asyn_params[BURST_TIME_BURST],   info.time_burst);
     setDoubleParam(m_asyn_params[BURST_TIME_READ],    info.time_read);
     setDoubleParam(m_asyn_params[BURST_TIME_PROCESS], info.time_process);
     
+    // Remember the trigger time of the stream for checking the burst deadline,
+    // and count the burst for the stream.
+    if (info.stream >= 0 && info.stream < (int)m_streams.size()) {
+        ReadStream &rs = *m_streams[info.stream];
+        if (info.trigger_time.secPastEpoch != 0 || info.trigger_time.nsec != 0) {
+            rs.trigger_valid = true;
+            rs.trigger_id = info.burst_id;
+            rs.trigger_time = info.trigger_time;
+        }
+        rs.num_bursts++;
+    }
+    
+    // Count the burst for the arming statistics.
+    m_arming_num_bursts++;
+    TRSetInt64Param(*this, 0, m_asyn_params[ARMING_NUM_BURSTS], (epicsInt64)m_arming_num_bursts);
+    TRSetInt64Param(*this, 0, m_asyn_params[ARMING_NUM_ELIDED], (epicsInt64)epicsAtomicGetSizeT(&m_arming_num_elided));
+    
     callParamCallbacks();
 }
 
+TRTriggerRoute TRBaseDriver::routeBurst (int source)
+{
+    assert(source >= 0 && source < m_num_trigger_sources);
+    
+    return m_trigger_driver.route(source);
+}
+
+void TRBaseDriver::setBurstIdParams (int param, int param64, epicsInt64 burst_id)
+{
+    // The 32-bit parameter has the low 31 bits of the ID, so that it wraps
+    // around to zero after 2^31-1 as before, and -1 is preserved.
+    setIntegerParam(m_asyn_params[param], (burst_id < 0) ? -1 : (int)(burst_id & 0x7FFFFFFF));
+    
+    TRSetInt64Param(*this, 0, m_asyn_params[param64], burst_id);
+}
+
 void TRBaseDriver::maybeSleepForTesting ()
 {
     double sleep_time;
@@ -149,6 +367,8 @@ void TRBaseDriver::maybeSleepForTesting ()
     if (sleep_time > 0) {
         epicsThreadSleep(sleep_time);
     }
+    
+    injectLoad(TRInjectPointAfterBurst);
 }
 
 bool TRBaseDriver::isArmed ()
@@ -156,6 +376,107 @@ bool TRBaseDriver::isArmed ()
     return m_armed;
 }
 
+void TRBaseDriver::report (FILE *fp, int details)
+{
+    asynPortDriver::report(fp, details);
+    
+    if (details >= 1) {
+        epicsGuard<asynPortDriver> lock(*this);
+        printArmingSummary(fp);
+    }
+}
+
+// Prints a line either to the file or using errlog if the file is NULL.
+static void printSummaryLine (FILE *fp, char const *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    if (fp != NULL) {
+        vfprintf(fp, fmt, ap);
+    } else {
+        errlogVprintf(fmt, ap);
+    }
+    va_end(ap);
+}
+
+void TRBaseDriver::printArmingSummary (FILE *fp)
+{
+    // Include samples of driver entries not yet aggregated by the watchdog.
+    m_perf_driver.aggregateCounters();
+    
+    // Determine the duration of acquisition, up to now if still armed.
+    double duration = NAN;
+    if (!std::isnan(m_arming_start_time)) {
+        double end_time = std::isnan(m_arming_end_time) ? TRPerfClock::now() : m_arming_end_time;
+        duration = end_time - m_arming_start_time;
+    }
+    double burst_rate = (duration > 0.0) ? (m_arming_num_bursts / duration) : NAN;
+    double data_rate = (duration > 0.0) ? (m_arming_num_bytes / duration / 1e6) : NAN;
+    
+    printSummaryLine(fp, "TRBaseDriver Info: Arming summary for %s\n", portName);
+    printSummaryLine(fp, "  acquisition time %.3f s, bursts %llu (%.3f Hz), data %.3f MB (%.3f MB/s)\n",
+        duration, (unsigned long long)m_arming_num_bursts, burst_rate, m_arming_num_bytes / 1e6, data_rate);
+    printSummaryLine(fp, "  arrays %llu, dropped arrays %llu, elided arrays %llu, overflows %llu\n",
+        (unsigned long long)m_arming_num_arrays, (unsigned long long)m_arming_num_dropped,
+        (unsigned long long)epicsAtomicGetSizeT(&m_arming_num_elided),
+        (unsigned long long)m_arming_num_overflows);
+    if (m_streams.size() > 1) {
+        for (size_t i = 0; i < m_streams.size(); i++) {
+            ReadStream const &rs = *m_streams[i];
+            printSummaryLine(fp, "  stream %d: bursts %llu (%.3f Hz), overflows %llu\n",
+                (int)i, (unsigned long long)rs.num_bursts,
+                (duration > 0.0) ? (rs.num_bursts / duration) : NAN,
+                (unsigned long long)rs.num_overflows);
+        }
+    }
+    if (m_num_trigger_sources > 1) {
+        for (int i = 0; i < m_num_trigger_sources; i++) {
+            epicsUInt64 num_accepted;
+            epicsUInt64 num_limited;
+            m_trigger_driver.getCounts(i, &num_accepted, &num_limited);
+            printSummaryLine(fp, "  trigger source %d: accepted bursts %llu, rate-limited bursts %llu\n",
+                i, (unsigned long long)num_accepted, (unsigned long long)num_limited);
+        }
+    }
+    if (!std::isnan(m_worst_burst_latency)) {
+        printSummaryLine(fp, "  burst deadline misses %llu, worst burst %lld: latency %.3f ms "
+            "(read %.3f ms, check overflow %.3f ms, process %.3f ms)\n",
+            (unsigned long long)m_burst_deadline_misses, (long long)m_worst_burst_id, 1000.0 * m_worst_burst_latency,
+            1000.0 * m_worst_burst_time_read, 1000.0 * m_worst_burst_time_check,
+            1000.0 * m_worst_burst_time_process);
+    }
+    if (m_scratch_arena.getSize() > 0) {
+        printSummaryLine(fp, "  scratch arena %.3f MB, peak used %.3f MB, failed allocations %d\n",
+            m_scratch_arena.getSize() / 1e6, m_scratch_arena.getPeakUsed() / 1e6,
+            m_scratch_arena.getNumFailed());
+    }
+    printSummaryLine(fp, "  %-22s %10s %12s %12s %12s %s\n", "entry", "count", "min", "mean", "max", "unit");
+    
+    for (int i = 0; i < m_perf_driver.numEntries(); i++) {
+        TRPerfStat stat = m_perf_driver.getStat(i);
+        if (stat.getCount() == 0) {
+            continue;
+        }
+        double scale = m_perf_driver.entryScale(i);
+        printSummaryLine(fp, "  %-22s %10llu %12.3f %12.3f %12.3f %s\n",
+            m_perf_driver.entryName(i).c_str(), (unsigned long long)stat.getCount(),
+            scale * stat.getMin(), scale * stat.getMean(), scale * stat.getMax(),
+            (scale == 1.0) ? "" : "ms");
+    }
+    
+    if (TRAllocAudit::enabled()) {
+        printSummaryLine(fp, "  steady-state allocations (process-wide): pool growth %llu\n",
+            (unsigned long long)TRAllocAudit::getPoolGrowthCount());
+        for (int i = 0; i < TRNumAllocAuditCategories; i++) {
+            size_t count = TRAllocAudit::getCount(i);
+            if (count > 0) {
+                printSummaryLine(fp, "    %-22s %10llu\n", TRAllocAudit::categoryName(i),
+                    (unsigned long long)count);
+            }
+        }
+    }
+}
+
 asynStatus TRBaseDriver::writeInt32 (asynUser *pasynUser, int value)
 {
     int reason = pasynUser->reason;
@@ -225,13 +546,29 @@ asynStatus TRBaseDriver::handleArmRequest (int armRequest)
         return asynError;
     }
 
+    // Time of the request for measuring arm latency.
+    double request_time = TRPerfClock::now();
+
     if (m_arm_state == ArmStateDisarm) {
         // We are currently disarmed. If the request is to arm, start the arming.
         // Otherwise the request is to disarm, so no need to do anything.
         if (armRequest != ArmStateDisarm) {
+            m_arm_request_time = request_time;
+            m_arm_request_is_rearm = false;
             startArming((ArmState)armRequest);
         }
     } else {
+        // Remember the time of an arm request (if none is pending already),
+        // or forget about any pending arm request if the request is to disarm.
+        if (armRequest != ArmStateDisarm) {
+            if (std::isnan(m_arm_request_time)) {
+                m_arm_request_time = request_time;
+                m_arm_request_is_rearm = true;
+            }
+        } else {
+            m_arm_request_time = NAN;
+        }
+        
         // We are currently in some state that is not disarmed.
         // Request disarming, and also request rearming if the
         // request is to arm.
@@ -255,6 +592,9 @@ void TRBaseDriver::startArming (ArmState requested_arm_state)
     m_disarm_requested = false;
     m_requested_rearm_state = ArmStateDisarm;
     m_in_read_loop = false;
+    m_reading_interrupted = false;
+    m_watchdog_interrupt_retries = 0;
+    m_watchdog_gave_up = false;
     
     // Raise the signal to the read thread.
     m_start_arming_event.signal();
@@ -271,6 +611,9 @@ void TRBaseDriver::requestDisarming (ArmState requested_rearm_state)
         // that disarming must be done.
         m_disarm_requested = true;
         
+        // Remember the time for measuring disarm latency.
+        m_disarm_request_time = TRPerfClock::now();
+        
         // Do not allow any more data to be submitted.
         m_allowing_data = false;
         
@@ -288,7 +631,7 @@ void TRBaseDriver::requestDisarming (ArmState requested_rearm_state)
         // and starts disarming. Note that interruptReading is intentionally
         // called with the lock held and must not block.
         if (m_in_read_loop) {
-            interruptReading();
+            interruptReadingOnce();
         }
         
         // Note that if reading is not in progress, the read loop will
@@ -324,6 +667,85 @@ void TRBaseDriver::readThread ()
     }
 }
 
+void TRBaseDriver::watchdogThreadTrampoline (void *obj)
+{
+    static_cast<TRBaseDriver *>(obj)->watchdogThread();
+}
+
+void TRBaseDriver::watchdogThread ()
+{
+    while (true) {
+        epicsThreadSleep(WatchdogPeriod);
+        bool armed = watchdogCheck();
+        
+        // Merge samples of driver-registered entries and the data path.
+        m_perf_driver.aggregateCounters();
+        
+        // These return right away unless lifetime tracking is used or
+        // the global memory budget is configured.
+        m_channels_driver->checkTrackedArrays();
+        m_channels_driver->checkMemoryBudget();
+        
+        // Consumers and pool usage only change significantly while armed
+        // (both are also updated when arming and disarming).
+        if (armed) {
+            m_channels_driver->updateConsumers();
+            updatePoolParams();
+        }
+    }
+}
+
+bool TRBaseDriver::watchdogCheck ()
+{
+    // Check for timed functions past their deadline.
+    bool stalled = m_perf_driver.checkStalls();
+    
+    epicsGuard<asynPortDriver> lock(*this);
+    
+    bool armed = m_armed;
+    
+    // Publish the overall stall state.
+    if (stalled != m_read_loop_stalled) {
+        m_read_loop_stalled = stalled;
+        setIntegerParam(m_asyn_params[READ_LOOP_STALLED], stalled);
+        callParamCallbacks();
+    }
+    
+    // Escalation is only relevant if it is enabled and the read thread
+    // has not left the read loop after disarming was requested.
+    double timeout;
+    getDoubleParam(m_asyn_params[WATCHDOG_DISARM_TIMEOUT], &timeout);
+    if (!(timeout > 0.0) || !m_disarm_requested || !m_in_read_loop ||
+        m_watchdog_gave_up || std::isnan(m_disarm_request_time))
+    {
+        return armed;
+    }
+    
+    // Each step of escalation happens after another timeout period.
+    double elapsed = TRPerfClock::now() - m_disarm_request_time;
+    if (elapsed < timeout * (m_watchdog_interrupt_retries + 1)) {
+        return armed;
+    }
+    
+    if (m_watchdog_interrupt_retries < WatchdogMaxInterruptRetries) {
+        // Try to interrupt reading again.
+        m_watchdog_interrupt_retries++;
+        errlogSevPrintf(errlogMinor,
+            "TRBaseDriver Warning: Read loop not stopped %.3f s after disarm request, "
+            "calling interruptReading again.\n", elapsed);
+        timedInterruptReading();
+    } else {
+        // Give up and make the problem visible. Disarming will complete
+        // normally if the read thread eventually leaves the read loop.
+        m_watchdog_gave_up = true;
+        errlogSevPrintf(errlogMajor,
+            "TRBaseDriver Error: Read loop stuck %.3f s after disarm request.\n", elapsed);
+        setArmState(ArmStateError);
+    }
+    
+    return armed;
+}
+
 void TRBaseDriver::readThreadIteration ()
 {
     // Wait for a request for reading/arming to start.
@@ -342,9 +764,12 @@ void TRBaseDriver::readThreadIteration ()
         // Assume armed for isArmed().
         m_armed = true;
         
+        // Start collecting statistics for this arming.
+        resetArmingStats();
+        
         // Wait for preconditfor arming to be satisfied.
         // NOTE: On success this locks the asyn port.
-        if (!waitForPreconditions()) {
+        if (!timedWaitForPreconditions()) {
             unlock();
             goto error;
         }
@@ -359,8 +784,8 @@ void TRBaseDriver::readThreadIteration ()
         }
         
         // Check for preconditions, wait for outstanding calculations, etc.
-        TRArmInfo arm_info;
-        if (!checkSettings(arm_info)) {
+        TRArmInfo arm_info(m_num_channels);
+        if (!timedCheckSettings(arm_info)) {
             unlock();
             goto error;
         }
@@ -371,6 +796,33 @@ void TRBaseDriver::readThreadIteration ()
             goto error;
         }
         
+        // Take the settings of the processing graph, which may further
+        // decimate channels.
+        std::vector<int> decimation = arm_info.channel_decimation;
+        if (m_process_graph.get() != NULL && !m_process_graph->configure(arm_info.process_input_data_type, &decimation)) {
+            unlock();
+            goto error;
+        }
+        
+        // Make the scratch arena available with the requested size. This
+        // may allocate memory, which is done with the port unlocked.
+        unlock();
+        bool scratch_prepared = m_scratch_arena.prepare(arm_info.scratch_size);
+        lock();
+        if (!scratch_prepared) {
+            errlogSevPrintf(errlogMajor, "TRBaseDriver Error: Failed to allocate scratch arena of %lu bytes.\n",
+                (unsigned long)arm_info.scratch_size);
+            unlock();
+            goto error;
+        }
+        setDoubleParam(m_asyn_params[SCRATCH_SIZE], arm_info.scratch_size / 1e6);
+        
+        // Determine the numbers of samples of channels.
+        setupSampleCounts(arm_info, decimation);
+        
+        // Determine the needed size of the NDArray pool.
+        sizeArrayPool(arm_info);
+        
         // Remember the rate for display. This will be also used by
         // TRChannelDataSubmit for the NDArray attributes.
         m_rate_for_display = arm_info.rate_for_display;
@@ -379,11 +831,14 @@ void TRBaseDriver::readThreadIteration ()
         setEffectiveParams();
         
         // Setup the time array.
-        setupTimeArray(arm_info);
+        setupTimeArray();
         
         // Reset the arrays in the channels port.
         m_channels_driver->resetArrays();
         
+        // Determine which addresses have consumers before the first burst.
+        m_channels_driver->updateConsumers();
+        
         // This variable is used to limit reading only a specific number of
         // bursts, if desired. A negative value indicates that reading should
         // continue indefinitely until manual disarm. If the value is not
@@ -394,10 +849,9 @@ void TRBaseDriver::readThreadIteration ()
             remainingBursts = -1; // we use negative as infinity
         }
 
-        // The overflow flag indicates whether there has been a buffer overflow.
-        // It is set to true upon detection of overflow, and back to false after
-        // the remaining bursts in the buffer have been read and acquisition has
-        // been restarted.
+        // The overflow flag indicates whether acquisition is being restarted
+        // after a buffer overflow, once the remaining bursts in the buffer
+        // have been read (with a single read stream).
         bool overflow = false;
 
         // This loop is for overflow recovery.
@@ -420,7 +874,7 @@ void TRBaseDriver::readThreadIteration ()
             need_stop_acquisition = true;
             
             // Call the startAcquisition function of the driver.
-            if (!startAcquisition(overflow)) {
+            if (!timedStartAcquisition(overflow)) {
                 goto error;
             }
             
@@ -434,99 +888,55 @@ void TRBaseDriver::readThreadIteration ()
             
             // Set the arm state to armed, unless we are here for overflow recovery.
             if (!overflow) {
+                if (!std::isnan(m_arm_request_time)) {
+                    recordTransitionLatency(
+                        m_arm_request_is_rearm ? TRPerfTransitionRearm : TRPerfTransitionArm,
+                        ARM_LATENCY, m_arm_request_time);
+                    m_arm_request_time = NAN;
+                }
                 setArmState(m_requested_arm_state);
+                m_arming_start_time = TRPerfClock::now();
             }
             
             // Set this flag to indicate we are entering the read loop.
             m_in_read_loop = true;                
             
-            unlock();
-
-            // Initialize currentRemBursts to remainingBursts and clear
-            // the overflow flag, as we are either here initially or we are
-            // recovering from overflow.
-            // The counter currentRemBursts is initialized to remainingBursts
-            // and will be decremented by one each time a burst is read. It will
-            // also be changed in case there is an overflow, so we then read only
-            // so many bursts more before recovering.
-            // However, remainingBursts is only decremented by one for each burst
-            // read and is not affected by overflow handling.
-            int currentRemBursts = remainingBursts;
-            
-            // Clear the overflow flag.
-            overflow = false;
-
-            // Main burst reading loop.
-            while (currentRemBursts != 0) {
-                // Wait for and read a burst of data.
-                if (!readBurst()){
-                    goto error;
+            // With multiple streams, start the read loops of all streams
+            // on their threads and wait until all of them have ended.
+            // Overflows are handled by the streams themselves.
+            if (m_streams.size() > 1) {
+                m_num_streams_running = (int)m_streams.size();
+                m_stream_failed = false;
+                for (size_t i = 0; i < m_streams.size(); i++) {
+                    m_streams[i]->remaining_bursts = remainingBursts;
+                    m_streams[i]->start_event.signal();
                 }
                 
-                // If disarming has been requested, abort.
-                // This check is here intentionally, after reading the burst data
-                // but before processing it, so that we do not process the data
-                // when we are being disarmed.
-                if (checkDisarmRequestedUnlocked()) {
-                    goto stopped;
-                }
+                unlock();
+                m_streams_done_event.wait();
+                lock();
                 
-                if (!overflow) {
-                    // Check for overflow.
-                    bool overflow_detected;
-                    int num_buffer_bursts;
-                    if (!checkOverflow(&overflow_detected, &num_buffer_bursts)){
-                        goto error;
-                    }
-
-                    if (overflow_detected) {
-                        // Starting overflow handling.
-                        overflow = true;
-                        
-                        // The num_buffer_bursts must be positive since it includes the
-                        // burst that has just been read.
-                        assert(num_buffer_bursts > 0);
-                        
-                        errlogSevPrintf(errlogMinor,
-                            "TRBaseDriver Warning: Buffer overflow, reading up to %d remaining bursts\n",
-                            (num_buffer_bursts - 1));
-                        
-                        // Bump down currentRemainingBursts so that we do not read more than
-                        // num_buffer_bursts bursts before restarting.
-                        if (currentRemBursts < 0) {
-                            currentRemBursts = num_buffer_bursts;
-                        } else {
-                            currentRemBursts = std::min(currentRemBursts, num_buffer_bursts);
-                        }
-                    }
-                }
-
-                // Process the bust data which was read.
-                if (!processBurstData()) {
+                bool failed = m_stream_failed;
+                unlock();
+                if (failed) {
                     goto error;
                 }
-
-                // Decrement burst counters.
-                if (currentRemBursts > 0) {
-                    currentRemBursts--;
-                }
-                if (remainingBursts > 0) {
-                    remainingBursts--;
-                }
-                
-                // Possibly sleep here if enabled, for testing.
-                maybeSleepForTesting();
+                goto stopped;
             }
-
-            // We've come here because currentRemainingBursts==0.
-            // If we've read all requested bursts (remainingBursts==0),
-            // then we stop normally.
-            if (remainingBursts == 0) {
+            
+            unlock();
+            
+            // Run the read loop on this thread.
+            ReadLoopResult result = runReadLoop(0, remainingBursts);
+            if (result == ReadLoopStopped) {
                 goto stopped;
             }
+            if (result == ReadLoopError) {
+                goto error;
+            }
             
             // Otherwise we must be here due to a buffer overflow.
-            assert(overflow);
+            overflow = true;
             
             errlogSevPrintf(errlogMinor, "TRBaseDriver Warning: Restarting after overflow.");
 
@@ -547,6 +957,9 @@ stopped:
 error:
     // We come here if there is an unexpected error.
     // The had_error is already true.
+    
+    // We may have jumped here from the steady state of the read loop.
+    TRAllocAudit::leaveSteadyState();
 
     lock();
     
@@ -554,10 +967,16 @@ error:
     // since we may have jumped here from within the reading loop.
     m_in_read_loop = false;
     
+    // Remember when acquisition ended for the arming statistics.
+    m_arming_end_time = TRPerfClock::now();
+    
     // If there was an error and disarming was not requested, we want to
     // report the error via the state and delay disarming until it is
     // requested.
     if (had_error && !m_disarm_requested) {
+        // Arming has failed, so the arm request is no longer pending.
+        m_arm_request_time = NAN;
+        
         // Set the arm state to error to make the error visible.
         setArmState(ArmStateError);
         
@@ -567,7 +986,7 @@ error:
         // was called.
         if (!need_stop_acquisition) {
             m_armed = false;
-            onDisarmed();
+            timedOnDisarmed();
         }
         
         // Wait until disarming is requested.
@@ -582,17 +1001,36 @@ error:
     // Call the stopAcquisition function of the driver if needed.
     if (need_stop_acquisition) {
         unlock();
-        stopAcquisition();
+        timedStopAcquisition();
         lock();
     }
         
     // Assume not armed for isArmed().
     m_armed = false;
-    onDisarmed();
+    timedOnDisarmed();
     
     // Reset the effective-value parameters to invalid values.
     clearEffectiveParams();
     
+    // Publish the arming statistics and log the summary if enabled.
+    updateArmingStatsParams();
+    observePoolSizingInputs();
+    int summary_log;
+    getIntegerParam(m_asyn_params[ARMING_SUMMARY_LOG], &summary_log);
+    if (summary_log) {
+        printArmingSummary(NULL);
+    }
+    
+    // Release all scratch memory of this arming.
+    m_scratch_arena.reset();
+    
+    // Release cached arrays of the NDArray pool according to the policy.
+    trimArrayPool(summary_log);
+    
+    // Publish the pool usage after trimming, the watchdog only does this
+    // while armed.
+    updatePoolParams();
+    
     // Clear this event since it may have been signaled but not waited.
     m_disarm_requested_event.tryWait();
     
@@ -607,9 +1045,19 @@ error:
         // would be visible externally in the asyn parameter.
         m_arm_state = ArmStateDisarm;
         
+        // The disarming is part of the rearm cycle, so it does not count
+        // toward disarm latency (rearm latency will be recorded instead).
+        m_disarm_request_time = NAN;
+        
         // Rearming has been requested, so start another arming.
         startArming(m_requested_rearm_state);
     } else {
+        // Record the disarm latency.
+        if (!std::isnan(m_disarm_request_time)) {
+            recordTransitionLatency(TRPerfTransitionDisarm, DISARM_LATENCY, m_disarm_request_time);
+            m_disarm_request_time = NAN;
+        }
+        
         // We're done, set the arm state to disarmed.
         setArmState(ArmStateDisarm);
     }
@@ -617,6 +1065,183 @@ error:
     unlock();
 }
 
+TRBaseDriver::ReadLoopResult TRBaseDriver::runReadLoop (int stream, int &remaining_bursts)
+{
+    // Initialize currentRemBursts to remaining_bursts as we are either here
+    // initially or we are recovering from overflow.
+    // The counter currentRemBursts will be decremented by one each time a
+    // burst is read. It will also be changed in case there is an overflow,
+    // so we then read only so many bursts more before recovering.
+    // However, remaining_bursts is only decremented by one for each burst
+    // read and is not affected by overflow handling.
+    int currentRemBursts = remaining_bursts;
+    
+    // The overflow flag indicates whether there has been a buffer overflow
+    // since the read loop was entered.
+    bool overflow = false;
+    
+    // Number of bursts processed since the start of acquisition,
+    // for allocation auditing.
+    int num_processed_bursts = 0;
+
+    // Main burst reading loop.
+    while (currentRemBursts != 0) {
+        // Wait for and read a burst of data.
+        if (!timedReadBurst(stream)) {
+            TRAllocAudit::leaveSteadyState();
+            return ReadLoopError;
+        }
+        
+        // Remember when the burst was read and when overflow was
+        // checked, for the breakdown of burst latency.
+        epicsTimeStamp read_end_time;
+        epicsTimeGetCurrent(&read_end_time);
+        epicsTimeStamp check_end_time = read_end_time;
+        
+        // If disarming has been requested, abort.
+        // This check is here intentionally, after reading the burst data
+        // but before processing it, so that we do not process the data
+        // when we are being disarmed.
+        if (checkStopReadingUnlocked()) {
+            TRAllocAudit::leaveSteadyState();
+            return ReadLoopStopped;
+        }
+        
+        if (!overflow) {
+            // Check for overflow.
+            bool overflow_detected;
+            int num_buffer_bursts;
+            if (!timedCheckOverflow(stream, &overflow_detected, &num_buffer_bursts)) {
+                TRAllocAudit::leaveSteadyState();
+                return ReadLoopError;
+            }
+            epicsTimeGetCurrent(&check_end_time);
+
+            if (overflow_detected) {
+                // Starting overflow handling.
+                overflow = true;
+                
+                // Count the overflow for the arming statistics.
+                lock();
+                m_arming_num_overflows++;
+                m_streams[stream]->num_overflows++;
+                unlock();
+                
+                // The num_buffer_bursts must be positive since it includes the
+                // burst that has just been read.
+                assert(num_buffer_bursts > 0);
+                
+                errlogSevPrintf(errlogMinor,
+                    "TRBaseDriver Warning: Buffer overflow, reading up to %d remaining bursts\n",
+                    (num_buffer_bursts - 1));
+                
+                // Bump down currentRemainingBursts so that we do not read more than
+                // num_buffer_bursts bursts before restarting.
+                if (currentRemBursts < 0) {
+                    currentRemBursts = num_buffer_bursts;
+                } else {
+                    currentRemBursts = std::min(currentRemBursts, num_buffer_bursts);
+                }
+            }
+        }
+
+        // Process the bust data which was read.
+        if (!timedProcessBurstData(stream)) {
+            TRAllocAudit::leaveSteadyState();
+            return ReadLoopError;
+        }
+        
+        // Check the latency of the burst against the deadline.
+        checkBurstDeadline(stream, read_end_time, check_end_time);
+        
+        // Audit allocations after the warm-up bursts (if enabled in the build).
+        num_processed_bursts++;
+        if (num_processed_bursts >= TRAllocAudit::warmupBursts()) {
+            TRAllocAudit::enterSteadyState();
+        }
+
+        // Decrement burst counters.
+        if (currentRemBursts > 0) {
+            currentRemBursts--;
+        }
+        if (remaining_bursts > 0) {
+            remaining_bursts--;
+        }
+        
+        // Possibly sleep here if enabled, for testing.
+        maybeSleepForTesting();
+    }
+
+    // Not in the steady state of the read loop anymore.
+    TRAllocAudit::leaveSteadyState();
+    
+    // We've come here because currentRemainingBursts==0.
+    // If we've read all requested bursts (remaining_bursts==0),
+    // then we stop normally.
+    if (remaining_bursts == 0) {
+        return ReadLoopStopped;
+    }
+    
+    // Otherwise we must be here due to a buffer overflow.
+    assert(overflow);
+    return ReadLoopOverflow;
+}
+
+void TRBaseDriver::streamThreadTrampoline (void *obj)
+{
+    ReadStream *rs = static_cast<ReadStream *>(obj);
+    rs->driver->streamThread(*rs);
+}
+
+void TRBaseDriver::streamThread (ReadStream &rs)
+{
+    // Each iteration of this loop corresponds to one arming.
+    while (true) {
+        // Wait until the read thread starts the read loops.
+        rs.start_event.wait();
+        
+        int remaining_bursts = rs.remaining_bursts;
+        bool had_error = false;
+        
+        // This loop is for overflow recovery of this stream.
+        while (true) {
+            ReadLoopResult result = runReadLoop(rs.index, remaining_bursts);
+            if (result == ReadLoopStopped) {
+                break;
+            }
+            if (result == ReadLoopError) {
+                had_error = true;
+                break;
+            }
+            
+            // Restart the stream after reading the remaining bursts,
+            // unless reading should stop anyway.
+            if (checkStopReadingUnlocked()) {
+                break;
+            }
+            errlogSevPrintf(errlogMinor, "TRBaseDriver Warning: Restarting stream %d after overflow.\n", rs.index);
+            if (!timedRestartStream(rs.index)) {
+                had_error = true;
+                break;
+            }
+        }
+        
+        epicsGuard<asynPortDriver> lock(*this);
+        
+        // If this stream failed, make the other streams stop reading.
+        if (had_error && !m_stream_failed) {
+            m_stream_failed = true;
+            interruptReadingOnce();
+        }
+        
+        // The read thread continues when the last stream is done.
+        m_num_streams_running--;
+        if (m_num_streams_running == 0) {
+            m_streams_done_event.signal();
+        }
+    }
+}
+
 void TRBaseDriver::setEffectiveParams ()
 {
     // Set the EFFECTIVE_SAMPLE_RATE parameter.
@@ -655,14 +1280,22 @@ void TRBaseDriver::setArmState (ArmState armState)
     callParamCallbacks();
 }
 
-bool TRBaseDriver::checkDisarmRequestedUnlocked ()
+bool TRBaseDriver::checkStopReadingUnlocked ()
 {
     lock();
-    bool stop_requested = m_disarm_requested;
+    bool stop_requested = m_disarm_requested || m_stream_failed;
     unlock();
     return stop_requested;
 }
 
+void TRBaseDriver::interruptReadingOnce ()
+{
+    if (!m_reading_interrupted) {
+        m_reading_interrupted = true;
+        timedInterruptReading();
+    }
+}
+
 bool TRBaseDriver::checkBasicSettings ()
 {
     // Sanity check NUM_BURSTS.
@@ -732,18 +1365,23 @@ bool TRBaseDriver::checkArmInfo (TRArmInfo const &arm_info)
         }
     }
     
+    // Check the decimation of channels.
+    if (arm_info.channel_decimation.size() != (size_t)m_num_channels) {
+        errlogSevPrintf(errlogMajor, "TRBaseDriver Error: The size of channel_decimation was changed.\n");
+        return false;
+    }
+    for (int channel = 0; channel < m_num_channels; channel++) {
+        if (arm_info.channel_decimation[channel] < 1) {
+            errlogSevPrintf(errlogMajor, "TRBaseDriver Error: channel_decimation of channel %d is not positive.\n", channel);
+            return false;
+        }
+    }
+    
     return true;
 }
 
-void TRBaseDriver::setupTimeArray (TRArmInfo const &arm_info)
+void TRBaseDriver::setupSampleCounts (TRArmInfo const &arm_info, std::vector<int> const &decimation)
 {
-    // Get the inverse of the unit (in seconds^-1).
-    double time_unit_inv;
-    getDoubleParam(m_asyn_params[TIME_ARRAY_UNIT_INV], &time_unit_inv);
-    
-    // Calculate the time step for the array.
-    double time_step = time_unit_inv / m_rate_for_display;
-    
     int num_pre;
     int num_post;
     
@@ -762,8 +1400,421 @@ void TRBaseDriver::setupTimeArray (TRArmInfo const &arm_info)
         num_pre = num_pre_post - num_post;
     }
     
+    m_arm_num_pre = num_pre;
+    m_arm_num_post = num_post;
+    m_channel_input_decimation = arm_info.channel_decimation;
+    m_channel_decimation = decimation;
+    
+    // Publish the numbers of samples of channels.
+    m_channels_driver->setSampleCounts(m_channel_decimation, num_pre, num_post);
+}
+
+void TRBaseDriver::getChannelSampleCounts (int channel, int *num_pre, int *num_post)
+{
+    assert(channel >= 0 && channel < m_num_channels);
+    
+    TRArmInfo::decimateSampleCounts(m_channel_input_decimation[channel], m_arm_num_pre, m_arm_num_post,
+                                    num_pre, num_post);
+}
+
+void TRBaseDriver::setupTimeArray ()
+{
+    // Get the inverse of the unit (in seconds^-1).
+    double time_unit_inv;
+    getDoubleParam(m_asyn_params[TIME_ARRAY_UNIT_INV], &time_unit_inv);
+    
+    // Calculate the time step for the array.
+    double time_step = time_unit_inv / m_rate_for_display;
+    
     // Set the the time array parameters.
-    m_time_array_driver.setTimeArrayParams(time_step, num_pre, num_post);
+    m_time_array_driver.setTimeArrayParams(time_step, m_arm_num_pre, m_arm_num_post, m_channel_decimation);
+}
+
+void TRBaseDriver::resetArmingStats ()
+{
+    m_arming_num_bursts = 0;
+    m_arming_num_overflows = 0;
+    m_arming_num_arrays = 0;
+    m_arming_num_dropped = 0;
+    epicsAtomicSetSizeT(&m_arming_num_elided, 0);
+    m_arming_num_bytes = 0.0;
+    m_arming_start_time = NAN;
+    m_arming_end_time = NAN;
+    for (size_t i = 0; i < m_streams.size(); i++) {
+        m_streams[i]->num_bursts = 0;
+        m_streams[i]->num_overflows = 0;
+        m_streams[i]->trigger_valid = false;
+    }
+    m_burst_deadline_misses = 0;
+    m_worst_burst_id = -1;
+    m_worst_burst_latency = NAN;
+    m_worst_burst_time_read = NAN;
+    m_worst_burst_time_check = NAN;
+    m_worst_burst_time_process = NAN;
+    
+    m_perf_driver.resetArmingStats();
+    if (m_inject_driver.get() != NULL) {
+        m_inject_driver->resetArmingStats();
+    }
+    m_trigger_driver.resetArmingStats();
+    TRAllocAudit::reset();
+    
+    updateArmingStatsParams();
+}
+
+void TRBaseDriver::updateArmingStatsParams ()
+{
+    double duration = m_arming_end_time - m_arming_start_time;
+    
+    TRSetInt64Param(*this, 0, m_asyn_params[ARMING_NUM_BURSTS],    (epicsInt64)m_arming_num_bursts);
+    TRSetInt64Param(*this, 0, m_asyn_params[ARMING_NUM_OVERFLOWS], (epicsInt64)m_arming_num_overflows);
+    TRSetInt64Param(*this, 0, m_asyn_params[ARMING_NUM_DROPPED],   (epicsInt64)m_arming_num_dropped);
+    TRSetInt64Param(*this, 0, m_asyn_params[ARMING_NUM_ELIDED],    (epicsInt64)epicsAtomicGetSizeT(&m_arming_num_elided));
+    setDoubleParam(m_asyn_params[ARMING_BURST_RATE],
+                   (duration > 0.0) ? (m_arming_num_bursts / duration) : NAN);
+    setDoubleParam(m_asyn_params[ARMING_DATA_RATE],
+                   (duration > 0.0) ? (m_arming_num_bytes / duration / 1e6) : NAN);
+    TRSetInt64Param(*this, 0, m_asyn_params[BURST_DEADLINE_MISSES], (epicsInt64)m_burst_deadline_misses);
+    setBurstIdParams(WORST_BURST_ID, WORST_BURST_ID64, m_worst_burst_id);
+    setDoubleParam(m_asyn_params[WORST_BURST_LATENCY],      1000.0 * m_worst_burst_latency);
+    setDoubleParam(m_asyn_params[WORST_BURST_TIME_READ],    1000.0 * m_worst_burst_time_read);
+    setDoubleParam(m_asyn_params[WORST_BURST_TIME_CHECK],   1000.0 * m_worst_burst_time_check);
+    setDoubleParam(m_asyn_params[WORST_BURST_TIME_PROCESS], 1000.0 * m_worst_burst_time_process);
+    setDoubleParam(m_asyn_params[SCRATCH_SIZE],      m_scratch_arena.getSize() / 1e6);
+    setDoubleParam(m_asyn_params[SCRATCH_PEAK_USED], m_scratch_arena.getPeakUsed() / 1e6);
+    setIntegerParam(m_asyn_params[SCRATCH_FAILED],   m_scratch_arena.getNumFailed());
+    
+    callParamCallbacks();
+}
+
+void TRBaseDriver::sizeArrayPool (TRArmInfo const &arm_info)
+{
+    int mode;
+    double cap_mb;
+    double latency_ms;
+    getIntegerParam(m_asyn_params[POOL_AUTO_SIZE],        &mode);
+    getDoubleParam(m_asyn_params[POOL_AUTO_SIZE_CAP],     &cap_mb);
+    getDoubleParam(m_asyn_params[POOL_CONSUMER_LATENCY],  &latency_ms);
+    
+    // Use information from the driver if provided, else what was observed
+    // in the previous arming.
+    double burst_bytes = (arm_info.burst_memory > 0) ?
+        (double)arm_info.burst_memory : m_observed_burst_bytes;
+    
+    // If the driver gave the sample size, compute the burst memory from
+    // the numbers of samples of channels (decimated channels need less).
+    if (arm_info.burst_memory == 0 && arm_info.sample_size > 0) {
+        burst_bytes = 0.0;
+        for (int channel = 0; channel < m_num_channels; channel++) {
+            int num_pre;
+            int num_post;
+            getChannelSampleCounts(channel, &num_pre, &num_post);
+            
+            // Arrays of channels processed by the processing graph are
+            // allocated with the input samples as doubles.
+            size_t sample_size = (m_process_graph.get() != NULL && m_process_graph->hasChain(channel)) ?
+                sizeof(double) : arm_info.sample_size;
+            burst_bytes += ((double)num_pre + num_post) * sample_size;
+        }
+    }
+    double burst_rate = !std::isnan(arm_info.expected_burst_rate) ?
+        arm_info.expected_burst_rate : m_observed_burst_rate;
+    double arrays_per_burst = (m_observed_arrays_per_burst > 0.0) ?
+        m_observed_arrays_per_burst : (double)m_num_channels;
+    
+    size_t limit = 0;
+    
+    if (mode == TRPoolAutoSizeOff || !(burst_bytes > 0.0) || !(burst_rate > 0.0)) {
+        setIntegerParam(m_asyn_params[POOL_RECOMMENDED_BUFFERS], 0);
+        setDoubleParam(m_asyn_params[POOL_RECOMMENDED_MEMORY], NAN);
+    } else {
+        // The consumer latency is the configured value or the lifetime of
+        // arrays observed by lifetime tracking, whichever is larger.
+        double latency = std::max(latency_ms / 1000.0, m_channels_driver->getMaxLifetime());
+        
+        // Bursts in use at the same time: those submitted within the
+        // consumer latency, plus the one being filled and the previous one
+        // which may be referenced by pArrays.
+        double depth = std::ceil(burst_rate * latency) + 2.0;
+        double memory = depth * burst_bytes;
+        int buffers = (int)std::ceil(depth * arrays_per_burst);
+        
+        setIntegerParam(m_asyn_params[POOL_RECOMMENDED_BUFFERS], buffers);
+        setDoubleParam(m_asyn_params[POOL_RECOMMENDED_MEMORY], memory / 1e6);
+        
+        // Apply the recommended memory as a limit within the hard cap if enabled.
+        double cap = cap_mb * 1e6;
+        if (mode == TRPoolAutoSizeApply) {
+            double applied = (cap > 0.0 && memory > cap) ? cap : memory;
+            limit = (size_t)std::ceil(applied);
+        }
+        
+        // Warn if the memory limits of the pool are not sufficient.
+        double available = (double)m_max_ad_memory;
+        if (limit > 0 && (available == 0.0 || limit < available)) {
+            available = (double)limit;
+        }
+        if (available > 0.0 && memory > available) {
+            errlogSevPrintf(errlogMinor, "TRBaseDriver Warning: %s needs %.3f MB of NDArrays for %.3g bursts/s with %.1f ms consumer latency, but only %.3f MB are available.\n",
+                portName, memory / 1e6, burst_rate, 1000.0 * latency, available / 1e6);
+        }
+        if (m_max_ad_buffers > 0 && buffers > m_max_ad_buffers) {
+            errlogSevPrintf(errlogMinor, "TRBaseDriver Warning: %s needs %d NDArrays for %.3g bursts/s with %.1f ms consumer latency, but max_ad_buffers is %d.\n",
+                portName, buffers, burst_rate, 1000.0 * latency, m_max_ad_buffers);
+        }
+    }
+    
+    m_channels_driver->setPoolLimit(limit);
+    setDoubleParam(m_asyn_params[POOL_LIMIT], limit / 1e6);
+}
+
+void TRBaseDriver::observePoolSizingInputs ()
+{
+    double duration = m_arming_end_time - m_arming_start_time;
+    
+    // Only update if the arming had enough bursts to be representative.
+    if (m_arming_num_bursts < 2 || !(duration > 0.0)) {
+        return;
+    }
+    
+    m_observed_burst_bytes = m_arming_num_bytes / m_arming_num_bursts;
+    m_observed_arrays_per_burst = (double)m_arming_num_arrays / m_arming_num_bursts;
+    m_observed_burst_rate = m_arming_num_bursts / duration;
+}
+
+void TRBaseDriver::trimArrayPool (bool log)
+{
+    int mode;
+    int keep_arrays;
+    double keep_memory;
+    getIntegerParam(m_asyn_params[POOL_TRIM_MODE],        &mode);
+    getIntegerParam(m_asyn_params[POOL_TRIM_KEEP_ARRAYS], &keep_arrays);
+    getDoubleParam(m_asyn_params[POOL_TRIM_KEEP_MEMORY],  &keep_memory);
+    
+    if (mode <= TRPoolTrimNone || mode > TRPoolTrimAll) {
+        return;
+    }
+    
+    // Keep the memory as a byte count, the parameter is in MB.
+    size_t keep_bytes = (keep_memory > 0.0) ? (size_t)(keep_memory * 1e6) : 0;
+    
+    // Trim with the port unlocked since freeing may take a while.
+    unlock();
+    size_t freed = m_channels_driver->trimPool((TRPoolTrimMode)mode, keep_arrays, keep_bytes);
+    updatePoolParams();
+    lock();
+    
+    if (log && freed > 0) {
+        errlogSevPrintf(errlogInfo, "TRBaseDriver Info: Released %.3f MB of cached NDArrays for %s.\n",
+            freed / 1e6, portName);
+    }
+}
+
+void TRBaseDriver::updatePoolParams ()
+{
+    int num_buffers;
+    int num_free;
+    size_t memory;
+    m_channels_driver->getPoolUsage(&num_buffers, &num_free, &memory);
+    
+    size_t budget_total;
+    size_t budget_used;
+    TRMemoryBudget::getTotals(&budget_total, &budget_used);
+    int budget_denied = m_channels_driver->m_memory_budget.getNumDenied();
+    
+    epicsGuard<asynPortDriver> lock(*this);
+    setIntegerParam(m_asyn_params[POOL_BUFFERS],        num_buffers);
+    setIntegerParam(m_asyn_params[POOL_FREE_BUFFERS],   num_free);
+    setDoubleParam(m_asyn_params[POOL_MEMORY],          memory / 1e6);
+    setIntegerParam(m_asyn_params[POOL_BUDGET_DENIED],  budget_denied);
+    setDoubleParam(m_asyn_params[MEMORY_BUDGET_TOTAL],  budget_total / 1e6);
+    setDoubleParam(m_asyn_params[MEMORY_BUDGET_USED],   budget_used / 1e6);
+    callParamCallbacks();
+}
+
+void TRBaseDriver::recordTransitionLatency (TRPerfTransition transition, int param, double request_time)
+{
+    double latency = TRPerfClock::now() - request_time;
+    m_perf_driver.addSample(transition, latency);
+    setDoubleParam(m_asyn_params[param], 1000.0 * latency);
+}
+
+void TRBaseDriver::checkBurstDeadline (int stream, epicsTimeStamp const &read_end_time,
+                                       epicsTimeStamp const &check_end_time)
+{
+    epicsTimeStamp process_end_time;
+    epicsTimeGetCurrent(&process_end_time);
+    
+    epicsGuard<asynPortDriver> lock(*this);
+    
+    // Nothing to do if the driver did not provide the trigger time.
+    ReadStream &rs = *m_streams[stream];
+    if (!rs.trigger_valid) {
+        return;
+    }
+    rs.trigger_valid = false;
+    
+    double latency = epicsTimeDiffInSeconds(&process_end_time, &rs.trigger_time);
+    setDoubleParam(m_asyn_params[BURST_LATENCY], 1000.0 * latency);
+    
+    // Count a deadline miss if the deadline is enabled.
+    double deadline;
+    getDoubleParam(m_asyn_params[BURST_DEADLINE], &deadline);
+    if (deadline > 0.0 && 1000.0 * latency > deadline) {
+        m_burst_deadline_misses++;
+        TRSetInt64Param(*this, 0, m_asyn_params[BURST_DEADLINE_MISSES], (epicsInt64)m_burst_deadline_misses);
+    }
+    
+    // Remember the worst burst of the arming with the breakdown of its latency.
+    if (std::isnan(m_worst_burst_latency) || latency > m_worst_burst_latency) {
+        m_worst_burst_id = (epicsInt64)rs.trigger_id;
+        m_worst_burst_latency = latency;
+        m_worst_burst_time_read = epicsTimeDiffInSeconds(&read_end_time, &rs.trigger_time);
+        m_worst_burst_time_check = epicsTimeDiffInSeconds(&check_end_time, &read_end_time);
+        m_worst_burst_time_process = epicsTimeDiffInSeconds(&process_end_time, &check_end_time);
+        
+        setBurstIdParams(WORST_BURST_ID, WORST_BURST_ID64, m_worst_burst_id);
+        setDoubleParam(m_asyn_params[WORST_BURST_LATENCY],      1000.0 * m_worst_burst_latency);
+        setDoubleParam(m_asyn_params[WORST_BURST_TIME_READ],    1000.0 * m_worst_burst_time_read);
+        setDoubleParam(m_asyn_params[WORST_BURST_TIME_CHECK],   1000.0 * m_worst_burst_time_check);
+        setDoubleParam(m_asyn_params[WORST_BURST_TIME_PROCESS], 1000.0 * m_worst_burst_time_process);
+    }
+    
+    callParamCallbacks();
+}
+
+void TRBaseDriver::countSubmittedArray (bool dropped, size_t num_bytes)
+{
+    if (dropped) {
+        m_arming_num_dropped++;
+    } else {
+        m_arming_num_arrays++;
+        m_arming_num_bytes += num_bytes;
+    }
+}
+
+void TRBaseDriver::countElidedArray ()
+{
+    epicsAtomicIncrSizeT(&m_arming_num_elided);
+}
+
+bool TRBaseDriver::hasArrayConsumers (int channel, TRTriggerRoute const &route)
+{
+    assert(channel >= 0 && channel < m_num_channels);
+    
+    return m_channels_driver->hasConsumers(route.channelAddress(channel));
+}
+
+void TRBaseDriver::submitProcessedBurst (TRProcessInput const *inputs, epicsUInt64 burst_id,
+                                         double timestamp, epicsTimeStamp epics_ts,
+                                         TRTriggerRoute const &route)
+{
+    assert(m_process_graph.get() != NULL);
+    
+    // Do not process a burst whose arrays would not be submitted.
+    if (!route.accepted()) {
+        return;
+    }
+    
+    m_process_graph->run(*this, m_parallel_copy, inputs, burst_id, timestamp, epics_ts, route);
+}
+
+bool TRBaseDriver::injectLoad (TRInjectPoint point)
+{
+    if (m_inject_driver.get() == NULL) {
+        return true;
+    }
+    return m_inject_driver->inject(point, *this, m_channels_driver.get());
+}
+
+bool TRBaseDriver::timedWaitForPreconditions ()
+{
+    TRAllocAuditScope audit(TRPerfPhaseWaitForPreconditions);
+    double start = m_perf_driver.beginSample(TRPerfPhaseWaitForPreconditions);
+    bool result = waitForPreconditions();
+    m_perf_driver.endSample(TRPerfPhaseWaitForPreconditions, start);
+    return result;
+}
+
+bool TRBaseDriver::timedCheckSettings (TRArmInfo &arm_info)
+{
+    TRAllocAuditScope audit(TRPerfPhaseCheckSettings);
+    double start = m_perf_driver.beginSample(TRPerfPhaseCheckSettings);
+    bool result = checkSettings(arm_info);
+    m_perf_driver.endSample(TRPerfPhaseCheckSettings, start);
+    return result;
+}
+
+bool TRBaseDriver::timedStartAcquisition (bool overflow)
+{
+    TRAllocAuditScope audit(TRPerfPhaseStartAcquisition);
+    double start = m_perf_driver.beginSample(TRPerfPhaseStartAcquisition);
+    bool result = startAcquisition(overflow);
+    m_perf_driver.endSample(TRPerfPhaseStartAcquisition, start);
+    return result;
+}
+
+bool TRBaseDriver::timedReadBurst (int stream)
+{
+    TRAllocAuditScope audit(TRPerfPhaseReadBurst);
+    double start = m_perf_driver.beginSample(TRPerfPhaseReadBurst, stream);
+    bool result = readStreamBurst(stream);
+    injectLoad(TRInjectPointRead);
+    m_perf_driver.endSample(TRPerfPhaseReadBurst, start, stream);
+    return result;
+}
+
+bool TRBaseDriver::timedCheckOverflow (int stream, bool *had_overflow, int *num_buffer_bursts)
+{
+    TRAllocAuditScope audit(TRPerfPhaseCheckOverflow);
+    double start = m_perf_driver.beginSample(TRPerfPhaseCheckOverflow, stream);
+    bool result = checkStreamOverflow(stream, had_overflow, num_buffer_bursts);
+    m_perf_driver.endSample(TRPerfPhaseCheckOverflow, start, stream);
+    return result;
+}
+
+bool TRBaseDriver::timedProcessBurstData (int stream)
+{
+    TRAllocAuditScope audit(TRPerfPhaseProcessBurstData);
+    double start = m_perf_driver.beginSample(TRPerfPhaseProcessBurstData, stream);
+    bool result = processStreamBurstData(stream);
+    injectLoad(TRInjectPointProcess);
+    m_perf_driver.endSample(TRPerfPhaseProcessBurstData, start, stream);
+    return result;
+}
+
+bool TRBaseDriver::timedRestartStream (int stream)
+{
+    // Restarting a stream is accounted as starting acquisition.
+    TRAllocAuditScope audit(TRPerfPhaseStartAcquisition);
+    double start = m_perf_driver.beginSample(TRPerfPhaseStartAcquisition, stream);
+    bool result = restartStream(stream);
+    m_perf_driver.endSample(TRPerfPhaseStartAcquisition, start, stream);
+    return result;
+}
+
+void TRBaseDriver::timedInterruptReading ()
+{
+    TRAllocAuditScope audit(TRPerfPhaseInterruptReading);
+    double start = m_perf_driver.beginSample(TRPerfPhaseInterruptReading);
+    interruptReading();
+    m_perf_driver.endSample(TRPerfPhaseInterruptReading, start);
+}
+
+void TRBaseDriver::timedStopAcquisition ()
+{
+    TRAllocAuditScope audit(TRPerfPhaseStopAcquisition);
+    double start = m_perf_driver.beginSample(TRPerfPhaseStopAcquisition);
+    stopAcquisition();
+    m_perf_driver.endSample(TRPerfPhaseStopAcquisition, start);
+}
+
+void TRBaseDriver::timedOnDisarmed ()
+{
+    TRAllocAuditScope audit(TRPerfPhaseOnDisarmed);
+    double start = m_perf_driver.beginSample(TRPerfPhaseOnDisarmed);
+    onDisarmed();
+    m_perf_driver.endSample(TRPerfPhaseOnDisarmed, start);
 }
 
 TRChannelsDriver * TRBaseDriver::createChannelsDriver ()
@@ -812,6 +1863,34 @@ bool TRBaseDriver::processBurstData ()
     return false;
 }
 
+bool TRBaseDriver::readStreamBurst (int stream)
+{
+    // Default implementation for drivers with a single stream.
+    (void)stream;
+    return readBurst();
+}
+
+bool TRBaseDriver::checkStreamOverflow (int stream, bool *had_overflow, int *num_buffer_bursts)
+{
+    // Default implementation for drivers with a single stream.
+    (void)stream;
+    return checkOverflow(had_overflow, num_buffer_bursts);
+}
+
+bool TRBaseDriver::processStreamBurstData (int stream)
+{
+    // Default implementation for drivers with a single stream.
+    (void)stream;
+    return processBurstData();
+}
+
+bool TRBaseDriver::restartStream (int stream)
+{
+    // Default implementation for drivers which do not support restarting streams.
+    errlogSevPrintf(errlogMajor, "TRBaseDriver Error: The driver does not support restarting stream %d after overflow.\n", stream);
+    return false;
+}
+
 void TRBaseDriver::interruptReading ()
 {
     // Default implementation for drivers which do not use our read loop.
@@ -34,6 +34,13 @@
 #include "TRChannelsDriver.h"
 #include "TRConfigParam.h"
 #include "TRNonCopyable.h"
+#include "TRParallelCopy.h"
+#include "TRPerfStatsDriver.h"
+#include "TRLoadInjectDriver.h"
+#include "TRProcessGraph.h"
+#include "TRTriggerDriver.h"
+#include "TRTriggerRoute.h"
+#include "TRScratchArena.h"
 #include "TRTimeArrayDriver.h"
 
 /**
@@ -60,6 +67,8 @@ class TRBaseDriver : public asynPortDriver,
     
     friend class TRChannelsDriver;
     friend class TRChannelDataSubmit;
+    friend class TRPerfCounter;
+    friend class TRProcessGraph;
 
 public:
     /**
@@ -145,6 +154,51 @@ public:
         return *m_channels_driver;
     }
     
+    /**
+     * Return a reference to the helper for copying and converting large
+     * amounts of data.
+     * 
+     * It uses TRBaseConfig::num_copy_threads helper threads. For copying
+     * burst data into NDArrays, TRChannelDataSubmit::copyData can be used.
+     * 
+     * @return Reference to the parallel copy helper.
+     */
+    inline TRParallelCopy & getParallelCopy ()
+    {
+        return m_parallel_copy;
+    }
+    
+    /**
+     * Allocate a temporary buffer from the scratch arena.
+     * 
+     * This may be called from startAcquisition until the end of the arming
+     * (including stopAcquisition and onDisarmed), from any thread. The
+     * memory is released when disarming. The arena has the capacity
+     * requested in TRArmInfo::scratch_size by checkSettings.
+     * 
+     * @param size Number of bytes.
+     * @param alignment Alignment of the buffer, a power of two up to 64.
+     * @return Pointer to the buffer, or NULL if the arena does not have
+     *         enough space left.
+     */
+    inline void * allocScratch (size_t size, size_t alignment = TRScratchArena::DefaultAlignment)
+    {
+        return m_scratch_arena.alloc(size, alignment);
+    }
+    
+    /**
+     * Return a reference to the scratch arena.
+     * 
+     * This allows releasing memory of a single burst using
+     * TRScratchArena::getMark and TRScratchArena::releaseToMark.
+     * 
+     * @return Reference to the scratch arena.
+     */
+    inline TRScratchArena & getScratchArena ()
+    {
+        return m_scratch_arena;
+    }
+    
     /**
      * Set the name of the digitizer, which will appear as the value
      * of the "name" PV.
@@ -160,6 +214,24 @@ public:
      */
     void setDigitizerName (char const *name);
     
+    /**
+     * Register a performance statistics entry of the driver.
+     * 
+     * The entry is exposed by the performance statistics port like the
+     * framework entries (see TRPerfStatsDriver), included in the arming
+     * summary and reset at the start of arming. Samples are added using
+     * TRPerfCounter objects.
+     * 
+     * This should be called from the driver's constructor. At most
+     * TRBaseConfig::num_perf_entries entries can be registered.
+     * 
+     * @param name Name of the entry (exposed as PERF_NAME).
+     * @param type Whether samples are durations or other values.
+     * @return The index (asyn address) of the entry, or -1 on error
+     *         (in which case an error has been logged).
+     */
+    int registerPerfEntry (char const *name, TRPerfEntryType type);
+    
     /**
      * Returns the requested sample rate.
      * 
@@ -269,6 +341,25 @@ public:
         return m_param_achievable_sample_rate.getSnapshot();
     }
     
+    /**
+     * Returns the number of samples of a channel for the current arming.
+     * 
+     * This accounts for the decimation ratio of the channel as set in
+     * @ref TRArmInfo::channel_decimation (see TRArmInfo::decimateSampleCounts).
+     * The full-rate numbers of samples are the desired numbers of samples,
+     * or the custom inputs for the time array if set in TRArmInfo. These are
+     * the numbers of samples of data from the driver, which do not include
+     * decimation by the processing graph (see @ref submitProcessedBurst).
+     * 
+     * This may be called from @ref startAcquisition until the end of the
+     * arming, from the read thread or with the port locked.
+     * 
+     * @param channel The channel number.
+     * @param num_pre Set to the number of pre-trigger samples of the channel.
+     * @param num_post Set to the number of post-trigger samples of the channel.
+     */
+    void getChannelSampleCounts (int channel, int *num_pre, int *num_post);
+    
     /**
      * Request disarming of acquisition.
      * 
@@ -317,12 +408,88 @@ public:
      * all channels involved in the burst (the epics_ts argument to
      * TRChannelDataSubmit::submit).
      * 
+     * If TRBurstMetaInfo::trigger_time is set, the latency of the burst
+     * is determined when processBurstData returns, so this function
+     * should be called before that (from processBurstData or readBurst).
+     * 
      * This function MUST be called with the port unlocked.
      * 
      * @param info Meta-information about the burst.
      */
     void publishBurstMetaInfo (TRBurstMetaInfo const &info);
     
+    /**
+     * Determine the route of a burst from a trigger source.
+     * 
+     * This should be called once for each burst, before submitting its
+     * arrays, by drivers with more than one trigger source
+     * (TRBaseConfig::num_trigger_sources). The result should be passed to
+     * TRChannelDataSubmit::submit for all arrays of the burst, which submits
+     * them to the address range of the source. The burst is counted for
+     * the source and checked against its rate limit (see TRTriggerDriver);
+     * if it is not accepted (TRTriggerRoute::accepted), its arrays are not
+     * submitted and the driver may skip processing its data.
+     * 
+     * This function may be called with the port locked or unlocked.
+     * 
+     * @param source The trigger source (0 to num_trigger_sources-1).
+     * @return The route of the burst.
+     */
+    TRTriggerRoute routeBurst (int source);
+    
+    /**
+     * Check whether arrays of a channel currently have consumers.
+     * 
+     * An address of the channels port has consumers if array callbacks
+     * are enabled (`ENABLE_CALLBACKS`) and at least one plugin is receiving
+     * arrays from it, or if UPDATE_ARRAYS is enabled. Drivers can use this
+     * to skip computing products of the channel which nobody would receive.
+     * With TRBaseConfig::elide_unused_arrays, TRChannelDataSubmit::allocateArray
+     * uses this to skip allocating arrays.
+     * 
+     * The result is cached. Plugins are checked at the start of arming and
+     * periodically (every 0.1 s) while armed, and the parameters when they
+     * are written,
+     * so a newly enabled plugin may miss arrays submitted shortly before.
+     * 
+     * This function may be called with the port locked or unlocked.
+     * 
+     * @param channel The channel number.
+     * @param route The route of the burst (see @ref routeBurst), which
+     *              determines the address for the trigger source.
+     * @return Whether the channel has consumers.
+     */
+    bool hasArrayConsumers (int channel, TRTriggerRoute const &route = TRTriggerRoute());
+    
+    /**
+     * Process and submit the data of all channels of a burst using the
+     * processing graph.
+     * 
+     * This requires TRBaseConfig::process_graph. Each channel is processed
+     * by the chain of stages configured for it (see TRProcessGraph) and
+     * submitted as an NDFloat64 array, or copied and submitted unchanged if
+     * it has no chain. Channels are processed concurrently on the
+     * TRBaseConfig::num_copy_threads helper threads, and this function
+     * returns when all arrays have been submitted.
+     * 
+     * The number of samples of each input must be as given by
+     * @ref getChannelSampleCounts, which does not include decimation by
+     * the processing graph; the numbers of samples of the submitted arrays
+     * (NUM_SAMPLES of the channels port) and the time arrays do include it.
+     * 
+     * This function MUST be called with the port unlocked.
+     * 
+     * @param inputs The input data of each channel (num_channels entries).
+     * @param burst_id The burst ID (see TRChannelDataSubmit::submit).
+     * @param timestamp The timestamp for the NDArrays.
+     * @param epics_ts The epicsTimeStamp for the NDArrays.
+     * @param route The route of the burst (see @ref routeBurst). If it is not
+     *              accepted, nothing is done.
+     */
+    void submitProcessedBurst (TRProcessInput const *inputs, epicsUInt64 burst_id,
+                               double timestamp, epicsTimeStamp epics_ts,
+                               TRTriggerRoute const &route = TRTriggerRoute());
+    
     /**
      * Possibly sleep for testing if enabled.
      * 
@@ -336,6 +503,9 @@ public:
      * gain the capability to sleep after reading a burst (or generally
      * wherever it wishes).
      * 
+     * This is also the AfterBurst point of load injection if enabled (see
+     * @ref TRLoadInjectDriver), which supersedes the fixed sleep.
+     * 
      * This function MUST be called with the port unlocked.
      */
     void maybeSleepForTesting ();
@@ -569,6 +739,71 @@ protected:
      */
     virtual bool processBurstData ();
     
+    /**
+     * Wait for and read a burst of data of a read stream.
+     * 
+     * This is the equivalent of @ref readBurst for drivers with multiple
+     * read streams (TRBaseConfig::num_read_streams). It is called in the read
+     * loop of each stream, on the thread of the stream, so calls for different
+     * streams run concurrently. The same requirements as for readBurst apply.
+     * 
+     * The default implementation calls @ref readBurst, so drivers with a
+     * single stream need not override this.
+     * 
+     * @param stream The read stream (0 to num_read_streams-1).
+     * @return True on success of if aborted due to @ref interruptReading, false
+     *         on error (stop reading).
+     */
+    virtual bool readStreamBurst (int stream);
+    
+    /**
+     * Check if there has been a buffer overflow of a read stream.
+     * 
+     * This is the equivalent of @ref checkOverflow for drivers with multiple
+     * read streams. Overflows are handled separately for each stream: the
+     * remaining bursts of the stream are read and then @ref restartStream
+     * is called, while other streams continue reading.
+     * 
+     * The default implementation calls @ref checkOverflow.
+     * 
+     * @param stream The read stream.
+     * @param had_overflow See @ref checkOverflow.
+     * @param num_buffer_bursts See @ref checkOverflow.
+     * @return True on success, false on error (stop reading).
+     */
+    virtual bool checkStreamOverflow (int stream, bool *had_overflow, int *num_buffer_bursts);
+    
+    /**
+     * Process the burst that has just been read by readStreamBurst.
+     * 
+     * This is the equivalent of @ref processBurstData for drivers with
+     * multiple read streams. The driver should set TRBurstMetaInfo::stream
+     * when publishing meta-information about the burst.
+     * 
+     * The default implementation calls @ref processBurstData.
+     * 
+     * @param stream The read stream.
+     * @return True on success, false on error (stop reading).
+     */
+    virtual bool processStreamBurstData (int stream);
+    
+    /**
+     * Restart acquisition of a read stream after a buffer overflow.
+     * 
+     * This is only called with multiple read streams, after the remaining
+     * bursts of the stream have been read following an overflow (with a
+     * single stream, @ref startAcquisition is called with overflow==true
+     * instead). It is called on the thread of the stream, with the port
+     * unlocked, and MUST return unlocked.
+     * 
+     * The default implementation reports an error and returns false.
+     * 
+     * @param stream The read stream.
+     * @return True on success (continue reading the stream), false on error
+     *         (stop reading).
+     */
+    virtual bool restartStream (int stream);
+    
     /**
      * Interrupt reading of data.
      * 
@@ -579,11 +814,18 @@ protected:
      * read loop, that is after a successful @ref startAcquisition but before
      * @ref stopAcquisition, and also only in between two startAcquisition in
      * case of buffer overflows. It will also be called no more than once in
-     * the entire arming sequence.
+     * the entire arming sequence, except if the read loop watchdog is enabled
+     * (WATCHDOG_DISARM_TIMEOUT parameter): then, if the read loop does not exit
+     * within the timeout after disarming was requested, it is called again (a
+     * limited number of times) from the watchdog thread. Drivers which enable
+     * the watchdog must tolerate such repeated calls.
      * 
      * Calling this must ensure that any ongoing or future @ref readBurst call
      * returns as soon as possible and that any future readBurst call
-     * returns immediately. Note that readBurst must not return an error
+     * returns immediately. With multiple read streams this applies to
+     * @ref readStreamBurst of all streams, and this is also called (once) when
+     * the read loop of a stream fails so that the other streams stop.
+     * Note that readBurst must not return an error
      * (false) due to this interruption; readBurst does not need to report
      * to the caller whether it returned due to interruption or because a
      * burst was read.
@@ -676,6 +918,33 @@ public:
      */
     virtual asynStatus writeFloat64 (asynUser *pasynUser, epicsFloat64 value);
     
+    /**
+     * Overridden asyn report function.
+     * 
+     * In addition to the standard report, this prints a summary of the
+     * current or last arming (see @ref printArmingSummary) if details
+     * is at least 1. It is invoked by the `asynReport` iocsh command.
+     * 
+     * @param fp File to print to.
+     * @param details Level of detail.
+     */
+    virtual void report (FILE *fp, int details);
+    
+    /**
+     * Print a summary of the current or last arming.
+     * 
+     * The summary includes the number of bursts, burst and data rates,
+     * overflows, dropped arrays and the timing statistics of driver
+     * functions called by the framework (see @ref TRPerfPhase).
+     * The same summary is logged automatically after each disarming
+     * if enabled using the ARMING_SUMMARY_LOG parameter (off by default).
+     * 
+     * This function MUST be called with the port locked.
+     * 
+     * @param fp File to print to, or NULL to print using errlog.
+     */
+    void printArmingSummary (FILE *fp);
+    
 private:
     // Enumeration of asyn parameters of this class, excluding
     // those managed by TRConfigParam.
@@ -684,12 +953,51 @@ private:
         ARM_STATE,
         EFFECTIVE_SAMPLE_RATE,
         BURST_ID,
+        BURST_ID64,
         BURST_TIME_BURST,
         BURST_TIME_READ,
         BURST_TIME_PROCESS,
         SLEEP_AFTER_BURST,
         DIGITIZER_NAME,
         TIME_ARRAY_UNIT_INV,
+        ARMING_NUM_BURSTS,
+        ARMING_NUM_OVERFLOWS,
+        ARMING_NUM_DROPPED,
+        ARMING_NUM_ELIDED,
+        ARMING_BURST_RATE,
+        ARMING_DATA_RATE,
+        ARMING_SUMMARY_LOG,
+        ARM_LATENCY,
+        DISARM_LATENCY,
+        WATCHDOG_DISARM_TIMEOUT,
+        READ_LOOP_STALLED,
+        BURST_DEADLINE,
+        BURST_LATENCY,
+        BURST_DEADLINE_MISSES,
+        WORST_BURST_ID,
+        WORST_BURST_ID64,
+        WORST_BURST_LATENCY,
+        WORST_BURST_TIME_READ,
+        WORST_BURST_TIME_CHECK,
+        WORST_BURST_TIME_PROCESS,
+        SCRATCH_SIZE,
+        SCRATCH_PEAK_USED,
+        SCRATCH_FAILED,
+        POOL_TRIM_MODE,
+        POOL_TRIM_KEEP_ARRAYS,
+        POOL_TRIM_KEEP_MEMORY,
+        POOL_BUFFERS,
+        POOL_FREE_BUFFERS,
+        POOL_MEMORY,
+        POOL_BUDGET_DENIED,
+        MEMORY_BUDGET_TOTAL,
+        MEMORY_BUDGET_USED,
+        POOL_AUTO_SIZE,
+        POOL_AUTO_SIZE_CAP,
+        POOL_CONSUMER_LATENCY,
+        POOL_RECOMMENDED_BUFFERS,
+        POOL_RECOMMENDED_MEMORY,
+        POOL_LIMIT,
         NUM_BASE_ASYN_PARAMS
     };
 
@@ -706,12 +1014,18 @@ private:
     // Number of channels supported (as passed to constructor).
     int m_num_channels;
     
+    // Number of trigger sources (at least one).
+    int m_num_trigger_sources;
+    
     // Whether the driver supports pre-samples.
     bool m_supports_pre_samples;
     
     // Whether copies of submitted NDArrays are kept in the TRChannelsDriver
     // (initial value only used by TRChannelsDriver constructor).
     bool m_update_arrays;
+    
+    // Whether arrays without consumers are not allocated.
+    bool m_elide_unused_arrays;
 
     // Flag whether completeInit has been called.
     bool m_init_completed;
@@ -722,6 +1036,13 @@ private:
     // Parameters remembered for the TRChannelsDriver constructor.
     int m_max_ad_buffers;
     size_t m_max_ad_memory;
+    size_t m_ad_memory_reservation;
+    
+    // Burst size and rate observed in the last arming, for automatic
+    // sizing of the NDArray pool (zero if unknown).
+    double m_observed_burst_bytes;
+    double m_observed_arrays_per_burst;
+    double m_observed_burst_rate;
     
     // Total number of configuration parameters.
     int m_num_config_params;
@@ -767,10 +1088,23 @@ private:
     // This flag indicates whether we are inside the read loop.
     bool m_in_read_loop;
     
+    // Whether interruptReading was called in this arming (other than
+    // by the watchdog).
+    bool m_reading_interrupted;
+    
     // Sample rate for display (time array and NDArrray attributes).
     // This is set during arming to the value provided by checkSettings.
     double m_rate_for_display;
     
+    // Decimation ratio of each channel and the full-rate numbers of
+    // samples for the arming, set during arming from TRArmInfo.
+    // The input decimation is that of the data from the driver and the
+    // other also includes decimation by the processing graph.
+    std::vector<int> m_channel_input_decimation;
+    std::vector<int> m_channel_decimation;
+    int m_arm_num_pre;
+    int m_arm_num_post;
+    
     // This event is raised from handleArmRequest to the
     // read_thread in order to start the arming.
     epicsEvent m_start_arming_event;
@@ -786,6 +1120,97 @@ private:
     
     // Asyn port for the time array.
     TRTimeArrayDriver m_time_array_driver;
+    
+    // Asyn port for performance statistics.
+    TRPerfStatsDriver m_perf_driver;
+    
+    // Asyn port for synthetic load injection (NULL if not enabled).
+    epics_auto_ptr<TRLoadInjectDriver> m_inject_driver;
+    
+    // Asyn port for trigger sources.
+    TRTriggerDriver m_trigger_driver;
+    
+    // Helper for copying and converting large bursts.
+    TRParallelCopy m_parallel_copy;
+    
+    // Asyn port for the processing graph (NULL if not enabled).
+    epics_auto_ptr<TRProcessGraph> m_process_graph;
+    
+    // Temporary buffers for the current arming.
+    TRScratchArena m_scratch_arena;
+    
+    // Statistics of the current or last arming (protected by the port lock).
+    // The start time is when the requested arm state was reached and the
+    // end time is when the read loop was left (or NAN if not yet reached).
+    epicsUInt64 m_arming_num_bursts;
+    epicsUInt64 m_arming_num_overflows;
+    epicsUInt64 m_arming_num_arrays;
+    epicsUInt64 m_arming_num_dropped;
+    size_t m_arming_num_elided; // accessed atomically
+    double m_arming_num_bytes;
+    double m_arming_start_time;
+    double m_arming_end_time;
+    
+    // Time of the pending arm request (NAN if none) and whether it was
+    // received while not disarmed, for measuring arm latency.
+    double m_arm_request_time;
+    bool m_arm_request_is_rearm;
+    
+    // Time of the pending disarm request (NAN if none), for measuring
+    // disarm latency.
+    double m_disarm_request_time;
+    
+    // State of the watchdog for the current arming: how many times it
+    // has called interruptReading and whether it has given up.
+    int m_watchdog_interrupt_retries;
+    bool m_watchdog_gave_up;
+    
+    // Whether any timed function is currently past its deadline.
+    bool m_read_loop_stalled;
+    
+    // State of a read stream. All streams use the read loop in
+    // runReadLoop; with a single stream it runs on the read thread,
+    // otherwise each stream has its own thread.
+    struct ReadStream {
+        TRBaseDriver *driver;
+        int index;
+        
+        // Signaled to start the read loop of the stream, after
+        // remaining_bursts has been set.
+        epicsEvent start_event;
+        int remaining_bursts;
+        
+        // Statistics of the current or last arming (protected by the port lock).
+        epicsUInt64 num_bursts;
+        epicsUInt64 num_overflows;
+        
+        // Trigger time of the current burst as published by the driver
+        // (protected by the port lock, valid flag cleared when consumed).
+        bool trigger_valid;
+        epicsUInt64 trigger_id;
+        epicsTimeStamp trigger_time;
+    };
+    
+    // The read streams. These are allocated in the constructor and never
+    // freed, since stream threads run for the lifetime of the driver.
+    std::vector<ReadStream *> m_streams;
+    
+    // With multiple streams, the number of streams whose read loop has not
+    // ended, whether the read loop of any stream failed (protected by the
+    // port lock) and the event signaled when the last read loop has ended.
+    int m_num_streams_running;
+    bool m_stream_failed;
+    epicsEvent m_streams_done_event;
+    
+    // Burst latency statistics of the current or last arming (protected
+    // by the port lock). Worst latency is NAN if no latency was measured;
+    // durations are in seconds. Worst burst ID is -1 if none.
+    epicsUInt64 m_burst_deadline_misses;
+    epicsInt64 m_worst_burst_id;
+    double m_worst_burst_latency;
+    double m_worst_burst_time_read;
+    double m_worst_burst_time_check;
+    double m_worst_burst_time_process;
 
 private:
     // Add this parameter index to m_protected_params.
@@ -813,6 +1238,31 @@ private:
     // One iteration of the read thread (one arming and disarming).
     void readThreadIteration ();
     
+    // Result of runReadLoop.
+    enum ReadLoopResult {
+        ReadLoopStopped,  // all bursts read or reading should stop
+        ReadLoopOverflow, // remaining bursts read after a buffer overflow
+        ReadLoopError     // a driver function failed
+    };
+    
+    // The read loop of a stream, reading bursts until the remaining bursts
+    // (negative for no limit) are read, reading should stop or the remaining
+    // bursts after an overflow are read. Must be called unlocked.
+    ReadLoopResult runReadLoop (int stream, int &remaining_bursts);
+    
+    // Threads of read streams, used with multiple streams.
+    static void streamThreadTrampoline (void *obj);
+    void streamThread (ReadStream &rs);
+    
+    // Watchdog thread (started by completeInit), periodically calls
+    // watchdogCheck and does bookkeeping of the channels port.
+    static void watchdogThreadTrampoline (void *obj);
+    void watchdogThread ();
+    
+    // Detects stalls of timed functions and escalates if the read loop
+    // does not exit after disarming was requested. Returns whether armed.
+    bool watchdogCheck ();
+    
     // Set effective-value parameters, during arming.
     void setEffectiveParams ();
     
@@ -825,8 +1275,13 @@ private:
     // Sets m_arm_state and updates the asyn parameter.
     void setArmState (ArmState armState);
     
-    // Reads the m_stop_requested, locking and unlocking the port.
-    bool checkDisarmRequestedUnlocked ();
+    // Checks whether reading should stop because disarming was requested
+    // or the read loop of another stream failed, locking and unlocking the port.
+    bool checkStopReadingUnlocked ();
+    
+    // Calls interruptReading unless already called in this arming.
+    // Must be called locked.
+    void interruptReadingOnce ();
     
     // Check basic settings before proceeding with arming.
     bool checkBasicSettings ();
@@ -834,8 +1289,73 @@ private:
     // Check values provided by checkSettings in TRArmInfo.
     bool checkArmInfo (TRArmInfo const &arm_info);
     
-    // Sets up the time array based on snapshot settings and m_rate_for_display.
-    void setupTimeArray (TRArmInfo const &arm_info);
+    // Determines the numbers of samples for the arming from snapshot settings
+    // or custom inputs, and the decimation of channels (from the driver and
+    // including the processing graph).
+    void setupSampleCounts (TRArmInfo const &arm_info, std::vector<int> const &decimation);
+    
+    // Sets up the time arrays based on sample counts and m_rate_for_display.
+    void setupTimeArray ();
+    
+    // Injects synthetic load at a point of the data path if enabled
+    // (see TRLoadInjectDriver), returns false if a failure was injected,
+    // which is only possible at TRInjectPointAlloc.
+    // Must be called with no port locked.
+    bool injectLoad (TRInjectPoint point);
+    
+    // Resets the statistics of the arming, at the start of arming.
+    void resetArmingStats ();
+    
+    // Updates the arming statistics parameters, at the end of arming.
+    void updateArmingStatsParams ();
+    
+    // Sets a burst ID to the 32-bit parameter (low 31 bits) and to the
+    // corresponding 64-bit parameter. Must be called locked.
+    void setBurstIdParams (int param, int param64, epicsInt64 burst_id);
+    
+    // Determines the recommended size of the NDArray pool for the arming,
+    // applies it as a limit if enabled and warns if the configured limits
+    // are insufficient (POOL_AUTO_SIZE and related parameters).
+    void sizeArrayPool (TRArmInfo const &arm_info);
+    
+    // Remembers the burst size and rate of the arming for sizeArrayPool,
+    // at the end of arming.
+    void observePoolSizingInputs ();
+    
+    // Releases cached arrays of the NDArray pool according to the
+    // POOL_TRIM_* parameters, at the end of arming.
+    void trimArrayPool (bool log);
+    
+    // Updates the POOL_* usage parameters. Must be called unlocked.
+    void updatePoolParams ();
+    
+    // Records the latency of a transition given the request time and
+    // sets the associated parameter (callParamCallbacks is not called).
+    void recordTransitionLatency (TRPerfTransition transition, int param, double request_time);
+    
+    // Determines the latency of the burst of a stream just processed and
+    // checks it against the deadline, given the times when readBurst and
+    // checkOverflow returned. Must be called unlocked.
+    void checkBurstDeadline (int stream, epicsTimeStamp const &read_end_time,
+                             epicsTimeStamp const &check_end_time);
+    
+    // Counts an array submitted or dropped by TRChannelDataSubmit.
+    void countSubmittedArray (bool dropped, size_t num_bytes);
+    
+    // Counts an array elided by TRChannelDataSubmit (no lock needed).
+    void countElidedArray ();
+    
+    // Wrappers for driver functions which record their duration.
+    bool timedWaitForPreconditions ();
+    bool timedCheckSettings (TRArmInfo &arm_info);
+    bool timedStartAcquisition (bool overflow);
+    bool timedReadBurst (int stream);
+    bool timedCheckOverflow (int stream, bool *had_overflow, int *num_buffer_bursts);
+    bool timedProcessBurstData (int stream);
+    bool timedRestartStream (int stream);
+    void timedInterruptReading ();
+    void timedStopAcquisition ();
+    void timedOnDisarmed ();
 };
 
 #endif
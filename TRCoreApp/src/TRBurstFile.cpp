@@ -0,0 +1,221 @@
+/* This file is part of the Transient Recorder Framework.
+ * It is subject to the license terms in the LICENSE.txt file found in the
+ * top-level directory of this distribution and at
+ * https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. No part
+ * of the Transient Recorder Framework, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <cmath>
+
+#include <epicsAssert.h>
+#include <errlog.h>
+
+#include "TRBurstFile.h"
+
+char const TRBurstFile::Magic[8] = {'T', 'R', 'B', 'U', 'R', 'S', 'T', '\0'};
+
+TRBurstFile::TRBurstFile ()
+: m_fd(-1),
+  m_map(NULL),
+  m_map_size(0),
+  m_data(NULL),
+  m_is_burst_file(false),
+  m_num_channels(0),
+  m_num_samples(0),
+  m_data_type(NDInt16),
+  m_sample_rate(NAN),
+  m_record_header_size(0),
+  m_record_size(0),
+  m_num_bursts(0)
+{
+}
+
+TRBurstFile::~TRBurstFile ()
+{
+    close();
+}
+
+bool TRBurstFile::open (std::string const &path, RawLayout const *raw_layout)
+{
+    close();
+
+    m_path = path;
+
+    m_fd = ::open(path.c_str(), O_RDONLY);
+    if (m_fd < 0) {
+        errlogSevPrintf(errlogMajor, "TRBurstFile Error: Failed to open %s: %s.\n",
+            path.c_str(), strerror(errno));
+        goto error;
+    }
+
+    struct stat st;
+    if (fstat(m_fd, &st) != 0) {
+        errlogSevPrintf(errlogMajor, "TRBurstFile Error: Failed to stat %s: %s.\n",
+            path.c_str(), strerror(errno));
+        goto error;
+    }
+    m_map_size = (size_t)st.st_size;
+
+    if (m_map_size > 0) {
+        void *map = mmap(NULL, m_map_size, PROT_READ, MAP_SHARED, m_fd, 0);
+        if (map == MAP_FAILED) {
+            errlogSevPrintf(errlogMajor, "TRBurstFile Error: Failed to map %s: %s.\n",
+                path.c_str(), strerror(errno));
+            m_map_size = 0;
+            goto error;
+        }
+        m_map = (char const *)map;
+    }
+
+    {
+        TRBurstFileHeader header;
+        bool has_magic = m_map_size >= sizeof(header) &&
+            memcmp(m_map, Magic, sizeof(Magic)) == 0;
+
+        if (has_magic) {
+            memcpy(&header, m_map, sizeof(header));
+
+            if (header.version != Version) {
+                errlogSevPrintf(errlogMajor, "TRBurstFile Error: %s has unsupported version %u.\n",
+                    path.c_str(), (unsigned int)header.version);
+                goto error;
+            }
+            if (header.header_size < sizeof(header) || header.header_size > m_map_size) {
+                errlogSevPrintf(errlogMajor, "TRBurstFile Error: %s has an invalid header size.\n",
+                    path.c_str());
+                goto error;
+            }
+
+            m_is_burst_file = true;
+            m_num_channels = (int)header.num_channels;
+            m_num_samples = (size_t)header.num_samples;
+            m_data_type = (NDDataType_t)header.data_type;
+            m_sample_rate = header.sample_rate;
+            m_record_header_size = sizeof(TRBurstFileRecord);
+            m_data = m_map + header.header_size;
+        } else if (raw_layout != NULL) {
+            m_is_burst_file = false;
+            m_num_channels = raw_layout->num_channels;
+            m_num_samples = raw_layout->num_samples;
+            m_data_type = raw_layout->data_type;
+            m_sample_rate = raw_layout->sample_rate;
+            m_record_header_size = 0;
+            m_data = m_map;
+        } else {
+            errlogSevPrintf(errlogMajor, "TRBurstFile Error: %s is not a burst file.\n",
+                path.c_str());
+            goto error;
+        }
+    }
+
+    if (m_num_channels <= 0 || m_num_samples == 0 || elementSize(m_data_type) == 0) {
+        errlogSevPrintf(errlogMajor, "TRBurstFile Error: Invalid layout of %s (channels %d, samples %lu, data type %d).\n",
+            path.c_str(), m_num_channels, (unsigned long)m_num_samples, (int)m_data_type);
+        goto error;
+    }
+
+    // Compute the record size without overflow; a record must fit into
+    // the file (this also ensures that the record size is not zero).
+    {
+        size_t data_size = m_map_size - (size_t)(m_data - m_map);
+        size_t element_size = elementSize(m_data_type);
+        if (data_size < m_record_header_size ||
+            m_num_samples > data_size / element_size ||
+            (size_t)m_num_channels > (data_size - m_record_header_size) / (m_num_samples * element_size))
+        {
+            errlogSevPrintf(errlogMajor, "TRBurstFile Error: A burst of %s (channels %d, samples %lu) does not fit into the file.\n",
+                path.c_str(), m_num_channels, (unsigned long)m_num_samples);
+            goto error;
+        }
+        m_record_size = m_record_header_size + (size_t)m_num_channels * getChannelDataSize();
+        m_num_bursts = data_size / m_record_size;
+    }
+
+    return true;
+
+error:
+    close();
+    return false;
+}
+
+void TRBurstFile::close ()
+{
+    if (m_map != NULL) {
+        munmap((void *)m_map, m_map_size);
+        m_map = NULL;
+    }
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+    m_map_size = 0;
+    m_data = NULL;
+    m_num_bursts = 0;
+}
+
+void TRBurstFile::getBurstInfo (size_t burst, epicsUInt64 *burst_id, epicsTimeStamp *timestamp) const
+{
+    assert(burst < m_num_bursts);
+
+    if (!m_is_burst_file) {
+        *burst_id = burst;
+        timestamp->secPastEpoch = 0;
+        timestamp->nsec = 0;
+        return;
+    }
+
+    TRBurstFileRecord record;
+    memcpy(&record, m_data + burst * m_record_size, sizeof(record));
+
+    *burst_id = record.burst_id;
+    timestamp->secPastEpoch = record.sec_past_epoch;
+    timestamp->nsec = record.nsec;
+}
+
+void TRBurstFile::prefetch (size_t first_burst, size_t num_bursts) const
+{
+    if (first_burst >= m_num_bursts) {
+        return;
+    }
+    if (num_bursts > m_num_bursts - first_burst) {
+        num_bursts = m_num_bursts - first_burst;
+    }
+
+    // madvise requires a page-aligned address.
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    size_t start = (size_t)(m_data - m_map) + first_burst * m_record_size;
+    size_t aligned_start = start / page_size * page_size;
+    size_t length = start - aligned_start + num_bursts * m_record_size;
+
+    madvise((void *)(m_map + aligned_start), length, MADV_WILLNEED);
+}
+
+size_t TRBurstFile::elementSize (NDDataType_t data_type)
+{
+    switch (data_type) {
+        case NDInt8:
+        case NDUInt8:
+            return 1;
+        case NDInt16:
+        case NDUInt16:
+            return 2;
+        case NDInt32:
+        case NDUInt32:
+        case NDFloat32:
+            return 4;
+        case NDFloat64:
+            return 8;
+        default:
+            return 0;
+    }
+}
@@ -0,0 +1,270 @@
+/* This file is part of the Transient Recorder Framework.
+ * It is subject to the license terms in the LICENSE.txt file found in the
+ * top-level directory of this distribution and at
+ * https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. No part
+ * of the Transient Recorder Framework, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ */
+
+/**
+ * @file
+ *
+ * Defines the recorded burst file format and the TRBurstFile class for
+ * reading such files.
+ */
+
+#ifndef TRANSREC_BURST_FILE_H
+#define TRANSREC_BURST_FILE_H
+
+#include <stddef.h>
+
+#include <string>
+
+#include <epicsTypes.h>
+#include <epicsTime.h>
+
+#include <NDArray.h>
+
+#include "TRNonCopyable.h"
+
+/**
+ * Header at the start of a burst file.
+ *
+ * A burst file consists of this header followed by fixed-size burst
+ * records. Each record consists of a TRBurstFileRecord followed by the
+ * data of all channels, one channel after the other (num_samples samples
+ * of data_type each). All values are in the byte order of the host which
+ * wrote the file.
+ */
+struct TRBurstFileHeader {
+    /**
+     * Identification of the format, @ref TRBurstFile::Magic.
+     */
+    char magic[8];
+
+    /**
+     * Version of the format, @ref TRBurstFile::Version.
+     */
+    epicsUInt32 version;
+
+    /**
+     * Size of this header (offset of the first record).
+     */
+    epicsUInt32 header_size;
+
+    /**
+     * Number of channels in each burst.
+     */
+    epicsUInt32 num_channels;
+
+    /**
+     * Data type of the samples (NDDataType_t).
+     */
+    epicsUInt32 data_type;
+
+    /**
+     * Number of samples per channel in each burst.
+     */
+    epicsUInt64 num_samples;
+
+    /**
+     * Sample rate (Hz), or NAN if not known.
+     */
+    double sample_rate;
+
+    /**
+     * Reserved, zero.
+     */
+    char reserved[24];
+};
+
+/**
+ * Header of each burst record in a burst file.
+ */
+struct TRBurstFileRecord {
+    /**
+     * Burst ID as published by the driver which recorded the burst.
+     */
+    epicsUInt64 burst_id;
+
+    /**
+     * Timestamp of the burst (EPICS epoch), zero if not known.
+     */
+    epicsUInt32 sec_past_epoch;
+    epicsUInt32 nsec;
+
+    /**
+     * Reserved, zero.
+     */
+    char reserved[16];
+};
+
+/**
+ * Read-only access to recorded bursts, using a memory mapping of the file.
+ *
+ * Two kinds of files are supported:
+ * - Burst files (see TRBurstFileHeader), which describe themselves and
+ *   contain the ID and timestamp of each burst.
+ * - Raw files, which only contain the sample data of consecutive bursts,
+ *   in the same layout as the data of burst records. The number of
+ *   channels, samples and the data type must be given when opening.
+ *   Burst IDs are the indices of the bursts and timestamps are not known.
+ *
+ * Access is not synchronized; concurrent reading from multiple threads
+ * is fine since the mapping is read-only.
+ */
+class TRBurstFile :
+    private TRNonCopyable
+{
+public:
+    /**
+     * The magic identifying burst files.
+     */
+    static char const Magic[8];
+
+    /**
+     * The version of the burst file format which is supported.
+     */
+    static epicsUInt32 const Version = 1;
+
+    /**
+     * Layout of raw files, see @ref open.
+     */
+    struct RawLayout {
+        int num_channels;
+        size_t num_samples;
+        NDDataType_t data_type;
+        double sample_rate;
+    };
+
+    TRBurstFile ();
+
+    ~TRBurstFile ();
+
+    /**
+     * Open and map a file.
+     *
+     * If the file starts with the burst file magic, it is read as a burst
+     * file. Otherwise it is read as a raw file using the given layout, if
+     * provided.
+     *
+     * @param path Path of the file.
+     * @param raw_layout Layout for raw files, or NULL to only accept burst files.
+     * @return True on success, false on error (which is logged).
+     */
+    bool open (std::string const &path, RawLayout const *raw_layout);
+
+    /**
+     * Unmap and close the file, if open.
+     */
+    void close ();
+
+    /**
+     * Return whether the file is a burst file, as opposed to a raw file.
+     */
+    inline bool isBurstFile () const
+    {
+        return m_is_burst_file;
+    }
+
+    /**
+     * Return the path as given to @ref open.
+     */
+    inline std::string const & getPath () const
+    {
+        return m_path;
+    }
+
+    inline int getNumChannels () const
+    {
+        return m_num_channels;
+    }
+
+    inline size_t getNumSamples () const
+    {
+        return m_num_samples;
+    }
+
+    inline NDDataType_t getDataType () const
+    {
+        return m_data_type;
+    }
+
+    /**
+     * Return the sample rate (Hz), NAN if not known.
+     */
+    inline double getSampleRate () const
+    {
+        return m_sample_rate;
+    }
+
+    /**
+     * Return the number of complete bursts in the file.
+     */
+    inline size_t getNumBursts () const
+    {
+        return m_num_bursts;
+    }
+
+    /**
+     * Return the size of the data of one channel in a burst (bytes).
+     */
+    inline size_t getChannelDataSize () const
+    {
+        return m_num_samples * elementSize(m_data_type);
+    }
+
+    /**
+     * Get the ID and timestamp of a burst.
+     *
+     * @param burst Index of the burst (less than getNumBursts).
+     * @param burst_id Set to the burst ID.
+     * @param timestamp Set to the timestamp, zero if not known.
+     */
+    void getBurstInfo (size_t burst, epicsUInt64 *burst_id, epicsTimeStamp *timestamp) const;
+
+    /**
+     * Return a pointer to the data of a channel in a burst.
+     *
+     * @param burst Index of the burst (less than getNumBursts).
+     * @param channel Channel number (less than getNumChannels).
+     */
+    inline void const * getChannelData (size_t burst, int channel) const
+    {
+        return m_data + burst * m_record_size + m_record_header_size +
+            (size_t)channel * getChannelDataSize();
+    }
+
+    /**
+     * Advise the kernel that the bursts in the given range will be
+     * needed soon (read-ahead).
+     *
+     * @param first_burst Index of the first burst.
+     * @param num_bursts Number of bursts.
+     */
+    void prefetch (size_t first_burst, size_t num_bursts) const;
+
+    /**
+     * Return the size of an element of the given data type (bytes),
+     * zero for invalid types.
+     */
+    static size_t elementSize (NDDataType_t data_type);
+
+private:
+    std::string m_path;
+    int m_fd;
+    char const *m_map;
+    size_t m_map_size;
+    char const *m_data;
+    bool m_is_burst_file;
+    int m_num_channels;
+    size_t m_num_samples;
+    NDDataType_t m_data_type;
+    double m_sample_rate;
+    size_t m_record_header_size;
+    size_t m_record_size;
+    size_t m_num_bursts;
+};
+
+#endif
@@ -18,6 +18,9 @@
 
 #include <math.h>
 
+#include <epicsTypes.h>
+#include <epicsTime.h>
+
 /**
  * Structure for burst meta-information.
  * 
@@ -33,21 +36,24 @@ public:
      * other variable.
      * 
      * @param burst_id The burst identifier. This should be one more
-     *                 for each subsequent burst and wrap around to zero
-     *                 before reaching INT_MAX.
+     *                 for each subsequent burst. It is 64-bit so that
+     *                 drivers do not need to wrap it around.
      */
-    inline TRBurstMetaInfo (int burst_id)
+    inline TRBurstMetaInfo (epicsUInt64 burst_id)
     : burst_id(burst_id),
       time_burst(NAN),
       time_read(NAN),
-      time_process(NAN)
+      time_process(NAN),
+      stream(0)
     {
+        trigger_time.secPastEpoch = 0;
+        trigger_time.nsec = 0;
     }
 
     /**
     * The burst ID (refer to the constructor).
     */
-    int burst_id;
+    epicsUInt64 burst_id;
 
     /**
      * The duration of the burst (us).
@@ -63,6 +69,26 @@ public:
      * The time it took to process the burst after it was read (us).
      */
     double time_process;
+    
+    /**
+     * The time of the trigger of the burst.
+     * 
+     * This should be a hardware timestamp in the same time base as the
+     * IOC clock. If set, the framework compares it to the time when
+     * @ref TRBaseDriver::processBurstData returns in order to monitor
+     * burst latency against the deadline (BURST_DEADLINE parameter).
+     * The default (zero) means that the trigger time is not known.
+     */
+    epicsTimeStamp trigger_time;
+    
+    /**
+     * The read stream which read the burst (see TRBaseConfig::num_read_streams).
+     * 
+     * With multiple streams, this must be set so that the burst is counted
+     * for the right stream and its latency is determined when processing
+     * by the same stream returns. The default is 0.
+     */
+    int stream;
 };
 
 #endif
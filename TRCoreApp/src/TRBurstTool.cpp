@@ -0,0 +1,452 @@
+/* This file is part of the Transient Recorder Framework.
+ * It is subject to the license terms in the LICENSE.txt file found in the
+ * top-level directory of this distribution and at
+ * https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. No part
+ * of the Transient Recorder Framework, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ */
+
+/*
+ * trBurstTool: offline analysis of recorded burst files (see TRBurstFile).
+ *
+ * For each file and channel, a CSV line is written with the sample
+ * statistics, burst ID gaps and the statistics of intervals between burst
+ * timestamps. Files are memory-mapped and processed in parallel, and Int16
+ * data uses the SIMD kernels of TRKernels. Selected bursts of a file can
+ * also be extracted into a new burst file.
+ *
+ * Usage: trBurstTool [options] file...
+ *   -j <threads>             Number of files processed in parallel
+ *                            (default: number of CPUs).
+ *   -o <csv>                 Write the CSV summary to a file (default: stdout).
+ *   -r <ch>,<samples>,<type> Layout of raw files (type is an NDDataType_t value).
+ *   -x <first>,<count>,<out> Extract bursts of the (single) file into a burst file.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <epicsTypes.h>
+#include <epicsTime.h>
+#include <epicsThread.h>
+#include <epicsMutex.h>
+#include <epicsEvent.h>
+#include <epicsGuard.h>
+
+#include "TRBurstFile.h"
+#include "TRKernels.h"
+#include "TRPerfStat.h"
+
+// Number of bursts ahead of the current one for which read-ahead is requested.
+static size_t const PrefetchBursts = 64;
+
+// Statistics of the samples of one channel.
+struct ChannelStats {
+    double min;
+    double max;
+    double sum;
+    double count;
+
+    ChannelStats ()
+    : min(INFINITY),
+      max(-INFINITY),
+      sum(0.0),
+      count(0.0)
+    {
+    }
+};
+
+// Results for one file.
+struct FileResult {
+    bool ok;
+    size_t num_bursts;
+    double num_bytes;
+    std::vector<ChannelStats> channels;
+    size_t id_gaps;
+    double ids_missing;
+    TRPerfStat intervals;
+
+    FileResult ()
+    : ok(false),
+      num_bursts(0),
+      num_bytes(0.0),
+      id_gaps(0),
+      ids_missing(0.0)
+    {
+    }
+};
+
+template <typename T>
+static void addSamples (void const *data, size_t count, ChannelStats &stats)
+{
+    T const *samples = (T const *)data;
+    double min = stats.min;
+    double max = stats.max;
+    double sum = 0.0;
+    for (size_t i = 0; i < count; i++) {
+        double value = samples[i];
+        min = std::min(min, value);
+        max = std::max(max, value);
+        sum += value;
+    }
+    stats.min = min;
+    stats.max = max;
+    stats.sum += sum;
+    stats.count += count;
+}
+
+static void addChannelData (NDDataType_t data_type, void const *data, size_t count, ChannelStats &stats)
+{
+    switch (data_type) {
+        case NDInt16: {
+            epicsInt16 min;
+            epicsInt16 max;
+            epicsInt64 sum;
+            TRKernels::minMaxSumInt16((epicsInt16 const *)data, count, &min, &max, &sum);
+            stats.min = std::min(stats.min, (double)min);
+            stats.max = std::max(stats.max, (double)max);
+            stats.sum += (double)sum;
+            stats.count += count;
+        } break;
+        case NDInt8:    addSamples<epicsInt8>(data, count, stats); break;
+        case NDUInt8:   addSamples<epicsUInt8>(data, count, stats); break;
+        case NDUInt16:  addSamples<epicsUInt16>(data, count, stats); break;
+        case NDInt32:   addSamples<epicsInt32>(data, count, stats); break;
+        case NDUInt32:  addSamples<epicsUInt32>(data, count, stats); break;
+        case NDFloat32: addSamples<epicsFloat32>(data, count, stats); break;
+        case NDFloat64: addSamples<epicsFloat64>(data, count, stats); break;
+        default: break;
+    }
+}
+
+static void analyzeFile (std::string const &path, TRBurstFile::RawLayout const *raw_layout,
+                         FileResult &result)
+{
+    TRBurstFile file;
+    if (!file.open(path, raw_layout)) {
+        return;
+    }
+
+    int num_channels = file.getNumChannels();
+    size_t num_bursts = file.getNumBursts();
+    size_t num_samples = file.getNumSamples();
+    NDDataType_t data_type = file.getDataType();
+
+    result.num_bursts = num_bursts;
+    result.num_bytes = (double)num_bursts * num_channels * file.getChannelDataSize();
+    result.channels.resize(num_channels);
+
+    bool have_prev = false;
+    epicsUInt64 prev_id = 0;
+    epicsTimeStamp prev_ts = {0, 0};
+
+    file.prefetch(0, PrefetchBursts);
+
+    for (size_t burst = 0; burst < num_bursts; burst++) {
+        if (burst % PrefetchBursts == 0) {
+            file.prefetch(burst + PrefetchBursts, PrefetchBursts);
+        }
+
+        epicsUInt64 id;
+        epicsTimeStamp ts;
+        file.getBurstInfo(burst, &id, &ts);
+
+        if (have_prev) {
+            // The difference is modulo 2^64 so that IDs which wrapped
+            // around are handled; a "negative" difference means that IDs
+            // went backwards (e.g. the IOC was restarted).
+            epicsUInt64 step = id - prev_id;
+            if (step != 1) {
+                result.id_gaps++;
+                if (step != 0 && step < ((epicsUInt64)1 << 63)) {
+                    result.ids_missing += (double)(step - 1);
+                }
+            }
+            bool ts_valid = !(ts.secPastEpoch == 0 && ts.nsec == 0);
+            bool prev_ts_valid = !(prev_ts.secPastEpoch == 0 && prev_ts.nsec == 0);
+            if (ts_valid && prev_ts_valid) {
+                result.intervals.add(epicsTimeDiffInSeconds(&ts, &prev_ts));
+            }
+        }
+        have_prev = true;
+        prev_id = id;
+        prev_ts = ts;
+
+        for (int channel = 0; channel < num_channels; channel++) {
+            addChannelData(data_type, file.getChannelData(burst, channel), num_samples,
+                           result.channels[channel]);
+        }
+    }
+
+    result.ok = true;
+}
+
+static bool extractBursts (std::string const &path, TRBurstFile::RawLayout const *raw_layout,
+                           size_t first, size_t count, std::string const &out_path)
+{
+    TRBurstFile file;
+    if (!file.open(path, raw_layout)) {
+        return false;
+    }
+
+    if (first > file.getNumBursts() || count > file.getNumBursts() - first) {
+        fprintf(stderr, "Bursts %lu to %lu are not in %s (%lu bursts).\n",
+            (unsigned long)first, (unsigned long)(first + count), path.c_str(),
+            (unsigned long)file.getNumBursts());
+        return false;
+    }
+
+    FILE *out = fopen(out_path.c_str(), "wb");
+    if (out == NULL) {
+        perror(out_path.c_str());
+        return false;
+    }
+
+    TRBurstFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRBurstFile::Magic, sizeof(header.magic));
+    header.version = TRBurstFile::Version;
+    header.header_size = sizeof(header);
+    header.num_channels = file.getNumChannels();
+    header.data_type = file.getDataType();
+    header.num_samples = file.getNumSamples();
+    header.sample_rate = file.getSampleRate();
+
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+
+    // The data of all channels of a burst is contiguous.
+    size_t data_size = file.getNumChannels() * file.getChannelDataSize();
+
+    for (size_t burst = first; ok && burst < first + count; burst++) {
+        TRBurstFileRecord record;
+        memset(&record, 0, sizeof(record));
+        epicsTimeStamp ts;
+        file.getBurstInfo(burst, &record.burst_id, &ts);
+        record.sec_past_epoch = ts.secPastEpoch;
+        record.nsec = ts.nsec;
+
+        ok = fwrite(&record, sizeof(record), 1, out) == 1 &&
+             fwrite(file.getChannelData(burst, 0), data_size, 1, out) == 1;
+    }
+
+    if (fclose(out) != 0) {
+        ok = false;
+    }
+    if (!ok) {
+        perror(out_path.c_str());
+    }
+    return ok;
+}
+
+// Processes files taken from a shared list until there are none left.
+class FileWorkers {
+public:
+    FileWorkers (std::vector<std::string> const &paths, TRBurstFile::RawLayout const *raw_layout,
+                 std::vector<FileResult> &results)
+    : m_paths(paths),
+      m_raw_layout(raw_layout),
+      m_results(results),
+      m_next(0)
+    {
+    }
+
+    void run (int num_threads)
+    {
+        for (int i = 0; i < num_threads; i++) {
+            Thread *thread = new Thread(*this);
+            char name[32];
+            snprintf(name, sizeof(name), "TRscan%d", i);
+            epicsThreadMustCreate(name, epicsThreadPriorityLow,
+                epicsThreadGetStackSize(epicsThreadStackMedium), threadTrampoline, thread);
+            m_threads.push_back(thread);
+        }
+        for (size_t i = 0; i < m_threads.size(); i++) {
+            m_threads[i]->done.wait();
+            delete m_threads[i];
+        }
+        m_threads.clear();
+    }
+
+private:
+    struct Thread {
+        FileWorkers &workers;
+        epicsEvent done;
+
+        Thread (FileWorkers &workers)
+        : workers(workers)
+        {
+        }
+    };
+
+    std::vector<std::string> const &m_paths;
+    TRBurstFile::RawLayout const *m_raw_layout;
+    std::vector<FileResult> &m_results;
+    epicsMutex m_mutex;
+    size_t m_next;
+    std::vector<Thread *> m_threads;
+
+    static void threadTrampoline (void *arg)
+    {
+        Thread *thread = (Thread *)arg;
+        thread->workers.work();
+        thread->done.signal();
+    }
+
+    void work ()
+    {
+        while (true) {
+            size_t index;
+            {
+                epicsGuard<epicsMutex> lock(m_mutex);
+                if (m_next >= m_paths.size()) {
+                    return;
+                }
+                index = m_next++;
+            }
+            analyzeFile(m_paths[index], m_raw_layout, m_results[index]);
+        }
+    }
+};
+
+static void writeCsv (FILE *fp, std::vector<std::string> const &paths,
+                      std::vector<FileResult> const &results)
+{
+    fprintf(fp, "file,channel,bursts,samples,min,max,mean,id_gaps,ids_missing,"
+                "interval_mean_ms,interval_min_ms,interval_max_ms,interval_p99_ms\n");
+
+    for (size_t i = 0; i < paths.size(); i++) {
+        FileResult const &result = results[i];
+        if (!result.ok) {
+            continue;
+        }
+        TRPerfStat const &intervals = result.intervals;
+        for (size_t channel = 0; channel < result.channels.size(); channel++) {
+            ChannelStats const &stats = result.channels[channel];
+            fprintf(fp, "%s,%d,%lu,%.0f,%.17g,%.17g,%.17g,%lu,%.0f,%.6f,%.6f,%.6f,%.6f\n",
+                paths[i].c_str(), (int)channel, (unsigned long)result.num_bursts,
+                stats.count, stats.min, stats.max,
+                (stats.count > 0.0) ? (stats.sum / stats.count) : NAN,
+                (unsigned long)result.id_gaps, result.ids_missing,
+                1000.0 * intervals.getMean(), 1000.0 * intervals.getMin(),
+                1000.0 * intervals.getMax(), 1000.0 * intervals.getPercentile(0.99));
+        }
+    }
+}
+
+static void usage (char const *prog)
+{
+    fprintf(stderr,
+        "Usage: %s [options] file...\n"
+        "  -j <threads>             Number of files processed in parallel (default: CPUs).\n"
+        "  -o <csv>                 Write the CSV summary to a file (default: stdout).\n"
+        "  -r <ch>,<samples>,<type> Layout of raw files (type is an NDDataType_t value).\n"
+        "  -x <first>,<count>,<out> Extract bursts of the (single) file into a burst file.\n",
+        prog);
+}
+
+int main (int argc, char *argv[])
+{
+    int num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    char const *csv_path = NULL;
+    TRBurstFile::RawLayout raw_layout = {0, 0, NDInt16, NAN};
+    bool have_raw_layout = false;
+    bool extract = false;
+    unsigned long extract_first = 0;
+    unsigned long extract_count = 0;
+    std::string extract_path;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "j:o:r:x:h")) != -1) {
+        switch (opt) {
+            case 'j':
+                num_threads = atoi(optarg);
+                break;
+            case 'o':
+                csv_path = optarg;
+                break;
+            case 'r': {
+                unsigned long num_samples;
+                int data_type;
+                if (sscanf(optarg, "%d,%lu,%d", &raw_layout.num_channels, &num_samples, &data_type) != 3) {
+                    usage(argv[0]);
+                    return 2;
+                }
+                raw_layout.num_samples = num_samples;
+                raw_layout.data_type = (NDDataType_t)data_type;
+                have_raw_layout = true;
+            } break;
+            case 'x': {
+                int path_pos = 0;
+                if (sscanf(optarg, "%lu,%lu,%n", &extract_first, &extract_count, &path_pos) != 2 ||
+                    optarg[path_pos] == '\0')
+                {
+                    usage(argv[0]);
+                    return 2;
+                }
+                extract_path = optarg + path_pos;
+                extract = true;
+            } break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+
+    std::vector<std::string> paths(argv + optind, argv + argc);
+    if (paths.empty() || (extract && paths.size() != 1)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    TRBurstFile::RawLayout const *layout = have_raw_layout ? &raw_layout : NULL;
+
+    if (extract) {
+        return extractBursts(paths[0], layout, extract_first, extract_count, extract_path) ? 0 : 1;
+    }
+
+    num_threads = std::max(1, std::min(num_threads, (int)paths.size()));
+
+    double start = TRPerfClock::now();
+
+    std::vector<FileResult> results(paths.size());
+    FileWorkers workers(paths, layout, results);
+    workers.run(num_threads);
+
+    double elapsed = TRPerfClock::now() - start;
+
+    FILE *csv = stdout;
+    if (csv_path != NULL) {
+        csv = fopen(csv_path, "w");
+        if (csv == NULL) {
+            perror(csv_path);
+            return 1;
+        }
+    }
+    writeCsv(csv, paths, results);
+    if (csv != stdout) {
+        fclose(csv);
+    }
+
+    // Report the throughput and count files which could not be read.
+    double num_bytes = 0.0;
+    int num_failed = 0;
+    for (size_t i = 0; i < results.size(); i++) {
+        num_bytes += results[i].num_bytes;
+        num_failed += results[i].ok ? 0 : 1;
+    }
+    fprintf(stderr, "Scanned %lu files (%.3f MB) in %.3f s (%.1f MB/s) using %s kernels.\n",
+        (unsigned long)(paths.size() - num_failed), num_bytes / 1e6, elapsed,
+        (elapsed > 0.0) ? (num_bytes / elapsed / 1e6) : 0.0,
+        TRKernels::isaName(TRKernels::activeIsa()));
+
+    return (num_failed > 0) ? 1 : 0;
+}
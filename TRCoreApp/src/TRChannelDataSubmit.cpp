@@ -15,22 +15,45 @@
 
 #include "TRChannelsDriver.h"
 #include "TRBaseDriver.h"
+#include "TRPerfStatsDriver.h"
+#include "TRTimedGuard.h"
 
 #include "TRChannelDataSubmit.h"
 
 bool TRChannelDataSubmit::allocateArray (
-    TRBaseDriver &driver, int channel_num, NDDataType_t data_type, int num_samples)
+    TRBaseDriver &driver, int channel_num, NDDataType_t data_type, int num_samples,
+    TRTriggerRoute const &route)
 {
     assert(m_array == NULL);
     assert(channel_num >= 0 && channel_num < driver.m_num_channels);
     
     TRChannelsDriver &ch_driver = *driver.m_channels_driver;
     
-    // Allocate the NDArray.
-    NDArray *array = ch_driver.allocateArray(data_type, num_samples);
+    // Do not allocate an array which would not be submitted.
+    if (!route.accepted()) {
+        return true;
+    }
+    
+    // Do not allocate an array which nobody would receive, if the driver
+    // allows that.
+    if (driver.m_elide_unused_arrays && !ch_driver.hasConsumers(route.channelAddress(channel_num))) {
+        driver.countElidedArray();
+        return true;
+    }
+    
+    // Allocate the NDArray, unless a failure is injected for testing.
+    NDArray *array = NULL;
+    if (driver.injectLoad(TRInjectPointAlloc)) {
+        array = ch_driver.allocateArray(data_type, num_samples);
+    }
     if (array == NULL) {
         errlogSevPrintf(errlogMajor, "TRChannelDataSubmit Error: NDArray allocation failed for channel %d.\n",
             channel_num);
+        
+        // Count the array as dropped for the arming statistics.
+        epicsGuard<asynPortDriver> lock(driver);
+        driver.countSubmittedArray(true, 0);
+        
         return false;
     }
     
@@ -40,9 +63,29 @@ bool TRChannelDataSubmit::allocateArray (
     return true;
 }
 
+bool TRChannelDataSubmit::copyData (TRBaseDriver &driver, void const *src, size_t size)
+{
+    if (m_array == NULL) {
+        return false;
+    }
+    
+    if (size > m_array->dataSize) {
+        errlogSevPrintf(errlogMajor, "TRChannelDataSubmit Error: Data size %lu exceeds the array size %lu.\n",
+            (unsigned long)size, (unsigned long)m_array->dataSize);
+        return false;
+    }
+    
+    double start = TRPerfClock::now();
+    driver.m_parallel_copy.copy(m_array->pData, src, size);
+    driver.m_perf_driver.addSample(TRPerfDataPathDataCopy, TRPerfClock::now() - start);
+    
+    return true;
+}
+
 void TRChannelDataSubmit::submit (
-    TRBaseDriver &driver, int channel, int unique_id, double timestamp,
-    epicsTimeStamp epics_ts, TRArrayCompletionCallback *compl_cb)
+    TRBaseDriver &driver, int channel, epicsUInt64 burst_id, double timestamp,
+    epicsTimeStamp epics_ts, TRArrayCompletionCallback *compl_cb,
+    TRTriggerRoute const &route)
 {
     assert(channel >= 0 && channel < driver.m_num_channels);
     
@@ -51,38 +94,62 @@ void TRChannelDataSubmit::submit (
         return;
     }
     
+    // If the burst was rejected by the rate limit of its trigger source,
+    // release the array. This is not counted as a dropped array since it
+    // was rejected on purpose (the trigger port counts it).
+    if (!route.accepted()) {
+        releaseArray();
+        return;
+    }
+    
+    // Inject load for testing if enabled.
+    driver.injectLoad(TRInjectPointSubmit);
+    
     // Take the array out of this object.
     NDArray *array = m_array;
     m_array = NULL;
     
     // Set the NDArray metadata fields.
-    array->uniqueId = unique_id;
+    // The uniqueId is only 32-bit, it has the low 31 bits of the burst ID
+    // (the full ID is in the TR_BURST_ID attribute).
+    array->uniqueId = (int)(burst_id & 0x7FFFFFFF);
     array->timeStamp = timestamp;
     array->epicsTS = epics_ts;
     
     TRChannelsDriver &ch_driver = *driver.m_channels_driver;
     
-    // Sanity check the maxAddr of the channels port.
-    assert(ch_driver.maxAddr >= driver.m_num_channels);
+    // Determine the address for the trigger source and sanity check it
+    // against the maxAddr of the channels port.
+    int addr = route.channelAddress(channel);
+    assert(addr < ch_driver.maxAddr);
     
     bool proceed = true;
     double sample_rate;
     
+    // Get the size of the data for the arming statistics.
+    NDArrayInfo array_info;
+    array->getInfo(&array_info);
+    
     {
-        epicsGuard<asynPortDriver> lock(driver);
+        TRTimedGuard<asynPortDriver> lock(driver, driver.m_perf_driver,
+            TRPerfDataPathSubmitLockWait, TRPerfDataPathSubmitLockHold);
         
         // Check if the main port allows data to be submitted.
         if (!driver.m_allowing_data) {
             proceed = false;
         } else {
-            // Get the sample rate from the driver for the attribute.
-            sample_rate = driver.m_rate_for_display;
+            // Get the sample rate from the driver for the attribute,
+            // which is lower for decimated channels.
+            sample_rate = driver.m_rate_for_display / driver.m_channel_decimation[channel];
         }
+        
+        // Count the array for the arming statistics.
+        driver.countSubmittedArray(!proceed, array_info.totalBytes);
     }
     
     if (proceed) {
         // Pass the array on to the channel driver for the rest of the processing.
-        ch_driver.submitArray(array, channel, sample_rate, compl_cb);
+        ch_driver.submitArray(array, addr, route.source(), sample_rate, burst_id, compl_cb);
     } else {
         array->release();
     }
@@ -18,11 +18,13 @@
 
 #include <stddef.h>
 
+#include <epicsTypes.h>
 #include <epicsTime.h>
 
 #include <NDArray.h>
 
 #include "TRNonCopyable.h"
+#include "TRTriggerRoute.h"
 
 class TRBaseDriver;
 class TRArrayCompletionCallback;
@@ -38,6 +40,8 @@ class TRArrayCompletionCallback;
 class TRChannelDataSubmit :
     private TRNonCopyable
 {
+    friend class TRProcessGraph;
+    
 public:
     /**
      * Constructor for the data-submit object.
@@ -70,7 +74,12 @@ public:
      * Set parameters for the array and allocate the NDArray.
      * 
      * This may only be called in the without-array state.
-     * Upon success, the state changes to with-array.
+     * Upon success, the state changes to with-array, except if the array
+     * is not needed: if the burst was not accepted (TRTriggerRoute::accepted)
+     * or, with TRBaseConfig::elide_unused_arrays, if the channel has no
+     * consumers (TRBaseDriver::hasArrayConsumers). In that case true is
+     * returned in the without-array state, @ref data returns NULL and the
+     * driver should skip the data of the channel.
      * 
      * This function MUST be called with the base and channels drivers
      * unlocked.
@@ -80,10 +89,11 @@ public:
      *                    number for the TRBaseDriver.
      * @param data_type The AreaDetector data type for the array.
      * @param num_samples Number of samples for the burst.
+     * @param route The route of the burst, as will be passed to @ref submit.
      * @return true on success, false on error
      */
     bool allocateArray (TRBaseDriver &driver, int channel_num, NDDataType_t data_type,
-                        int num_samples);
+                        int num_samples, TRTriggerRoute const &route = TRTriggerRoute());
     
     /**
      * Release any array.
@@ -116,6 +126,26 @@ public:
         return (m_array == NULL) ? NULL : m_array->pData;
     }
     
+    /**
+     * Copy data into the array.
+     * 
+     * This is meant for drivers which cannot read data directly into the
+     * array. Large amounts of data are copied using non-temporal stores
+     * and multiple threads (see TRParallelCopy). The time taken is recorded
+     * in the dataCopy performance statistics entry.
+     * 
+     * This function MUST be called with the base and channels drivers
+     * unlocked.
+     * 
+     * @param driver The TRBaseDriver as was passed to @ref allocateArray.
+     * @param src The data to copy to the start of the array.
+     * @param size Number of bytes to copy, must not exceed the size of
+     *             the array.
+     * @return true on success, false if there is no array or the size
+     *         is too large.
+     */
+    bool copyData (TRBaseDriver &driver, void const *src, size_t size);
+    
     /**
      * Submit the array to AreaDetector.
      * 
@@ -135,7 +165,9 @@ public:
      * 
      * @param driver The TRBaseDriver as was passed to @ref allocateArray.
      * @param channel The channel number as was passed to @ref allocateArray.
-     * @param unique_id The unique_id for the NDArray.
+     * @param burst_id The burst ID. The uniqueId of the NDArray is set
+     *                 to its low 31 bits and the full ID is provided in
+     *                 the attribute TR_BURST_ID.
      * @param timestamp The timestamp for the NDArray.
      * @param epics_ts The epicsTimeStamp for the NDArray.
      * @param compl_cb Optional callback to be called just before submitting
@@ -145,10 +177,16 @@ public:
      *                 It is called with the channels port
      *                 (TRChannelsDriver) locked. This callbacks also
      *                 allows inhibiting array submission.
+     * @param route The route of the burst as returned by
+     *              TRBaseDriver::routeBurst, which determines the channels
+     *              port address and the TR_TRIGGER_SOURCE attribute. If the
+     *              burst was not accepted, the array is released without
+     *              submitting it. The default is source 0.
      */
-    void submit (TRBaseDriver &driver, int channel, int unique_id,
+    void submit (TRBaseDriver &driver, int channel, epicsUInt64 burst_id,
                  double timestamp, epicsTimeStamp epics_ts,
-                 TRArrayCompletionCallback *compl_cb);
+                 TRArrayCompletionCallback *compl_cb,
+                 TRTriggerRoute const &route = TRTriggerRoute());
     
 private:
     // The current NDArray, or NULL if none.
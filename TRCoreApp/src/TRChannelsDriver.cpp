@@ -9,48 +9,133 @@
 
 #include <stddef.h>
 
+#include <algorithm>
 #include <string>
+#include <vector>
 
 #include <epicsAssert.h>
 #include <epicsGuard.h>
+#include <epicsTime.h>
+#include <ellLib.h>
 
 #include "TRBaseDriver.h"
 #include "TRChannelsDriver.h"
 #include "TRChannelDataSubmit.h"
+#include "TRPerfStat.h"
+#include "TRPerfStatsDriver.h"
+#include "TRTimedGuard.h"
+#include "TRAllocAudit.h"
+#include "TRInt64Param.h"
 
 TRChannelsDriver::TRChannelsDriver (TRChannelsDriverConfig const &cfg)
 :   asynNDArrayDriver(
         (std::string(cfg.base_driver.portName) + "_channels").c_str(),
-        cfg.base_driver.m_num_channels + cfg.num_extra_addrs,
+        cfg.base_driver.m_num_channels * cfg.base_driver.m_num_trigger_sources + cfg.num_extra_addrs,
         NUM_CHANNEL_ASYN_PARAMS + cfg.num_asyn_params,
         cfg.base_driver.m_max_ad_buffers,
         cfg.base_driver.m_max_ad_memory,
-        asynGenericPointerMask|asynDrvUserMask, // interfaceMask
-        asynGenericPointerMask, // interruptMask
+        asynGenericPointerMask|asynDrvUserMask|TRInt64Mask, // interfaceMask
+        asynGenericPointerMask|TRInt64Mask, // interruptMask
         ASYN_MULTIDEVICE, // asynFlags (no ASYN_CANBLOCK - we don't block)
         1, // autoConnect
         0, // priority (ignored with no ASYN_CANBLOCK)
         0  // stackSize (ignored witn no ASYN_CANBLOCK)
-    )
+    ),
+    m_base_driver(cfg.base_driver),
+    m_perf_driver(cfg.base_driver.m_perf_driver),
+    m_tracking(cfg.base_driver.m_num_channels * cfg.base_driver.m_num_trigger_sources + cfg.num_extra_addrs),
+    m_pool_limit(0),
+    m_tracking_active(0),
+    m_has_consumers(cfg.base_driver.m_num_channels * cfg.base_driver.m_num_trigger_sources + cfg.num_extra_addrs, 1),
+    m_subscriber_counts(cfg.base_driver.m_num_channels * cfg.base_driver.m_num_trigger_sources + cfg.num_extra_addrs, 0)
 {
     // Create asyn parameters.
     createParam("UPDATE_ARRAYS", asynParamInt32, &m_asyn_params[UPDATE_ARRAYS]);
+    createParam("LATENCY_PROBE", asynParamInt32, &m_asyn_params[LATENCY_PROBE]);
+    createParam("TRACK_LIFETIME",       asynParamInt32,   &m_asyn_params[TRACK_LIFETIME]);
+    createParam("LIFETIME_OUTSTANDING", asynParamInt32,   &m_asyn_params[LIFETIME_OUTSTANDING]);
+    createParam("LIFETIME_OLDEST",      asynParamFloat64, &m_asyn_params[LIFETIME_OLDEST]);
+    createParam("LIFETIME_COUNT",       TRInt64ParamType, &m_asyn_params[LIFETIME_COUNT]);
+    createParam("LIFETIME_MEAN",        asynParamFloat64, &m_asyn_params[LIFETIME_MEAN]);
+    createParam("LIFETIME_P50",         asynParamFloat64, &m_asyn_params[LIFETIME_P50]);
+    createParam("LIFETIME_P90",         asynParamFloat64, &m_asyn_params[LIFETIME_P90]);
+    createParam("LIFETIME_P99",         asynParamFloat64, &m_asyn_params[LIFETIME_P99]);
+    createParam("LIFETIME_MAX",         asynParamFloat64, &m_asyn_params[LIFETIME_MAX]);
+    createParam("DECIMATION",           asynParamInt32,   &m_asyn_params[DECIMATION]);
+    createParam("NUM_SAMPLES",          asynParamInt32,   &m_asyn_params[NUM_SAMPLES]);
+    createParam("CONSUMERS",            asynParamInt32,   &m_asyn_params[CONSUMERS]);
 
     // Query base driver whether to update pArrays.
     int updateArraysDefault = (int)cfg.base_driver.m_update_arrays;
     
-    int num_channels = cfg.base_driver.m_num_channels;
-    for (int channel = 0; channel < num_channels; channel++) {
+    // Initialize the address of each channel for each trigger source.
+    int num_channel_addrs = cfg.base_driver.m_num_channels * cfg.base_driver.m_num_trigger_sources;
+    for (int channel = 0; channel < num_channel_addrs; channel++) {
         // Enable callbacks by default.
         setIntegerParam(channel, NDArrayCallbacks, 1);
         
         // Apply default pArrays update policy.
         setIntegerParam(channel, m_asyn_params[UPDATE_ARRAYS], updateArraysDefault);
+        
+        // Latency probe attributes are disabled by default.
+        setIntegerParam(channel, m_asyn_params[LATENCY_PROBE], 0);
+        
+        // Lifetime tracking is disabled by default.
+        setIntegerParam(channel, m_asyn_params[TRACK_LIFETIME], 0);
+        
+        // Channels are not decimated until the driver says otherwise.
+        setIntegerParam(channel, m_asyn_params[DECIMATION], 1);
+        setIntegerParam(channel, m_asyn_params[NUM_SAMPLES], 0);
+        
+        // Until consumers are first determined, all addresses are assumed
+        // to have consumers (m_has_consumers is initialized to 1), while
+        // the CONSUMERS readback stays 0 until the first scan.
+        setIntegerParam(channel, m_asyn_params[CONSUMERS], 0);
     }
+    
+    // Register the NDArray pool with the global memory budget.
+    m_memory_budget.init(portName, cfg.base_driver.m_ad_memory_reservation);
 }
 
 TRChannelsDriver::~TRChannelsDriver ()
 {
+    // Release any tracked arrays.
+    for (size_t channel = 0; channel < m_tracking.size(); channel++) {
+        std::vector<TrackedArray> &arrays = m_tracking[channel].arrays;
+        for (size_t i = 0; i < arrays.size(); i++) {
+            arrays[i].array->release();
+        }
+    }
+}
+
+asynStatus TRChannelsDriver::writeInt32 (asynUser *pasynUser, epicsInt32 value)
+{
+    int reason = pasynUser->reason;
+    
+    // The number of consumers is read-only.
+    if (reason == m_asyn_params[CONSUMERS]) {
+        return asynError;
+    }
+    
+    asynStatus status = asynNDArrayDriver::writeInt32(pasynUser, value);
+    
+    // Update the consumers of the address right away if array callbacks
+    // or pArrays updates have been enabled or disabled.
+    if (status == asynSuccess && (reason == NDArrayCallbacks || reason == m_asyn_params[UPDATE_ARRAYS])) {
+        int addr;
+        getAddress(pasynUser, &addr);
+        if (addr >= 0 && addr < maxAddr) {
+            countArraySubscribers(m_subscriber_counts);
+            setConsumers(addr, m_subscriber_counts[addr]);
+        }
+    }
+    
+    // Lifetime tracking needs periodic checks from now on.
+    if (status == asynSuccess && reason == m_asyn_params[TRACK_LIFETIME] && value != 0) {
+        epicsAtomicSetIntT(&m_tracking_active, 1);
+    }
+    
+    return status;
 }
 
 void TRChannelsDriver::resetArrays ()
@@ -66,16 +151,90 @@ void TRChannelsDriver::resetArrays ()
     }
 }
 
+// Size of an element of an NDArray data type.
+static size_t dataTypeSize (NDDataType_t data_type)
+{
+    switch (data_type) {
+        case NDInt8:
+        case NDUInt8:
+            return 1;
+        case NDInt16:
+        case NDUInt16:
+            return 2;
+        case NDInt32:
+        case NDUInt32:
+        case NDFloat32:
+            return 4;
+        default:
+            return 8;
+    }
+}
+
 NDArray * TRChannelsDriver::allocateArray (NDDataType_t data_type, int num_samples)
 {
-    epicsGuard<asynPortDriver> lock(*this);
+    TRTimedGuard<asynPortDriver> lock(*this, m_perf_driver,
+        TRPerfDataPathAllocLockWait, TRPerfDataPathAllocLockHold);
     
     size_t dims[1] = {(size_t)num_samples};
-    return pNDArrayPool->alloc(1, dims, data_type, 0, NULL);
+    
+    // Determine how much the pool may grow. A cached array is reused if
+    // there is one, so the pool only grows for certain if there is none.
+    // Otherwise the cached buffer may be too small and be reallocated,
+    // which is checked after the allocation since the sizes of cached
+    // buffers are not known.
+    size_t memory = pNDArrayPool->memorySize();
+    size_t growth = (pNDArrayPool->numFree() > 0) ? 0 :
+        (size_t)num_samples * dataTypeSize(data_type);
+    
+    // Respect the limit applied by automatic pool sizing.
+    if (m_pool_limit > 0 && growth > 0 && memory + growth > m_pool_limit) {
+        return NULL;
+    }
+    
+    // Ask the global memory budget whether the pool may grow.
+    if (!m_memory_budget.requestGrowth(memory, growth)) {
+        m_memory_budget.countDenied();
+        return NULL;
+    }
+    
+    int num_buffers_before = TRAllocAudit::enabled() ? pNDArrayPool->numBuffers() : 0;
+    
+    double alloc_start = TRPerfClock::now();
+    NDArray *array = pNDArrayPool->alloc(1, dims, data_type, 0, NULL);
+    m_perf_driver.addSample(TRPerfDataPathPoolAlloc, TRPerfClock::now() - alloc_start);
+    
+    // If a cached buffer was reallocated, check the unexpected growth now.
+    // The memory is already allocated, but failing the allocation keeps the
+    // pool from growing further; the enlarged buffer stays cached and is
+    // reused by the next allocation. Cached arrays are released in favor of
+    // other pools by checkMemoryBudget, not here.
+    size_t memory_after = pNDArrayPool->memorySize();
+    if (array != NULL && memory_after > memory + growth) {
+        size_t extra = memory_after - (memory + growth);
+        if (m_pool_limit > 0 && memory_after > m_pool_limit) {
+            array->release();
+            array = NULL;
+        } else if (!m_memory_budget.requestGrowth(memory + growth, extra)) {
+            m_memory_budget.countDenied();
+            array->release();
+            array = NULL;
+        }
+    }
+    
+    // Replace the requested growth with the actual memory use.
+    m_memory_budget.setUsed(memory_after);
+    
+    // Count growth of the pool for allocation auditing.
+    if (TRAllocAudit::enabled() && pNDArrayPool->numBuffers() > num_buffers_before) {
+        TRAllocAudit::countPoolGrowth();
+    }
+    
+    return array;
 }
 
 void TRChannelsDriver::submitArray (
-    NDArray *array, int channel, double sample_rate, TRArrayCompletionCallback *compl_cb)
+    NDArray *array, int channel, int trigger_source, double sample_rate,
+    epicsUInt64 burst_id, TRArrayCompletionCallback *compl_cb)
 {
     assert(array != NULL);
     assert(channel < maxAddr);
@@ -87,7 +246,8 @@ void TRChannelsDriver::submitArray (
     bool submit = true;
     
     {
-        epicsGuard<asynPortDriver> lock(*this);
+        TRTimedGuard<asynPortDriver> lock(*this, m_perf_driver,
+            TRPerfDataPathChannelsLockWait, TRPerfDataPathChannelsLockHold);
         
         // Check if array callbacks are enabled.
         getIntegerParam(channel, NDArrayCallbacks, &arrayCallbacks);
@@ -96,17 +256,63 @@ void TRChannelsDriver::submitArray (
         int update_parrays;
         getIntegerParam(channel, m_asyn_params[UPDATE_ARRAYS], &update_parrays);
         
-        // Call getAttributes of the channels port to fill the attributes.
-        getAttributes(array->pAttributeList);
+        // Check if lifetime tracking is enabled.
+        int track_lifetime = 0;
+        getIntegerParam(channel, m_asyn_params[TRACK_LIFETIME], &track_lifetime);
+        
+        // Attributes are only needed if the array goes anywhere. Evaluating
+        // the attributes of the port may be expensive, so skip this otherwise.
+        bool need_attributes = arrayCallbacks || update_parrays || track_lifetime;
+        
+        if (need_attributes) {
+            // Call getAttributes of the channels port to fill the attributes.
+            getAttributes(array->pAttributeList);
+            
+            // Add the sample rate attribute.
+            array->pAttributeList->add("READ_SAMPLE_RATE", "sample rate", NDAttrFloat64, (void *)&sample_rate);
+            
+            // Add the full burst ID attribute (uniqueId only has the low 31 bits).
+            // This is a double for compatibility with older areaDetector, exact
+            // up to 2^53.
+            double burst_id_attr = (double)burst_id;
+            array->pAttributeList->add("TR_BURST_ID", "burst ID", NDAttrFloat64, (void *)&burst_id_attr);
+            
+            // Add the trigger source attribute.
+            epicsInt32 trigger_source_attr = trigger_source;
+            array->pAttributeList->add("TR_TRIGGER_SOURCE", "trigger source", NDAttrInt32, (void *)&trigger_source_attr);
+        }
         
-        // Add the sample rate attribute.
-        array->pAttributeList->add("READ_SAMPLE_RATE", "sample rate", NDAttrFloat64, (void *)&sample_rate);
+        // Add the latency probe attributes if enabled.
+        int latency_probe = 0;
+        getIntegerParam(channel, m_asyn_params[LATENCY_PROBE], &latency_probe);
+        if (need_attributes && latency_probe) {
+            epicsTimeStamp now;
+            epicsTimeGetCurrent(&now);
+            double trigger_time = array->epicsTS.secPastEpoch + array->epicsTS.nsec * 1e-9;
+            double submit_time = now.secPastEpoch + now.nsec * 1e-9;
+            array->pAttributeList->add("TR_TRIGGER_TIME", "trigger time", NDAttrFloat64, (void *)&trigger_time);
+            array->pAttributeList->add("TR_SUBMIT_TIME", "submit time", NDAttrFloat64, (void *)&submit_time);
+        }
         
         // Call the array completion callback if given.
         if (compl_cb != NULL) {
             submit = compl_cb->completeArray(array);
         }
         
+        // Release tracked arrays which are no longer used.
+        if (!m_tracking[channel].arrays.empty()) {
+            collectTrackedArrays(channel, TRPerfClock::now());
+        }
+        
+        // Start tracking the lifetime of the array if enabled.
+        if (submit && track_lifetime) {
+            array->reserve();
+            TrackedArray tracked;
+            tracked.array = array;
+            tracked.submit_time = TRPerfClock::now();
+            m_tracking[channel].arrays.push_back(tracked);
+        }
+        
         if (submit && update_parrays) {
             // Increment the reference count of the array since we will
             // be putting it into pArrays.
@@ -122,9 +328,257 @@ void TRChannelsDriver::submitArray (
     
     // Call the array callback if enabled.
     if (submit && arrayCallbacks) {
+        m_base_driver.injectLoad(TRInjectPointCallback);
+        
+        double callbacks_start = TRPerfClock::now();
         doCallbacksGenericPointer(array, NDArrayData, channel);
+        m_perf_driver.addSample(TRPerfDataPathArrayCallbacks, TRPerfClock::now() - callbacks_start);
     }
     
     // Release our reference to the array.
     array->release();
 }
+
+void TRChannelsDriver::checkTrackedArrays ()
+{
+    // Nothing to do if tracking was never enabled or everything was
+    // collected after it was disabled.
+    if (!epicsAtomicGetIntT(&m_tracking_active)) {
+        return;
+    }
+    
+    epicsGuard<asynPortDriver> lock(*this);
+    
+    double now = TRPerfClock::now();
+    bool any_active = false;
+    
+    for (int channel = 0; channel < (int)m_tracking.size(); channel++) {
+        ChannelTracking &tracking = m_tracking[channel];
+        
+        int enabled = 0;
+        getIntegerParam(channel, m_asyn_params[TRACK_LIFETIME], &enabled);
+        
+        // Start with fresh statistics whenever tracking is enabled.
+        if (enabled && !tracking.was_enabled) {
+            tracking.lifetimes.reset();
+        }
+        tracking.was_enabled = enabled;
+        
+        if (!enabled && tracking.arrays.empty()) {
+            continue;
+        }
+        
+        collectTrackedArrays(channel, now);
+        
+        if (enabled || !tracking.arrays.empty()) {
+            any_active = true;
+        }
+        
+        // Arrays are tracked in the order of submission, so the first
+        // is the oldest.
+        double oldest = tracking.arrays.empty() ? 0.0 : (now - tracking.arrays.front().submit_time);
+        
+        // Lifetimes are kept in seconds but exposed in milliseconds.
+        TRPerfStat const &stat = tracking.lifetimes;
+        setIntegerParam(channel, m_asyn_params[LIFETIME_OUTSTANDING], (int)tracking.arrays.size());
+        setDoubleParam(channel,  m_asyn_params[LIFETIME_OLDEST], 1000.0 * oldest);
+        TRSetInt64Param(*this, channel, m_asyn_params[LIFETIME_COUNT], (epicsInt64)stat.getCount());
+        setDoubleParam(channel,  m_asyn_params[LIFETIME_MEAN], 1000.0 * stat.getMean());
+        setDoubleParam(channel,  m_asyn_params[LIFETIME_P50],  1000.0 * stat.getPercentile(0.50));
+        setDoubleParam(channel,  m_asyn_params[LIFETIME_P90],  1000.0 * stat.getPercentile(0.90));
+        setDoubleParam(channel,  m_asyn_params[LIFETIME_P99],  1000.0 * stat.getPercentile(0.99));
+        setDoubleParam(channel,  m_asyn_params[LIFETIME_MAX],  1000.0 * stat.getMax());
+        callParamCallbacks(channel);
+    }
+    
+    if (!any_active) {
+        epicsAtomicSetIntT(&m_tracking_active, 0);
+    }
+}
+
+void TRChannelsDriver::collectTrackedArrays (int channel, double now)
+{
+    ChannelTracking &tracking = m_tracking[channel];
+    
+    size_t num_remaining = 0;
+    for (size_t i = 0; i < tracking.arrays.size(); i++) {
+        TrackedArray const &tracked = tracking.arrays[i];
+        
+        // If only our reference remains, all consumers have released the
+        // array. Nobody else can reserve it then, so reading the reference
+        // count without the pool lock is fine.
+        if (tracked.array->referenceCount <= 1) {
+            tracking.lifetimes.add(now - tracked.submit_time);
+            tracked.array->release();
+        } else {
+            tracking.arrays[num_remaining++] = tracked;
+        }
+    }
+    tracking.arrays.resize(num_remaining);
+}
+
+size_t TRChannelsDriver::trimPool (TRPoolTrimMode mode, int keep_arrays, size_t keep_bytes)
+{
+    if (mode == TRPoolTrimNone) {
+        return 0;
+    }
+    
+    // Lock to serialize with allocateArray.
+    epicsGuard<asynPortDriver> lock(*this);
+    
+    size_t memory_before = pNDArrayPool->memorySize();
+    
+    // The pool can only free all cached arrays. So first take the arrays
+    // which should be kept from the pool, free the rest, and then return
+    // the kept arrays to the pool. Allocating with minimal size takes a
+    // cached array without reallocating its memory.
+    std::vector<NDArray *> kept;
+    if (mode != TRPoolTrimAll) {
+        size_t kept_bytes = 0;
+        while (pNDArrayPool->numFree() > 0) {
+            if (mode == TRPoolTrimKeepArrays && (int)kept.size() >= keep_arrays) {
+                break;
+            }
+            
+            size_t dims[1] = {1};
+            NDArray *array = pNDArrayPool->alloc(1, dims, NDInt8, 0, NULL);
+            if (array == NULL) {
+                break;
+            }
+            
+            if (mode == TRPoolTrimKeepMemory && kept_bytes + array->dataSize > keep_bytes) {
+                // Return it to be freed below.
+                array->release();
+                break;
+            }
+            
+            kept.push_back(array);
+            kept_bytes += array->dataSize;
+        }
+    }
+    
+    pNDArrayPool->emptyFreeList();
+    
+    for (size_t i = 0; i < kept.size(); i++) {
+        kept[i]->release();
+    }
+    
+    size_t memory_after = pNDArrayPool->memorySize();
+    m_memory_budget.setUsed(memory_after);
+    return (memory_after < memory_before) ? (memory_before - memory_after) : 0;
+}
+
+void TRChannelsDriver::getPoolUsage (int *num_buffers, int *num_free, size_t *memory)
+{
+    *num_buffers = pNDArrayPool->numBuffers();
+    *num_free = pNDArrayPool->numFree();
+    *memory = pNDArrayPool->memorySize();
+}
+
+void TRChannelsDriver::checkMemoryBudget ()
+{
+    if (!m_memory_budget.takeReclaimRequest()) {
+        return;
+    }
+    
+    epicsGuard<asynPortDriver> lock(*this);
+    
+    pNDArrayPool->emptyFreeList();
+    m_memory_budget.setUsed(pNDArrayPool->memorySize());
+}
+
+double TRChannelsDriver::getMaxLifetime ()
+{
+    epicsGuard<asynPortDriver> lock(*this);
+    
+    double max_lifetime = 0.0;
+    for (size_t channel = 0; channel < m_tracking.size(); channel++) {
+        TRPerfStat const &stat = m_tracking[channel].lifetimes;
+        if (stat.getCount() > 0) {
+            max_lifetime = std::max(max_lifetime, stat.getPercentile(0.99));
+        }
+    }
+    return max_lifetime;
+}
+
+void TRChannelsDriver::setPoolLimit (size_t limit)
+{
+    epicsGuard<asynPortDriver> lock(*this);
+    m_pool_limit = limit;
+}
+
+void TRChannelsDriver::setSampleCounts (std::vector<int> const &decimation, int num_pre, int num_post)
+{
+    epicsGuard<asynPortDriver> lock(*this);
+    
+    // The values are the same at the addresses of all trigger sources.
+    int num_channels = (int)decimation.size();
+    int num_channel_addrs = num_channels * m_base_driver.m_num_trigger_sources;
+    for (int addr = 0; addr < num_channel_addrs; addr++) {
+        int channel = addr % num_channels;
+        int dec_num_pre;
+        int dec_num_post;
+        TRArmInfo::decimateSampleCounts(decimation[channel], num_pre, num_post, &dec_num_pre, &dec_num_post);
+        
+        setIntegerParam(addr, m_asyn_params[DECIMATION], decimation[channel]);
+        setIntegerParam(addr, m_asyn_params[NUM_SAMPLES], dec_num_pre + dec_num_post);
+        callParamCallbacks(addr);
+    }
+}
+
+void TRChannelsDriver::updateConsumers ()
+{
+    epicsGuard<asynPortDriver> lock(*this);
+    
+    countArraySubscribers(m_subscriber_counts);
+    
+    for (int addr = 0; addr < maxAddr; addr++) {
+        setConsumers(addr, m_subscriber_counts[addr]);
+    }
+}
+
+void TRChannelsDriver::countArraySubscribers (std::vector<int> &counts)
+{
+    // Plugins register for NDArray callbacks as interrupt users of the
+    // generic pointer interface, and only while they are enabled.
+    // This is the same list that doCallbacksGenericPointer walks.
+    void *interrupt_pvt = asynStdInterfaces.genericPointerInterruptPvt;
+    
+    std::fill(counts.begin(), counts.end(), 0);
+    
+    ELLLIST *client_list;
+    pasynManager->interruptStart(interrupt_pvt, &client_list);
+    
+    for (interruptNode *node = (interruptNode *)ellFirst(client_list); node != NULL;
+         node = (interruptNode *)ellNext(&node->node))
+    {
+        asynGenericPointerInterrupt *interrupt = (asynGenericPointerInterrupt *)node->drvPvt;
+        if (interrupt->pasynUser->reason != NDArrayData) {
+            continue;
+        }
+        int addr;
+        pasynManager->getAddr(interrupt->pasynUser, &addr);
+        if (addr == -1) {
+            addr = 0;
+        }
+        if (addr >= 0 && addr < (int)counts.size()) {
+            counts[addr]++;
+        }
+    }
+    
+    pasynManager->interruptEnd(interrupt_pvt);
+}
+
+void TRChannelsDriver::setConsumers (int addr, int num_subscribers)
+{
+    int array_callbacks = 0;
+    int update_parrays = 0;
+    getIntegerParam(addr, NDArrayCallbacks, &array_callbacks);
+    getIntegerParam(addr, m_asyn_params[UPDATE_ARRAYS], &update_parrays);
+    
+    int consumers = array_callbacks ? num_subscribers : 0;
+    epicsAtomicSetIntT(&m_has_consumers[addr], (consumers > 0 || update_parrays) ? 1 : 0);
+    
+    setIntegerParam(addr, m_asyn_params[CONSUMERS], consumers);
+    callParamCallbacks(addr);
+}
@@ -19,15 +19,38 @@
 #include <stddef.h>
 
 #include <string>
+#include <vector>
+
+#include <epicsAtomic.h>
 
 #include <asynNDArrayDriver.h>
 
+#include "TRMemoryBudget.h"
 #include "TRNonCopyable.h"
+#include "TRPerfStat.h"
 
 class TRBaseDriver;
 class TRChannelsDriver;
 class TRChannelDataSubmit;
 class TRArrayCompletionCallback;
+class TRPerfStatsDriver;
+
+/**
+ * Policies for releasing cached arrays of the NDArray pool of the
+ * channels port when disarming (POOL_TRIM_MODE parameter of TRBaseDriver).
+ *
+ * Arrays which are still in use by consumers are never affected.
+ */
+enum TRPoolTrimMode {
+    /// Keep all cached arrays (the behavior of the NDArrayPool).
+    TRPoolTrimNone,
+    /// Keep up to POOL_TRIM_KEEP_ARRAYS cached arrays.
+    TRPoolTrimKeepArrays,
+    /// Keep cached arrays up to a total of POOL_TRIM_KEEP_MEMORY.
+    TRPoolTrimKeepMemory,
+    /// Free all cached arrays.
+    TRPoolTrimAll
+};
 
 /**
  * Construction parameters for TRChannelsDriver.
@@ -57,8 +80,10 @@ public:
      * Number of additional asyn addresses to support.
      * 
      * The addresses in the channels driver will be first one address
-     * for each channel, then this many additional addresses. This
-     * allows the driver to implement additional data sources.
+     * for each channel and trigger source (see
+     * TRBaseConfig::num_trigger_sources), then this many additional
+     * addresses. This allows the driver to implement additional data
+     * sources.
      */
     int num_extra_addrs;
     
@@ -92,6 +117,27 @@ private:
     TRBaseDriver &base_driver;
 };
 
+/**
+ * Automatic sizing of the NDArray pool (POOL_AUTO_SIZE parameter).
+ */
+enum TRPoolAutoSizeMode {
+    /**
+     * No automatic sizing.
+     */
+    TRPoolAutoSizeOff,
+    
+    /**
+     * Publish the recommended size and warn if the limits are insufficient.
+     */
+    TRPoolAutoSizeRecommend,
+    
+    /**
+     * Additionally limit the pool memory to the recommended size (within the
+     * hard cap, POOL_AUTO_SIZE_CAP).
+     */
+    TRPoolAutoSizeApply
+};
+
 /**
  * An asynNDArrayDriver-based class though which burst
  * data is submitted into the AreaDetector framework.
@@ -110,6 +156,34 @@ private:
  * will need to override the virtual function
  * TRBaseDriver::createChannelsDriver. Doing so allows the
  * driver to define channel-specific asyn parameters.
+ * 
+ * The channels port has one address for each channel and trigger source
+ * (see TRBaseConfig::num_trigger_sources), channel c of source s being at
+ * address s*num_channels+c. Submitted arrays have the attribute
+ * TR_TRIGGER_SOURCE with the trigger source of the burst.
+ * 
+ * The CONSUMERS parameter of each address is the number of plugins
+ * receiving its arrays (zero if array callbacks are disabled). Arrays of an
+ * address without plugins and with UPDATE_ARRAYS disabled have no consumers,
+ * which allows skipping them (see TRBaseDriver::hasArrayConsumers).
+ * 
+ * If the LATENCY_PROBE parameter is enabled for a channel, the
+ * attributes TR_TRIGGER_TIME and TR_SUBMIT_TIME are added to submitted
+ * arrays, which allows measuring end-to-end latency in plugins (see
+ * TRLatencyPlugin). The values are in seconds past the EPICS epoch;
+ * the trigger time is the epics_ts given to TRChannelDataSubmit::submit
+ * and the submit time is the time when the array was being submitted.
+ * 
+ * If the TRACK_LIFETIME parameter is enabled for a channel, the lifetime
+ * of submitted arrays (from submission until all consumers have released
+ * them) is tracked in order to identify consumers which hold arrays for
+ * long. For this, the channels port keeps an additional reference to each
+ * array and considers the array released when only that reference
+ * remains; it then releases it too. Released arrays are detected at each
+ * submission for the channel and periodically by the framework, so the
+ * lifetime is an upper bound with that resolution, and arrays are returned
+ * to the pool correspondingly later. Note that the reference in pArrays
+ * (UPDATE_ARRAYS parameter) also counts as a consumer.
  */
 class TRChannelsDriver : public asynNDArrayDriver,
     private TRNonCopyable
@@ -121,6 +195,19 @@ private:
     // Enumeration of asyn parameters.
     enum Params {
         UPDATE_ARRAYS,
+        LATENCY_PROBE,
+        TRACK_LIFETIME,
+        LIFETIME_OUTSTANDING,
+        LIFETIME_OLDEST,
+        LIFETIME_COUNT,
+        LIFETIME_MEAN,
+        LIFETIME_P50,
+        LIFETIME_P90,
+        LIFETIME_P99,
+        LIFETIME_MAX,
+        DECIMATION,
+        NUM_SAMPLES,
+        CONSUMERS,
         NUM_CHANNEL_ASYN_PARAMS
     };
     
@@ -134,6 +221,8 @@ public:
     
     virtual ~TRChannelsDriver ();
     
+    virtual asynStatus writeInt32 (asynUser *pasynUser, epicsInt32 value);
+    
 private:
     // The follwing functions are for internal use by Transient Recorder framework.
     
@@ -143,13 +232,107 @@ private:
     // Allocate an NDArray for later submission.
     NDArray * allocateArray (NDDataType_t data_type, int num_samples);
     
-    // Submit an NDArray to the port.
-    void submitArray (NDArray *array, int channel, double sample_rate,
-                      TRArrayCompletionCallback *compl_cb);
+    // Submit an NDArray to the port at the given address (that of the
+    // channel for the trigger source).
+    void submitArray (NDArray *array, int channel, int trigger_source, double sample_rate,
+                      epicsUInt64 burst_id, TRArrayCompletionCallback *compl_cb);
+    
+    // Detect released tracked arrays and update lifetime parameters
+    // (called periodically by the framework, returns right away unless
+    // tracking is in use).
+    void checkTrackedArrays ();
+    
+    // Release tracked arrays of a channel which are no longer used by
+    // consumers and record their lifetime. Must be called locked.
+    void collectTrackedArrays (int channel, double now);
+    
+    // Free cached arrays of the NDArray pool according to the policy
+    // (called when disarming, unlocked). Returns the number of bytes freed.
+    size_t trimPool (TRPoolTrimMode mode, int keep_arrays, size_t keep_bytes);
+    
+    // Get the number of arrays allocated by the pool, how many of them are
+    // cached (free), and the memory allocated by the pool.
+    void getPoolUsage (int *num_buffers, int *num_free, size_t *memory);
+    
+    // Release cached arrays if requested by the global memory budget
+    // in favor of other drivers (called periodically by the framework).
+    void checkMemoryBudget ();
+    
+    // Get the largest 99th percentile of array lifetimes of channels with
+    // lifetime tracking (s), or zero if there are no samples.
+    double getMaxLifetime ();
+    
+    // Set the limit of the pool memory for automatic pool sizing (bytes,
+    // 0 for no limit). This is in addition to the limits of the pool itself.
+    void setPoolLimit (size_t limit);
+    
+    // Publish the decimation ratio and number of samples of each channel
+    // for the arming (called locked during arming, with the main port locked).
+    void setSampleCounts (std::vector<int> const &decimation, int num_pre, int num_post);
+    
+    // Determine which addresses have consumers and update the CONSUMERS
+    // parameters (called unlocked, during arming and periodically while armed).
+    void updateConsumers ();
+    
+    // Count the plugins receiving arrays from each address (interrupt
+    // subscribers of the NDArray data). The vector must have maxAddr elements.
+    // Must be called locked.
+    void countArraySubscribers (std::vector<int> &counts);
+    
+    // Update the consumers of an address given its subscribers. Must be called locked.
+    void setConsumers (int addr, int num_subscribers);
+    
+    // Check whether an address has consumers (cached, no lock needed).
+    inline bool hasConsumers (int addr)
+    {
+        return epicsAtomicGetIntT(&m_has_consumers[addr]) != 0;
+    }
+    
+private:
+    // An array whose lifetime is being tracked.
+    struct TrackedArray {
+        NDArray *array;
+        double submit_time;
+    };
+    
+    // Lifetime tracking state of a channel (protected by the port lock).
+    struct ChannelTracking {
+        ChannelTracking () : was_enabled(false) {}
+        
+        std::vector<TrackedArray> arrays;
+        TRPerfStat lifetimes;
+        bool was_enabled;
+    };
     
 private:
     // Array of asyn parameter indices.
     int m_asyn_params[NUM_CHANNEL_ASYN_PARAMS];
+    
+    // The base driver (for load injection).
+    TRBaseDriver &m_base_driver;
+    
+    // Performance statistics port of the base driver.
+    TRPerfStatsDriver &m_perf_driver;
+    
+    // Lifetime tracking state for each address.
+    std::vector<ChannelTracking> m_tracking;
+    
+    // Participation of the NDArray pool in the global memory budget.
+    TRMemoryBudget m_memory_budget;
+    
+    // Limit of the pool memory applied by automatic pool sizing (0 for none).
+    size_t m_pool_limit;
+    
+    // Whether lifetime tracking may have work for checkTrackedArrays, set
+    // when it is enabled and cleared when nothing is tracked (accessed atomically).
+    int m_tracking_active;
+    
+    // Whether each address has consumers (accessed atomically).
+    std::vector<int> m_has_consumers;
+    
+    // Subscribers of each address, for countArraySubscribers (protected by
+    // the port lock).
+    std::vector<int> m_subscriber_counts;
 };
 
 #endif
@@ -0,0 +1,81 @@
+/* This file is part of the Transient Recorder Framework.
+ * It is subject to the license terms in the LICENSE.txt file found in the
+ * top-level directory of this distribution and at
+ * https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. No part
+ * of the Transient Recorder Framework, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ */
+
+/**
+ * @file
+ *
+ * Support for 64-bit integer asyn parameters (burst IDs and counters).
+ *
+ * 64-bit integer parameters are supported by asyn R4-33 and later; with
+ * older asyn these parameters are published as doubles, which are exact
+ * up to 2^53. Database templates select the device support with the
+ * macro `INT64_DTYP` (asynInt64 or asynFloat64).
+ */
+
+#ifndef TRANSREC_INT64_PARAM_H
+#define TRANSREC_INT64_PARAM_H
+
+#include <epicsTypes.h>
+
+#include <asynDriver.h>
+#include <asynPortDriver.h>
+
+#if ASYN_VERSION > 4 || (ASYN_VERSION == 4 && ASYN_REVISION >= 33)
+#define TR_HAVE_ASYN_INT64 1
+#else
+#define TR_HAVE_ASYN_INT64 0
+#endif
+
+/**
+ * Parameter type for 64-bit integer parameters.
+ */
+#if TR_HAVE_ASYN_INT64
+static asynParamType const TRInt64ParamType = asynParamInt64;
+#else
+static asynParamType const TRInt64ParamType = asynParamFloat64;
+#endif
+
+/**
+ * Interface and interrupt mask needed for 64-bit integer parameters.
+ */
+#if TR_HAVE_ASYN_INT64
+static int const TRInt64Mask = asynInt64Mask;
+#else
+static int const TRInt64Mask = 0;
+#endif
+
+/**
+ * Set a 64-bit integer parameter (see @ref TRInt64ParamType).
+ *
+ * @param port The port of the parameter.
+ * @param addr The address.
+ * @param param The parameter index.
+ * @param value The value.
+ */
+inline void TRSetInt64Param (asynPortDriver &port, int addr, int param, epicsInt64 value)
+{
+#if TR_HAVE_ASYN_INT64
+    port.setInteger64Param(addr, param, value);
+#else
+    port.setDoubleParam(addr, param, (double)value);
+#endif
+}
+
+/**
+ * Limit a 64-bit count to the range of a 32-bit parameter or array element.
+ *
+ * @param value The count.
+ * @return The count, or the largest epicsInt32 if it is larger.
+ */
+inline epicsInt32 TRSaturateInt32 (epicsUInt64 value)
+{
+    return (value > 0x7FFFFFFF) ? (epicsInt32)0x7FFFFFFF : (epicsInt32)value;
+}
+
+#endif
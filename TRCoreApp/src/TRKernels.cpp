@@ -0,0 +1,383 @@
+/* This file is part of the Transient Recorder Framework.
+ * It is subject to the license terms in the LICENSE.txt file found in the
+ * top-level directory of this distribution and at
+ * https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. No part
+ * of the Transient Recorder Framework, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cmath>
+#include <vector>
+
+#include <iocsh.h>
+
+#include <epicsExport.h>
+
+#include "TRKernelsImpl.h"
+
+// Scalar implementations.
+
+static void convertInt16ToFloat64Scalar (epicsInt16 const *in, double *out, size_t count,
+                                         double scale, double offset)
+{
+    for (size_t i = 0; i < count; i++) {
+        out[i] = in[i] * scale + offset;
+    }
+}
+
+void TRKernelsDeinterleaveInt16Scalar (epicsInt16 const *in, size_t num_samples,
+                                       int num_channels, epicsInt16 * const *out)
+{
+    for (int c = 0; c < num_channels; c++) {
+        epicsInt16 const *src = in + c;
+        epicsInt16 *dst = out[c];
+        for (size_t i = 0; i < num_samples; i++) {
+            dst[i] = src[i * num_channels];
+        }
+    }
+}
+
+static void minMaxSumInt16Scalar (epicsInt16 const *in, size_t count, epicsInt16 *min,
+                                  epicsInt16 *max, epicsInt64 *sum)
+{
+    epicsInt16 min_val = (count > 0) ? in[0] : 0;
+    epicsInt16 max_val = min_val;
+    epicsInt64 sum_val = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (in[i] < min_val) {
+            min_val = in[i];
+        }
+        if (in[i] > max_val) {
+            max_val = in[i];
+        }
+        sum_val += in[i];
+    }
+    *min = min_val;
+    *max = max_val;
+    *sum = sum_val;
+}
+
+static void timeArrayScalar (double *out, size_t count, double first_index, double unit)
+{
+    for (size_t i = 0; i < count; i++) {
+        out[i] = (first_index + (double)i) * unit;
+    }
+}
+
+static void copyNonTemporalScalar (void *dst, void const *src, size_t size)
+{
+    memcpy(dst, src, size);
+}
+
+TRKernelTable const TRKernelsScalar = {
+    convertInt16ToFloat64Scalar,
+    TRKernelsDeinterleaveInt16Scalar,
+    minMaxSumInt16Scalar,
+    timeArrayScalar,
+    copyNonTemporalScalar
+};
+
+// Selection of implementations.
+
+static char const * const IsaNames[TRNumKernelIsas] = {
+    "scalar",
+    "sse4.2",
+    "avx2",
+    "avx512"
+};
+
+static TRKernelTable const * const IsaTables[TRNumKernelIsas] = {
+    &TRKernelsScalar,
+#ifdef TR_KERNELS_X86
+    &TRKernelsSse42,
+    &TRKernelsAvx2,
+    &TRKernelsAvx512
+#else
+    NULL,
+    NULL,
+    NULL
+#endif
+};
+
+static bool cpuSupports (TRKernelIsa isa)
+{
+    switch (isa) {
+        case TRKernelIsaScalar:
+            return true;
+#ifdef TR_KERNELS_X86
+        case TRKernelIsaSse42:
+            return __builtin_cpu_supports("sse4.2");
+        case TRKernelIsaAvx2:
+            return __builtin_cpu_supports("avx2");
+        case TRKernelIsaAvx512:
+            return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+#endif
+        default:
+            return false;
+    }
+}
+
+static TRKernelIsa detectIsa ()
+{
+#ifdef TR_KERNELS_X86
+    __builtin_cpu_init();
+#endif
+
+    // Apply the limit from the environment, if any.
+    int max_isa = TRNumKernelIsas - 1;
+    char const *limit = getenv("TR_KERNELS_MAX_ISA");
+    if (limit != NULL) {
+        for (int isa = 0; isa < TRNumKernelIsas; isa++) {
+            if (strcmp(limit, IsaNames[isa]) == 0) {
+                max_isa = isa;
+            }
+        }
+    }
+
+    int isa = max_isa;
+    while (isa > TRKernelIsaScalar && (IsaTables[isa] == NULL || !cpuSupports((TRKernelIsa)isa))) {
+        isa--;
+    }
+    return (TRKernelIsa)isa;
+}
+
+static TRKernelIsa s_active_isa = detectIsa();
+
+// Select the best implementation of one kernel, the member is given as an
+// offset into TRKernelTable so that this works for all kernels.
+template <typename FuncPtr>
+static FuncPtr selectKernel (FuncPtr TRKernelTable::*member)
+{
+    for (int isa = s_active_isa; isa > TRKernelIsaScalar; isa--) {
+        if (IsaTables[isa] != NULL && IsaTables[isa]->*member != NULL) {
+            return IsaTables[isa]->*member;
+        }
+    }
+    return TRKernelsScalar.*member;
+}
+
+static TRKernelTable selectKernels ()
+{
+    TRKernelTable table;
+    table.convertInt16ToFloat64 = selectKernel(&TRKernelTable::convertInt16ToFloat64);
+    table.deinterleaveInt16     = selectKernel(&TRKernelTable::deinterleaveInt16);
+    table.minMaxSumInt16        = selectKernel(&TRKernelTable::minMaxSumInt16);
+    table.timeArray             = selectKernel(&TRKernelTable::timeArray);
+    table.copyNonTemporal       = selectKernel(&TRKernelTable::copyNonTemporal);
+    return table;
+}
+
+TRKernelTable TRKernels::s_active = selectKernels();
+
+TRKernelIsa TRKernels::activeIsa ()
+{
+    return s_active_isa;
+}
+
+char const * TRKernels::isaName (TRKernelIsa isa)
+{
+    return IsaNames[isa];
+}
+
+// Verification of implementations.
+
+namespace {
+
+// Deterministic pseudo-random numbers for test data.
+class TestRandom {
+public:
+    TestRandom () : m_state(12345) {}
+
+    epicsInt16 nextInt16 ()
+    {
+        m_state = m_state * 1103515245u + 12345u;
+        return (epicsInt16)(m_state >> 16);
+    }
+
+private:
+    epicsUInt32 m_state;
+};
+
+// Sizes tested, covering remainder handling of all vector widths.
+size_t const TestMaxSmallSize = 70;
+size_t const TestLargeSize = 10007;
+
+// Offsets of the start of arrays to test unaligned access.
+size_t const TestMaxOffset = 3;
+
+class KernelChecker {
+public:
+    KernelChecker (FILE *fp, TRKernelTable const &table, char const *isa_name)
+    : m_fp(fp),
+      m_table(table),
+      m_isa_name(isa_name),
+      m_input(TestLargeSize * 2 + TestMaxOffset)
+    {
+        TestRandom random;
+        for (size_t i = 0; i < m_input.size(); i++) {
+            m_input[i] = random.nextInt16();
+        }
+        // Include the extreme values.
+        m_input[1] = -32768;
+        m_input[5] = 32767;
+    }
+
+    bool checkAll ()
+    {
+        bool ok = true;
+        if (m_table.convertInt16ToFloat64 != NULL) {
+            ok = report("convertInt16ToFloat64", forAllSizes(&KernelChecker::checkConvert)) && ok;
+        }
+        if (m_table.deinterleaveInt16 != NULL) {
+            ok = report("deinterleaveInt16", forAllSizes(&KernelChecker::checkDeinterleave)) && ok;
+        }
+        if (m_table.minMaxSumInt16 != NULL) {
+            ok = report("minMaxSumInt16", forAllSizes(&KernelChecker::checkMinMaxSum)) && ok;
+        }
+        if (m_table.timeArray != NULL) {
+            ok = report("timeArray", forAllSizes(&KernelChecker::checkTimeArray)) && ok;
+        }
+        if (m_table.copyNonTemporal != NULL) {
+            ok = report("copyNonTemporal", forAllSizes(&KernelChecker::checkCopy)) && ok;
+        }
+        return ok;
+    }
+
+private:
+    FILE *m_fp;
+    TRKernelTable const &m_table;
+    char const *m_isa_name;
+    std::vector<epicsInt16> m_input;
+
+    bool report (char const *kernel, bool ok)
+    {
+        fprintf(m_fp, "  %-8s %-24s %s\n", m_isa_name, kernel, ok ? "OK" : "FAILED");
+        return ok;
+    }
+
+    bool forAllSizes (bool (KernelChecker::*check) (size_t count, size_t offset))
+    {
+        for (size_t offset = 0; offset <= TestMaxOffset; offset++) {
+            for (size_t count = 0; count <= TestMaxSmallSize; count++) {
+                if (!(this->*check)(count, offset)) {
+                    return false;
+                }
+            }
+            if (!(this->*check)(TestLargeSize, offset)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool checkConvert (size_t count, size_t offset)
+    {
+        std::vector<double> ref(count + offset), out(count + offset);
+        double const scale = 0.000152587890625 * 1.1;
+        double const offs = -0.37;
+        TRKernelsScalar.convertInt16ToFloat64(&m_input[offset], &ref[offset], count, scale, offs);
+        m_table.convertInt16ToFloat64(&m_input[offset], &out[offset], count, scale, offs);
+        for (size_t i = offset; i < count + offset; i++) {
+            // Allow for a difference due to fused multiply-add.
+            if (std::fabs(out[i] - ref[i]) > 1e-15 * (1.0 + std::fabs(ref[i]))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool checkDeinterleave (size_t count, size_t offset)
+    {
+        for (int num_channels = 1; num_channels <= 4; num_channels++) {
+            std::vector<epicsInt16> ref(num_channels * (count + offset));
+            std::vector<epicsInt16> out(num_channels * (count + offset));
+            std::vector<epicsInt16 *> ref_ptrs(num_channels), out_ptrs(num_channels);
+            for (int c = 0; c < num_channels; c++) {
+                ref_ptrs[c] = &ref[c * (count + offset) + offset];
+                out_ptrs[c] = &out[c * (count + offset) + offset];
+            }
+            TRKernelsScalar.deinterleaveInt16(&m_input[offset], count, num_channels, &ref_ptrs[0]);
+            m_table.deinterleaveInt16(&m_input[offset], count, num_channels, &out_ptrs[0]);
+            if (ref != out) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool checkMinMaxSum (size_t count, size_t offset)
+    {
+        epicsInt16 ref_min, ref_max, out_min, out_max;
+        epicsInt64 ref_sum, out_sum;
+        TRKernelsScalar.minMaxSumInt16(&m_input[offset], count, &ref_min, &ref_max, &ref_sum);
+        m_table.minMaxSumInt16(&m_input[offset], count, &out_min, &out_max, &out_sum);
+        return out_min == ref_min && out_max == ref_max && out_sum == ref_sum;
+    }
+
+    bool checkTimeArray (size_t count, size_t offset)
+    {
+        std::vector<double> ref(count + offset), out(count + offset);
+        double const first_index = -(double)(count / 3) - 7.0;
+        double const unit = 1.0 / 3e9;
+        TRKernelsScalar.timeArray(&ref[offset], count, first_index, unit);
+        m_table.timeArray(&out[offset], count, first_index, unit);
+        return out == ref;
+    }
+
+    bool checkCopy (size_t count, size_t offset)
+    {
+        // Use odd sizes and different alignment of source and destination.
+        size_t size = 2 * count + offset;
+        char const *src = (char const *)&m_input[0] + offset + 1;
+        std::vector<char> ref(size + offset), out(size + offset);
+        memcpy(&ref[offset], src, size);
+        m_table.copyNonTemporal(&out[offset], src, size);
+        return out == ref;
+    }
+};
+
+} // namespace
+
+bool TRKernels::selfCheck (FILE *fp)
+{
+    fprintf(fp, "TRKernels: active instruction set %s\n", IsaNames[s_active_isa]);
+
+    bool ok = true;
+    for (int isa = TRKernelIsaScalar + 1; isa < TRNumKernelIsas; isa++) {
+        if (IsaTables[isa] == NULL) {
+            continue;
+        }
+        if (!cpuSupports((TRKernelIsa)isa)) {
+            fprintf(fp, "  %-8s not supported by the CPU\n", IsaNames[isa]);
+            continue;
+        }
+        KernelChecker checker(fp, *IsaTables[isa], IsaNames[isa]);
+        ok = checker.checkAll() && ok;
+    }
+
+    fprintf(fp, "TRKernels: %s\n", ok ? "all checks passed" : "CHECKS FAILED");
+    return ok;
+}
+
+// iocsh registration of TRKernelsCheck.
+
+static const iocshFuncDef checkFuncDef = {"TRKernelsCheck", 0, NULL};
+
+static void checkCallFunc (const iocshArgBuf *args)
+{
+    TRKernels::selfCheck(stdout);
+}
+
+static void TRKernelsRegister (void)
+{
+    iocshRegister(&checkFuncDef, checkCallFunc);
+}
+
+extern "C" {
+    epicsExportRegistrar(TRKernelsRegister);
+}
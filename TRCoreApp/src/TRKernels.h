@@ -0,0 +1,184 @@
+/* This file is part of the Transient Recorder Framework.
+ * It is subject to the license terms in the LICENSE.txt file found in the
+ * top-level directory of this distribution and at
+ * https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. No part
+ * of the Transient Recorder Framework, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ */
+
+/**
+ * @file
+ *
+ * Defines the TRKernels class, which provides data processing kernels
+ * with implementations selected at runtime for the CPU.
+ */
+
+#ifndef TRANSREC_KERNELS_H
+#define TRANSREC_KERNELS_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include <epicsTypes.h>
+
+/**
+ * Instruction set levels for which kernel implementations may exist.
+ *
+ * Each level implies support of the lower levels.
+ */
+enum TRKernelIsa {
+    TRKernelIsaScalar,
+    TRKernelIsaSse42,
+    TRKernelIsaAvx2,
+    TRKernelIsaAvx512,
+    TRNumKernelIsas
+};
+
+/**
+ * Table of kernel implementations for one instruction set level.
+ *
+ * Entries are NULL for kernels which have no implementation for the level.
+ * This is an implementation detail of TRKernels.
+ */
+struct TRKernelTable {
+    void (*convertInt16ToFloat64) (epicsInt16 const *in, double *out, size_t count,
+                                   double scale, double offset);
+    void (*deinterleaveInt16) (epicsInt16 const *in, size_t num_samples, int num_channels,
+                               epicsInt16 * const *out);
+    void (*minMaxSumInt16) (epicsInt16 const *in, size_t count, epicsInt16 *min,
+                            epicsInt16 *max, epicsInt64 *sum);
+    void (*timeArray) (double *out, size_t count, double first_index, double unit);
+    void (*copyNonTemporal) (void *dst, void const *src, size_t size);
+};
+
+/**
+ * Data processing and copy kernels for use by the framework and drivers.
+ *
+ * For each kernel, the best implementation supported by the CPU is selected
+ * when the library is loaded (the kernels must therefore not be used from
+ * static initializers). Scalar implementations are the reference; other
+ * implementations give bit-identical results, except for
+ * convertInt16ToFloat64 where the scalar implementation may be compiled to
+ * use fused multiply-add, so results may differ in the last bit.
+ *
+ * The environment variable `TR_KERNELS_MAX_ISA` can limit the selection to
+ * a lower instruction set level (`scalar`, `sse4.2`, `avx2` or `avx512`),
+ * for example to compare performance or to work around a problem.
+ *
+ * Implementations can be verified using the iocsh command `TRKernelsCheck`,
+ * which compares all implementations supported by the CPU against the scalar
+ * ones (see @ref selfCheck). This requires `TRKernels.dbd` to be included in
+ * the IOC.
+ *
+ * SIMD implementations are only available on x86 with GCC 4.9 or later or
+ * Clang; otherwise only the scalar implementations are used.
+ */
+class TRKernels {
+public:
+    /**
+     * Convert samples to floating point, out[i] = in[i] * scale + offset.
+     *
+     * @param in Input samples.
+     * @param out Output array (must not overlap the input).
+     * @param count Number of samples.
+     * @param scale Scale factor.
+     * @param offset Offset added after scaling.
+     */
+    static inline void convertInt16ToFloat64 (epicsInt16 const *in, double *out, size_t count,
+                                              double scale, double offset)
+    {
+        s_active.convertInt16ToFloat64(in, out, count, scale, offset);
+    }
+
+    /**
+     * De-interleave samples of multiple channels,
+     * out[c][i] = in[i * num_channels + c].
+     *
+     * SIMD implementations exist for two channels only.
+     *
+     * @param in Interleaved input samples (num_samples * num_channels elements).
+     * @param num_samples Number of samples per channel.
+     * @param num_channels Number of channels.
+     * @param out Output arrays, one for each channel (must not overlap the input).
+     */
+    static inline void deinterleaveInt16 (epicsInt16 const *in, size_t num_samples, int num_channels,
+                                          epicsInt16 * const *out)
+    {
+        s_active.deinterleaveInt16(in, num_samples, num_channels, out);
+    }
+
+    /**
+     * Compute the minimum, maximum and sum of samples.
+     *
+     * If count is zero, min and max are set to zero.
+     *
+     * @param in Input samples.
+     * @param count Number of samples.
+     * @param min Returns the minimum.
+     * @param max Returns the maximum.
+     * @param sum Returns the sum.
+     */
+    static inline void minMaxSumInt16 (epicsInt16 const *in, size_t count, epicsInt16 *min,
+                                       epicsInt16 *max, epicsInt64 *sum)
+    {
+        s_active.minMaxSumInt16(in, count, min, max, sum);
+    }
+
+    /**
+     * Generate a time array, out[i] = (first_index + i) * unit.
+     *
+     * @param out Output array.
+     * @param count Number of elements.
+     * @param first_index Sample index of the first element (an integer,
+     *                    e.g. the negative number of pre-trigger samples).
+     * @param unit Time between samples.
+     */
+    static inline void timeArray (double *out, size_t count, double first_index, double unit)
+    {
+        s_active.timeArray(out, count, first_index, unit);
+    }
+
+    /**
+     * Copy memory using non-temporal stores where possible.
+     *
+     * Non-temporal stores bypass the cache, so that copying large amounts of
+     * data does not evict the working set of other code. This is slower than
+     * memcpy for data which is soon used again, so it should only be used for
+     * large copies (see TRParallelCopy). The scalar implementation is memcpy.
+     *
+     * @param dst Destination (must not overlap the source).
+     * @param src Source.
+     * @param size Number of bytes.
+     */
+    static inline void copyNonTemporal (void *dst, void const *src, size_t size)
+    {
+        s_active.copyNonTemporal(dst, src, size);
+    }
+
+    /**
+     * Return the highest instruction set level supported by the CPU
+     * (and permitted by TR_KERNELS_MAX_ISA).
+     */
+    static TRKernelIsa activeIsa ();
+
+    /**
+     * Return the name of an instruction set level.
+     */
+    static char const * isaName (TRKernelIsa isa);
+
+    /**
+     * Compare all implementations supported by the CPU against the scalar
+     * implementations, using pseudo-random data of various sizes and
+     * alignments.
+     *
+     * @param fp File to print results to.
+     * @return True if all implementations gave correct results.
+     */
+    static bool selfCheck (FILE *fp);
+
+private:
+    static TRKernelTable s_active;
+};
+
+#endif
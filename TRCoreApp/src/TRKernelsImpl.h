@@ -0,0 +1,43 @@
+/* This file is part of the Transient Recorder Framework.
+ * It is subject to the license terms in the LICENSE.txt file found in the
+ * top-level directory of this distribution and at
+ * https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. No part
+ * of the Transient Recorder Framework, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ */
+
+/**
+ * @file
+ *
+ * Internal declarations shared by the TRKernels implementation files.
+ */
+
+#ifndef TRANSREC_KERNELS_IMPL_H
+#define TRANSREC_KERNELS_IMPL_H
+
+#include "TRKernels.h"
+
+// SIMD implementations require the target attribute and __builtin_cpu_supports.
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || (defined(__GNUC__) && \
+        (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define TR_KERNELS_X86 1
+#endif
+
+// Scalar (reference) implementations.
+extern TRKernelTable const TRKernelsScalar;
+
+#ifdef TR_KERNELS_X86
+// Implementations for x86 instruction set levels (entries may be NULL).
+extern TRKernelTable const TRKernelsSse42;
+extern TRKernelTable const TRKernelsAvx2;
+extern TRKernelTable const TRKernelsAvx512;
+#endif
+
+// Scalar de-interleaving, used by SIMD implementations for unsupported
+// numbers of channels.
+void TRKernelsDeinterleaveInt16Scalar (epicsInt16 const *in, size_t num_samples,
+                                       int num_channels, epicsInt16 * const *out);
+
+#endif
@@ -0,0 +1,399 @@
+/* This file is part of the Transient Recorder Framework.
+ * It is subject to the license terms in the LICENSE.txt file found in the
+ * top-level directory of this distribution and at
+ * https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. No part
+ * of the Transient Recorder Framework, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ */
+
+/*
+ * SIMD implementations of TRKernels for x86.
+ *
+ * Functions are compiled for their instruction set using the target
+ * attribute, so that this file does not require special compiler flags
+ * and the library still runs on CPUs without these instructions (the
+ * functions are only called when TRKernels detected support). Remaining
+ * elements after the vector loops are processed like in the scalar
+ * implementations, and the order of floating point operations is the same,
+ * so that results are identical.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "TRKernelsImpl.h"
+
+#ifdef TR_KERNELS_X86
+
+#include <immintrin.h>
+
+#define TR_TARGET_SSE42 __attribute__((target("sse4.2")))
+#define TR_TARGET_AVX2 __attribute__((target("avx2")))
+#define TR_TARGET_AVX512 __attribute__((target("avx512f,avx512bw")))
+
+// SSE4.2 implementations.
+
+TR_TARGET_SSE42
+static void convertInt16ToFloat64Sse42 (epicsInt16 const *in, double *out, size_t count,
+                                        double scale, double offset)
+{
+    __m128d vscale = _mm_set1_pd(scale);
+    __m128d voffset = _mm_set1_pd(offset);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i v16 = _mm_loadl_epi64((__m128i const *)(in + i));
+        __m128i v32 = _mm_cvtepi16_epi32(v16);
+        __m128d lo = _mm_cvtepi32_pd(v32);
+        __m128d hi = _mm_cvtepi32_pd(_mm_srli_si128(v32, 8));
+        _mm_storeu_pd(out + i,     _mm_add_pd(_mm_mul_pd(lo, vscale), voffset));
+        _mm_storeu_pd(out + i + 2, _mm_add_pd(_mm_mul_pd(hi, vscale), voffset));
+    }
+    for (; i < count; i++) {
+        out[i] = in[i] * scale + offset;
+    }
+}
+
+TR_TARGET_SSE42
+static void deinterleaveInt16Sse42 (epicsInt16 const *in, size_t num_samples, int num_channels,
+                                    epicsInt16 * const *out)
+{
+    if (num_channels != 2) {
+        TRKernelsDeinterleaveInt16Scalar(in, num_samples, num_channels, out);
+        return;
+    }
+
+    // Move the even 16-bit elements to the low half and the odd to the high half.
+    __m128i const shuffle = _mm_setr_epi8(0, 1, 4, 5, 8, 9, 12, 13, 2, 3, 6, 7, 10, 11, 14, 15);
+
+    epicsInt16 *out0 = out[0];
+    epicsInt16 *out1 = out[1];
+    size_t i = 0;
+    for (; i + 8 <= num_samples; i += 8) {
+        __m128i v0 = _mm_shuffle_epi8(_mm_loadu_si128((__m128i const *)(in + 2 * i)), shuffle);
+        __m128i v1 = _mm_shuffle_epi8(_mm_loadu_si128((__m128i const *)(in + 2 * i + 8)), shuffle);
+        _mm_storeu_si128((__m128i *)(out0 + i), _mm_unpacklo_epi64(v0, v1));
+        _mm_storeu_si128((__m128i *)(out1 + i), _mm_unpackhi_epi64(v0, v1));
+    }
+    for (; i < num_samples; i++) {
+        out0[i] = in[2 * i];
+        out1[i] = in[2 * i + 1];
+    }
+}
+
+TR_TARGET_SSE42
+static void minMaxSumInt16Sse42 (epicsInt16 const *in, size_t count, epicsInt16 *min,
+                                 epicsInt16 *max, epicsInt64 *sum)
+{
+    if (count < 8) {
+        TRKernelsScalar.minMaxSumInt16(in, count, min, max, sum);
+        return;
+    }
+
+    __m128i const ones = _mm_set1_epi16(1);
+    __m128i vmin = _mm_loadu_si128((__m128i const *)in);
+    __m128i vmax = vmin;
+    __m128i vsum = _mm_setzero_si128(); // two 64-bit sums
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128((__m128i const *)(in + i));
+        vmin = _mm_min_epi16(vmin, v);
+        vmax = _mm_max_epi16(vmax, v);
+        // Sum pairs into 32 bits (cannot overflow), then widen to 64 bits.
+        __m128i pairs = _mm_madd_epi16(v, ones);
+        vsum = _mm_add_epi64(vsum, _mm_cvtepi32_epi64(pairs));
+        vsum = _mm_add_epi64(vsum, _mm_cvtepi32_epi64(_mm_srli_si128(pairs, 8)));
+    }
+
+    epicsInt16 min_lanes[8], max_lanes[8];
+    epicsInt64 sum_lanes[2];
+    _mm_storeu_si128((__m128i *)min_lanes, vmin);
+    _mm_storeu_si128((__m128i *)max_lanes, vmax);
+    _mm_storeu_si128((__m128i *)sum_lanes, vsum);
+
+    epicsInt16 min_val = min_lanes[0];
+    epicsInt16 max_val = max_lanes[0];
+    for (int k = 1; k < 8; k++) {
+        if (min_lanes[k] < min_val) {
+            min_val = min_lanes[k];
+        }
+        if (max_lanes[k] > max_val) {
+            max_val = max_lanes[k];
+        }
+    }
+    epicsInt64 sum_val = sum_lanes[0] + sum_lanes[1];
+    for (; i < count; i++) {
+        if (in[i] < min_val) {
+            min_val = in[i];
+        }
+        if (in[i] > max_val) {
+            max_val = in[i];
+        }
+        sum_val += in[i];
+    }
+    *min = min_val;
+    *max = max_val;
+    *sum = sum_val;
+}
+
+TR_TARGET_SSE42
+static void timeArraySse42 (double *out, size_t count, double first_index, double unit)
+{
+    __m128d vunit = _mm_set1_pd(unit);
+    __m128d vstep = _mm_set1_pd(2.0);
+    __m128d vindex = _mm_setr_pd(first_index, first_index + 1.0);
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        _mm_storeu_pd(out + i, _mm_mul_pd(vindex, vunit));
+        vindex = _mm_add_pd(vindex, vstep);
+    }
+    for (; i < count; i++) {
+        out[i] = (first_index + (double)i) * unit;
+    }
+}
+
+TR_TARGET_SSE42
+static void copyNonTemporalSse42 (void *dst, void const *src, size_t size)
+{
+    char *d = (char *)dst;
+    char const *s = (char const *)src;
+
+    // Copy the head normally to align the destination for streaming stores.
+    size_t head = (16 - ((uintptr_t)d & 15)) & 15;
+    if (head >= size) {
+        memcpy(d, s, size);
+        return;
+    }
+    memcpy(d, s, head);
+    size_t i = head;
+    for (; i + 64 <= size; i += 64) {
+        __m128i v0 = _mm_loadu_si128((__m128i const *)(s + i));
+        __m128i v1 = _mm_loadu_si128((__m128i const *)(s + i + 16));
+        __m128i v2 = _mm_loadu_si128((__m128i const *)(s + i + 32));
+        __m128i v3 = _mm_loadu_si128((__m128i const *)(s + i + 48));
+        _mm_stream_si128((__m128i *)(d + i), v0);
+        _mm_stream_si128((__m128i *)(d + i + 16), v1);
+        _mm_stream_si128((__m128i *)(d + i + 32), v2);
+        _mm_stream_si128((__m128i *)(d + i + 48), v3);
+    }
+    // Make the streaming stores visible before any subsequent stores.
+    _mm_sfence();
+    memcpy(d + i, s + i, size - i);
+}
+
+TRKernelTable const TRKernelsSse42 = {
+    convertInt16ToFloat64Sse42,
+    deinterleaveInt16Sse42,
+    minMaxSumInt16Sse42,
+    timeArraySse42,
+    copyNonTemporalSse42
+};
+
+// AVX2 implementations.
+
+TR_TARGET_AVX2
+static void convertInt16ToFloat64Avx2 (epicsInt16 const *in, double *out, size_t count,
+                                       double scale, double offset)
+{
+    __m256d vscale = _mm256_set1_pd(scale);
+    __m256d voffset = _mm256_set1_pd(offset);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i v32 = _mm256_cvtepi16_epi32(_mm_loadu_si128((__m128i const *)(in + i)));
+        __m256d lo = _mm256_cvtepi32_pd(_mm256_castsi256_si128(v32));
+        __m256d hi = _mm256_cvtepi32_pd(_mm256_extracti128_si256(v32, 1));
+        _mm256_storeu_pd(out + i,     _mm256_add_pd(_mm256_mul_pd(lo, vscale), voffset));
+        _mm256_storeu_pd(out + i + 4, _mm256_add_pd(_mm256_mul_pd(hi, vscale), voffset));
+    }
+    for (; i < count; i++) {
+        out[i] = in[i] * scale + offset;
+    }
+}
+
+TR_TARGET_AVX2
+static void deinterleaveInt16Avx2 (epicsInt16 const *in, size_t num_samples, int num_channels,
+                                   epicsInt16 * const *out)
+{
+    if (num_channels != 2) {
+        TRKernelsDeinterleaveInt16Scalar(in, num_samples, num_channels, out);
+        return;
+    }
+
+    // Within each 128-bit lane, move even elements to the low and odd elements
+    // to the high 64 bits, then gather the 64-bit parts of each channel.
+    __m256i const shuffle = _mm256_setr_epi8(
+        0, 1, 4, 5, 8, 9, 12, 13, 2, 3, 6, 7, 10, 11, 14, 15,
+        0, 1, 4, 5, 8, 9, 12, 13, 2, 3, 6, 7, 10, 11, 14, 15);
+
+    epicsInt16 *out0 = out[0];
+    epicsInt16 *out1 = out[1];
+    size_t i = 0;
+    for (; i + 16 <= num_samples; i += 16) {
+        __m256i v0 = _mm256_shuffle_epi8(_mm256_loadu_si256((__m256i const *)(in + 2 * i)), shuffle);
+        __m256i v1 = _mm256_shuffle_epi8(_mm256_loadu_si256((__m256i const *)(in + 2 * i + 16)), shuffle);
+        v0 = _mm256_permute4x64_epi64(v0, _MM_SHUFFLE(3, 1, 2, 0));
+        v1 = _mm256_permute4x64_epi64(v1, _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256((__m256i *)(out0 + i), _mm256_permute2x128_si256(v0, v1, 0x20));
+        _mm256_storeu_si256((__m256i *)(out1 + i), _mm256_permute2x128_si256(v0, v1, 0x31));
+    }
+    for (; i < num_samples; i++) {
+        out0[i] = in[2 * i];
+        out1[i] = in[2 * i + 1];
+    }
+}
+
+TR_TARGET_AVX2
+static void minMaxSumInt16Avx2 (epicsInt16 const *in, size_t count, epicsInt16 *min,
+                                epicsInt16 *max, epicsInt64 *sum)
+{
+    if (count < 16) {
+        TRKernelsScalar.minMaxSumInt16(in, count, min, max, sum);
+        return;
+    }
+
+    __m256i const ones = _mm256_set1_epi16(1);
+    __m256i vmin = _mm256_loadu_si256((__m256i const *)in);
+    __m256i vmax = vmin;
+    __m256i vsum = _mm256_setzero_si256(); // four 64-bit sums
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i v = _mm256_loadu_si256((__m256i const *)(in + i));
+        vmin = _mm256_min_epi16(vmin, v);
+        vmax = _mm256_max_epi16(vmax, v);
+        // Sum pairs into 32 bits (cannot overflow), then widen to 64 bits.
+        __m256i pairs = _mm256_madd_epi16(v, ones);
+        vsum = _mm256_add_epi64(vsum, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(pairs)));
+        vsum = _mm256_add_epi64(vsum, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(pairs, 1)));
+    }
+
+    epicsInt16 min_lanes[16], max_lanes[16];
+    epicsInt64 sum_lanes[4];
+    _mm256_storeu_si256((__m256i *)min_lanes, vmin);
+    _mm256_storeu_si256((__m256i *)max_lanes, vmax);
+    _mm256_storeu_si256((__m256i *)sum_lanes, vsum);
+
+    epicsInt16 min_val = min_lanes[0];
+    epicsInt16 max_val = max_lanes[0];
+    for (int k = 1; k < 16; k++) {
+        if (min_lanes[k] < min_val) {
+            min_val = min_lanes[k];
+        }
+        if (max_lanes[k] > max_val) {
+            max_val = max_lanes[k];
+        }
+    }
+    epicsInt64 sum_val = sum_lanes[0] + sum_lanes[1] + sum_lanes[2] + sum_lanes[3];
+    for (; i < count; i++) {
+        if (in[i] < min_val) {
+            min_val = in[i];
+        }
+        if (in[i] > max_val) {
+            max_val = in[i];
+        }
+        sum_val += in[i];
+    }
+    *min = min_val;
+    *max = max_val;
+    *sum = sum_val;
+}
+
+TR_TARGET_AVX2
+static void timeArrayAvx2 (double *out, size_t count, double first_index, double unit)
+{
+    __m256d vunit = _mm256_set1_pd(unit);
+    __m256d vstep = _mm256_set1_pd(4.0);
+    __m256d vindex = _mm256_setr_pd(first_index, first_index + 1.0, first_index + 2.0, first_index + 3.0);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        _mm256_storeu_pd(out + i, _mm256_mul_pd(vindex, vunit));
+        vindex = _mm256_add_pd(vindex, vstep);
+    }
+    for (; i < count; i++) {
+        out[i] = (first_index + (double)i) * unit;
+    }
+}
+
+TR_TARGET_AVX2
+static void copyNonTemporalAvx2 (void *dst, void const *src, size_t size)
+{
+    char *d = (char *)dst;
+    char const *s = (char const *)src;
+
+    // Copy the head normally to align the destination for streaming stores.
+    size_t head = (32 - ((uintptr_t)d & 31)) & 31;
+    if (head >= size) {
+        memcpy(d, s, size);
+        return;
+    }
+    memcpy(d, s, head);
+    size_t i = head;
+    for (; i + 128 <= size; i += 128) {
+        __m256i v0 = _mm256_loadu_si256((__m256i const *)(s + i));
+        __m256i v1 = _mm256_loadu_si256((__m256i const *)(s + i + 32));
+        __m256i v2 = _mm256_loadu_si256((__m256i const *)(s + i + 64));
+        __m256i v3 = _mm256_loadu_si256((__m256i const *)(s + i + 96));
+        _mm256_stream_si256((__m256i *)(d + i), v0);
+        _mm256_stream_si256((__m256i *)(d + i + 32), v1);
+        _mm256_stream_si256((__m256i *)(d + i + 64), v2);
+        _mm256_stream_si256((__m256i *)(d + i + 96), v3);
+    }
+    // Make the streaming stores visible before any subsequent stores.
+    _mm_sfence();
+    memcpy(d + i, s + i, size - i);
+}
+
+TRKernelTable const TRKernelsAvx2 = {
+    convertInt16ToFloat64Avx2,
+    deinterleaveInt16Avx2,
+    minMaxSumInt16Avx2,
+    timeArrayAvx2,
+    copyNonTemporalAvx2
+};
+
+// AVX-512 implementations (other kernels use the AVX2 implementations).
+
+TR_TARGET_AVX512
+static void convertInt16ToFloat64Avx512 (epicsInt16 const *in, double *out, size_t count,
+                                         double scale, double offset)
+{
+    __m512d vscale = _mm512_set1_pd(scale);
+    __m512d voffset = _mm512_set1_pd(offset);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m512i v32 = _mm512_cvtepi16_epi32(_mm256_loadu_si256((__m256i const *)(in + i)));
+        __m512d lo = _mm512_cvtepi32_pd(_mm512_castsi512_si256(v32));
+        __m512d hi = _mm512_cvtepi32_pd(_mm512_extracti64x4_epi64(v32, 1));
+        _mm512_storeu_pd(out + i,     _mm512_add_pd(_mm512_mul_pd(lo, vscale), voffset));
+        _mm512_storeu_pd(out + i + 8, _mm512_add_pd(_mm512_mul_pd(hi, vscale), voffset));
+    }
+    for (; i < count; i++) {
+        out[i] = in[i] * scale + offset;
+    }
+}
+
+TR_TARGET_AVX512
+static void timeArrayAvx512 (double *out, size_t count, double first_index, double unit)
+{
+    __m512d vunit = _mm512_set1_pd(unit);
+    __m512d vstep = _mm512_set1_pd(8.0);
+    __m512d vindex = _mm512_add_pd(_mm512_set1_pd(first_index),
+                                   _mm512_setr_pd(0.0, 1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7.0));
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        _mm512_storeu_pd(out + i, _mm512_mul_pd(vindex, vunit));
+        vindex = _mm512_add_pd(vindex, vstep);
+    }
+    for (; i < count; i++) {
+        out[i] = (first_index + (double)i) * unit;
+    }
+}
+
+TRKernelTable const TRKernelsAvx512 = {
+    convertInt16ToFloat64Avx512,
+    NULL,
+    NULL,
+    timeArrayAvx512,
+    NULL
+};
+
+#endif
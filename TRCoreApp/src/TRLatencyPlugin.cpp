@@ -0,0 +1,205 @@
+/* This file is part of the Transient Recorder Framework.
+ * It is subject to the license terms in the LICENSE.txt file found in the
+ * top-level directory of this distribution and at
+ * https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. No part
+ * of the Transient Recorder Framework, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ */
+
+#include <stddef.h>
+
+#include <string>
+#include <algorithm>
+
+#include <epicsTime.h>
+#include <iocsh.h>
+
+#include <NDArray.h>
+
+#include <epicsExport.h>
+
+#include "TRLatencyPlugin.h"
+#include "TRInt64Param.h"
+
+// Names of measurements and their parameters, used to build parameter names.
+static char const * const MeasNames[] = {"TRIGGER", "SUBMIT"};
+static char const * const MeasParamNames[] = {
+    "COUNT", "LAST", "MIN", "MEAN", "MAX", "P50", "P90", "P99", "HISTOGRAM"
+};
+
+TRLatencyPlugin::TRLatencyPlugin (char const *port_name, int queue_size, int blocking_callbacks,
+                                  char const *ndarray_port, int ndarray_addr)
+:   NDPluginDriver(
+        port_name,
+        queue_size,
+        blocking_callbacks,
+        ndarray_port,
+        ndarray_addr,
+        1, // maxAddr
+        NumPluginParams,
+        0, // maxBuffers (we do not allocate arrays)
+        0, // maxMemory
+        asynInt32Mask|asynFloat64Mask|asynInt32ArrayMask|asynFloat64ArrayMask|
+            asynGenericPointerMask|asynDrvUserMask, // interfaceMask
+        asynInt32Mask|asynFloat64Mask|asynGenericPointerMask, // interruptMask
+        ASYN_MULTIDEVICE, // asynFlags
+        1, // autoConnect
+        0, // priority
+        0  // stackSize
+    ),
+    m_num_missing(0)
+{
+    for (int meas = 0; meas < NumMeasurements; meas++) {
+        for (int param = 0; param < NUM_MEAS_PARAMS; param++) {
+            std::string name = std::string("TRLAT_") + MeasNames[meas] + "_" + MeasParamNames[param];
+            asynParamType type =
+                (param == MEAS_COUNT) ? asynParamInt32 :
+                (param == MEAS_HISTOGRAM) ? asynParamInt32Array : asynParamFloat64;
+            createParam(name.c_str(), type, &m_meas_params[meas][param]);
+        }
+    }
+    createParam("TRLAT_MISSING",          asynParamInt32,        &m_params[MISSING]);
+    createParam("TRLAT_RESET",            asynParamInt32,        &m_params[RESET]);
+    createParam("TRLAT_HISTOGRAM_BOUNDS", asynParamFloat64Array, &m_params[HISTOGRAM_BOUNDS]);
+
+    setStringParam(NDPluginDriverPluginType, "TRLatencyPlugin");
+
+    updateParams();
+
+    // Try to connect to the array port.
+    connectToArrayPort();
+}
+
+void TRLatencyPlugin::processCallbacks (NDArray *pArray)
+{
+    // Note, this is called with the port locked.
+
+    // Take the arrival time first so that nothing else is included.
+    epicsTimeStamp now_ts;
+    epicsTimeGetCurrent(&now_ts);
+    double now = now_ts.secPastEpoch + now_ts.nsec * 1e-9;
+
+    // Call the base class method which updates common parameters.
+    NDPluginDriver::processCallbacks(pArray);
+
+    bool have_trigger = addLatency(pArray, "TR_TRIGGER_TIME", MeasTrigger, now);
+    bool have_submit = addLatency(pArray, "TR_SUBMIT_TIME", MeasSubmit, now);
+    if (!have_trigger || !have_submit) {
+        m_num_missing++;
+    }
+
+    updateParams();
+}
+
+asynStatus TRLatencyPlugin::writeInt32 (asynUser *pasynUser, epicsInt32 value)
+{
+    if (pasynUser->reason == m_params[RESET]) {
+        if (value != 0) {
+            for (int meas = 0; meas < NumMeasurements; meas++) {
+                m_stats[meas].reset();
+            }
+            m_num_missing = 0;
+            updateParams();
+        }
+        return asynSuccess;
+    }
+
+    // Delegate to base class.
+    return NDPluginDriver::writeInt32(pasynUser, value);
+}
+
+asynStatus TRLatencyPlugin::readInt32Array (asynUser *pasynUser, epicsInt32 *value,
+                                            size_t nElements, size_t *nIn)
+{
+    for (int meas = 0; meas < NumMeasurements; meas++) {
+        if (pasynUser->reason == m_meas_params[meas][MEAS_HISTOGRAM]) {
+            size_t num = std::min(nElements, (size_t)TRPerfStat::NumBuckets);
+            for (size_t i = 0; i < num; i++) {
+                value[i] = TRSaturateInt32(m_stats[meas].getBucketCount(i));
+            }
+            *nIn = num;
+            return asynSuccess;
+        }
+    }
+
+    // Delegate to base class.
+    return NDPluginDriver::readInt32Array(pasynUser, value, nElements, nIn);
+}
+
+asynStatus TRLatencyPlugin::readFloat64Array (asynUser *pasynUser, epicsFloat64 *value,
+                                              size_t nElements, size_t *nIn)
+{
+    if (pasynUser->reason == m_params[HISTOGRAM_BOUNDS]) {
+        size_t num = std::min(nElements, (size_t)TRPerfStat::NumBuckets);
+        for (size_t i = 0; i < num; i++) {
+            value[i] = 1000.0 * TRPerfStat::bucketUpperBound(i);
+        }
+        *nIn = num;
+        return asynSuccess;
+    }
+
+    // Delegate to base class.
+    return NDPluginDriver::readFloat64Array(pasynUser, value, nElements, nIn);
+}
+
+bool TRLatencyPlugin::addLatency (NDArray *pArray, char const *attr_name, Measurement meas, double now)
+{
+    NDAttribute *attr = pArray->pAttributeList->find(attr_name);
+    if (attr == NULL) {
+        return false;
+    }
+
+    double time;
+    if (attr->getValue(NDAttrFloat64, &time) != ND_SUCCESS) {
+        return false;
+    }
+
+    m_stats[meas].add(now - time);
+    return true;
+}
+
+void TRLatencyPlugin::updateParams ()
+{
+    for (int meas = 0; meas < NumMeasurements; meas++) {
+        TRPerfStat const &stat = m_stats[meas];
+        int const *params = m_meas_params[meas];
+
+        // Statistics are kept in seconds but exposed in milliseconds.
+        setIntegerParam(params[MEAS_COUNT], TRSaturateInt32(stat.getCount()));
+        setDoubleParam(params[MEAS_LAST], 1000.0 * stat.getLast());
+        setDoubleParam(params[MEAS_MIN],  1000.0 * stat.getMin());
+        setDoubleParam(params[MEAS_MEAN], 1000.0 * stat.getMean());
+        setDoubleParam(params[MEAS_MAX],  1000.0 * stat.getMax());
+        setDoubleParam(params[MEAS_P50],  1000.0 * stat.getPercentile(0.50));
+        setDoubleParam(params[MEAS_P90],  1000.0 * stat.getPercentile(0.90));
+        setDoubleParam(params[MEAS_P99],  1000.0 * stat.getPercentile(0.99));
+    }
+    setIntegerParam(m_params[MISSING], m_num_missing);
+
+    callParamCallbacks();
+}
+
+// iocsh registration of TRLatencyPluginConfigure.
+
+static const iocshArg initArg0 = {"portName", iocshArgString};
+static const iocshArg initArg1 = {"queueSize", iocshArgInt};
+static const iocshArg initArg2 = {"blockingCallbacks", iocshArgInt};
+static const iocshArg initArg3 = {"NDArrayPort", iocshArgString};
+static const iocshArg initArg4 = {"NDArrayAddr", iocshArgInt};
+static const iocshArg * const initArgs[] = {&initArg0, &initArg1, &initArg2, &initArg3, &initArg4};
+static const iocshFuncDef initFuncDef = {"TRLatencyPluginConfigure", 5, initArgs};
+
+static void initCallFunc (const iocshArgBuf *args)
+{
+    new TRLatencyPlugin(args[0].sval, args[1].ival, args[2].ival, args[3].sval, args[4].ival);
+}
+
+static void TRLatencyPluginRegister (void)
+{
+    iocshRegister(&initFuncDef, initCallFunc);
+}
+
+extern "C" {
+    epicsExportRegistrar(TRLatencyPluginRegister);
+}
@@ -0,0 +1,125 @@
+/* This file is part of the Transient Recorder Framework.
+ * It is subject to the license terms in the LICENSE.txt file found in the
+ * top-level directory of this distribution and at
+ * https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. No part
+ * of the Transient Recorder Framework, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ */
+
+/**
+ * @file
+ *
+ * Defines the TRLatencyPlugin class, an NDPlugin which measures
+ * end-to-end latency of channel data.
+ */
+
+#ifndef TRANSREC_LATENCY_PLUGIN_H
+#define TRANSREC_LATENCY_PLUGIN_H
+
+#include <stddef.h>
+
+#include <epicsTypes.h>
+
+#include <NDPluginDriver.h>
+
+#include "TRNonCopyable.h"
+#include "TRPerfStat.h"
+
+/**
+ * NDPlugin which records the latency of arriving channel data arrays.
+ *
+ * This plugin is meant to be connected to the channels port (or any
+ * other plugin in the pipeline) with the latency probe enabled for the
+ * channel (LATENCY_PROBE parameter of TRChannelsDriver). For each
+ * received array it measures the time from the trigger (TR_TRIGGER_TIME
+ * attribute) and the time from submission (TR_SUBMIT_TIME attribute) to
+ * arrival in this plugin. The latter is mostly time spent queued or in
+ * processing by plugins upstream.
+ *
+ * Both measurements provide the parameters TRLAT_<M>_COUNT, TRLAT_<M>_LAST,
+ * TRLAT_<M>_MIN, TRLAT_<M>_MEAN, TRLAT_<M>_MAX, TRLAT_<M>_P50,
+ * TRLAT_<M>_P90, TRLAT_<M>_P99 (milliseconds) and TRLAT_<M>_HISTOGRAM,
+ * where M is TRIGGER or SUBMIT. The histogram bucket bounds are provided
+ * by TRLAT_HISTOGRAM_BOUNDS. Arrays without the probe attributes are
+ * counted in TRLAT_MISSING. Writing TRLAT_RESET resets all statistics.
+ *
+ * The plugin is created using the iocsh command TRLatencyPluginConfigure
+ * (see TRLatencyPlugin.dbd).
+ */
+class TRLatencyPlugin : public NDPluginDriver,
+    private TRNonCopyable
+{
+public:
+    /**
+     * Constructor for the latency plugin.
+     *
+     * @param port_name The asyn port name of the plugin.
+     * @param queue_size Size of the input queue (for non-blocking callbacks).
+     * @param blocking_callbacks Whether to process arrays in the thread of
+     *                           the upstream port.
+     * @param ndarray_port The port name of the upstream port.
+     * @param ndarray_addr The address in the upstream port.
+     */
+    TRLatencyPlugin (char const *port_name, int queue_size, int blocking_callbacks,
+                     char const *ndarray_port, int ndarray_addr);
+
+    virtual void processCallbacks (NDArray *pArray);
+
+    virtual asynStatus writeInt32 (asynUser *pasynUser, epicsInt32 value);
+
+    virtual asynStatus readInt32Array (asynUser *pasynUser, epicsInt32 *value,
+                                       size_t nElements, size_t *nIn);
+
+    virtual asynStatus readFloat64Array (asynUser *pasynUser, epicsFloat64 *value,
+                                         size_t nElements, size_t *nIn);
+
+private:
+    // Measured latencies.
+    enum Measurement {
+        MeasTrigger,
+        MeasSubmit,
+        NumMeasurements
+    };
+
+    // Parameters of each measurement.
+    enum MeasParams {
+        MEAS_COUNT,
+        MEAS_LAST,
+        MEAS_MIN,
+        MEAS_MEAN,
+        MEAS_MAX,
+        MEAS_P50,
+        MEAS_P90,
+        MEAS_P99,
+        MEAS_HISTOGRAM,
+        NUM_MEAS_PARAMS
+    };
+
+    // Other parameters.
+    enum Params {
+        MISSING,
+        RESET,
+        HISTOGRAM_BOUNDS,
+        NUM_PARAMS
+    };
+
+    static int const NumPluginParams = NumMeasurements * NUM_MEAS_PARAMS + NUM_PARAMS;
+
+private:
+    int m_meas_params[NumMeasurements][NUM_MEAS_PARAMS];
+    int m_params[NUM_PARAMS];
+
+    // Statistics (protected by the port lock).
+    TRPerfStat m_stats[NumMeasurements];
+    int m_num_missing;
+
+private:
+    // Add a sample to a measurement if the attribute is present.
+    bool addLatency (NDArray *pArray, char const *attr_name, Measurement meas, double now);
+
+    // Update parameters of all measurements.
+    void updateParams ();
+};
+
+#endif
@@ -0,0 +1,235 @@
+/* This file is part of the Transient Recorder Framework.
+ * It is subject to the license terms in the LICENSE.txt file found in the
+ * top-level directory of this distribution and at
+ * https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. No part
+ * of the Transient Recorder Framework, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ */
+
+#include <cmath>
+#include <algorithm>
+
+#include <epicsAtomic.h>
+#include <epicsGuard.h>
+#include <epicsThread.h>
+
+#include "TRLoadInjectDriver.h"
+#include "TRPerfStat.h"
+
+TRLoadInjectDriver::TRLoadInjectDriver (std::string const &base_port_name)
+:   asynPortDriver(
+        (base_port_name + "_inject").c_str(),
+        TRNumInjectPoints, // maxAddr
+        NUM_PARAMS,
+        asynInt32Mask|asynFloat64Mask|asynDrvUserMask|TRInt64Mask, // interfaceMask
+        asynInt32Mask|asynFloat64Mask|TRInt64Mask, // interruptMask
+        ASYN_MULTIDEVICE, // asynFlags (no ASYN_CANBLOCK - we don't block)
+        1, // autoConnect
+        0, // priority (ignored with no ASYN_CANBLOCK)
+        0  // stackSize (ignored witn no ASYN_CANBLOCK)
+    ),
+    m_enabled_mask(0)
+{
+    createParam("INJECT_MODE",   asynParamInt32,   &m_params[MODE]);
+    createParam("INJECT_DIST",   asynParamInt32,   &m_params[DIST]);
+    createParam("INJECT_TIME",   asynParamFloat64, &m_params[TIME]);
+    createParam("INJECT_SPREAD", asynParamFloat64, &m_params[SPREAD]);
+    createParam("INJECT_PROB",   asynParamFloat64, &m_params[PROB]);
+    createParam("INJECT_SEED",   asynParamInt32,   &m_params[SEED]);
+    createParam("INJECT_COUNT",  TRInt64ParamType, &m_params[COUNT]);
+    createParam("INJECT_TOTAL",  asynParamFloat64, &m_params[TOTAL]);
+
+    for (int i = 0; i < TRNumInjectPoints; i++) {
+        setIntegerParam(i, m_params[MODE],   TRInjectModeOff);
+        setIntegerParam(i, m_params[DIST],   TRInjectDistFixed);
+        setDoubleParam(i,  m_params[TIME],   0.0);
+        setDoubleParam(i,  m_params[SPREAD], 0.0);
+        setDoubleParam(i,  m_params[PROB],   1.0);
+        setIntegerParam(i, m_params[SEED],   1);
+        m_count[i] = 0;
+        m_total[i] = 0.0;
+    }
+}
+
+#if TR_HAVE_ASYN_INT64
+asynStatus TRLoadInjectDriver::readInt64 (asynUser *pasynUser, epicsInt64 *value)
+{
+    if (pasynUser->reason == m_params[COUNT]) {
+        int addr;
+        getAddress(pasynUser, &addr);
+        if (addr < 0 || addr >= TRNumInjectPoints) {
+            return asynError;
+        }
+        *value = (epicsInt64)m_count[addr];
+        return asynSuccess;
+    }
+
+    // Delegate to base class.
+    return asynPortDriver::readInt64(pasynUser, value);
+}
+#endif
+
+asynStatus TRLoadInjectDriver::readFloat64 (asynUser *pasynUser, epicsFloat64 *value)
+{
+#if !TR_HAVE_ASYN_INT64
+    // Without 64-bit integer parameters, the count is a double.
+    if (pasynUser->reason == m_params[COUNT]) {
+        int addr;
+        getAddress(pasynUser, &addr);
+        if (addr < 0 || addr >= TRNumInjectPoints) {
+            return asynError;
+        }
+        *value = (double)m_count[addr];
+        return asynSuccess;
+    }
+#endif
+
+    if (pasynUser->reason == m_params[TOTAL]) {
+        int addr;
+        getAddress(pasynUser, &addr);
+        if (addr < 0 || addr >= TRNumInjectPoints) {
+            return asynError;
+        }
+        // Delays are kept in seconds but exposed in milliseconds.
+        *value = 1000.0 * m_total[addr];
+        return asynSuccess;
+    }
+
+    // Delegate to base class.
+    return asynPortDriver::readFloat64(pasynUser, value);
+}
+
+asynStatus TRLoadInjectDriver::writeInt32 (asynUser *pasynUser, epicsInt32 value)
+{
+    int reason = pasynUser->reason;
+
+    // Counters are read-only.
+    if (reason == m_params[COUNT]) {
+        return asynError;
+    }
+
+    // Failures can only be injected where the caller handles them.
+    if (reason == m_params[MODE] && value == TRInjectModeFail) {
+        int addr;
+        getAddress(pasynUser, &addr);
+        if (addr != TRInjectPointAlloc) {
+            return asynError;
+        }
+    }
+
+    asynStatus status = asynPortDriver::writeInt32(pasynUser, value);
+
+    // Maintain the mask of enabled points for the fast path.
+    if (status == asynSuccess && reason == m_params[MODE]) {
+        int mask = 0;
+        for (int i = 0; i < TRNumInjectPoints; i++) {
+            int mode;
+            getIntegerParam(i, m_params[MODE], &mode);
+            if (mode != TRInjectModeOff) {
+                mask |= 1 << i;
+            }
+        }
+        epicsAtomicSetIntT(&m_enabled_mask, mask);
+    }
+
+    return status;
+}
+
+bool TRLoadInjectDriver::inject (TRInjectPoint point, asynPortDriver &port, asynPortDriver *channels_port)
+{
+    if ((epicsAtomicGetIntT(&m_enabled_mask) & (1 << point)) == 0) {
+        return true;
+    }
+
+    int mode;
+    double delay = 0.0;
+    {
+        epicsGuard<asynPortDriver> lock(*this);
+
+        int dist;
+        double time;
+        double spread;
+        double prob;
+        getIntegerParam(point, m_params[MODE],   &mode);
+        getIntegerParam(point, m_params[DIST],   &dist);
+        getDoubleParam(point,  m_params[TIME],   &time);
+        getDoubleParam(point,  m_params[SPREAD], &spread);
+        getDoubleParam(point,  m_params[PROB],   &prob);
+
+        TRRandom &random = m_random[point];
+        if (mode == TRInjectModeOff || (mode == TRInjectModeFail && point != TRInjectPointAlloc) ||
+            (prob < 1.0 && !(random.uniform() < prob)))
+        {
+            return true;
+        }
+
+        // Settings are in milliseconds.
+        time /= 1000.0;
+        spread /= 1000.0;
+
+        switch (dist) {
+            case TRInjectDistUniform:
+                delay = time + spread * (2.0 * random.uniform() - 1.0);
+                break;
+            case TRInjectDistExponential:
+                delay = random.exponential(time);
+                break;
+            case TRInjectDistNormal:
+                delay = random.normal(time, spread);
+                break;
+            default:
+                delay = time;
+                break;
+        }
+        if (!(delay > 0.0) || mode == TRInjectModeFail) {
+            delay = 0.0;
+        }
+
+        m_count[point]++;
+        m_total[point] += delay;
+    }
+
+    switch (mode) {
+        case TRInjectModeSleep:
+            if (delay > 0.0) {
+                epicsThreadSleep(delay);
+            }
+            break;
+        case TRInjectModeBurn: {
+            double end = TRPerfClock::now() + delay;
+            while (TRPerfClock::now() < end) {
+                // Busy-wait to occupy the CPU for the delay.
+            }
+        } break;
+        case TRInjectModeHoldPortLock: {
+            epicsGuard<asynPortDriver> lock(port);
+            epicsThreadSleep(delay);
+        } break;
+        case TRInjectModeHoldChannelsLock:
+            if (channels_port != NULL) {
+                epicsGuard<asynPortDriver> lock(*channels_port);
+                epicsThreadSleep(delay);
+            }
+            break;
+        case TRInjectModeFail:
+            return false;
+        default:
+            break;
+    }
+
+    return true;
+}
+
+void TRLoadInjectDriver::resetArmingStats ()
+{
+    epicsGuard<asynPortDriver> lock(*this);
+
+    for (int i = 0; i < TRNumInjectPoints; i++) {
+        int seed;
+        getIntegerParam(i, m_params[SEED], &seed);
+        m_random[i].seed((epicsUInt64)(epicsUInt32)seed + (epicsUInt64)i * 1000003);
+        m_count[i] = 0;
+        m_total[i] = 0.0;
+    }
+}
@@ -0,0 +1,169 @@
+/* This file is part of the Transient Recorder Framework.
+ * It is subject to the license terms in the LICENSE.txt file found in the
+ * top-level directory of this distribution and at
+ * https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. No part
+ * of the Transient Recorder Framework, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ */
+
+/**
+ * @file
+ *
+ * Defines the TRLoadInjectDriver class, used for injecting synthetic load
+ * into the data path for testing.
+ */
+
+#ifndef TRANSREC_LOAD_INJECT_DRIVER_H
+#define TRANSREC_LOAD_INJECT_DRIVER_H
+
+#include <string>
+
+#include <epicsTypes.h>
+
+#include <asynPortDriver.h>
+
+#include "TRInt64Param.h"
+#include "TRNonCopyable.h"
+#include "TRRandom.h"
+
+class TRBaseDriver;
+
+/**
+ * Points in the data path where load can be injected.
+ *
+ * The enumeration value is the asyn address of the injection point in the
+ * load injection port (see TRLoadInjectDriver). All points are reached with
+ * no port locked.
+ *
+ * - Read: after TRBaseDriver::readBurst (included in its timing).
+ * - Process: after TRBaseDriver::processBurstData (included in its timing).
+ * - Submit: at the start of TRChannelDataSubmit::submit, for each array.
+ * - Alloc: at the start of TRChannelDataSubmit::allocateArray, for each array.
+ * - Callback: before the NDArray callbacks to plugins, for each array.
+ * - AfterBurst: in TRBaseDriver::maybeSleepForTesting, after each burst.
+ */
+enum TRInjectPoint {
+    TRInjectPointRead,
+    TRInjectPointProcess,
+    TRInjectPointSubmit,
+    TRInjectPointAlloc,
+    TRInjectPointCallback,
+    TRInjectPointAfterBurst,
+    TRNumInjectPoints
+};
+
+/**
+ * What is injected at an injection point (INJECT_MODE).
+ *
+ * - Off: nothing.
+ * - Sleep: the thread sleeps for the delay.
+ * - Burn: the thread busy-waits for the delay (CPU contention).
+ * - HoldPortLock: the thread holds the lock of the main port for the delay.
+ * - HoldChannelsLock: the thread holds the lock of the channels port for
+ *   the delay.
+ * - Fail: the operation fails; only supported at the Alloc point, where
+ *   the array is not allocated (the same as when the pool is exhausted).
+ *   Writing this mode for other points is rejected.
+ */
+enum TRInjectMode {
+    TRInjectModeOff,
+    TRInjectModeSleep,
+    TRInjectModeBurn,
+    TRInjectModeHoldPortLock,
+    TRInjectModeHoldChannelsLock,
+    TRInjectModeFail
+};
+
+/**
+ * Distribution of injected delays (INJECT_DIST).
+ *
+ * - Fixed: INJECT_TIME.
+ * - Uniform: uniform within INJECT_TIME +/- INJECT_SPREAD.
+ * - Exponential: exponential with mean INJECT_TIME (INJECT_SPREAD is not used).
+ * - Normal: normal with mean INJECT_TIME and standard deviation INJECT_SPREAD.
+ *
+ * Negative delays are treated as zero.
+ */
+enum TRInjectDist {
+    TRInjectDistFixed,
+    TRInjectDistUniform,
+    TRInjectDistExponential,
+    TRInjectDistNormal
+};
+
+/**
+ * Asyn port for injecting synthetic load into the data path, for testing
+ * the behavior under load (buffer overflows, dropped arrays, deadline misses).
+ *
+ * The port is only created if TRBaseConfig::load_injection is set, and is
+ * named as the base port with the suffix `_inject`.
+ * It is a multi-device port where each address corresponds to an injection
+ * point (see @ref TRInjectPoint). Each address provides the parameters:
+ * - INJECT_MODE: what is injected (@ref TRInjectMode, default Off).
+ * - INJECT_DIST: distribution of delays (@ref TRInjectDist, default Fixed).
+ * - INJECT_TIME, INJECT_SPREAD: parameters of the distribution (ms).
+ * - INJECT_PROB: probability of injecting at each occurrence (default 1).
+ * - INJECT_SEED: seed of the pseudo-random generator of the point, which
+ *   is reseeded at the start of each arming so that runs are repeatable.
+ * - INJECT_COUNT, INJECT_TOTAL (readback): the number of injections and the
+ *   total injected delay (ms) since the start of the arming. Values are
+ *   computed when the parameters are read, so records should be scanned.
+ *   INJECT_COUNT is a 64-bit parameter (see TRInt64Param.h).
+ *
+ * Settings take effect immediately, also while armed. When no injection
+ * point is enabled the overhead in the data path is a single atomic read.
+ */
+class TRLoadInjectDriver : public asynPortDriver,
+    private TRNonCopyable
+{
+    friend class TRBaseDriver;
+
+    // Enumeration of asyn parameters.
+    enum Params {
+        MODE,
+        DIST,
+        TIME,
+        SPREAD,
+        PROB,
+        SEED,
+        COUNT,
+        TOTAL,
+        NUM_PARAMS
+    };
+
+private:
+    int m_params[NUM_PARAMS];
+
+    // Bit mask of injection points with a mode other than Off
+    // (accessed atomically).
+    int m_enabled_mask;
+
+    // State of injection points (protected by the port lock).
+    TRRandom m_random[TRNumInjectPoints];
+    epicsUInt64 m_count[TRNumInjectPoints];
+    double m_total[TRNumInjectPoints];
+
+public:
+    TRLoadInjectDriver (std::string const &base_port_name);
+
+#if TR_HAVE_ASYN_INT64
+    virtual asynStatus readInt64 (asynUser *pasynUser, epicsInt64 *value);
+#endif
+
+    virtual asynStatus readFloat64 (asynUser *pasynUser, epicsFloat64 *value);
+
+    virtual asynStatus writeInt32 (asynUser *pasynUser, epicsInt32 value);
+
+private:
+    // The follwing functions are for internal use by Transient Recorder framework.
+
+    // Inject load at a point, if enabled. Must be called with no port locked.
+    // Returns false if a failure was injected (only at the Alloc point).
+    bool inject (TRInjectPoint point, asynPortDriver &port, asynPortDriver *channels_port);
+
+    // Reseed the generators and reset the counters (called at the start of arming).
+    void resetArmingStats ();
+};
+
+#endif
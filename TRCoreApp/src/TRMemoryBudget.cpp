@@ -0,0 +1,305 @@
+/* This file is part of the Transient Recorder Framework.
+ * It is subject to the license terms in the LICENSE.txt file found in the
+ * top-level directory of this distribution and at
+ * https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. No part
+ * of the Transient Recorder Framework, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <list>
+
+#include <epicsAssert.h>
+#include <epicsMutex.h>
+#include <epicsGuard.h>
+#include <epicsThread.h>
+#include <errlog.h>
+#include <iocsh.h>
+
+#include <epicsExport.h>
+
+#include "TRMemoryBudget.h"
+
+// Global state of the budget, created on first use.
+struct TRMemoryBudgetState {
+    epicsMutex mutex;
+    bool configured;
+    bool pools_initialized;
+    size_t total_size;
+    size_t total_reserved;
+    std::list<TRMemoryBudget *> pools;
+
+    TRMemoryBudgetState ()
+    : configured(false),
+      pools_initialized(false),
+      total_size(0),
+      total_reserved(0)
+    {
+    }
+
+    // Memory committed to a pool, which cannot be borrowed by others.
+    static size_t committed (TRMemoryBudget const *pool)
+    {
+        return std::max(pool->m_used, pool->m_reservation);
+    }
+};
+
+static epicsThreadOnceId s_state_once = EPICS_THREAD_ONCE_INIT;
+static TRMemoryBudgetState *s_state;
+
+static void createState (void *)
+{
+    s_state = new TRMemoryBudgetState();
+}
+
+static TRMemoryBudgetState & getState ()
+{
+    epicsThreadOnce(&s_state_once, createState, NULL);
+    return *s_state;
+}
+
+bool TRMemoryBudget::configure (size_t total_size)
+{
+    TRMemoryBudgetState &state = getState();
+    epicsGuard<epicsMutex> lock(state.mutex);
+
+    if (state.configured) {
+        errlogSevPrintf(errlogMajor, "TRMemoryBudget Error: The budget is already configured.\n");
+        return false;
+    }
+
+    if (state.pools_initialized) {
+        errlogSevPrintf(errlogMajor, "TRMemoryBudget Error: The budget must be configured before drivers are initialized.\n");
+        return false;
+    }
+
+    state.configured = true;
+    state.total_size = total_size;
+    return true;
+}
+
+void TRMemoryBudget::report (FILE *fp)
+{
+    TRMemoryBudgetState &state = getState();
+    epicsGuard<epicsMutex> lock(state.mutex);
+
+    if (!state.configured) {
+        fprintf(fp, "TRMemoryBudget: not configured\n");
+        return;
+    }
+
+    size_t total_used = 0;
+    for (std::list<TRMemoryBudget *>::iterator it = state.pools.begin(); it != state.pools.end(); ++it) {
+        total_used += (*it)->m_used;
+    }
+
+    fprintf(fp, "TRMemoryBudget: total %.3f MB, reserved %.3f MB, used %.3f MB\n",
+        state.total_size / 1e6, state.total_reserved / 1e6, total_used / 1e6);
+    fprintf(fp, "  %-24s %12s %12s %12s %8s\n", "pool", "reserved MB", "used MB", "peak MB", "denied");
+
+    for (std::list<TRMemoryBudget *>::iterator it = state.pools.begin(); it != state.pools.end(); ++it) {
+        TRMemoryBudget const *pool = *it;
+        fprintf(fp, "  %-24s %12.3f %12.3f %12.3f %8d\n", pool->m_name.c_str(),
+            pool->m_reservation / 1e6, pool->m_used / 1e6, pool->m_peak_used / 1e6,
+            pool->m_num_denied);
+    }
+}
+
+void TRMemoryBudget::getTotals (size_t *total_size, size_t *total_used)
+{
+    TRMemoryBudgetState &state = getState();
+    epicsGuard<epicsMutex> lock(state.mutex);
+
+    *total_size = state.total_size;
+    *total_used = 0;
+    for (std::list<TRMemoryBudget *>::iterator it = state.pools.begin(); it != state.pools.end(); ++it) {
+        *total_used += (*it)->m_used;
+    }
+}
+
+TRMemoryBudget::TRMemoryBudget ()
+: m_registered(false),
+  m_reservation(0),
+  m_used(0),
+  m_peak_used(0),
+  m_num_denied(0),
+  m_reclaim_requested(false)
+{
+}
+
+TRMemoryBudget::~TRMemoryBudget ()
+{
+    if (m_registered) {
+        TRMemoryBudgetState &state = getState();
+        epicsGuard<epicsMutex> lock(state.mutex);
+
+        state.total_reserved -= m_reservation;
+        state.pools.remove(this);
+    }
+}
+
+void TRMemoryBudget::init (std::string const &name, size_t reservation)
+{
+    TRMemoryBudgetState &state = getState();
+    epicsGuard<epicsMutex> lock(state.mutex);
+
+    assert(!m_registered);
+
+    state.pools_initialized = true;
+
+    if (!state.configured) {
+        return;
+    }
+
+    size_t available = state.total_size - state.total_reserved;
+    if (reservation > available) {
+        errlogSevPrintf(errlogMajor, "TRMemoryBudget Error: Reservation of %.3f MB for %s reduced to %.3f MB which remains in the budget.\n",
+            reservation / 1e6, name.c_str(), available / 1e6);
+        reservation = available;
+    }
+
+    m_registered = true;
+    m_name = name;
+    m_reservation = reservation;
+    state.total_reserved += reservation;
+    state.pools.push_back(this);
+}
+
+bool TRMemoryBudget::requestGrowth (size_t used, size_t growth)
+{
+    if (!m_registered) {
+        return true;
+    }
+
+    TRMemoryBudgetState &state = getState();
+    epicsGuard<epicsMutex> lock(state.mutex);
+
+    m_used = used;
+
+    // Growth within the reservation is always granted, otherwise it must
+    // fit into the memory not committed to other pools.
+    bool granted = (growth == 0);
+    if (!granted && growth <= state.total_size && used <= state.total_size - growth) {
+        size_t new_used = used + growth;
+
+        size_t committed_others = 0;
+        for (std::list<TRMemoryBudget *>::iterator it = state.pools.begin(); it != state.pools.end(); ++it) {
+            if (*it != this) {
+                committed_others += TRMemoryBudgetState::committed(*it);
+            }
+        }
+
+        granted = new_used <= m_reservation || committed_others <= state.total_size - new_used;
+    }
+
+    if (granted) {
+        m_used += growth;
+        m_peak_used = std::max(m_peak_used, m_used);
+        return true;
+    }
+
+    // Ask pools which borrow more than a fair share of the unreserved
+    // memory to release cached arrays.
+    size_t num_borrowing = 1;
+    for (std::list<TRMemoryBudget *>::iterator it = state.pools.begin(); it != state.pools.end(); ++it) {
+        if (*it != this && (*it)->m_used > (*it)->m_reservation) {
+            num_borrowing++;
+        }
+    }
+    size_t fair_share = (state.total_size - state.total_reserved) / num_borrowing;
+
+    for (std::list<TRMemoryBudget *>::iterator it = state.pools.begin(); it != state.pools.end(); ++it) {
+        TRMemoryBudget *pool = *it;
+        if (pool != this && pool->m_used > pool->m_reservation &&
+            pool->m_used - pool->m_reservation > fair_share)
+        {
+            pool->m_reclaim_requested = true;
+        }
+    }
+
+    return false;
+}
+
+void TRMemoryBudget::setUsed (size_t used)
+{
+    if (!m_registered) {
+        return;
+    }
+
+    TRMemoryBudgetState &state = getState();
+    epicsGuard<epicsMutex> lock(state.mutex);
+
+    m_used = used;
+    m_peak_used = std::max(m_peak_used, m_used);
+}
+
+void TRMemoryBudget::countDenied ()
+{
+    if (!m_registered) {
+        return;
+    }
+
+    TRMemoryBudgetState &state = getState();
+    epicsGuard<epicsMutex> lock(state.mutex);
+
+    m_num_denied++;
+}
+
+bool TRMemoryBudget::takeReclaimRequest ()
+{
+    if (!m_registered) {
+        return false;
+    }
+
+    TRMemoryBudgetState &state = getState();
+    epicsGuard<epicsMutex> lock(state.mutex);
+
+    bool requested = m_reclaim_requested;
+    m_reclaim_requested = false;
+    return requested;
+}
+
+int TRMemoryBudget::getNumDenied ()
+{
+    TRMemoryBudgetState &state = getState();
+    epicsGuard<epicsMutex> lock(state.mutex);
+
+    return m_num_denied;
+}
+
+// iocsh registration of TRMemoryBudgetConfigure and TRMemoryBudgetReport.
+
+static const iocshArg configureArg0 = {"total memory (MB)", iocshArgDouble};
+static const iocshArg * const configureArgs[] = {&configureArg0};
+static const iocshFuncDef configureFuncDef = {"TRMemoryBudgetConfigure", 1, configureArgs};
+
+static void configureCallFunc (const iocshArgBuf *args)
+{
+    double total_mb = args[0].dval;
+    if (!(total_mb > 0.0)) {
+        errlogSevPrintf(errlogMajor, "TRMemoryBudget Error: The total memory must be positive.\n");
+        return;
+    }
+    TRMemoryBudget::configure((size_t)(total_mb * 1e6));
+}
+
+static const iocshFuncDef reportFuncDef = {"TRMemoryBudgetReport", 0, NULL};
+
+static void reportCallFunc (const iocshArgBuf *args)
+{
+    TRMemoryBudget::report(stdout);
+}
+
+static void TRMemoryBudgetRegister (void)
+{
+    iocshRegister(&configureFuncDef, configureCallFunc);
+    iocshRegister(&reportFuncDef, reportCallFunc);
+}
+
+extern "C" {
+    epicsExportRegistrar(TRMemoryBudgetRegister);
+}
@@ -0,0 +1,153 @@
+/* This file is part of the Transient Recorder Framework.
+ * It is subject to the license terms in the LICENSE.txt file found in the
+ * top-level directory of this distribution and at
+ * https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. No part
+ * of the Transient Recorder Framework, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ */
+
+/**
+ * @file
+ *
+ * Defines the TRMemoryBudget class, which implements an optional NDArray
+ * memory budget shared by all drivers in the IOC.
+ */
+
+#ifndef TRANSREC_MEMORY_BUDGET_H
+#define TRANSREC_MEMORY_BUDGET_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include <string>
+
+#include "TRNonCopyable.h"
+
+/**
+ * Participation of one NDArray pool in the global memory budget.
+ *
+ * The global budget is enabled by calling @ref configure (iocsh command
+ * `TRMemoryBudgetConfigure`) before drivers are initialized. Each
+ * TRChannelsDriver then registers its NDArray pool, with the minimum
+ * reservation from TRBaseConfig::ad_memory_reservation, and requests
+ * permission before an allocation may grow the pool. If a cached array
+ * is reused, growth due to reallocating a too small buffer is only known
+ * after the allocation, which then fails if the growth is denied.
+ *
+ * The rules are:
+ * - A pool may always grow up to its reservation, since the sum of
+ *   reservations cannot exceed the budget.
+ * - Beyond its reservation, a pool may borrow any memory which is neither
+ *   reserved by nor borrowed by other pools. Therefore a busy pool can use
+ *   the memory of idle ones, but reservations remain guaranteed.
+ * - When a request is denied, pools borrowing more than a fair share of
+ *   the unreserved memory (divided equally between the borrowing pools
+ *   including the denied one) are asked to release their cached arrays
+ *   (see @ref takeReclaimRequest).
+ *
+ * Memory use of a pool is the memory allocated by the NDArray pool
+ * (including cached arrays), as reported by the pool.
+ *
+ * If the budget is not configured, all requests are granted.
+ *
+ * All functions are thread-safe.
+ */
+class TRMemoryBudget :
+    private TRNonCopyable
+{
+public:
+    /**
+     * Enable the global budget.
+     *
+     * This must be called before any driver is initialized and only once.
+     *
+     * @param total_size The total memory of all pools (bytes).
+     * @return True on success, false on error (which is logged).
+     */
+    static bool configure (size_t total_size);
+
+    /**
+     * Print the state of the budget and all pools.
+     *
+     * @param fp File to print to.
+     */
+    static void report (FILE *fp);
+
+    /**
+     * Default constructor, the object does not participate in the budget
+     * until @ref init is called.
+     */
+    TRMemoryBudget ();
+
+    /**
+     * Destructor, releases the reservation.
+     */
+    ~TRMemoryBudget ();
+
+    /**
+     * Register the pool with the budget, if it is configured.
+     *
+     * @param name Name for reporting (e.g. the port name).
+     * @param reservation Minimum memory reserved for the pool (bytes).
+     *                    If it does not fit into the budget it is reduced
+     *                    (and an error is logged).
+     */
+    void init (std::string const &name, size_t reservation);
+
+    /**
+     * Request permission to grow the pool.
+     *
+     * If granted, the growth is counted as used until the next call of
+     * @ref setUsed (or this function), so that concurrent requests from
+     * other pools take it into account.
+     *
+     * @param used Current memory use of the pool (bytes).
+     * @param growth Maximum growth caused by the allocation (bytes).
+     * @return Whether the allocation may proceed.
+     */
+    bool requestGrowth (size_t used, size_t growth);
+
+    /**
+     * Update the memory use of the pool, after an allocation or after
+     * cached arrays were freed.
+     *
+     * @param used Current memory use of the pool (bytes).
+     */
+    void setUsed (size_t used);
+
+    /**
+     * Count an allocation which failed because requests were denied.
+     */
+    void countDenied ();
+
+    /**
+     * Return whether cached arrays should be released in favor of other
+     * pools, and clear the request.
+     */
+    bool takeReclaimRequest ();
+
+    /**
+     * Return the number of allocations counted by @ref countDenied.
+     */
+    int getNumDenied ();
+
+    /**
+     * Get the total size of the budget and the memory used by all pools
+     * (bytes). Both are zero if the budget is not configured.
+     */
+    static void getTotals (size_t *total_size, size_t *total_used);
+
+private:
+    friend struct TRMemoryBudgetState;
+
+    bool m_registered;
+    std::string m_name;
+    size_t m_reservation;
+    size_t m_used;
+    size_t m_peak_used;
+    int m_num_denied;
+    bool m_reclaim_requested;
+};
+
+#endif
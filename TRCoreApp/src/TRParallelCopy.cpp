@@ -0,0 +1,256 @@
+/* This file is part of the Transient Recorder Framework.
+ * It is subject to the license terms in the LICENSE.txt file found in the
+ * top-level directory of this distribution and at
+ * https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. No part
+ * of the Transient Recorder Framework, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+
+#include <algorithm>
+
+#include <epicsGuard.h>
+#include <epicsAtomic.h>
+#include <epicsAssert.h>
+
+#include "TRParallelCopy.h"
+#include "TRKernels.h"
+#include "TRAllocAudit.h"
+
+// Parts are multiples of this many bytes of output, so that threads do not
+// write to the same cache lines.
+static size_t const PartAlignment = 64;
+
+// Helper thread which processes one part of each job.
+class TRParallelCopy::Helper :
+    private TRNonCopyable,
+    private epicsThreadRunable
+{
+public:
+    Helper (TRParallelCopy &owner, int part, std::string const &name, unsigned int priority)
+    : m_owner(owner),
+      m_part(part),
+      m_stop(false),
+      m_thread(*this, name.c_str(), epicsThreadGetStackSize(epicsThreadStackMedium), priority)
+    {
+        m_thread.start();
+    }
+
+    ~Helper ()
+    {
+        m_stop = true;
+        m_start_event.signal();
+        m_thread.exitWait();
+    }
+
+    void startPart ()
+    {
+        m_start_event.signal();
+    }
+
+private:
+    TRParallelCopy &m_owner;
+    int m_part;
+    bool m_stop;
+    epicsEvent m_start_event;
+    epicsThread m_thread;
+
+    void run ()
+    {
+        // Parts are processed on behalf of the read thread.
+        TRAllocAudit::setWorkerThread();
+
+        while (true) {
+            m_start_event.wait();
+            if (m_stop) {
+                break;
+            }
+            m_owner.runPart(m_part);
+            m_owner.partDone();
+        }
+    }
+};
+
+TRParallelCopy::TRParallelCopy (std::string const &name_suffix, int num_threads, unsigned int priority)
+: m_job_type(JobCopy),
+  m_job_dst(NULL),
+  m_job_src(NULL),
+  m_job_count(0),
+  m_job_part_count(0),
+  m_job_scale(0.0),
+  m_job_offset(0.0),
+  m_job_task(NULL),
+  m_job_next_item(0),
+  m_parts_remaining(0)
+{
+    // Part 0 is done by the calling thread, helpers do the following parts.
+    m_helpers.reserve(num_threads);
+    for (int i = 0; i < num_threads; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "TRcopy%d:", i);
+        m_helpers.push_back(new Helper(*this, i + 1, name + name_suffix, priority));
+    }
+}
+
+TRParallelCopy::~TRParallelCopy ()
+{
+    for (size_t i = 0; i < m_helpers.size(); i++) {
+        delete m_helpers[i];
+    }
+}
+
+void TRParallelCopy::copy (void *dst, void const *src, size_t size)
+{
+    if (size < NonTemporalThreshold) {
+        memcpy(dst, src, size);
+        return;
+    }
+
+    // Copy in this thread without locking if the copy would not be split,
+    // or if the helpers are busy with a job of another thread (e.g. another
+    // read stream), so that concurrent copies are not serialized.
+    if (size < ParallelThreshold || m_helpers.empty() || !m_job_mutex.tryLock()) {
+        TRKernels::copyNonTemporal(dst, src, size);
+        return;
+    }
+
+    m_job_dst = dst;
+    m_job_src = src;
+    runJob(JobCopy, size, PartAlignment);
+
+    m_job_mutex.unlock();
+}
+
+void TRParallelCopy::convertInt16ToFloat64 (epicsInt16 const *in, double *out, size_t count,
+                                            double scale, double offset)
+{
+    if (count * sizeof(double) < ParallelThreshold || m_helpers.empty() || !m_job_mutex.tryLock()) {
+        TRKernels::convertInt16ToFloat64(in, out, count, scale, offset);
+        return;
+    }
+
+    m_job_dst = out;
+    m_job_src = in;
+    m_job_scale = scale;
+    m_job_offset = offset;
+    runJob(JobConvert, count, PartAlignment / sizeof(double));
+
+    m_job_mutex.unlock();
+}
+
+void TRParallelCopy::run (TRParallelTask &task, int num_items)
+{
+    // Without helpers, or if they are busy with a job of another thread,
+    // just run the items in order.
+    if (m_helpers.empty() || num_items <= 1 || !m_job_mutex.tryLock()) {
+        for (int item = 0; item < num_items; item++) {
+            task.runParallelItem(item);
+        }
+        return;
+    }
+
+    m_job_task = &task;
+    epicsAtomicSetIntT(&m_job_next_item, 0);
+    runJob(JobTask, (size_t)num_items, 1);
+    m_job_task = NULL;
+
+    m_job_mutex.unlock();
+}
+
+void TRParallelCopy::runJob (JobType type, size_t count, size_t granularity)
+{
+    m_job_type = type;
+    m_job_count = count;
+
+    // Determine the number of parts, the output must be large enough
+    // for splitting to be worthwhile. Items of tasks are taken by parts
+    // dynamically, so there is no need for more parts than items.
+    int num_parts;
+    if (type == JobTask) {
+        num_parts = (int)std::min(count, m_helpers.size() + 1);
+    } else {
+        size_t output_size = (type == JobCopy) ? count : (count * sizeof(double));
+        num_parts = (output_size < ParallelThreshold) ? 1 : (int)(m_helpers.size() + 1);
+    }
+
+    // Determine the part size, rounded up to the granularity.
+    size_t part_count = (count + num_parts - 1) / num_parts;
+    part_count = (part_count + granularity - 1) / granularity * granularity;
+    m_job_part_count = part_count;
+
+    // Start the helpers.
+    {
+        epicsGuard<epicsMutex> lock(m_mutex);
+        m_parts_remaining = num_parts - 1;
+    }
+    m_done_event.tryWait();
+    for (int part = 1; part < num_parts; part++) {
+        m_helpers[part - 1]->startPart();
+    }
+
+    // Process the first part in this thread.
+    runPart(0);
+
+    // Wait for the helpers.
+    while (true) {
+        {
+            epicsGuard<epicsMutex> lock(m_mutex);
+            if (m_parts_remaining == 0) {
+                break;
+            }
+        }
+        m_done_event.wait();
+    }
+}
+
+void TRParallelCopy::runPart (int part)
+{
+    // Items of tasks are not bound to parts, take the next item until
+    // there are none left.
+    if (m_job_type == JobTask) {
+        while (true) {
+            int item = epicsAtomicIncrIntT(&m_job_next_item) - 1;
+            if (item >= (int)m_job_count) {
+                break;
+            }
+            m_job_task->runParallelItem(item);
+        }
+        return;
+    }
+
+    size_t start = part * m_job_part_count;
+    if (start >= m_job_count) {
+        return;
+    }
+    size_t count = m_job_count - start;
+    if (count > m_job_part_count) {
+        count = m_job_part_count;
+    }
+
+    if (m_job_type == JobCopy) {
+        TRKernels::copyNonTemporal((char *)m_job_dst + start, (char const *)m_job_src + start, count);
+    } else {
+        TRKernels::convertInt16ToFloat64((epicsInt16 const *)m_job_src + start,
+                                         (double *)m_job_dst + start, count,
+                                         m_job_scale, m_job_offset);
+    }
+}
+
+void TRParallelCopy::partDone ()
+{
+    bool all_done;
+    {
+        epicsGuard<epicsMutex> lock(m_mutex);
+        assert(m_parts_remaining > 0);
+        m_parts_remaining--;
+        all_done = (m_parts_remaining == 0);
+    }
+
+    if (all_done) {
+        m_done_event.signal();
+    }
+}
@@ -0,0 +1,175 @@
+/* This file is part of the Transient Recorder Framework.
+ * It is subject to the license terms in the LICENSE.txt file found in the
+ * top-level directory of this distribution and at
+ * https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. No part
+ * of the Transient Recorder Framework, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ */
+
+/**
+ * @file
+ *
+ * Defines the TRParallelCopy class, which copies and converts large
+ * amounts of data using multiple threads.
+ */
+
+#ifndef TRANSREC_PARALLEL_COPY_H
+#define TRANSREC_PARALLEL_COPY_H
+
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+#include <epicsTypes.h>
+#include <epicsMutex.h>
+#include <epicsEvent.h>
+#include <epicsThread.h>
+
+#include "TRNonCopyable.h"
+
+/**
+ * Interface for work which can be split into independent items, for
+ * running on the helper threads of TRParallelCopy (see TRParallelCopy::run).
+ */
+class TRParallelTask {
+public:
+    /**
+     * Process one item of the work.
+     *
+     * This is called concurrently for different items, from the thread
+     * which called TRParallelCopy::run and from helper threads.
+     *
+     * @param item The item (0 to num_items-1).
+     */
+    virtual void runParallelItem (int item) = 0;
+};
+
+/**
+ * Copy and conversion of large data blocks, such as burst data from DMA
+ * buffers into NDArrays.
+ *
+ * The strategy is chosen by the size of the data:
+ * - Below NonTemporalThreshold, a plain memcpy is used (conversions are
+ *   always done with normal stores).
+ * - From NonTemporalThreshold, non-temporal stores are used for copying
+ *   (TRKernels::copyNonTemporal), so that the data does not evict the
+ *   working set of the read thread from the cache.
+ * - From ParallelThreshold, if there are helper threads, the data is split
+ *   into equal parts which are processed concurrently by the calling thread
+ *   and the helper threads.
+ *
+ * The helper threads can also run other work which is split into independent
+ * items (see @ref run), such as the processing graph of channels.
+ *
+ * The functions block until all parts are done. The helper threads work on
+ * one job at a time; a call made while they are busy with a call from
+ * another thread does the work in the calling thread alone, rather than
+ * waiting. No memory is allocated after construction.
+ *
+ * An instance with the number of helper threads from
+ * TRBaseConfig::num_copy_threads is owned by TRBaseDriver (see
+ * TRBaseDriver::getParallelCopy and TRChannelDataSubmit::copyData).
+ */
+class TRParallelCopy :
+    private TRNonCopyable
+{
+public:
+    /**
+     * Size in bytes from which non-temporal stores are used for copying.
+     */
+    static size_t const NonTemporalThreshold = 4 * 1024 * 1024;
+
+    /**
+     * Size in bytes (of the output) from which work is split across threads.
+     */
+    static size_t const ParallelThreshold = 16 * 1024 * 1024;
+
+    /**
+     * Constructor, starts the helper threads.
+     *
+     * @param name_suffix Suffix for names of helper threads (e.g. the port name).
+     * @param num_threads Number of helper threads (0 to not use threads).
+     * @param priority EPICS priority of helper threads.
+     */
+    TRParallelCopy (std::string const &name_suffix, int num_threads, unsigned int priority);
+
+    /**
+     * Destructor, stops the helper threads.
+     */
+    ~TRParallelCopy ();
+
+    /**
+     * Copy memory.
+     *
+     * @param dst Destination (must not overlap the source).
+     * @param src Source.
+     * @param size Number of bytes.
+     */
+    void copy (void *dst, void const *src, size_t size);
+
+    /**
+     * Convert samples to floating point (see TRKernels::convertInt16ToFloat64).
+     *
+     * @param in Input samples.
+     * @param out Output array (must not overlap the input).
+     * @param count Number of samples.
+     * @param scale Scale factor.
+     * @param offset Offset added after scaling.
+     */
+    void convertInt16ToFloat64 (epicsInt16 const *in, double *out, size_t count,
+                                double scale, double offset);
+
+    /**
+     * Run independent items of work concurrently.
+     *
+     * Items are distributed dynamically to the calling thread and the
+     * helper threads, so items may take different times. Items must not
+     * use this object themselves (e.g. through TRChannelDataSubmit::copyData).
+     *
+     * @param task The work.
+     * @param num_items Number of items.
+     */
+    void run (TRParallelTask &task, int num_items);
+
+private:
+    class Helper;
+
+    enum JobType {
+        JobCopy,
+        JobConvert,
+        JobTask
+    };
+
+    // The current job (protected by m_job_mutex, read by helpers
+    // between the start signal and completion).
+    JobType m_job_type;
+    void *m_job_dst;
+    void const *m_job_src;
+    size_t m_job_count;
+    size_t m_job_part_count;
+    double m_job_scale;
+    double m_job_offset;
+    TRParallelTask *m_job_task;
+    int m_job_next_item; // accessed atomically
+
+    epicsMutex m_job_mutex;
+    std::vector<Helper *> m_helpers;
+
+    // Completion of parts by helpers (protected by m_mutex).
+    epicsMutex m_mutex;
+    int m_parts_remaining;
+    epicsEvent m_done_event;
+
+    // Split the job into parts, run them and wait for completion.
+    void runJob (JobType type, size_t count, size_t granularity);
+
+    // Process one part of the current job.
+    void runPart (int part);
+
+    // Called by helpers when they finished a part.
+    void partDone ();
+};
+
+#endif
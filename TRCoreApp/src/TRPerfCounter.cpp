@@ -0,0 +1,64 @@
+/* This file is part of the Transient Recorder Framework.
+ * It is subject to the license terms in the LICENSE.txt file found in the
+ * top-level directory of this distribution and at
+ * https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. No part
+ * of the Transient Recorder Framework, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ */
+
+#include <stddef.h>
+
+#include <epicsThread.h>
+
+#include "TRPerfCounter.h"
+#include "TRBaseDriver.h"
+
+TRPerfCounter::TRPerfCounter ()
+: m_perf_driver(NULL),
+  m_entry(-1),
+  m_active(0),
+  m_writing(0)
+{
+}
+
+TRPerfCounter::TRPerfCounter (TRBaseDriver &driver, int entry)
+: m_perf_driver(NULL),
+  m_entry(-1),
+  m_active(0),
+  m_writing(0)
+{
+    init(driver, entry);
+}
+
+TRPerfCounter::~TRPerfCounter ()
+{
+    if (m_perf_driver != NULL) {
+        m_perf_driver->removeCounter(this);
+    }
+}
+
+void TRPerfCounter::init (TRBaseDriver &driver, int entry)
+{
+    assert(m_perf_driver == NULL);
+    assert(entry >= TRNumPerfFrameworkEntries && entry < driver.m_perf_driver.numEntries());
+
+    m_perf_driver = &driver.m_perf_driver;
+    m_entry = entry;
+    m_perf_driver->addCounter(this);
+}
+
+void TRPerfCounter::flushTo (TRPerfStat &stat)
+{
+    // Switch add to the other accumulator.
+    int old = epicsAtomicGetIntT(&m_active);
+    epicsAtomicCmpAndSwapIntT(&m_active, old, 1 - old);
+
+    // Wait until an add which may still use the old one is done.
+    while (epicsAtomicCmpAndSwapIntT(&m_writing, old + 1, old + 1) == old + 1) {
+        epicsThreadSleep(0.0);
+    }
+
+    stat.merge(m_stats[old]);
+    m_stats[old].reset();
+}
@@ -0,0 +1,150 @@
+/* This file is part of the Transient Recorder Framework.
+ * It is subject to the license terms in the LICENSE.txt file found in the
+ * top-level directory of this distribution and at
+ * https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. No part
+ * of the Transient Recorder Framework, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ */
+
+/**
+ * @file
+ *
+ * Defines the TRPerfCounter and TRPerfTimerScope classes, used by drivers
+ * to update their own performance statistics entries.
+ */
+
+#ifndef TRANSREC_PERF_COUNTER_H
+#define TRANSREC_PERF_COUNTER_H
+
+#include <epicsAssert.h>
+#include <epicsAtomic.h>
+
+#include "TRNonCopyable.h"
+#include "TRPerfStat.h"
+
+class TRBaseDriver;
+class TRPerfStatsDriver;
+
+/**
+ * Accumulates samples of a driver-registered performance statistics entry.
+ *
+ * The entry must first be registered using TRBaseDriver::registerPerfEntry.
+ * Samples are added to one of two local accumulators without locking; when
+ * the framework periodically merges the samples into the performance
+ * statistics port (see TRPerfStatsDriver), it switches to the other
+ * accumulator and merges the previous one once any add in progress is
+ * done. Therefore add must not be called concurrently for the same object:
+ * each thread which updates an entry must use its own TRPerfCounter object,
+ * while multiple objects may refer to the same entry.
+ *
+ * Samples not yet merged when the object is destroyed are merged then.
+ * The object must be destroyed before the TRBaseDriver.
+ */
+class TRPerfCounter :
+    private TRNonCopyable
+{
+    friend class TRPerfStatsDriver;
+
+public:
+    /**
+     * Default constructor, init must be called before use.
+     */
+    TRPerfCounter ();
+
+    /**
+     * Constructor which also calls init.
+     *
+     * @param driver The driver which registered the entry.
+     * @param entry The index of the entry as returned by
+     *              TRBaseDriver::registerPerfEntry.
+     */
+    TRPerfCounter (TRBaseDriver &driver, int entry);
+
+    /**
+     * Destructor, merges remaining samples.
+     */
+    ~TRPerfCounter ();
+
+    /**
+     * Associate the object with an entry.
+     *
+     * This must be called exactly once (unless the constructor with
+     * arguments was used).
+     *
+     * @param driver The driver which registered the entry.
+     * @param entry The index of the entry as returned by
+     *              TRBaseDriver::registerPerfEntry.
+     */
+    void init (TRBaseDriver &driver, int entry);
+
+    /**
+     * Add a sample.
+     *
+     * For timers the value is a duration in seconds (see TRPerfClock),
+     * for counters it is any value.
+     *
+     * @param value The sample value.
+     */
+    inline void add (double value)
+    {
+        assert(m_perf_driver != NULL);
+
+        // Announce which accumulator is being written, then check that it
+        // is still the active one (flushTo may have just switched). The
+        // compare-and-swap operations are full memory barriers.
+        int active;
+        do {
+            active = epicsAtomicGetIntT(&m_active);
+            epicsAtomicCmpAndSwapIntT(&m_writing, 0, active + 1);
+            if (epicsAtomicCmpAndSwapIntT(&m_active, active, active) == active) {
+                break;
+            }
+            epicsAtomicCmpAndSwapIntT(&m_writing, active + 1, 0);
+        } while (true);
+
+        m_stats[active].add(value);
+
+        epicsAtomicCmpAndSwapIntT(&m_writing, active + 1, 0);
+    }
+
+private:
+    TRPerfStatsDriver *m_perf_driver;
+    int m_entry;
+
+    // Accumulators, the one being added to, and the one being written by
+    // add plus one (zero if none). Accessed atomically.
+    TRPerfStat m_stats[2];
+    int m_active;
+    int m_writing;
+
+    // Merge samples into the given statistics and reset the local ones.
+    // Must be called with the mutex of the performance statistics port
+    // locked, so that it does not run concurrently with itself.
+    void flushTo (TRPerfStat &stat);
+};
+
+/**
+ * Adds the duration of its lifetime as a sample to a TRPerfCounter.
+ */
+class TRPerfTimerScope :
+    private TRNonCopyable
+{
+public:
+    inline TRPerfTimerScope (TRPerfCounter &counter)
+    : m_counter(counter),
+      m_start(TRPerfClock::now())
+    {
+    }
+
+    inline ~TRPerfTimerScope ()
+    {
+        m_counter.add(TRPerfClock::now() - m_start);
+    }
+
+private:
+    TRPerfCounter &m_counter;
+    double m_start;
+};
+
+#endif
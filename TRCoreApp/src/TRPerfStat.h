@@ -0,0 +1,297 @@
+/* This file is part of the Transient Recorder Framework.
+ * It is subject to the license terms in the LICENSE.txt file found in the
+ * top-level directory of this distribution and at
+ * https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. No part
+ * of the Transient Recorder Framework, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ */
+
+/**
+ * @file
+ *
+ * Defines the TRPerfStat class and the TRPerfClock helper, used for
+ * performance measurements within the framework.
+ */
+
+#ifndef TRANSREC_PERF_STAT_H
+#define TRANSREC_PERF_STAT_H
+
+#include <math.h>
+
+#include <epicsTypes.h>
+#include <epicsTime.h>
+#include <epicsVersion.h>
+
+/**
+ * Source of time for performance measurements.
+ *
+ * This uses the monotonic clock where the EPICS version provides one,
+ * otherwise it falls back to the current (wall-clock) time.
+ */
+class TRPerfClock {
+public:
+    /**
+     * Return the current time in seconds relative to an arbitrary origin.
+     *
+     * Only differences between values returned by this function are
+     * meaningful.
+     *
+     * @return Current time (s).
+     */
+    inline static double now ()
+    {
+#if defined(VERSION_INT) && EPICS_VERSION_INT >= VERSION_INT(3,16,1,0)
+        return epicsMonotonicGet() * 1e-9;
+#else
+        epicsTimeStamp ts;
+        epicsTimeGetCurrent(&ts);
+        return ts.secPastEpoch + ts.nsec * 1e-9;
+#endif
+    }
+};
+
+/**
+ * Accumulator of duration samples (count, last, min, mean, max
+ * and percentiles).
+ *
+ * Percentiles are estimated using a histogram with logarithmically
+ * spaced buckets (four per octave starting at 1 us), so they have a
+ * relative error of at most about 25%.
+ *
+ * This class has no internal synchronization.
+ */
+class TRPerfStat {
+public:
+    /**
+     * Number of histogram buckets per octave.
+     */
+    static int const BucketsPerOctave = 4;
+    
+    /**
+     * Total number of histogram buckets.
+     * 
+     * Bucket 0 is for values below 1 us, and the last bucket also
+     * receives all values beyond the range of the histogram (about 19 h).
+     */
+    static int const NumBuckets = 1 + 36 * BucketsPerOctave;
+    
+    /**
+     * Constructor, initializes the statistics to the empty state.
+     */
+    inline TRPerfStat ()
+    {
+        reset();
+    }
+
+    /**
+     * Discard all samples.
+     */
+    inline void reset ()
+    {
+        m_count = 0;
+        m_last = 0.0;
+        m_min = 0.0;
+        m_max = 0.0;
+        m_sum = 0.0;
+        for (int i = 0; i < NumBuckets; i++) {
+            m_buckets[i] = 0;
+        }
+    }
+
+    /**
+     * Add a sample.
+     *
+     * @param value The sample value (a duration in seconds by convention).
+     */
+    inline void add (double value)
+    {
+        if (m_count == 0 || value < m_min) {
+            m_min = value;
+        }
+        if (m_count == 0 || value > m_max) {
+            m_max = value;
+        }
+        m_last = value;
+        m_sum += value;
+        m_count++;
+        m_buckets[bucketIndex(value)]++;
+    }
+
+    /**
+     * Add all samples from another statistics object.
+     * 
+     * The last sample is taken from the other object if it has any samples.
+     * 
+     * @param other The statistics to merge into this one.
+     */
+    inline void merge (TRPerfStat const &other)
+    {
+        if (other.m_count == 0) {
+            return;
+        }
+        if (m_count == 0 || other.m_min < m_min) {
+            m_min = other.m_min;
+        }
+        if (m_count == 0 || other.m_max > m_max) {
+            m_max = other.m_max;
+        }
+        m_last = other.m_last;
+        m_sum += other.m_sum;
+        m_count += other.m_count;
+        for (int i = 0; i < NumBuckets; i++) {
+            m_buckets[i] += other.m_buckets[i];
+        }
+    }
+
+    /**
+     * Return the number of samples.
+     *
+     * @return Number of samples since the last reset.
+     */
+    inline epicsUInt64 getCount () const
+    {
+        return m_count;
+    }
+
+    /**
+     * Return the most recent sample, NAN if there are no samples.
+     *
+     * @return Last sample.
+     */
+    inline double getLast () const
+    {
+        return (m_count == 0) ? NAN : m_last;
+    }
+
+    /**
+     * Return the smallest sample, NAN if there are no samples.
+     *
+     * @return Minimum sample.
+     */
+    inline double getMin () const
+    {
+        return (m_count == 0) ? NAN : m_min;
+    }
+
+    /**
+     * Return the average of samples, NAN if there are no samples.
+     *
+     * @return Mean of samples.
+     */
+    inline double getMean () const
+    {
+        return (m_count == 0) ? NAN : (m_sum / m_count);
+    }
+
+    /**
+     * Return the largest sample, NAN if there are no samples.
+     *
+     * @return Maximum sample.
+     */
+    inline double getMax () const
+    {
+        return (m_count == 0) ? NAN : m_max;
+    }
+
+    /**
+     * Return the sum of all samples.
+     *
+     * @return Sum of samples (0 if there are no samples).
+     */
+    inline double getSum () const
+    {
+        return m_sum;
+    }
+    
+    /**
+     * Return an estimate of a percentile of the samples.
+     * 
+     * The result is the upper bound of the histogram bucket containing
+     * the percentile, limited to the range of the samples.
+     * 
+     * @param fraction The percentile as a fraction (e.g. 0.99).
+     * @return Estimated percentile, NAN if there are no samples.
+     */
+    inline double getPercentile (double fraction) const
+    {
+        if (m_count == 0) {
+            return NAN;
+        }
+        
+        double target = fraction * m_count;
+        epicsUInt64 cumulative = 0;
+        int index = 0;
+        for (; index < NumBuckets - 1; index++) {
+            cumulative += m_buckets[index];
+            if (cumulative >= target) {
+                break;
+            }
+        }
+        
+        double result = bucketUpperBound(index);
+        if (result < m_min) {
+            result = m_min;
+        }
+        if (result > m_max) {
+            result = m_max;
+        }
+        return result;
+    }
+    
+    /**
+     * Return the number of samples in a histogram bucket.
+     * 
+     * @param index The bucket index (0 to NumBuckets-1).
+     * @return Number of samples in the bucket.
+     */
+    inline epicsUInt64 getBucketCount (int index) const
+    {
+        return m_buckets[index];
+    }
+    
+    /**
+     * Return the upper bound of a histogram bucket.
+     * 
+     * Note that the last bucket also receives values beyond its upper bound.
+     * 
+     * @param index The bucket index (0 to NumBuckets-1).
+     * @return Upper bound of the bucket (s).
+     */
+    inline static double bucketUpperBound (int index)
+    {
+        if (index == 0) {
+            return 1e-6;
+        }
+        int exponent = 1 + (index - 1) / BucketsPerOctave;
+        int slice = (index - 1) % BucketsPerOctave;
+        double mantissa = 0.5 + (slice + 1) / (2.0 * BucketsPerOctave);
+        return ldexp(mantissa, exponent) * 1e-6;
+    }
+    
+private:
+    inline static int bucketIndex (double value)
+    {
+        double value_us = value * 1e6;
+        if (!(value_us >= 1.0)) {
+            return 0;
+        }
+        
+        // value_us = mantissa * 2^exponent, mantissa in [0.5, 1).
+        int exponent;
+        double mantissa = frexp(value_us, &exponent);
+        int index = 1 + (exponent - 1) * BucketsPerOctave +
+                    (int)((mantissa - 0.5) * (2 * BucketsPerOctave));
+        return (index < NumBuckets) ? index : (NumBuckets - 1);
+    }
+
+private:
+    epicsUInt64 m_count;
+    double m_last;
+    double m_min;
+    double m_max;
+    double m_sum;
+    epicsUInt64 m_buckets[NumBuckets];
+};
+
+#endif
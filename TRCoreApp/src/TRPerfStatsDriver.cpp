@@ -0,0 +1,532 @@
+/* This file is part of the Transient Recorder Framework.
+ * It is subject to the license terms in the LICENSE.txt file found in the
+ * top-level directory of this distribution and at
+ * https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. No part
+ * of the Transient Recorder Framework, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ */
+
+#include <cmath>
+#include <algorithm>
+
+#include <epicsAssert.h>
+#include <epicsGuard.h>
+
+#include "TRPerfStatsDriver.h"
+#include "TRPerfCounter.h"
+
+// Names of the framework entries, indexed by TRPerfPhase, TRPerfTransition
+// and TRPerfDataPath.
+static char const * const EntryNames[TRNumPerfFrameworkEntries] = {
+    "waitForPreconditions",
+    "checkSettings",
+    "startAcquisition",
+    "readBurst",
+    "checkOverflow",
+    "processBurstData",
+    "interruptReading",
+    "stopAcquisition",
+    "onDisarmed",
+    "armLatency",
+    "rearmLatency",
+    "disarmLatency",
+    "allocLockWait",
+    "allocLockHold",
+    "poolAlloc",
+    "submitLockWait",
+    "submitLockHold",
+    "channelsLockWait",
+    "channelsLockHold",
+    "arrayCallbacks",
+    "dataCopy",
+    "procConvert",
+    "procBaseline",
+    "procFilter",
+    "procDecimate",
+    "procStats",
+    "procRoi"
+};
+
+// Counters of the data path measurements for one thread.
+struct TRPerfStatsDriver::ThreadCounters {
+    TRPerfCounter counters[TRNumPerfFrameworkEntries - TRPerfTransitionsEnd];
+};
+
+TRPerfStatsDriver::TRPerfStatsDriver (std::string const &base_port_name, int max_driver_entries,
+                                      int num_slots)
+:   asynPortDriver(
+        (base_port_name + "_perf").c_str(),
+        TRNumPerfFrameworkEntries + max_driver_entries, // maxAddr
+        NUM_PARAMS,
+        asynInt32Mask|asynFloat64Mask|asynOctetMask|asynInt32ArrayMask|
+            asynFloat64ArrayMask|asynDrvUserMask|TRInt64Mask, // interfaceMask
+        asynInt32Mask|asynFloat64Mask|asynOctetMask|TRInt64Mask, // interruptMask
+        ASYN_MULTIDEVICE, // asynFlags (no ASYN_CANBLOCK - we don't block)
+        1, // autoConnect
+        0, // priority (ignored with no ASYN_CANBLOCK)
+        0  // stackSize (ignored witn no ASYN_CANBLOCK)
+    ),
+    m_num_entries(TRNumPerfFrameworkEntries + max_driver_entries),
+    m_stats(m_num_entries),
+    m_names(m_num_entries),
+    m_scales(m_num_entries, 1000.0),
+    m_num_driver_entries(0),
+    m_thread_counters_key(epicsThreadPrivateCreate()),
+    m_num_slots(std::max(1, num_slots)),
+    m_deadlines(m_num_entries, 0.0),
+    m_misses(m_num_entries, 0),
+    m_active_since(m_num_entries * m_num_slots, NAN),
+    m_stalled(m_num_entries * m_num_slots, 0)
+{
+    createParam("PERF_NAME",  asynParamOctet,   &m_params[NAME]);
+    createParam("PERF_COUNT", TRInt64ParamType, &m_params[COUNT]);
+    createParam("PERF_LAST",  asynParamFloat64, &m_params[LAST]);
+    createParam("PERF_MIN",   asynParamFloat64, &m_params[MIN]);
+    createParam("PERF_MEAN",  asynParamFloat64, &m_params[MEAN]);
+    createParam("PERF_MAX",   asynParamFloat64, &m_params[MAX]);
+    createParam("PERF_SUM",   asynParamFloat64, &m_params[SUM]);
+    createParam("PERF_P50",   asynParamFloat64, &m_params[P50]);
+    createParam("PERF_P90",   asynParamFloat64, &m_params[P90]);
+    createParam("PERF_P99",   asynParamFloat64, &m_params[P99]);
+    createParam("PERF_RESET", asynParamInt32,   &m_params[RESET]);
+    createParam("PERF_DEADLINE", asynParamFloat64, &m_params[DEADLINE]);
+    createParam("PERF_MISSES",   TRInt64ParamType, &m_params[MISSES]);
+    createParam("PERF_STALLED",  asynParamInt32,   &m_params[STALLED]);
+    createParam("PERF_HISTOGRAM", asynParamInt32Array, &m_params[HISTOGRAM]);
+    createParam("PERF_HISTOGRAM_BOUNDS", asynParamFloat64Array, &m_params[HISTOGRAM_BOUNDS]);
+
+    for (int i = 0; i < m_num_entries; i++) {
+        if (i < TRNumPerfFrameworkEntries) {
+            m_names[i] = EntryNames[i];
+        }
+        setStringParam(i, m_params[NAME], m_names[i].c_str());
+        setIntegerParam(i, m_params[STALLED], 0);
+        callParamCallbacks(i);
+    }
+}
+
+TRPerfStatsDriver::~TRPerfStatsDriver ()
+{
+    // The counters remove themselves from m_counters, which locks m_mutex.
+    std::vector<ThreadCounters *> thread_counters;
+    {
+        epicsGuard<epicsMutex> lock(m_mutex);
+        thread_counters.swap(m_thread_counters);
+    }
+    for (size_t i = 0; i < thread_counters.size(); i++) {
+        delete thread_counters[i];
+    }
+    
+    epicsThreadPrivateDelete(m_thread_counters_key);
+}
+
+#if TR_HAVE_ASYN_INT64
+asynStatus TRPerfStatsDriver::readInt64 (asynUser *pasynUser, epicsInt64 *value)
+{
+    int reason = pasynUser->reason;
+
+    if (reason == m_params[COUNT] || reason == m_params[MISSES]) {
+        int addr;
+        getAddress(pasynUser, &addr);
+        if (addr < 0 || addr >= m_num_entries) {
+            return asynError;
+        }
+
+        *value = (epicsInt64)((reason == m_params[COUNT]) ? getStat(addr).getCount() : getMisses(addr));
+        return asynSuccess;
+    }
+
+    // Delegate to base class.
+    return asynPortDriver::readInt64(pasynUser, value);
+}
+#endif
+
+asynStatus TRPerfStatsDriver::readFloat64 (asynUser *pasynUser, epicsFloat64 *value)
+{
+    int reason = pasynUser->reason;
+
+#if !TR_HAVE_ASYN_INT64
+    // Without 64-bit integer parameters, the counts are doubles.
+    if (reason == m_params[COUNT] || reason == m_params[MISSES]) {
+        int addr;
+        getAddress(pasynUser, &addr);
+        if (addr < 0 || addr >= m_num_entries) {
+            return asynError;
+        }
+
+        *value = (double)((reason == m_params[COUNT]) ? getStat(addr).getCount() : getMisses(addr));
+        return asynSuccess;
+    }
+#endif
+
+    if (reason == m_params[LAST] || reason == m_params[MIN] ||
+        reason == m_params[MEAN] || reason == m_params[MAX] ||
+        reason == m_params[SUM] || reason == m_params[P50] || reason == m_params[P90] ||
+        reason == m_params[P99])
+    {
+        int addr;
+        getAddress(pasynUser, &addr);
+        if (addr < 0 || addr >= m_num_entries) {
+            return asynError;
+        }
+
+        TRPerfStat stat = getStat(addr);
+
+        // Durations are kept in seconds but exposed in milliseconds.
+        double result;
+        if (reason == m_params[LAST]) {
+            result = stat.getLast();
+        } else if (reason == m_params[MIN]) {
+            result = stat.getMin();
+        } else if (reason == m_params[MEAN]) {
+            result = stat.getMean();
+        } else if (reason == m_params[MAX]) {
+            result = stat.getMax();
+        } else if (reason == m_params[SUM]) {
+            result = stat.getSum();
+        } else if (reason == m_params[P50]) {
+            result = stat.getPercentile(0.50);
+        } else if (reason == m_params[P90]) {
+            result = stat.getPercentile(0.90);
+        } else {
+            result = stat.getPercentile(0.99);
+        }
+        *value = entryScale(addr) * result;
+        return asynSuccess;
+    }
+
+    // Delegate to base class.
+    return asynPortDriver::readFloat64(pasynUser, value);
+}
+
+asynStatus TRPerfStatsDriver::writeInt32 (asynUser *pasynUser, epicsInt32 value)
+{
+    if (pasynUser->reason == m_params[RESET]) {
+        int addr;
+        getAddress(pasynUser, &addr);
+        if (addr < 0 || addr >= m_num_entries) {
+            return asynError;
+        }
+
+        if (value != 0) {
+            epicsGuard<epicsMutex> lock(m_mutex);
+            m_stats[addr].reset();
+            m_misses[addr] = 0;
+        }
+        return asynSuccess;
+    }
+
+    // Delegate to base class.
+    return asynPortDriver::writeInt32(pasynUser, value);
+}
+
+asynStatus TRPerfStatsDriver::writeFloat64 (asynUser *pasynUser, epicsFloat64 value)
+{
+    if (pasynUser->reason == m_params[DEADLINE]) {
+        int addr;
+        getAddress(pasynUser, &addr);
+        if (addr < 0 || addr >= m_num_entries) {
+            return asynError;
+        }
+
+        // The deadline is given in milliseconds, zero or less disables it.
+        {
+            epicsGuard<epicsMutex> lock(m_mutex);
+            m_deadlines[addr] = (value > 0.0) ? (value / 1000.0) : 0.0;
+        }
+    }
+
+    // Delegate to base class (also for DEADLINE to store the value).
+    return asynPortDriver::writeFloat64(pasynUser, value);
+}
+
+asynStatus TRPerfStatsDriver::readInt32Array (asynUser *pasynUser, epicsInt32 *value,
+                                              size_t nElements, size_t *nIn)
+{
+    if (pasynUser->reason == m_params[HISTOGRAM]) {
+        int addr;
+        getAddress(pasynUser, &addr);
+        if (addr < 0 || addr >= m_num_entries) {
+            return asynError;
+        }
+
+        TRPerfStat stat = getStat(addr);
+
+        size_t num = std::min(nElements, (size_t)TRPerfStat::NumBuckets);
+        for (size_t i = 0; i < num; i++) {
+            value[i] = TRSaturateInt32(stat.getBucketCount(i));
+        }
+        *nIn = num;
+        return asynSuccess;
+    }
+
+    // Delegate to base class.
+    return asynPortDriver::readInt32Array(pasynUser, value, nElements, nIn);
+}
+
+asynStatus TRPerfStatsDriver::readFloat64Array (asynUser *pasynUser, epicsFloat64 *value,
+                                                size_t nElements, size_t *nIn)
+{
+    if (pasynUser->reason == m_params[HISTOGRAM_BOUNDS]) {
+        int addr;
+        getAddress(pasynUser, &addr);
+        if (addr < 0 || addr >= m_num_entries) {
+            return asynError;
+        }
+
+        // The bounds are in the same units as the values of the entry.
+        double scale = entryScale(addr);
+        size_t num = std::min(nElements, (size_t)TRPerfStat::NumBuckets);
+        for (size_t i = 0; i < num; i++) {
+            value[i] = scale * TRPerfStat::bucketUpperBound(i);
+        }
+        *nIn = num;
+        return asynSuccess;
+    }
+
+    // Delegate to base class.
+    return asynPortDriver::readFloat64Array(pasynUser, value, nElements, nIn);
+}
+
+std::string const & TRPerfStatsDriver::entryName (int index)
+{
+    assert(index >= 0 && index < m_num_entries);
+
+    return m_names[index];
+}
+
+double TRPerfStatsDriver::entryScale (int index)
+{
+    assert(index >= 0 && index < m_num_entries);
+
+    epicsGuard<epicsMutex> lock(m_mutex);
+    return m_scales[index];
+}
+
+int TRPerfStatsDriver::registerEntry (std::string const &name, TRPerfEntryType type)
+{
+    int index;
+    {
+        epicsGuard<epicsMutex> lock(m_mutex);
+
+        index = TRNumPerfFrameworkEntries + m_num_driver_entries;
+        if (index >= m_num_entries) {
+            return -1;
+        }
+        m_num_driver_entries++;
+
+        m_names[index] = name;
+        m_scales[index] = (type == TRPerfEntryTimer) ? 1000.0 : 1.0;
+    }
+
+    epicsGuard<asynPortDriver> lock(*this);
+    setStringParam(index, m_params[NAME], name.c_str());
+    callParamCallbacks(index);
+
+    return index;
+}
+
+void TRPerfStatsDriver::addCounter (TRPerfCounter *counter)
+{
+    epicsGuard<epicsMutex> lock(m_mutex);
+    m_counters.push_back(counter);
+}
+
+void TRPerfStatsDriver::removeCounter (TRPerfCounter *counter)
+{
+    epicsGuard<epicsMutex> lock(m_mutex);
+
+    std::vector<TRPerfCounter *>::iterator it =
+        std::find(m_counters.begin(), m_counters.end(), counter);
+    assert(it != m_counters.end());
+    m_counters.erase(it);
+
+    // Keep the samples which were not aggregated yet.
+    counter->flushTo(m_stats[counter->m_entry]);
+}
+
+void TRPerfStatsDriver::aggregateCounters ()
+{
+    epicsGuard<epicsMutex> lock(m_mutex);
+
+    for (size_t i = 0; i < m_counters.size(); i++) {
+        TRPerfCounter *counter = m_counters[i];
+        counter->flushTo(m_stats[counter->m_entry]);
+    }
+}
+
+void TRPerfStatsDriver::addSample (int index, double duration)
+{
+    assert(index >= 0 && index < m_num_entries);
+
+    // Data path measurements are frequent and made by many threads
+    // concurrently, so avoid the mutex for them.
+    if (index >= TRPerfTransitionsEnd && index < TRNumPerfFrameworkEntries) {
+        getThreadCounters().counters[index - TRPerfTransitionsEnd].add(duration);
+        return;
+    }
+
+    epicsGuard<epicsMutex> lock(m_mutex);
+    m_stats[index].add(duration);
+}
+
+TRPerfStatsDriver::ThreadCounters & TRPerfStatsDriver::getThreadCounters ()
+{
+    ThreadCounters *thread_counters = (ThreadCounters *)epicsThreadPrivateGet(m_thread_counters_key);
+    
+    if (thread_counters == NULL) {
+        thread_counters = new ThreadCounters;
+        
+        epicsGuard<epicsMutex> lock(m_mutex);
+        for (int i = 0; i < TRNumPerfFrameworkEntries - TRPerfTransitionsEnd; i++) {
+            TRPerfCounter &counter = thread_counters->counters[i];
+            counter.m_perf_driver = this;
+            counter.m_entry = TRPerfTransitionsEnd + i;
+            m_counters.push_back(&counter);
+        }
+        m_thread_counters.push_back(thread_counters);
+        
+        epicsThreadPrivateSet(m_thread_counters_key, thread_counters);
+    }
+    
+    return *thread_counters;
+}
+
+double TRPerfStatsDriver::beginSample (int index, int slot)
+{
+    assert(index >= 0 && index < m_num_entries);
+    assert(slot >= 0 && slot < m_num_slots);
+
+    double start_time = TRPerfClock::now();
+
+    epicsGuard<epicsMutex> lock(m_mutex);
+    m_active_since[index * m_num_slots + slot] = start_time;
+
+    return start_time;
+}
+
+void TRPerfStatsDriver::endSample (int index, double start_time, int slot)
+{
+    assert(index >= 0 && index < m_num_entries);
+    assert(slot >= 0 && slot < m_num_slots);
+
+    double duration = TRPerfClock::now() - start_time;
+    int state = index * m_num_slots + slot;
+    bool was_stalled;
+
+    {
+        epicsGuard<epicsMutex> lock(m_mutex);
+
+        m_stats[index].add(duration);
+        m_active_since[state] = NAN;
+
+        // Count a deadline miss, unless it was already counted when the
+        // stall was detected.
+        was_stalled = m_stalled[state];
+        if (!was_stalled && m_deadlines[index] > 0.0 && duration > m_deadlines[index]) {
+            m_misses[index]++;
+        }
+        m_stalled[state] = 0;
+    }
+
+    if (was_stalled) {
+        publishStalled(index);
+    }
+}
+
+bool TRPerfStatsDriver::checkStalls ()
+{
+    double now = TRPerfClock::now();
+    bool any_stalled = false;
+
+    for (int i = 0; i < m_num_entries; i++) {
+        bool newly_stalled = false;
+
+        {
+            epicsGuard<epicsMutex> lock(m_mutex);
+
+            for (int slot = 0; slot < m_num_slots; slot++) {
+                int state = i * m_num_slots + slot;
+                if (!m_stalled[state] && !std::isnan(m_active_since[state]) &&
+                    m_deadlines[i] > 0.0 && now - m_active_since[state] > m_deadlines[i])
+                {
+                    // Count the miss now because the function might never return.
+                    m_stalled[state] = 1;
+                    m_misses[i]++;
+                    newly_stalled = true;
+                }
+            }
+
+            if (isStalled(i)) {
+                any_stalled = true;
+            }
+        }
+
+        if (newly_stalled) {
+            publishStalled(i);
+        }
+    }
+
+    return any_stalled;
+}
+
+bool TRPerfStatsDriver::isStalled (int index)
+{
+    for (int slot = 0; slot < m_num_slots; slot++) {
+        if (m_stalled[index * m_num_slots + slot]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void TRPerfStatsDriver::publishStalled (int index)
+{
+    epicsGuard<asynPortDriver> lock(*this);
+
+    // Read the flag here (not passed by the caller) so that the latest
+    // value is published even if it changed concurrently.
+    bool stalled;
+    {
+        epicsGuard<epicsMutex> stats_lock(m_mutex);
+        stalled = isStalled(index);
+    }
+
+    setIntegerParam(index, m_params[STALLED], stalled);
+    callParamCallbacks(index);
+}
+
+epicsUInt64 TRPerfStatsDriver::getMisses (int index)
+{
+    assert(index >= 0 && index < m_num_entries);
+
+    epicsGuard<epicsMutex> lock(m_mutex);
+    return m_misses[index];
+}
+
+TRPerfStat TRPerfStatsDriver::getStat (int index)
+{
+    assert(index >= 0 && index < m_num_entries);
+
+    epicsGuard<epicsMutex> lock(m_mutex);
+    return m_stats[index];
+}
+
+void TRPerfStatsDriver::resetArmingStats ()
+{
+    epicsGuard<epicsMutex> lock(m_mutex);
+
+    for (int i = 0; i < TRNumPerfPhases; i++) {
+        m_stats[i].reset();
+    }
+    for (int i = TRPerfTransitionsEnd; i < m_num_entries; i++) {
+        m_stats[i].reset();
+    }
+
+    // Discard samples not yet aggregated, which belong to the previous arming.
+    for (size_t i = 0; i < m_counters.size(); i++) {
+        TRPerfStat discarded;
+        m_counters[i]->flushTo(discarded);
+    }
+}
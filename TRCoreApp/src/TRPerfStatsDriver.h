@@ -0,0 +1,318 @@
+/* This file is part of the Transient Recorder Framework.
+ * It is subject to the license terms in the LICENSE.txt file found in the
+ * top-level directory of this distribution and at
+ * https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. No part
+ * of the Transient Recorder Framework, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ */
+
+/**
+ * @file
+ *
+ * Defines the TRPerfStatsDriver class, which exposes performance statistics.
+ */
+
+#ifndef TRANSREC_PERF_STATS_DRIVER_H
+#define TRANSREC_PERF_STATS_DRIVER_H
+
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+#include <epicsMutex.h>
+#include <epicsThread.h>
+#include <epicsTypes.h>
+
+#include <asynPortDriver.h>
+
+#include "TRInt64Param.h"
+#include "TRNonCopyable.h"
+#include "TRPerfStat.h"
+
+class TRBaseDriver;
+class TRPerfCounter;
+template <typename Lockable> class TRTimedGuard;
+
+/**
+ * Phases of the arming sequence which are timed by the framework.
+ *
+ * Each phase corresponds to calls of one virtual function of TRBaseDriver.
+ * The enumeration value is the asyn address of the phase in the
+ * performance statistics port (see TRPerfStatsDriver).
+ */
+enum TRPerfPhase {
+    TRPerfPhaseWaitForPreconditions,
+    TRPerfPhaseCheckSettings,
+    TRPerfPhaseStartAcquisition,
+    TRPerfPhaseReadBurst,
+    TRPerfPhaseCheckOverflow,
+    TRPerfPhaseProcessBurstData,
+    TRPerfPhaseInterruptReading,
+    TRPerfPhaseStopAcquisition,
+    TRPerfPhaseOnDisarmed,
+    TRNumPerfPhases
+};
+
+/**
+ * Arm state transitions whose latency is measured by the framework.
+ *
+ * The enumeration value is the asyn address of the transition in the
+ * performance statistics port (see TRPerfStatsDriver). Unlike phases,
+ * these statistics are not reset at the start of arming but accumulate
+ * until reset using the PERF_RESET parameter.
+ *
+ * - Arm: from an arm request while disarmed to the requested arm state.
+ * - Rearm: from an arm request while not disarmed (which implies disarming
+ *   and arming again) to the requested arm state.
+ * - Disarm: from the first disarm request (external or from the driver)
+ *   to the disarmed state.
+ */
+enum TRPerfTransition {
+    TRPerfTransitionArm = TRNumPerfPhases,
+    TRPerfTransitionRearm,
+    TRPerfTransitionDisarm,
+    TRPerfTransitionsEnd
+};
+
+/**
+ * Measurements in the data path (allocation and submission of arrays)
+ * made by the framework.
+ *
+ * The enumeration value is the asyn address of the measurement in the
+ * performance statistics port (see TRPerfStatsDriver). Like phases,
+ * these statistics are reset at the start of each arming. Since these
+ * samples are taken for every array, they are accumulated per thread
+ * without locking and merged into the port periodically.
+ *
+ * - AllocLockWait/AllocLockHold: channels port lock when allocating an
+ *   array (TRChannelDataSubmit::allocateArray).
+ * - PoolAlloc: NDArrayPool::alloc (while holding the channels port lock).
+ * - SubmitLockWait/SubmitLockHold: main port lock in
+ *   TRChannelDataSubmit::submit.
+ * - ChannelsLockWait/ChannelsLockHold: channels port lock when submitting
+ *   an array, taken by TRChannelsDriver::submitArray (parameters, attributes
+ *   and array completion callback).
+ * - ArrayCallbacks: NDArray callbacks to plugins (includes processing in
+ *   plugins which are configured for blocking callbacks).
+ * - DataCopy: copying of data into arrays in TRChannelDataSubmit::copyData.
+ * - ProcConvert ... ProcRoi: stages of the processing graph, for one
+ *   channel each (see TRProcessGraph and @ref TRProcStage).
+ */
+enum TRPerfDataPath {
+    TRPerfDataPathAllocLockWait = TRPerfTransitionsEnd,
+    TRPerfDataPathAllocLockHold,
+    TRPerfDataPathPoolAlloc,
+    TRPerfDataPathSubmitLockWait,
+    TRPerfDataPathSubmitLockHold,
+    TRPerfDataPathChannelsLockWait,
+    TRPerfDataPathChannelsLockHold,
+    TRPerfDataPathArrayCallbacks,
+    TRPerfDataPathDataCopy,
+    TRPerfDataPathProcConvert,
+    TRPerfDataPathProcBaseline,
+    TRPerfDataPathProcFilter,
+    TRPerfDataPathProcDecimate,
+    TRPerfDataPathProcStats,
+    TRPerfDataPathProcRoi,
+    TRNumPerfFrameworkEntries
+};
+
+/**
+ * Types of performance statistics entries registered by drivers.
+ *
+ * - Timer: samples are durations in seconds, exposed in milliseconds
+ *   like framework entries.
+ * - Counter: samples are arbitrary values (e.g. a FIFO level or a number
+ *   of events), exposed unscaled. Percentiles and the histogram are only
+ *   meaningful for values between about 1e-6 and 6e4.
+ */
+enum TRPerfEntryType {
+    TRPerfEntryTimer,
+    TRPerfEntryCounter
+};
+
+/**
+ * Asyn port exposing performance statistics of the framework.
+ *
+ * The port is named as the base port with the suffix `_perf`.
+ * It is a multi-device port where each address corresponds to one
+ * statistics entry (see @ref TRPerfPhase, @ref TRPerfTransition
+ * and @ref TRPerfDataPath for the addresses of framework entries).
+ * Entries registered by the driver (see TRBaseDriver::registerPerfEntry)
+ * follow the framework entries.
+ * Each address provides the
+ * parameters PERF_NAME, PERF_COUNT, PERF_LAST, PERF_MIN, PERF_MEAN,
+ * PERF_MAX, PERF_SUM, PERF_P50, PERF_P90 and PERF_P99, with durations in
+ * milliseconds (values of counters are not scaled). Values are computed when the parameters are read, so
+ * records should be periodically scanned. PERF_COUNT is a 64-bit parameter
+ * (see TRInt64Param.h). Writing PERF_RESET resets
+ * the statistics of the entry. PERF_HISTOGRAM provides the counts of
+ * the histogram used for percentiles (limited to the range of epicsInt32),
+ * and PERF_HISTOGRAM_BOUNDS the
+ * upper bounds of its buckets in milliseconds.
+ *
+ * Additionally, each entry has a configurable deadline (PERF_DEADLINE,
+ * milliseconds, zero to disable). Samples longer than the deadline are
+ * counted in PERF_MISSES (a 64-bit parameter like PERF_COUNT). While a timed function is in progress for longer
+ * than its deadline, PERF_STALLED is 1 (this is detected by the watchdog of
+ * TRBaseDriver). The number of misses accumulates until PERF_RESET.
+ * Deadlines apply only to framework entries.
+ *
+ * Statistics of phases, data path measurements and driver entries are
+ * reset at the start of each arming. Samples of driver entries and data
+ * path measurements are accumulated in TRPerfCounter objects (for data
+ * path measurements, one set for each thread which adds samples) and
+ * merged into the port by the watchdog thread of TRBaseDriver (every
+ * 0.1 s) and before the arming summary is printed.
+ */
+class TRPerfStatsDriver : public asynPortDriver,
+    private TRNonCopyable
+{
+    friend class TRBaseDriver;
+    friend class TRChannelsDriver;
+    friend class TRChannelDataSubmit;
+    friend class TRPerfCounter;
+    friend class TRProcessGraph;
+    template <typename Lockable> friend class TRTimedGuard;
+
+    // Enumeration of asyn parameters.
+    enum Params {
+        NAME,
+        COUNT,
+        LAST,
+        MIN,
+        MEAN,
+        MAX,
+        SUM,
+        P50,
+        P90,
+        P99,
+        RESET,
+        DEADLINE,
+        MISSES,
+        STALLED,
+        HISTOGRAM,
+        HISTOGRAM_BOUNDS,
+        NUM_PARAMS
+    };
+
+private:
+    int m_params[NUM_PARAMS];
+    int m_num_entries;
+    epicsMutex m_mutex;
+    std::vector<TRPerfStat> m_stats;
+    std::vector<std::string> m_names;
+    
+    // Scale of values for parameters, 1000 for timers (protected by m_mutex).
+    std::vector<double> m_scales;
+    
+    // Number of registered driver entries (protected by m_mutex).
+    int m_num_driver_entries;
+    
+    // Counter objects of driver entries and data path measurements
+    // (protected by m_mutex).
+    std::vector<TRPerfCounter *> m_counters;
+    
+    // Counter objects of data path measurements for each thread which
+    // added samples. They are kept until the port is destroyed.
+    struct ThreadCounters;
+    epicsThreadPrivateId m_thread_counters_key;
+    std::vector<ThreadCounters *> m_thread_counters;
+    
+    // Per-entry deadline state (protected by m_mutex).
+    // The active-since time and the stalled flag are kept for each slot
+    // of an entry (index*m_num_slots+slot), so that threads using
+    // different slots (read streams) can time the same entry concurrently.
+    // The active-since time is NAN when the slot is not in progress.
+    int m_num_slots;
+    std::vector<double> m_deadlines;
+    std::vector<epicsUInt64> m_misses;
+    std::vector<double> m_active_since;
+    std::vector<char> m_stalled;
+
+public:
+    TRPerfStatsDriver (std::string const &base_port_name, int max_driver_entries, int num_slots);
+
+    virtual ~TRPerfStatsDriver ();
+
+#if TR_HAVE_ASYN_INT64
+    virtual asynStatus readInt64 (asynUser *pasynUser, epicsInt64 *value);
+#endif
+
+    virtual asynStatus readFloat64 (asynUser *pasynUser, epicsFloat64 *value);
+
+    virtual asynStatus writeInt32 (asynUser *pasynUser, epicsInt32 value);
+    
+    virtual asynStatus readInt32Array (asynUser *pasynUser, epicsInt32 *value,
+                                       size_t nElements, size_t *nIn);
+    
+    virtual asynStatus readFloat64Array (asynUser *pasynUser, epicsFloat64 *value,
+                                         size_t nElements, size_t *nIn);
+
+    virtual asynStatus writeFloat64 (asynUser *pasynUser, epicsFloat64 value);
+
+private:
+    // The follwing functions are for internal use by Transient Recorder framework.
+
+    // Return the number of statistics entries (asyn addresses).
+    inline int numEntries ()
+    {
+        return m_num_entries;
+    }
+
+    // Return the name of an entry.
+    std::string const & entryName (int index);
+    
+    // Return the scale of values of an entry for display.
+    double entryScale (int index);
+    
+    // Register a driver entry, returns its index or -1 if there is no space.
+    int registerEntry (std::string const &name, TRPerfEntryType type);
+    
+    // Add or remove a counter object for aggregation.
+    void addCounter (TRPerfCounter *counter);
+    void removeCounter (TRPerfCounter *counter);
+    
+    // Merge samples from all counter objects into the statistics.
+    void aggregateCounters ();
+
+    // Add a sample to an entry. Can be called from any thread. Samples of
+    // data path measurements are added to counters of the calling thread.
+    void addSample (int index, double duration);
+    
+    // Mark an entry as in progress and return the start time. Must be
+    // followed by endSample. Can be called from any thread but not
+    // concurrently for the same entry and slot (0 to num_slots-1).
+    double beginSample (int index, int slot = 0);
+    
+    // Add a sample for an entry started with beginSample.
+    void endSample (int index, double start_time, int slot = 0);
+    
+    // Detect entries in progress for longer than their deadline and
+    // update PERF_STALLED. Returns whether any entry is stalled.
+    bool checkStalls ();
+
+    // Return the number of deadline misses of an entry.
+    epicsUInt64 getMisses (int index);
+
+    // Return a copy of the statistics of an entry.
+    TRPerfStat getStat (int index);
+
+    // Reset the statistics of all phases, data path measurements and
+    // driver entries (called at the start of arming).
+    void resetArmingStats ();
+    
+    // Return the data path counters of the calling thread, creating them
+    // the first time.
+    ThreadCounters & getThreadCounters ();
+    
+    // Check whether any slot of an entry is stalled, called with m_mutex locked.
+    bool isStalled (int index);
+    
+    // Update the PERF_STALLED parameter, called without m_mutex locked.
+    void publishStalled (int index);
+};
+
+#endif
@@ -0,0 +1,468 @@
+/* This file is part of the Transient Recorder Framework.
+ * It is subject to the license terms in the LICENSE.txt file found in the
+ * top-level directory of this distribution and at
+ * https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. No part
+ * of the Transient Recorder Framework, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ */
+
+#include <string.h>
+
+#include <cmath>
+#include <algorithm>
+
+#include <epicsAssert.h>
+#include <epicsGuard.h>
+#include <errlog.h>
+
+#include "TRProcessGraph.h"
+#include "TRBaseDriver.h"
+#include "TRChannelDataSubmit.h"
+#include "TRKernels.h"
+#include "TRPerfStat.h"
+
+// Maximum length of the PROC_CHAIN parameter.
+static int const MaxChainLength = 256;
+
+// Names of stages, indexed by TRProcStage.
+static char const * const StageNames[TRNumProcStages] = {
+    "convert",
+    "baseline",
+    "filter",
+    "decimate",
+    "stats",
+    "roi"
+};
+
+TRProcessGraph::TRProcessGraph (std::string const &base_port_name, int num_channels)
+:   asynPortDriver(
+        (base_port_name + "_proc").c_str(),
+        std::max(1, num_channels), // maxAddr
+        NUM_PARAMS,
+        asynInt32Mask|asynFloat64Mask|asynOctetMask|asynDrvUserMask, // interfaceMask
+        asynInt32Mask|asynFloat64Mask|asynOctetMask, // interruptMask
+        ASYN_MULTIDEVICE, // asynFlags (no ASYN_CANBLOCK - we don't block)
+        1, // autoConnect
+        0, // priority (ignored with no ASYN_CANBLOCK)
+        0  // stackSize (ignored witn no ASYN_CANBLOCK)
+    ),
+    m_num_channels(num_channels),
+    m_input_data_type(NDInt16),
+    m_chains(num_channels),
+    m_results(num_channels),
+    m_run_driver(NULL),
+    m_run_inputs(NULL),
+    m_run_burst_id(0),
+    m_run_timestamp(0.0)
+{
+    createParam("PROC_CHAIN",            asynParamOctet,   &m_params[CHAIN]);
+    createParam("PROC_SCALE",            asynParamFloat64, &m_params[SCALE]);
+    createParam("PROC_OFFSET",           asynParamFloat64, &m_params[OFFSET]);
+    createParam("PROC_BASELINE_SAMPLES", asynParamInt32,   &m_params[BASELINE_SAMPLES]);
+    createParam("PROC_FILTER_WIDTH",     asynParamInt32,   &m_params[FILTER_WIDTH]);
+    createParam("PROC_DECIMATION",       asynParamInt32,   &m_params[DECIMATION]);
+    createParam("PROC_ROI_START",        asynParamInt32,   &m_params[ROI_START]);
+    createParam("PROC_ROI_SIZE",         asynParamInt32,   &m_params[ROI_SIZE]);
+    createParam("PROC_STAT_MIN",         asynParamFloat64, &m_params[STAT_MIN]);
+    createParam("PROC_STAT_MAX",         asynParamFloat64, &m_params[STAT_MAX]);
+    createParam("PROC_STAT_MEAN",        asynParamFloat64, &m_params[STAT_MEAN]);
+    createParam("PROC_STAT_RMS",         asynParamFloat64, &m_params[STAT_RMS]);
+    createParam("PROC_TIME",             asynParamFloat64, &m_params[TIME]);
+
+    m_run_epics_ts.secPastEpoch = 0;
+    m_run_epics_ts.nsec = 0;
+
+    for (int i = 0; i < num_channels; i++) {
+        setStringParam(i,  m_params[CHAIN],            "");
+        setDoubleParam(i,  m_params[SCALE],            1.0);
+        setDoubleParam(i,  m_params[OFFSET],           0.0);
+        setIntegerParam(i, m_params[BASELINE_SAMPLES], 1);
+        setIntegerParam(i, m_params[FILTER_WIDTH],     1);
+        setIntegerParam(i, m_params[DECIMATION],       1);
+        setIntegerParam(i, m_params[ROI_START],        0);
+        setIntegerParam(i, m_params[ROI_SIZE],         0);
+
+        Results &results = m_results[i];
+        results.stat_min = NAN;
+        results.stat_max = NAN;
+        results.stat_mean = NAN;
+        results.stat_rms = NAN;
+        results.time = NAN;
+    }
+}
+
+asynStatus TRProcessGraph::readFloat64 (asynUser *pasynUser, epicsFloat64 *value)
+{
+    int reason = pasynUser->reason;
+
+    if (reason == m_params[STAT_MIN] || reason == m_params[STAT_MAX] ||
+        reason == m_params[STAT_MEAN] || reason == m_params[STAT_RMS] ||
+        reason == m_params[TIME])
+    {
+        int addr;
+        getAddress(pasynUser, &addr);
+        if (addr < 0 || addr >= m_num_channels) {
+            return asynError;
+        }
+        Results const &results = m_results[addr];
+        if (reason == m_params[STAT_MIN]) {
+            *value = results.stat_min;
+        } else if (reason == m_params[STAT_MAX]) {
+            *value = results.stat_max;
+        } else if (reason == m_params[STAT_MEAN]) {
+            *value = results.stat_mean;
+        } else if (reason == m_params[STAT_RMS]) {
+            *value = results.stat_rms;
+        } else {
+            // Times are kept in seconds but exposed in milliseconds.
+            *value = 1000.0 * results.time;
+        }
+        return asynSuccess;
+    }
+
+    // Delegate to base class.
+    return asynPortDriver::readFloat64(pasynUser, value);
+}
+
+TRProcStage TRProcessGraph::parseStage (std::string const &name)
+{
+    for (int i = 0; i < TRNumProcStages; i++) {
+        if (name == StageNames[i]) {
+            return (TRProcStage)i;
+        }
+    }
+    return TRNumProcStages;
+}
+
+bool TRProcessGraph::configure (NDDataType_t input_data_type, std::vector<int> *decimation)
+{
+    epicsGuard<asynPortDriver> lock(*this);
+
+    m_input_data_type = input_data_type;
+
+    for (int channel = 0; channel < m_num_channels; channel++) {
+        Chain &chain = m_chains[channel];
+
+        char chain_str[MaxChainLength];
+        getStringParam(channel, m_params[CHAIN], MaxChainLength, chain_str);
+        getDoubleParam(channel,  m_params[SCALE],            &chain.scale);
+        getDoubleParam(channel,  m_params[OFFSET],           &chain.offset);
+        getIntegerParam(channel, m_params[BASELINE_SAMPLES], &chain.baseline_samples);
+        getIntegerParam(channel, m_params[FILTER_WIDTH],     &chain.filter_width);
+        getIntegerParam(channel, m_params[DECIMATION],       &chain.decimation);
+        getIntegerParam(channel, m_params[ROI_START],        &chain.roi_start);
+        getIntegerParam(channel, m_params[ROI_SIZE],         &chain.roi_size);
+
+        // Parse the names of stages.
+        chain.stages.clear();
+        bool used[TRNumProcStages] = {false};
+        std::string str(chain_str);
+        size_t pos = 0;
+        while (pos < str.size()) {
+            size_t end = str.find_first_of(", ", pos);
+            if (end == std::string::npos) {
+                end = str.size();
+            }
+            if (end > pos) {
+                std::string name = str.substr(pos, end - pos);
+                TRProcStage stage = parseStage(name);
+                if (stage == TRNumProcStages) {
+                    errlogSevPrintf(errlogMajor, "TRProcessGraph Error: Unknown stage %s for channel %d.\n",
+                        name.c_str(), channel);
+                    return false;
+                }
+                if (used[stage]) {
+                    errlogSevPrintf(errlogMajor, "TRProcessGraph Error: Stage %s is used twice for channel %d.\n",
+                        name.c_str(), channel);
+                    return false;
+                }
+                if (stage == TRProcStageConvert && !chain.stages.empty()) {
+                    errlogSevPrintf(errlogMajor, "TRProcessGraph Error: Stage convert is not first for channel %d.\n",
+                        channel);
+                    return false;
+                }
+                if (stage == TRProcStageDecimate && used[TRProcStageRoi]) {
+                    errlogSevPrintf(errlogMajor, "TRProcessGraph Error: Stage decimate follows roi for channel %d.\n",
+                        channel);
+                    return false;
+                }
+                used[stage] = true;
+                chain.stages.push_back(stage);
+            }
+            pos = end + 1;
+        }
+
+        // Check that the chain supports the inputs.
+        if (!chain.stages.empty() && input_data_type != NDInt16 && input_data_type != NDFloat64) {
+            errlogSevPrintf(errlogMajor, "TRProcessGraph Error: Input data type %d is not supported by the chain of channel %d.\n",
+                (int)input_data_type, channel);
+            return false;
+        }
+
+        // Check the parameters of the stages which are used.
+        if (used[TRProcStageBaseline] && chain.baseline_samples < 1) {
+            errlogSevPrintf(errlogMajor, "TRProcessGraph Error: PROC_BASELINE_SAMPLES of channel %d is not positive.\n",
+                channel);
+            return false;
+        }
+        if (used[TRProcStageFilter] && chain.filter_width < 1) {
+            errlogSevPrintf(errlogMajor, "TRProcessGraph Error: PROC_FILTER_WIDTH of channel %d is not positive.\n",
+                channel);
+            return false;
+        }
+        if (used[TRProcStageDecimate] && chain.decimation < 1) {
+            errlogSevPrintf(errlogMajor, "TRProcessGraph Error: PROC_DECIMATION of channel %d is not positive.\n",
+                channel);
+            return false;
+        }
+        if (used[TRProcStageRoi] && (chain.roi_start < 0 || chain.roi_size < 0)) {
+            errlogSevPrintf(errlogMajor, "TRProcessGraph Error: PROC_ROI_START or PROC_ROI_SIZE of channel %d is negative.\n",
+                channel);
+            return false;
+        }
+
+        // Parameters of unused stages have no effect.
+        if (!used[TRProcStageConvert]) {
+            chain.scale = 1.0;
+            chain.offset = 0.0;
+        }
+        if (!used[TRProcStageDecimate]) {
+            chain.decimation = 1;
+        }
+
+        // Allocate the history of the filter now, not when processing.
+        chain.filter_history.assign(used[TRProcStageFilter] ? chain.filter_width : 0, 0.0);
+
+        // The decimation by the chain adds to that of the channel.
+        (*decimation)[channel] *= chain.decimation;
+
+        Results &results = m_results[channel];
+        results.stat_min = NAN;
+        results.stat_max = NAN;
+        results.stat_mean = NAN;
+        results.stat_rms = NAN;
+        results.time = NAN;
+    }
+
+    return true;
+}
+
+bool TRProcessGraph::hasChain (int channel)
+{
+    return !m_chains[channel].stages.empty();
+}
+
+void TRProcessGraph::run (TRBaseDriver &driver, TRParallelCopy &parallel, TRProcessInput const *inputs,
+                          epicsUInt64 burst_id, double timestamp, epicsTimeStamp epics_ts,
+                          TRTriggerRoute const &route)
+{
+    epicsGuard<epicsMutex> lock(m_run_mutex);
+
+    m_run_driver = &driver;
+    m_run_inputs = inputs;
+    m_run_burst_id = burst_id;
+    m_run_timestamp = timestamp;
+    m_run_epics_ts = epics_ts;
+    m_run_route = route;
+
+    // Channels are independent, so they are processed concurrently
+    // by the helper threads.
+    parallel.run(*this, m_num_channels);
+
+    m_run_driver = NULL;
+    m_run_inputs = NULL;
+}
+
+void TRProcessGraph::runParallelItem (int item)
+{
+    int channel = item;
+    TRBaseDriver &driver = *m_run_driver;
+    TRProcessInput const &input = m_run_inputs[channel];
+
+    if (input.data == NULL) {
+        return;
+    }
+
+    int num_pre;
+    int num_post;
+    driver.getChannelSampleCounts(channel, &num_pre, &num_post);
+    assert(input.num_samples == (size_t)num_pre + num_post);
+
+    Chain &chain = m_chains[channel];
+    bool process = !chain.stages.empty();
+
+    // The chain was validated for the data type declared at arming only.
+    if (process && input.data_type != m_input_data_type) {
+        errlogSevPrintf(errlogMajor, "TRProcessGraph Error: Input of channel %d has data type %d instead of %d, skipping it.\n",
+            channel, (int)input.data_type, (int)m_input_data_type);
+        return;
+    }
+
+    // Allocate the array with the number of input samples. Stages work in
+    // place in the array and can only reduce the number of samples.
+    TRChannelDataSubmit submit;
+    NDDataType_t data_type = process ? NDFloat64 : input.data_type;
+    if (!submit.allocateArray(driver, channel, data_type, (int)input.num_samples, m_run_route)) {
+        return;
+    }
+
+    // No array means that the array is not needed, skip the channel.
+    NDArray *array = submit.m_array;
+    if (array == NULL) {
+        return;
+    }
+
+    if (!process) {
+        // Just copy the input.
+        NDArrayInfo info;
+        array->getInfo(&info);
+        memcpy(array->pData, input.data, info.totalBytes);
+    } else {
+        Results results;
+        results.stat_min = NAN;
+        results.stat_max = NAN;
+        results.stat_mean = NAN;
+        results.stat_rms = NAN;
+
+        double start = TRPerfClock::now();
+
+        // Load the input into the array. This is the convert stage if the
+        // chain starts with it, else a conversion with no scaling.
+        double *data = (double *)array->pData;
+        if (input.data_type == NDInt16) {
+            TRKernels::convertInt16ToFloat64((epicsInt16 const *)input.data, data, input.num_samples,
+                                             chain.scale, chain.offset);
+        } else {
+            double const *in = (double const *)input.data;
+            for (size_t i = 0; i < input.num_samples; i++) {
+                data[i] = in[i] * chain.scale + chain.offset;
+            }
+        }
+        driver.m_perf_driver.addSample(TRPerfDataPathProcConvert, TRPerfClock::now() - start);
+
+        size_t offset = 0;
+        size_t count = runChain(channel, chain, data, input.num_samples, num_pre, &offset, &results);
+
+        // Reduce the size of the array to the processed samples. The offset
+        // of the dimension gives the position of the first sample.
+        array->dims[0].size = count;
+        array->dims[0].offset = offset;
+
+        results.time = TRPerfClock::now() - start;
+
+        epicsGuard<asynPortDriver> lock(*this);
+        m_results[channel] = results;
+    }
+
+    submit.submit(driver, channel, m_run_burst_id, m_run_timestamp, m_run_epics_ts, NULL, m_run_route);
+}
+
+size_t TRProcessGraph::runChain (int channel, Chain &chain, double *data, size_t count, int num_pre,
+                                 size_t *offset, Results *results)
+{
+    TRPerfStatsDriver &perf_driver = m_run_driver->m_perf_driver;
+
+    for (size_t i = 0; i < chain.stages.size(); i++) {
+        TRProcStage stage = chain.stages[i];
+        double start = TRPerfClock::now();
+
+        switch (stage) {
+            case TRProcStageConvert:
+                // Done when loading the input.
+                continue;
+
+            case TRProcStageBaseline: {
+                size_t n = std::min(count, (size_t)chain.baseline_samples);
+                if (n == 0) {
+                    break;
+                }
+                double sum = 0.0;
+                for (size_t j = 0; j < n; j++) {
+                    sum += data[j];
+                }
+                double baseline = sum / n;
+                for (size_t j = 0; j < count; j++) {
+                    data[j] -= baseline;
+                }
+            } break;
+
+            case TRProcStageFilter: {
+                // The history holds the last inputs, as they are overwritten.
+                std::vector<double> &history = chain.filter_history;
+                size_t width = history.size();
+                double sum = 0.0;
+                for (size_t j = 0; j < count; j++) {
+                    size_t slot = j % width;
+                    if (j >= width) {
+                        sum -= history[slot];
+                    }
+                    history[slot] = data[j];
+                    sum += data[j];
+                    data[j] = sum / (double)std::min(j + 1, width);
+                }
+            } break;
+
+            case TRProcStageDecimate: {
+                // Output samples start at input samples whose index relative
+                // to the trigger is a multiple of the decimation ratio.
+                size_t ratio = (size_t)chain.decimation;
+                size_t first = (size_t)num_pre % ratio;
+                size_t out_count = (count > first) ? ((count - first + ratio - 1) / ratio) : 0;
+                for (size_t k = 0; k < out_count; k++) {
+                    size_t begin = first + k * ratio;
+                    size_t end = std::min(begin + ratio, count);
+                    double sum = 0.0;
+                    for (size_t j = begin; j < end; j++) {
+                        sum += data[j];
+                    }
+                    data[k] = sum / (double)(end - begin);
+                }
+                count = out_count;
+                num_pre = num_pre / (int)ratio;
+            } break;
+
+            case TRProcStageStats: {
+                if (count == 0) {
+                    break;
+                }
+                double min = data[0];
+                double max = data[0];
+                double sum = 0.0;
+                double sum_sq = 0.0;
+                for (size_t j = 0; j < count; j++) {
+                    double value = data[j];
+                    min = std::min(min, value);
+                    max = std::max(max, value);
+                    sum += value;
+                    sum_sq += value * value;
+                }
+                results->stat_min = min;
+                results->stat_max = max;
+                results->stat_mean = sum / count;
+                results->stat_rms = std::sqrt(sum_sq / count);
+            } break;
+
+            case TRProcStageRoi: {
+                size_t roi_start = std::min(count, (size_t)chain.roi_start);
+                size_t roi_size = count - roi_start;
+                if (chain.roi_size > 0) {
+                    roi_size = std::min(roi_size, (size_t)chain.roi_size);
+                }
+                if (roi_start > 0) {
+                    memmove(data, data + roi_start, roi_size * sizeof(double));
+                }
+                *offset += roi_start;
+                num_pre = std::max(0, num_pre - (int)roi_start);
+                count = roi_size;
+            } break;
+
+            default:
+                assert(false);
+        }
+
+        perf_driver.addSample(TRPerfDataPathProcConvert + stage, TRPerfClock::now() - start);
+    }
+
+    return count;
+}
@@ -0,0 +1,229 @@
+/* This file is part of the Transient Recorder Framework.
+ * It is subject to the license terms in the LICENSE.txt file found in the
+ * top-level directory of this distribution and at
+ * https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. No part
+ * of the Transient Recorder Framework, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ */
+
+/**
+ * @file
+ *
+ * Defines the TRProcessGraph class, the per-channel processing graph
+ * executed by the framework.
+ */
+
+#ifndef TRANSREC_PROCESS_GRAPH_H
+#define TRANSREC_PROCESS_GRAPH_H
+
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+#include <epicsTypes.h>
+#include <epicsTime.h>
+#include <epicsMutex.h>
+
+#include <asynPortDriver.h>
+#include <NDArray.h>
+
+#include "TRNonCopyable.h"
+#include "TRParallelCopy.h"
+#include "TRTriggerRoute.h"
+
+class TRBaseDriver;
+
+/**
+ * Built-in stages of the processing graph.
+ *
+ * The name of each stage, as used in the PROC_CHAIN parameter, is given in
+ * parentheses. All stages operate in place on the samples of the channel
+ * as floating-point values.
+ *
+ * - Convert (`convert`): out = in * PROC_SCALE + PROC_OFFSET. This can only
+ *   be the first stage; without it the input is converted with no scaling.
+ * - Baseline (`baseline`): subtract the mean of the first
+ *   PROC_BASELINE_SAMPLES samples (e.g. pre-trigger samples).
+ * - Filter (`filter`): causal moving average of PROC_FILTER_WIDTH samples
+ *   (fewer at the start of the data).
+ * - Decimate (`decimate`): reduce the sample rate by PROC_DECIMATION, each
+ *   output sample being the mean of the input samples from a sample aligned
+ *   to the trigger up to the next such sample (see
+ *   TRArmInfo::decimateSampleCounts). Cannot follow Roi.
+ * - Stats (`stats`): compute the minimum, maximum, mean and RMS of the
+ *   samples, without changing them.
+ * - Roi (`roi`): keep PROC_ROI_SIZE samples (0 for all) starting at
+ *   PROC_ROI_START. The offset of the region is in the offset of the first
+ *   dimension of the NDArray.
+ *
+ * The enumeration value plus TRPerfDataPathProcConvert is the performance
+ * statistics entry of the stage.
+ */
+enum TRProcStage {
+    TRProcStageConvert,
+    TRProcStageBaseline,
+    TRProcStageFilter,
+    TRProcStageDecimate,
+    TRProcStageStats,
+    TRProcStageRoi,
+    TRNumProcStages
+};
+
+/**
+ * Input data of a channel for TRBaseDriver::submitProcessedBurst.
+ */
+struct TRProcessInput {
+    /**
+     * Constructor for an empty input (the channel is skipped).
+     */
+    inline TRProcessInput ()
+    : data(NULL),
+      data_type(NDInt16),
+      num_samples(0)
+    {
+    }
+
+    /**
+     * The samples of the channel, or NULL to skip the channel.
+     */
+    void const *data;
+
+    /**
+     * The data type of the samples. For channels with a processing chain
+     * this must be TRArmInfo::process_input_data_type, other channels may
+     * use any type.
+     */
+    NDDataType_t data_type;
+
+    /**
+     * Number of samples, which must be the number given by
+     * TRBaseDriver::getChannelSampleCounts.
+     */
+    size_t num_samples;
+};
+
+/**
+ * Asyn port for the processing graph, a chain of built-in stages for each
+ * channel (see @ref TRProcStage), which is executed by the framework in
+ * TRBaseDriver::submitProcessedBurst. It is created if
+ * TRBaseConfig::process_graph is set.
+ *
+ * The port is named as the base port with the suffix `_proc`.
+ * It is a multi-device port where each address corresponds to a channel.
+ * Each address provides the parameters:
+ * - PROC_CHAIN: the names of the stages in order, separated by commas or
+ *   spaces (e.g. "convert,baseline,filter,stats"). Empty for no processing.
+ * - PROC_SCALE, PROC_OFFSET, PROC_BASELINE_SAMPLES, PROC_FILTER_WIDTH,
+ *   PROC_DECIMATION, PROC_ROI_START, PROC_ROI_SIZE: parameters of stages.
+ * - PROC_STAT_MIN, PROC_STAT_MAX, PROC_STAT_MEAN, PROC_STAT_RMS (readback):
+ *   results of the Stats stage for the last processed burst (NAN if none).
+ * - PROC_TIME (readback): time taken by the chain of the channel for the
+ *   last processed burst (ms), excluding allocation and submission of the
+ *   array.
+ * Readbacks are computed when the parameters are read, so records should
+ * be scanned.
+ *
+ * Settings take effect at the next arming, when they are validated; an
+ * invalid configuration fails the arming.
+ */
+class TRProcessGraph : public asynPortDriver,
+    private TRNonCopyable,
+    private TRParallelTask
+{
+    friend class TRBaseDriver;
+
+    // Enumeration of asyn parameters.
+    enum Params {
+        CHAIN,
+        SCALE,
+        OFFSET,
+        BASELINE_SAMPLES,
+        FILTER_WIDTH,
+        DECIMATION,
+        ROI_START,
+        ROI_SIZE,
+        STAT_MIN,
+        STAT_MAX,
+        STAT_MEAN,
+        STAT_RMS,
+        TIME,
+        NUM_PARAMS
+    };
+
+public:
+    TRProcessGraph (std::string const &base_port_name, int num_channels);
+
+    virtual asynStatus readFloat64 (asynUser *pasynUser, epicsFloat64 *value);
+
+private:
+    // The chain of a channel for the current arming.
+    struct Chain {
+        std::vector<TRProcStage> stages;
+        double scale;
+        double offset;
+        int baseline_samples;
+        int filter_width;
+        int decimation;
+        int roi_start;
+        int roi_size;
+
+        // History of inputs of the filter (allocated when configuring).
+        std::vector<double> filter_history;
+    };
+
+    // Results of a channel (protected by the port lock).
+    struct Results {
+        double stat_min;
+        double stat_max;
+        double stat_mean;
+        double stat_rms;
+        double time;
+    };
+
+    int m_params[NUM_PARAMS];
+    int m_num_channels;
+    NDDataType_t m_input_data_type;
+    std::vector<Chain> m_chains;
+    std::vector<Results> m_results;
+
+    // The burst being processed by run (protected by m_run_mutex).
+    epicsMutex m_run_mutex;
+    TRBaseDriver *m_run_driver;
+    TRProcessInput const *m_run_inputs;
+    epicsUInt64 m_run_burst_id;
+    double m_run_timestamp;
+    epicsTimeStamp m_run_epics_ts;
+    TRTriggerRoute m_run_route;
+
+private:
+    // The follwing functions are for internal use by Transient Recorder framework.
+
+    // Take the settings for an arming and validate them for inputs of the
+    // given data type. Sets the decimation of each channel by its chain.
+    // Returns false if the settings are invalid.
+    bool configure (NDDataType_t input_data_type, std::vector<int> *decimation);
+
+    // Check whether a channel has a non-empty chain for the current arming.
+    bool hasChain (int channel);
+
+    // Process and submit the channels of a burst using the helper threads.
+    // Must be called with no port locked.
+    void run (TRBaseDriver &driver, TRParallelCopy &parallel, TRProcessInput const *inputs,
+              epicsUInt64 burst_id, double timestamp, epicsTimeStamp epics_ts,
+              TRTriggerRoute const &route);
+
+    // Process and submit one channel of the burst being run.
+    virtual void runParallelItem (int item);
+
+    // Run the chain of a channel on the samples in place. Returns the
+    // resulting number of samples and sets the offset of the first sample.
+    size_t runChain (int channel, Chain &chain, double *data, size_t count, int num_pre,
+                     size_t *offset, Results *results);
+
+    // Parse the name of a stage, returns TRNumProcStages if unknown.
+    static TRProcStage parseStage (std::string const &name);
+};
+
+#endif
@@ -0,0 +1,92 @@
+/* This file is part of the Transient Recorder Framework.
+ * It is subject to the license terms in the LICENSE.txt file found in the
+ * top-level directory of this distribution and at
+ * https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. No part
+ * of the Transient Recorder Framework, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ */
+
+/**
+ * @file
+ *
+ * Defines the TRRandom class, a pseudo-random generator for testing.
+ */
+
+#ifndef TRANSREC_RANDOM_H
+#define TRANSREC_RANDOM_H
+
+#include <cmath>
+#include <algorithm>
+
+#include <epicsTypes.h>
+
+/**
+ * Small and fast pseudo-random generator (xorshift64*), used for
+ * simulations and load injection.
+ *
+ * Sequences are reproducible for a given seed. The class has no
+ * internal synchronization.
+ */
+class TRRandom {
+public:
+    /**
+     * Constructor, seeds the generator with 1.
+     */
+    inline TRRandom ()
+    {
+        seed(1);
+    }
+
+    /**
+     * Restart the sequence for the given seed.
+     */
+    inline void seed (epicsUInt64 seed)
+    {
+        // The state must not be zero.
+        m_state = seed * 0x9E3779B97F4A7C15ull + 1;
+    }
+
+    /**
+     * Return a uniformly distributed value in [0, 1).
+     */
+    inline double uniform ()
+    {
+        m_state ^= m_state >> 12;
+        m_state ^= m_state << 25;
+        m_state ^= m_state >> 27;
+        epicsUInt64 value = m_state * 0x2545F4914F6CDD1Dull;
+        return (value >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    /**
+     * Return a uniformly distributed integer in [0, n), n must be positive.
+     */
+    inline int below (int n)
+    {
+        return std::min(n - 1, (int)(uniform() * n));
+    }
+
+    /**
+     * Return an exponentially distributed value with the given mean.
+     */
+    inline double exponential (double mean)
+    {
+        return -mean * std::log(1.0 - uniform());
+    }
+
+    /**
+     * Return a normally distributed value (Box-Muller transform).
+     */
+    inline double normal (double mean, double stddev)
+    {
+        double u1 = 1.0 - uniform();
+        double u2 = uniform();
+        return mean + stddev * std::sqrt(-2.0 * std::log(u1)) * std::cos(6.283185307179586 * u2);
+    }
+
+private:
+    epicsUInt64 m_state;
+};
+
+#endif
@@ -0,0 +1,397 @@
+/* This file is part of the Transient Recorder Framework.
+ * It is subject to the license terms in the LICENSE.txt file found in the
+ * top-level directory of this distribution and at
+ * https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. No part
+ * of the Transient Recorder Framework, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ */
+
+#include <stddef.h>
+#include <limits.h>
+
+#include <cmath>
+
+#include <epicsGuard.h>
+#include <epicsTime.h>
+#include <errlog.h>
+#include <iocsh.h>
+
+#include <NDArray.h>
+
+#include <epicsExport.h>
+
+#include "TRReplayDriver.h"
+#include "TRBurstMetaInfo.h"
+#include "TRPerfStat.h"
+
+double const TRReplayDriver::StatsPeriod = 1.0;
+
+TRReplayDriver::TRReplayDriver (TRBaseConfig const &cfg, TRBurstFile *file, double raw_burst_rate)
+:   TRBaseDriver(cfg),
+    m_file(file),
+    m_raw_burst_period((raw_burst_rate > 0.0) ? (1.0 / raw_burst_rate) : 0.0),
+    m_interrupted(false),
+    m_mode(ReplayModeTimed),
+    m_speed(1.0),
+    m_loop(false),
+    m_position(0),
+    m_burst_counter(0),
+    m_schedule_valid(false),
+    m_schedule_wall_start(0.0),
+    m_schedule_file_start(0.0),
+    m_lag(0.0),
+    m_file_burst_id(0),
+    m_submits(new TRChannelDataSubmit[cfg.num_channels]),
+    m_stats_start(0.0),
+    m_stats_bytes(0.0),
+    m_stats_bursts(0)
+{
+    initConfigParam(m_param_mode,  "REPLAY_MODE",  -1);
+    initConfigParam(m_param_speed, "REPLAY_SPEED", (double)NAN);
+    initConfigParam(m_param_loop,  "REPLAY_LOOP",  -1);
+
+    createParam("REPLAY_NUM_BURSTS", asynParamInt32,   &m_asyn_params[REPLAY_NUM_BURSTS]);
+    createParam("REPLAY_POSITION",   asynParamInt32,   &m_asyn_params[REPLAY_POSITION]);
+    createParam("REPLAY_THROUGHPUT", asynParamFloat64, &m_asyn_params[REPLAY_THROUGHPUT]);
+    createParam("REPLAY_BURST_RATE", asynParamFloat64, &m_asyn_params[REPLAY_BURST_RATE]);
+    createParam("REPLAY_LAG",        asynParamFloat64, &m_asyn_params[REPLAY_LAG]);
+
+    setIntegerParam(m_asyn_params[REPLAY_NUM_BURSTS], (int)m_file->getNumBursts());
+    setIntegerParam(m_asyn_params[REPLAY_POSITION],   0);
+    setDoubleParam(m_asyn_params[REPLAY_THROUGHPUT],  0.0);
+    setDoubleParam(m_asyn_params[REPLAY_BURST_RATE],  0.0);
+    setDoubleParam(m_asyn_params[REPLAY_LAG],         0.0);
+}
+
+TRReplayDriver::~TRReplayDriver ()
+{
+    delete[] m_submits;
+}
+
+TRReplayDriver * TRReplayDriver::create (TRBaseConfig base_cfg, TRReplayConfig const &replay_cfg)
+{
+    bool allow_raw = replay_cfg.raw_layout.num_channels > 0;
+
+    epics_auto_ptr<TRBurstFile> file(new TRBurstFile());
+    if (!file->open(replay_cfg.file_path, allow_raw ? &replay_cfg.raw_layout : NULL)) {
+        return NULL;
+    }
+
+    if (file->getNumSamples() > INT_MAX) {
+        errlogSevPrintf(errlogMajor, "TRReplayDriver Error: Too many samples per burst in %s.\n",
+            replay_cfg.file_path.c_str());
+        return NULL;
+    }
+
+    base_cfg.num_channels = file->getNumChannels();
+    base_cfg.num_config_params += 3;
+    base_cfg.num_asyn_params += NUM_REPLAY_ASYN_PARAMS;
+
+    // Channels without consumers are not copied (copyData does nothing
+    // without an array).
+    base_cfg.elide_unused_arrays = true;
+
+    TRReplayDriver *driver = new TRReplayDriver(base_cfg, file.release(), replay_cfg.raw_burst_rate);
+    driver->completeInit();
+
+    return driver;
+}
+
+void TRReplayDriver::requestedSampleRateChanged ()
+{
+    // The sample rate is given by the file if it is known.
+    double sample_rate = m_file->getSampleRate();
+    if (std::isnan(sample_rate)) {
+        sample_rate = getRequestedSampleRate();
+    }
+    setAchievableSampleRate(sample_rate);
+}
+
+bool TRReplayDriver::checkSettings (TRArmInfo &arm_info)
+{
+    if (m_file->getNumBursts() == 0) {
+        errlogSevPrintf(errlogMajor, "TRReplayDriver Error: %s contains no bursts.\n",
+            m_file->getPath().c_str());
+        return false;
+    }
+
+    int mode = m_param_mode.getSnapshot();
+    if (mode != ReplayModeTimed && mode != ReplayModeFast) {
+        errlogSevPrintf(errlogMajor, "TRReplayDriver Error: Invalid replay mode.\n");
+        return false;
+    }
+    m_mode = (ReplayMode)mode;
+
+    if (m_mode == ReplayModeTimed) {
+        m_speed = m_param_speed.getSnapshot();
+        if (!(m_speed > 0.0)) {
+            errlogSevPrintf(errlogMajor, "TRReplayDriver Error: Replay speed must be positive.\n");
+            return false;
+        }
+        if (!m_file->isBurstFile() && m_raw_burst_period == 0.0) {
+            errlogSevPrintf(errlogMajor, "TRReplayDriver Error: Timed replay of a raw file requires a burst rate.\n");
+            return false;
+        }
+    } else {
+        m_param_speed.setIrrelevant();
+    }
+
+    m_loop = m_param_loop.getSnapshot() != 0;
+
+    // The number of samples is given by the file.
+    int num_samples = (int)m_file->getNumSamples();
+    arm_info.custom_time_array_calc_inputs = true;
+    arm_info.custom_time_array_num_pre_samples = 0;
+    arm_info.custom_time_array_num_post_samples = num_samples;
+
+    arm_info.rate_for_display = getAchievableSampleRateSnapshot();
+
+    // Help automatic pool sizing.
+    arm_info.burst_memory = m_file->getNumChannels() * m_file->getChannelDataSize();
+    if (m_mode == ReplayModeTimed && !m_file->isBurstFile()) {
+        arm_info.expected_burst_rate = m_speed / m_raw_burst_period;
+    }
+
+    return true;
+}
+
+bool TRReplayDriver::startAcquisition (bool overflow)
+{
+    {
+        epicsGuard<asynPortDriver> lock(*this);
+        m_interrupted = false;
+    }
+    m_interrupt_event.tryWait();
+
+    if (!overflow) {
+        m_position = 0;
+        m_burst_counter = 0;
+        m_schedule_valid = false;
+        m_lag = 0.0;
+        m_stats_start = TRPerfClock::now();
+        m_stats_bytes = 0.0;
+        m_stats_bursts = 0;
+
+        m_file->prefetch(0, PrefetchBursts);
+    }
+
+    return true;
+}
+
+bool TRReplayDriver::readBurst ()
+{
+    // At the end of the file, start again or disarm.
+    if (m_position >= m_file->getNumBursts()) {
+        if (!m_loop) {
+            epicsGuard<asynPortDriver> lock(*this);
+            requestDisarmingFromDriver();
+            return true;
+        }
+        m_position = 0;
+        m_schedule_valid = false;
+    }
+
+    if (m_mode == ReplayModeTimed) {
+        double file_time = burstFileTime(m_position);
+
+        // The schedule starts with the first burst after arming or wrapping
+        // around, and when timestamps are missing.
+        if (!m_schedule_valid || std::isnan(file_time)) {
+            m_schedule_valid = !std::isnan(file_time);
+            m_schedule_wall_start = TRPerfClock::now();
+            m_schedule_file_start = file_time;
+        }
+
+        double due = m_schedule_wall_start;
+        if (m_schedule_valid && file_time > m_schedule_file_start) {
+            due += (file_time - m_schedule_file_start) / m_speed;
+        }
+
+        if (!waitUntil(due)) {
+            return true;
+        }
+
+        m_lag = TRPerfClock::now() - due;
+    } else if (isInterrupted()) {
+        return true;
+    }
+
+    // Request read-ahead of the following bursts.
+    m_file->prefetch(m_position + 1, PrefetchBursts);
+
+    return true;
+}
+
+bool TRReplayDriver::processBurstData ()
+{
+    epicsTimeStamp file_ts;
+    m_file->getBurstInfo(m_position, &m_file_burst_id, &file_ts);
+
+    updateTimeStamp();
+    epicsTimeStamp epics_ts;
+    getTimeStamp(&epics_ts);
+    double timestamp = epics_ts.secPastEpoch + 1e-9 * epics_ts.nsec;
+
+    int num_channels = m_file->getNumChannels();
+    int num_samples = (int)m_file->getNumSamples();
+    size_t channel_size = m_file->getChannelDataSize();
+
+    for (int channel = 0; channel < num_channels; channel++) {
+        TRChannelDataSubmit &submit = m_submits[channel];
+        if (submit.allocateArray(*this, channel, m_file->getDataType(), num_samples)) {
+            submit.copyData(*this, m_file->getChannelData(m_position, channel), channel_size);
+        }
+        submit.submit(*this, channel, m_burst_counter, timestamp, epics_ts, this);
+    }
+
+    // In the Timed mode the trigger time is when the burst was due, so that
+    // the burst latency includes any lag behind the schedule.
+    TRBurstMetaInfo info(m_burst_counter);
+    if (m_mode == ReplayModeTimed) {
+        info.trigger_time = epics_ts;
+        epicsTimeAddSeconds(&info.trigger_time, -m_lag);
+    }
+    publishBurstMetaInfo(info);
+
+    m_burst_counter++;
+    m_position++;
+
+    m_stats_bytes += (double)num_channels * channel_size;
+    m_stats_bursts++;
+    updateStats(false);
+
+    return true;
+}
+
+void TRReplayDriver::interruptReading ()
+{
+    m_interrupted = true;
+    m_interrupt_event.signal();
+}
+
+void TRReplayDriver::stopAcquisition ()
+{
+    updateStats(true);
+}
+
+double TRReplayDriver::burstFileTime (size_t burst)
+{
+    if (!m_file->isBurstFile()) {
+        return burst * m_raw_burst_period;
+    }
+
+    epicsUInt64 burst_id;
+    epicsTimeStamp ts;
+    m_file->getBurstInfo(burst, &burst_id, &ts);
+
+    if (ts.secPastEpoch == 0 && ts.nsec == 0) {
+        return (m_raw_burst_period > 0.0) ? (burst * m_raw_burst_period) : NAN;
+    }
+    return ts.secPastEpoch + 1e-9 * ts.nsec;
+}
+
+bool TRReplayDriver::waitUntil (double time)
+{
+    while (true) {
+        if (isInterrupted()) {
+            return false;
+        }
+        double remaining = time - TRPerfClock::now();
+        if (remaining <= 0.0) {
+            return true;
+        }
+        m_interrupt_event.wait(remaining);
+    }
+}
+
+bool TRReplayDriver::isInterrupted ()
+{
+    epicsGuard<asynPortDriver> lock(*this);
+    return m_interrupted;
+}
+
+void TRReplayDriver::updateStats (bool force)
+{
+    double now = TRPerfClock::now();
+    double elapsed = now - m_stats_start;
+    if (!force && elapsed < StatsPeriod) {
+        return;
+    }
+
+    epicsGuard<asynPortDriver> lock(*this);
+
+    if (elapsed > 0.0) {
+        setDoubleParam(m_asyn_params[REPLAY_THROUGHPUT], m_stats_bytes / elapsed / 1e6);
+        setDoubleParam(m_asyn_params[REPLAY_BURST_RATE], m_stats_bursts / elapsed);
+    }
+    setIntegerParam(m_asyn_params[REPLAY_POSITION], (int)m_position);
+    setDoubleParam(m_asyn_params[REPLAY_LAG], (m_mode == ReplayModeTimed) ? (1000.0 * m_lag) : 0.0);
+    callParamCallbacks();
+
+    m_stats_start = now;
+    m_stats_bytes = 0.0;
+    m_stats_bursts = 0;
+}
+
+bool TRReplayDriver::completeArray (NDArray *array)
+{
+    // Keep the original burst ID (exact up to 2^53).
+    double burst_id = (double)m_file_burst_id;
+    array->pAttributeList->add("TR_REPLAY_BURST_ID", "burst ID in the replayed file",
+                               NDAttrFloat64, (void *)&burst_id);
+    return true;
+}
+
+// iocsh registration of TRReplayDriverConfigure.
+
+static const iocshArg initArg0 = {"portName", iocshArgString};
+static const iocshArg initArg1 = {"filePath", iocshArgString};
+static const iocshArg initArg2 = {"rawNumChannels", iocshArgInt};
+static const iocshArg initArg3 = {"rawNumSamples", iocshArgInt};
+static const iocshArg initArg4 = {"rawDataType", iocshArgInt};
+static const iocshArg initArg5 = {"rawSampleRate", iocshArgDouble};
+static const iocshArg initArg6 = {"rawBurstRate", iocshArgDouble};
+static const iocshArg initArg7 = {"readThreadPriority", iocshArgInt};
+static const iocshArg initArg8 = {"maxBuffers", iocshArgInt};
+static const iocshArg initArg9 = {"maxMemory", iocshArgDouble};
+static const iocshArg initArg10 = {"numCopyThreads", iocshArgInt};
+static const iocshArg * const initArgs[] = {
+    &initArg0, &initArg1, &initArg2, &initArg3, &initArg4, &initArg5,
+    &initArg6, &initArg7, &initArg8, &initArg9, &initArg10
+};
+static const iocshFuncDef initFuncDef = {"TRReplayDriverConfigure", 11, initArgs};
+
+static void initCallFunc (const iocshArgBuf *args)
+{
+    if (args[0].sval == NULL || args[1].sval == NULL) {
+        errlogSevPrintf(errlogMajor, "TRReplayDriver Error: Port name and file path are required.\n");
+        return;
+    }
+
+    TRBaseConfig base_cfg;
+    base_cfg.port_name = args[0].sval;
+    base_cfg.read_thread_prio = args[7].ival;
+    base_cfg.max_ad_buffers = args[8].ival;
+    base_cfg.max_ad_memory = (args[9].dval > 0.0) ? (size_t)args[9].dval : 0;
+    base_cfg.num_copy_threads = args[10].ival;
+
+    TRReplayConfig replay_cfg;
+    replay_cfg.file_path = args[1].sval;
+    replay_cfg.raw_layout.num_channels = args[2].ival;
+    replay_cfg.raw_layout.num_samples = (args[3].ival > 0) ? (size_t)args[3].ival : 0;
+    replay_cfg.raw_layout.data_type = (NDDataType_t)args[4].ival;
+    replay_cfg.raw_layout.sample_rate = (args[5].dval > 0.0) ? args[5].dval : NAN;
+    replay_cfg.raw_burst_rate = args[6].dval;
+
+    TRReplayDriver::create(base_cfg, replay_cfg);
+}
+
+static void TRReplayDriverRegister (void)
+{
+    iocshRegister(&initFuncDef, initCallFunc);
+}
+
+extern "C" {
+    epicsExportRegistrar(TRReplayDriverRegister);
+}
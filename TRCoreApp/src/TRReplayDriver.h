@@ -0,0 +1,185 @@
+/* This file is part of the Transient Recorder Framework.
+ * It is subject to the license terms in the LICENSE.txt file found in the
+ * top-level directory of this distribution and at
+ * https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. No part
+ * of the Transient Recorder Framework, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ */
+
+/**
+ * @file
+ *
+ * Defines the TRReplayDriver class, a driver which replays recorded bursts.
+ */
+
+#ifndef TRANSREC_REPLAY_DRIVER_H
+#define TRANSREC_REPLAY_DRIVER_H
+
+#include <stddef.h>
+
+#include <string>
+
+#include <epicsTypes.h>
+#include <epicsEvent.h>
+
+#include "TRBaseDriver.h"
+#include "TRBurstFile.h"
+#include "TRChannelDataSubmit.h"
+
+/**
+ * Configuration of TRReplayDriver, in addition to TRBaseConfig.
+ */
+struct TRReplayConfig {
+    /**
+     * Path of the burst file or raw file to replay.
+     */
+    std::string file_path;
+
+    /**
+     * Layout of raw files (see TRBurstFile::open). Raw files are only
+     * accepted if raw_layout.num_channels is positive.
+     */
+    TRBurstFile::RawLayout raw_layout;
+
+    /**
+     * Rate of bursts in raw files (Hz), used for timed replay since raw
+     * files contain no timestamps. Zero if not known (then raw files can
+     * only be replayed as fast as possible).
+     */
+    double raw_burst_rate;
+};
+
+/**
+ * Driver which replays recorded bursts from a file through the framework.
+ *
+ * The data is fed through the same path as for a digitizer (read loop,
+ * TRChannelDataSubmit, plugins), which allows reproducing performance
+ * problems offline with realistic data. The file is memory-mapped
+ * (see TRBurstFile) and the data is copied into NDArrays using
+ * TRChannelDataSubmit::copyData.
+ *
+ * The replay mode is a configuration parameter:
+ * - Timed: bursts are submitted according to their original timestamps
+ *   (or the configured burst rate for raw files), at a multiple of real
+ *   time given by the REPLAY_SPEED parameter.
+ * - Fast: bursts are submitted as fast as possible.
+ *
+ * When the end of the file is reached, replay continues at the start if
+ * the REPLAY_LOOP parameter is enabled, otherwise the driver disarms.
+ * The number of samples per burst is given by the file, the sample number
+ * settings of the framework are ignored. The achievable sample rate is the
+ * sample rate of the file, if known.
+ *
+ * The achieved data and burst rates and the lag behind the schedule in
+ * the Timed mode are reported by parameters (see TRReplay.db), in addition
+ * to the arming statistics of the framework. The original burst ID is
+ * added to arrays as the attribute TR_REPLAY_BURST_ID.
+ *
+ * An instance is created using the iocsh command TRReplayDriverConfigure
+ * (requires TRReplayDriver.dbd).
+ */
+class TRReplayDriver : public TRBaseDriver,
+    private TRArrayCompletionCallback
+{
+public:
+    /**
+     * Constructor, the file must already be open.
+     *
+     * @param cfg Configuration for TRBaseDriver, num_channels must match
+     *            the file.
+     * @param file The opened file, ownership is taken.
+     * @param raw_burst_rate See TRReplayConfig::raw_burst_rate.
+     */
+    TRReplayDriver (TRBaseConfig const &cfg, TRBurstFile *file, double raw_burst_rate);
+
+    ~TRReplayDriver ();
+
+    /**
+     * Open the file and create the driver.
+     *
+     * @param base_cfg Configuration for TRBaseDriver, num_channels is
+     *                 determined from the file.
+     * @param replay_cfg Configuration of the replay.
+     * @return The driver, or NULL on error (which is logged).
+     */
+    static TRReplayDriver * create (TRBaseConfig base_cfg, TRReplayConfig const &replay_cfg);
+
+protected:
+    void requestedSampleRateChanged ();
+    bool checkSettings (TRArmInfo &arm_info);
+    bool startAcquisition (bool overflow);
+    bool readBurst ();
+    bool processBurstData ();
+    void interruptReading ();
+    void stopAcquisition ();
+
+private:
+    enum ReplayMode {
+        ReplayModeTimed,
+        ReplayModeFast
+    };
+
+    enum Params {
+        REPLAY_NUM_BURSTS,
+        REPLAY_POSITION,
+        REPLAY_THROUGHPUT,
+        REPLAY_BURST_RATE,
+        REPLAY_LAG,
+        NUM_REPLAY_ASYN_PARAMS
+    };
+
+    // Number of bursts for which read-ahead is requested.
+    static size_t const PrefetchBursts = 4;
+
+    // Period for updating the throughput parameters (s).
+    static double const StatsPeriod;
+
+    epics_auto_ptr<TRBurstFile> m_file;
+    double m_raw_burst_period;
+    int m_asyn_params[NUM_REPLAY_ASYN_PARAMS];
+
+    // Configuration parameters.
+    TRConfigParam<int> m_param_mode;
+    TRConfigParam<double> m_param_speed;
+    TRConfigParam<int> m_param_loop;
+
+    // Set by interruptReading (protected by the port lock).
+    bool m_interrupted;
+    epicsEvent m_interrupt_event;
+
+    // State of the read loop (only accessed by the read thread), with
+    // the snapshot settings of the arming.
+    ReplayMode m_mode;
+    double m_speed;
+    bool m_loop;
+    size_t m_position;
+    epicsUInt64 m_burst_counter;
+    bool m_schedule_valid;
+    double m_schedule_wall_start;
+    double m_schedule_file_start;
+    double m_lag;
+    epicsUInt64 m_file_burst_id;
+    TRChannelDataSubmit *m_submits;
+
+    // Throughput statistics since the last update of the parameters.
+    double m_stats_start;
+    double m_stats_bytes;
+    int m_stats_bursts;
+
+    // Time of a burst in the file (s), NAN if not known.
+    double burstFileTime (size_t burst);
+
+    // Wait until the given time (TRPerfClock) or until interrupted.
+    // Returns false if interrupted.
+    bool waitUntil (double time);
+
+    bool isInterrupted ();
+
+    // Update the throughput parameters if the period has elapsed.
+    void updateStats (bool force);
+
+    bool completeArray (NDArray *array);
+};
+
+#endif
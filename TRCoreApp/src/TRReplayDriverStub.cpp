@@ -0,0 +1,25 @@
+/* This file is part of the Transient Recorder Framework.
+ * It is subject to the license terms in the LICENSE.txt file found in the
+ * top-level directory of this distribution and at
+ * https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. No part
+ * of the Transient Recorder Framework, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ */
+
+/*
+ * Registrar of TRReplayDriver.dbd for targets where TRReplayDriver is not
+ * built (it reads files using mmap, see TRBurstFile). This allows IOCs to
+ * include TRReplayDriver.dbd on all targets; TRReplayDriverConfigure is
+ * only available on Linux.
+ */
+
+#include <epicsExport.h>
+
+static void TRReplayDriverRegister (void)
+{
+}
+
+extern "C" {
+    epicsExportRegistrar(TRReplayDriverRegister);
+}
@@ -0,0 +1,134 @@
+/* This file is part of the Transient Recorder Framework.
+ * It is subject to the license terms in the LICENSE.txt file found in the
+ * top-level directory of this distribution and at
+ * https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. No part
+ * of the Transient Recorder Framework, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <epicsAssert.h>
+#include <epicsGuard.h>
+
+#include "TRScratchArena.h"
+
+TRScratchArena::TRScratchArena ()
+: m_buffer(NULL),
+  m_aligned_buffer(NULL),
+  m_buffer_size(0),
+  m_size(0),
+  m_prepared(false),
+  m_used(0),
+  m_peak_used(0),
+  m_num_failed(0)
+{
+}
+
+TRScratchArena::~TRScratchArena ()
+{
+    free(m_buffer);
+}
+
+void * TRScratchArena::alloc (size_t size, size_t alignment)
+{
+    assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+    assert(alignment <= DefaultAlignment);
+
+    epicsGuard<epicsMutex> lock(m_mutex);
+
+    // The buffer is aligned to DefaultAlignment so aligning the offset suffices.
+    size_t offset = (m_used + alignment - 1) & ~(alignment - 1);
+    if (!m_prepared || offset > m_size || size > m_size - offset) {
+        m_num_failed++;
+        return NULL;
+    }
+
+    m_used = offset + size;
+    if (m_used > m_peak_used) {
+        m_peak_used = m_used;
+    }
+
+    return m_aligned_buffer + offset;
+}
+
+size_t TRScratchArena::getMark ()
+{
+    epicsGuard<epicsMutex> lock(m_mutex);
+    return m_used;
+}
+
+void TRScratchArena::releaseToMark (size_t mark)
+{
+    epicsGuard<epicsMutex> lock(m_mutex);
+    assert(mark <= m_used);
+    m_used = mark;
+}
+
+size_t TRScratchArena::getSize ()
+{
+    epicsGuard<epicsMutex> lock(m_mutex);
+    return m_size;
+}
+
+size_t TRScratchArena::getPeakUsed ()
+{
+    epicsGuard<epicsMutex> lock(m_mutex);
+    return m_peak_used;
+}
+
+int TRScratchArena::getNumFailed ()
+{
+    epicsGuard<epicsMutex> lock(m_mutex);
+    return m_num_failed;
+}
+
+bool TRScratchArena::prepare (size_t size)
+{
+    epicsGuard<epicsMutex> lock(m_mutex);
+
+    assert(m_used == 0);
+
+    m_size = 0;
+    m_prepared = false;
+    m_peak_used = 0;
+    m_num_failed = 0;
+
+    // Reallocate the buffer if it is too small, or much larger than needed
+    // so that memory from a large arming is not held forever.
+    if (size > m_buffer_size || (m_buffer_size > 0 && size < m_buffer_size / 4)) {
+        free(m_buffer);
+        m_buffer = NULL;
+        m_aligned_buffer = NULL;
+        m_buffer_size = 0;
+
+        if (size > 0) {
+            if (size > (size_t)-1 - DefaultAlignment) {
+                return false;
+            }
+            m_buffer = (char *)malloc(size + DefaultAlignment - 1);
+            if (m_buffer == NULL) {
+                return false;
+            }
+            uintptr_t addr = (uintptr_t)m_buffer;
+            m_aligned_buffer = (char *)((addr + DefaultAlignment - 1) & ~(uintptr_t)(DefaultAlignment - 1));
+            m_buffer_size = size;
+        }
+    }
+
+    m_size = size;
+    m_prepared = true;
+    return true;
+}
+
+void TRScratchArena::reset ()
+{
+    epicsGuard<epicsMutex> lock(m_mutex);
+
+    // Keep m_size for the readback of the last arming.
+    m_used = 0;
+    m_prepared = false;
+}
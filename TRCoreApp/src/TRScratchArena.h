@@ -0,0 +1,119 @@
+/* This file is part of the Transient Recorder Framework.
+ * It is subject to the license terms in the LICENSE.txt file found in the
+ * top-level directory of this distribution and at
+ * https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. No part
+ * of the Transient Recorder Framework, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ */
+
+/**
+ * @file
+ *
+ * Defines the TRScratchArena class, which provides temporary buffers
+ * for the duration of an arming.
+ */
+
+#ifndef TRANSREC_SCRATCH_ARENA_H
+#define TRANSREC_SCRATCH_ARENA_H
+
+#include <stddef.h>
+
+#include <epicsMutex.h>
+
+#include "TRNonCopyable.h"
+
+/**
+ * Bump allocator for temporary buffers used during one arming.
+ *
+ * The arena is owned by TRBaseDriver. The driver specifies the size needed
+ * for an arming in TRBaseDriver::checkSettings (TRArmInfo::scratch_size),
+ * after which the framework makes sure that the arena has at least this
+ * capacity. Memory is then allocated using @ref alloc (or
+ * TRBaseDriver::allocScratch) from TRBaseDriver::startAcquisition until
+ * the end of the arming, without any heap allocation. All memory is
+ * released at once when disarming, but the backing buffer is kept for the
+ * next arming unless a smaller size suffices.
+ *
+ * Memory which is only needed while processing one burst can be returned
+ * using @ref getMark and @ref releaseToMark.
+ *
+ * All functions are thread-safe.
+ */
+class TRScratchArena :
+    private TRNonCopyable
+{
+public:
+    /**
+     * Alignment of allocations if not specified (a cache line).
+     */
+    static size_t const DefaultAlignment = 64;
+
+    TRScratchArena ();
+
+    ~TRScratchArena ();
+
+    /**
+     * Allocate memory from the arena.
+     *
+     * @param size Number of bytes.
+     * @param alignment Alignment of the memory, must be a power of two
+     *                  not greater than DefaultAlignment.
+     * @return Pointer to the memory, or NULL if the arena does not have
+     *         enough space left or is not prepared for an arming.
+     */
+    void * alloc (size_t size, size_t alignment = DefaultAlignment);
+
+    /**
+     * Return the current allocation position for @ref releaseToMark.
+     */
+    size_t getMark ();
+
+    /**
+     * Release all memory allocated since @ref getMark returned the mark.
+     *
+     * @param mark The mark returned by getMark.
+     */
+    void releaseToMark (size_t mark);
+
+    /**
+     * Return the capacity of the arena for the current arming, or the last
+     * one if not armed (bytes).
+     */
+    size_t getSize ();
+
+    /**
+     * Return the maximum amount of memory that was allocated since
+     * @ref prepare (bytes, including padding for alignment).
+     */
+    size_t getPeakUsed ();
+
+    /**
+     * Return the number of allocations which failed since @ref prepare.
+     */
+    int getNumFailed ();
+
+private:
+    friend class TRBaseDriver;
+    friend class TRScratchArenaTest;
+
+    epicsMutex m_mutex;
+    char *m_buffer;
+    char *m_aligned_buffer;
+    size_t m_buffer_size;
+    size_t m_size;
+    bool m_prepared;
+    size_t m_used;
+    size_t m_peak_used;
+    int m_num_failed;
+
+    // Make the arena usable with the given capacity (called by the framework
+    // after checkSettings). Returns false if memory could not be allocated.
+    bool prepare (size_t size);
+
+    // Release all allocations and make the arena unusable until the next
+    // prepare (called by the framework when disarming).
+    void reset ();
+};
+
+#endif
@@ -13,32 +13,43 @@
 #include <epicsGuard.h>
 
 #include "TRTimeArrayDriver.h"
+#include "TRArmInfo.h"
+#include "TRKernels.h"
 
-TRTimeArrayDriver::TRTimeArrayDriver (std::string const &base_port_name)
+TRTimeArrayDriver::TRTimeArrayDriver (std::string const &base_port_name, int num_channels)
 :   asynPortDriver(
         (base_port_name + "_time_array").c_str(),
-        1, // maxAddr
+        std::max(1, num_channels), // maxAddr
         NUM_PARAMS,
         asynInt32Mask|asynFloat64Mask|asynFloat64ArrayMask|asynDrvUserMask, // interfaceMask
         asynInt32Mask|asynFloat64Mask|asynFloat64ArrayMask, // interruptMask
-        0, // asynFlags (no ASYN_CANBLOCK - we don't block)
+        ASYN_MULTIDEVICE, // asynFlags (no ASYN_CANBLOCK - we don't block)
         1, // autoConnect
         0, // priority (ignored with no ASYN_CANBLOCK)
         0  // stackSize (ignored witn no ASYN_CANBLOCK)
     ),
     m_unit(0.0),
     m_num_pre(0),
-    m_num_post(0)
+    m_num_post(0),
+    m_decimation(num_channels, 1)
 {
-    createParam("ARRAY",  asynParamFloat64Array, &m_params[ARRAY]);
-    createParam("UPDATE", asynParamInt32,        &m_params[UPDATE]);
+    // ARRAY and UPDATE are for the common time array (address 0),
+    // CH_ARRAY and CH_UPDATE for the time arrays of channels (address
+    // is the channel), which differ for decimated channels.
+    createParam("ARRAY",     asynParamFloat64Array, &m_params[ARRAY]);
+    createParam("UPDATE",    asynParamInt32,        &m_params[UPDATE]);
+    createParam("CH_ARRAY",  asynParamFloat64Array, &m_params[CH_ARRAY]);
+    createParam("CH_UPDATE", asynParamInt32,        &m_params[CH_UPDATE]);
     
     setIntegerParam(m_params[UPDATE], 0);
+    for (int channel = 0; channel < num_channels; channel++) {
+        setIntegerParam(channel, m_params[CH_UPDATE], 0);
+    }
 }
 
 asynStatus TRTimeArrayDriver::readFloat64Array (asynUser *pasynUser, epicsFloat64 *value, size_t nElements, size_t *nIn)
 {
-    if (pasynUser->reason == m_params[ARRAY]) {
+    if (pasynUser->reason == m_params[ARRAY] || pasynUser->reason == m_params[CH_ARRAY]) {
         // Get the current parameters for the time array.
         double unit = m_unit;
         int num_pre = m_num_pre;
@@ -50,6 +61,19 @@ asynStatus TRTimeArrayDriver::readFloat64Array (asynUser *pasynUser, epicsFloat6
             return asynError;
         }
         
+        // For the time array of a channel, account for its decimation.
+        if (pasynUser->reason == m_params[CH_ARRAY]) {
+            int channel;
+            getAddress(pasynUser, &channel);
+            if (channel < 0 || channel >= (int)m_decimation.size()) {
+                *nIn = 0;
+                return asynError;
+            }
+            int decimation = m_decimation[channel];
+            TRArmInfo::decimateSampleCounts(decimation, num_pre, num_post, &num_pre, &num_post);
+            unit *= decimation;
+        }
+        
         // Calculate the number of elements to write to the array.
         int count = num_pre + num_post;
         if ((unsigned int)count > nElements) {
@@ -57,9 +81,7 @@ asynStatus TRTimeArrayDriver::readFloat64Array (asynUser *pasynUser, epicsFloat6
         }
         
         // Write the array.
-        for (int i = 0; i < count; i++) {
-            value[i] = (i - num_pre) * unit;
-        }
+        TRKernels::timeArray(value, count, -num_pre, unit);
         
         // Return the number of elements written and success.
         *nIn = count;
@@ -70,7 +92,8 @@ asynStatus TRTimeArrayDriver::readFloat64Array (asynUser *pasynUser, epicsFloat6
     return asynPortDriver::readFloat64Array(pasynUser, value, nElements, nIn);
 }
 
-void TRTimeArrayDriver::setTimeArrayParams (double unit, int num_pre, int num_post)
+void TRTimeArrayDriver::setTimeArrayParams (double unit, int num_pre, int num_post,
+                                            std::vector<int> const &decimation)
 {
     epicsGuard<asynPortDriver> lock(*this);
     
@@ -84,4 +107,13 @@ void TRTimeArrayDriver::setTimeArrayParams (double unit, int num_pre, int num_po
     getIntegerParam(m_params[UPDATE], &update);
     setIntegerParam(m_params[UPDATE], !update);
     callParamCallbacks();
+    
+    // Same for the time arrays of channels.
+    for (int channel = 0; channel < (int)m_decimation.size(); channel++) {
+        m_decimation[channel] = decimation[channel];
+        
+        getIntegerParam(channel, m_params[CH_UPDATE], &update);
+        setIntegerParam(channel, m_params[CH_UPDATE], !update);
+        callParamCallbacks(channel);
+    }
 }
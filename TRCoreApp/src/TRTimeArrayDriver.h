@@ -13,6 +13,7 @@
 #include <stddef.h>
 
 #include <string>
+#include <vector>
 
 #include <epicsTypes.h>
 
@@ -31,6 +32,8 @@ class TRTimeArrayDriver : public asynPortDriver,
     enum Params {
         ARRAY,
         UPDATE,
+        CH_ARRAY,
+        CH_UPDATE,
         NUM_PARAMS
     };
     
@@ -39,17 +42,20 @@ private:
     double m_unit;
     int m_num_pre;
     int m_num_post;
+    std::vector<int> m_decimation;
 
 public:
-    TRTimeArrayDriver (std::string const &base_port_name);
+    TRTimeArrayDriver (std::string const &base_port_name, int num_channels);
     
     virtual asynStatus readFloat64Array (asynUser *pasynUser, epicsFloat64 *value, size_t nElements, size_t *nIn);
     
 private:
     // The follwing functions are for internal use by Transient Recorder framework.
     
-    // Set the parameters for the time array and poke the UPDATE parameter.
-    void setTimeArrayParams (double unit, int num_pre, int num_post);
+    // Set the parameters for the time arrays and poke the UPDATE parameters.
+    // The decimation vector has the decimation ratio of each channel.
+    void setTimeArrayParams (double unit, int num_pre, int num_post,
+                             std::vector<int> const &decimation);
 };
 
 #endif
@@ -0,0 +1,83 @@
+/* This file is part of the Transient Recorder Framework.
+ * It is subject to the license terms in the LICENSE.txt file found in the
+ * top-level directory of this distribution and at
+ * https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. No part
+ * of the Transient Recorder Framework, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ */
+
+/**
+ * @file
+ *
+ * Defines the TRTimedGuard class, a lock guard which measures lock
+ * wait and hold times.
+ */
+
+#ifndef TRANSREC_TIMED_GUARD_H
+#define TRANSREC_TIMED_GUARD_H
+
+#include "TRNonCopyable.h"
+#include "TRPerfStat.h"
+#include "TRPerfStatsDriver.h"
+
+/**
+ * Lock guard which records lock wait and hold times.
+ *
+ * This is used like epicsGuard, but the time spent waiting for the lock
+ * and the time the lock was held are added as samples to the given
+ * entries of the performance statistics port. Both samples are recorded
+ * after unlocking, so that the lock of the performance statistics port is
+ * never taken while holding the measured lock and recording does not
+ * extend the hold time.
+ *
+ * The Lockable type must have lock and unlock functions (e.g. asynPortDriver
+ * or epicsMutex).
+ */
+template <typename Lockable>
+class TRTimedGuard :
+    private TRNonCopyable
+{
+public:
+    /**
+     * Lock and measure the wait time.
+     *
+     * @param lockable The object to lock.
+     * @param perf_driver The performance statistics port.
+     * @param wait_entry Entry for the lock wait time.
+     * @param hold_entry Entry for the lock hold time.
+     */
+    inline TRTimedGuard (Lockable &lockable, TRPerfStatsDriver &perf_driver,
+                         int wait_entry, int hold_entry)
+    : m_lockable(lockable),
+      m_perf_driver(perf_driver),
+      m_wait_entry(wait_entry),
+      m_hold_entry(hold_entry)
+    {
+        double wait_start = TRPerfClock::now();
+        m_lockable.lock();
+        m_locked_time = TRPerfClock::now();
+        m_wait_time = m_locked_time - wait_start;
+    }
+
+    /**
+     * Unlock and record the wait and hold times.
+     */
+    inline ~TRTimedGuard ()
+    {
+        double hold_end = TRPerfClock::now();
+        m_lockable.unlock();
+        m_perf_driver.addSample(m_wait_entry, m_wait_time);
+        m_perf_driver.addSample(m_hold_entry, hold_end - m_locked_time);
+    }
+
+private:
+    Lockable &m_lockable;
+    TRPerfStatsDriver &m_perf_driver;
+    int m_wait_entry;
+    int m_hold_entry;
+    double m_locked_time;
+    double m_wait_time;
+};
+
+#endif
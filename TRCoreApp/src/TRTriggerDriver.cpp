@@ -0,0 +1,155 @@
+/* This file is part of the Transient Recorder Framework.
+ * It is subject to the license terms in the LICENSE.txt file found in the
+ * top-level directory of this distribution and at
+ * https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. No part
+ * of the Transient Recorder Framework, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ */
+
+#include <cmath>
+
+#include <algorithm>
+
+#include <epicsAssert.h>
+#include <epicsGuard.h>
+
+#include "TRTriggerDriver.h"
+#include "TRPerfStat.h"
+#include "TRInt64Param.h"
+
+TRTriggerDriver::TRTriggerDriver (std::string const &base_port_name, int num_sources, int num_channels)
+:   asynPortDriver(
+        (base_port_name + "_trigger").c_str(),
+        std::max(1, num_sources), // maxAddr
+        NUM_PARAMS,
+        asynInt32Mask|asynFloat64Mask|asynDrvUserMask|TRInt64Mask, // interfaceMask
+        asynInt32Mask|asynFloat64Mask|TRInt64Mask, // interruptMask
+        ASYN_MULTIDEVICE, // asynFlags (no ASYN_CANBLOCK - we don't block)
+        1, // autoConnect
+        0, // priority (ignored with no ASYN_CANBLOCK)
+        0  // stackSize (ignored witn no ASYN_CANBLOCK)
+    ),
+    m_num_sources(std::max(1, num_sources)),
+    m_num_channels(num_channels),
+    m_sources(m_num_sources)
+{
+    createParam("TRIG_RATE_LIMIT",  asynParamFloat64, &m_params[RATE_LIMIT]);
+    createParam("TRIG_ADDR_OFFSET", asynParamInt32,   &m_params[ADDR_OFFSET]);
+    createParam("TRIG_ACCEPTED",    TRInt64ParamType, &m_params[ACCEPTED]);
+    createParam("TRIG_LIMITED",     TRInt64ParamType, &m_params[LIMITED]);
+
+    for (int i = 0; i < m_num_sources; i++) {
+        setDoubleParam(i,  m_params[RATE_LIMIT],  0.0);
+        setIntegerParam(i, m_params[ADDR_OFFSET], i * m_num_channels);
+        m_sources[i].last_accepted = NAN;
+        m_sources[i].num_accepted = 0;
+        m_sources[i].num_limited = 0;
+    }
+}
+
+#if TR_HAVE_ASYN_INT64
+asynStatus TRTriggerDriver::readInt64 (asynUser *pasynUser, epicsInt64 *value)
+{
+    if (isCount(pasynUser->reason)) {
+        epicsUInt64 count;
+        asynStatus status = readCount(pasynUser, &count);
+        *value = (epicsInt64)count;
+        return status;
+    }
+
+    // Delegate to base class.
+    return asynPortDriver::readInt64(pasynUser, value);
+}
+#else
+asynStatus TRTriggerDriver::readFloat64 (asynUser *pasynUser, epicsFloat64 *value)
+{
+    if (isCount(pasynUser->reason)) {
+        epicsUInt64 count;
+        asynStatus status = readCount(pasynUser, &count);
+        *value = (double)count;
+        return status;
+    }
+
+    // Delegate to base class.
+    return asynPortDriver::readFloat64(pasynUser, value);
+}
+#endif
+
+asynStatus TRTriggerDriver::writeInt32 (asynUser *pasynUser, epicsInt32 value)
+{
+    int reason = pasynUser->reason;
+
+    // Readbacks are read-only.
+    if (reason == m_params[ADDR_OFFSET]) {
+        return asynError;
+    }
+
+    // Delegate to base class.
+    return asynPortDriver::writeInt32(pasynUser, value);
+}
+
+TRTriggerRoute TRTriggerDriver::route (int source)
+{
+    assert(source >= 0 && source < m_num_sources);
+
+    epicsGuard<asynPortDriver> lock(*this);
+
+    Source &src = m_sources[source];
+
+    double rate_limit;
+    getDoubleParam(source, m_params[RATE_LIMIT], &rate_limit);
+
+    TRTriggerRoute route;
+    route.m_source = source;
+    route.m_addr_offset = source * m_num_channels;
+
+    double now = TRPerfClock::now();
+    if (rate_limit > 0.0 && !std::isnan(src.last_accepted) &&
+        now - src.last_accepted < 1.0 / rate_limit)
+    {
+        route.m_accepted = false;
+        src.num_limited++;
+    } else {
+        src.last_accepted = now;
+        src.num_accepted++;
+    }
+
+    return route;
+}
+
+void TRTriggerDriver::resetArmingStats ()
+{
+    epicsGuard<asynPortDriver> lock(*this);
+
+    for (int i = 0; i < m_num_sources; i++) {
+        m_sources[i].last_accepted = NAN;
+        m_sources[i].num_accepted = 0;
+        m_sources[i].num_limited = 0;
+    }
+}
+
+bool TRTriggerDriver::isCount (int reason)
+{
+    return reason == m_params[ACCEPTED] || reason == m_params[LIMITED];
+}
+
+asynStatus TRTriggerDriver::readCount (asynUser *pasynUser, epicsUInt64 *value)
+{
+    int addr;
+    getAddress(pasynUser, &addr);
+    if (addr < 0 || addr >= m_num_sources) {
+        return asynError;
+    }
+    Source const &src = m_sources[addr];
+    *value = (pasynUser->reason == m_params[ACCEPTED]) ? src.num_accepted : src.num_limited;
+    return asynSuccess;
+}
+
+void TRTriggerDriver::getCounts (int source, epicsUInt64 *num_accepted, epicsUInt64 *num_limited)
+{
+    epicsGuard<asynPortDriver> lock(*this);
+
+    *num_accepted = m_sources[source].num_accepted;
+    *num_limited = m_sources[source].num_limited;
+}
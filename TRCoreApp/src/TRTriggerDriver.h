@@ -0,0 +1,108 @@
+/* This file is part of the Transient Recorder Framework.
+ * It is subject to the license terms in the LICENSE.txt file found in the
+ * top-level directory of this distribution and at
+ * https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. No part
+ * of the Transient Recorder Framework, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ */
+
+/**
+ * @file
+ *
+ * Defines the TRTriggerDriver class, used for routing bursts by trigger
+ * source.
+ */
+
+#ifndef TRANSREC_TRIGGER_DRIVER_H
+#define TRANSREC_TRIGGER_DRIVER_H
+
+#include <string>
+#include <vector>
+
+#include <epicsTypes.h>
+
+#include <asynPortDriver.h>
+
+#include "TRInt64Param.h"
+#include "TRNonCopyable.h"
+#include "TRTriggerRoute.h"
+
+class TRBaseDriver;
+
+/**
+ * Asyn port for the trigger sources of bursts (see
+ * TRBaseConfig::num_trigger_sources and TRBaseDriver::routeBurst).
+ *
+ * The port is named as the base port with the suffix `_trigger`.
+ * It is a multi-device port where each address corresponds to a trigger
+ * source. Each address provides the parameters:
+ * - TRIG_RATE_LIMIT: the maximum rate of bursts from the source (Hz, 0 for
+ *   no limit). Bursts arriving sooner than 1/TRIG_RATE_LIMIT after the last
+ *   accepted burst of the source are not submitted. Takes effect immediately.
+ * - TRIG_ADDR_OFFSET (readback): the first channels port address of the
+ *   source; channel c of source s is at address s*num_channels+c.
+ * - TRIG_ACCEPTED, TRIG_LIMITED (readback): the number of bursts from the
+ *   source which were accepted and which were rejected by the rate limit
+ *   since the start of the arming (64-bit, see TRInt64Param.h). Values are
+ *   computed when the parameters are read, so records should be scanned.
+ */
+class TRTriggerDriver : public asynPortDriver,
+    private TRNonCopyable
+{
+    friend class TRBaseDriver;
+
+    // Enumeration of asyn parameters.
+    enum Params {
+        RATE_LIMIT,
+        ADDR_OFFSET,
+        ACCEPTED,
+        LIMITED,
+        NUM_PARAMS
+    };
+
+private:
+    int m_params[NUM_PARAMS];
+
+    int m_num_sources;
+    int m_num_channels;
+
+    // State of trigger sources (protected by the port lock).
+    struct Source {
+        double last_accepted;
+        epicsUInt64 num_accepted;
+        epicsUInt64 num_limited;
+    };
+    std::vector<Source> m_sources;
+
+public:
+    TRTriggerDriver (std::string const &base_port_name, int num_sources, int num_channels);
+
+#if TR_HAVE_ASYN_INT64
+    virtual asynStatus readInt64 (asynUser *pasynUser, epicsInt64 *value);
+#else
+    virtual asynStatus readFloat64 (asynUser *pasynUser, epicsFloat64 *value);
+#endif
+
+    virtual asynStatus writeInt32 (asynUser *pasynUser, epicsInt32 value);
+
+private:
+    // The follwing functions are for internal use by Transient Recorder framework.
+
+    // Decide the route of a burst from a source. May be called with any
+    // other port locked.
+    TRTriggerRoute route (int source);
+
+    // Reset the counters (called at the start of arming).
+    void resetArmingStats ();
+
+    // Get the counters of a source (for the arming summary).
+    void getCounts (int source, epicsUInt64 *num_accepted, epicsUInt64 *num_limited);
+
+    // Check whether a parameter is a counter, and read a counter for
+    // the address of the asynUser.
+    bool isCount (int reason);
+    asynStatus readCount (asynUser *pasynUser, epicsUInt64 *value);
+};
+
+#endif
@@ -0,0 +1,84 @@
+/* This file is part of the Transient Recorder Framework.
+ * It is subject to the license terms in the LICENSE.txt file found in the
+ * top-level directory of this distribution and at
+ * https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. No part
+ * of the Transient Recorder Framework, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ */
+
+/**
+ * @file
+ *
+ * Defines the TRTriggerRoute class, the routing decision for a burst
+ * from a trigger source.
+ */
+
+#ifndef TRANSREC_TRIGGER_ROUTE_H
+#define TRANSREC_TRIGGER_ROUTE_H
+
+class TRTriggerDriver;
+
+/**
+ * Routing decision for a burst, obtained from TRBaseDriver::routeBurst
+ * and passed to TRChannelDataSubmit::submit for each array of the burst.
+ *
+ * It identifies the trigger source of the burst, the channels port
+ * address range to which its arrays are submitted, and whether the burst
+ * is accepted by the rate limit of the source.
+ *
+ * A default-constructed route is the accepted route of source 0, which
+ * is what is used when a driver does not tag bursts.
+ */
+class TRTriggerRoute {
+    friend class TRTriggerDriver;
+
+public:
+    /**
+     * Constructor for the default route (source 0, accepted).
+     */
+    inline TRTriggerRoute ()
+    : m_source(0),
+      m_addr_offset(0),
+      m_accepted(true)
+    {
+    }
+
+    /**
+     * Return the trigger source of the burst.
+     */
+    inline int source () const
+    {
+        return m_source;
+    }
+
+    /**
+     * Return whether the burst was accepted by the rate limit of the source.
+     *
+     * If false, TRChannelDataSubmit::submit releases arrays without
+     * submitting them, and drivers may skip reading or processing the
+     * data of the burst altogether.
+     */
+    inline bool accepted () const
+    {
+        return m_accepted;
+    }
+
+    /**
+     * Return the channels port address for a channel of the burst.
+     *
+     * @param channel The channel number.
+     * @return The asyn address in the channels port.
+     */
+    inline int channelAddress (int channel) const
+    {
+        return m_addr_offset + channel;
+    }
+
+private:
+    int m_source;
+    int m_addr_offset;
+    bool m_accepted;
+};
+
+#endif
@@ -16,6 +16,7 @@
 #include <epicsAssert.h>
 
 #include "TRWorkerThread.h"
+#include "TRAllocAudit.h"
 
 TRWorkerThread::TRWorkerThread (std::string const &thread_name)
 : m_stop(false),
@@ -52,6 +53,9 @@ void TRWorkerThread::stop ()
 
 void TRWorkerThread::run ()
 {
+    // Allocations by tasks are audited (if enabled in the build).
+    TRAllocAudit::setWorkerThread();
+    
     epicsGuard<epicsMutex> lock(m_mutex);
     
     while (true) {
@@ -0,0 +1,395 @@
+/* This file is part of the Transient Recorder Framework.
+ * It is subject to the license terms in the LICENSE.txt file found in the
+ * top-level directory of this distribution and at
+ * https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. No part
+ * of the Transient Recorder Framework, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include <epicsGuard.h>
+#include <epicsThread.h>
+#include <errlog.h>
+
+#include <asynPortDriver.h>
+#include <asynInt32SyncIO.h>
+
+#include "TRArmStressDriver.h"
+#include "TRBurstMetaInfo.h"
+#include "TRPerfStat.h"
+
+// Timeout of asyn requests made by a stress run (s).
+static double const AsynTimeout = 5.0;
+
+// Interval for polling ARM_STATE while waiting for a state (s).
+static double const StatePollInterval = 0.0005;
+
+TRArmStressDriver::TRArmStressDriver (TRBaseConfig const &cfg)
+:   TRBaseDriver(cfg),
+    m_driver_disarm_prob(0.0),
+    m_max_phase_delay(0.0),
+    m_burst_period(0.001),
+    m_driver_disarms_enabled(false),
+    m_acquiring(false),
+    m_interrupted(false),
+    m_num_starts(0),
+    m_num_driver_disarms(0),
+    m_num_violations(0),
+    m_burst_counter(0)
+{
+}
+
+void TRArmStressDriver::requestedSampleRateChanged ()
+{
+    setAchievableSampleRate(getRequestedSampleRate());
+}
+
+bool TRArmStressDriver::checkSettings (TRArmInfo &arm_info)
+{
+    // Note that this is called with the port locked, so the delay also
+    // delays requests made through asyn.
+    phaseDelay();
+
+    arm_info.rate_for_display = 1.0 / m_burst_period;
+
+    return true;
+}
+
+bool TRArmStressDriver::startAcquisition (bool overflow)
+{
+    phaseDelay();
+
+    epicsGuard<asynPortDriver> lock(*this);
+
+    if (m_acquiring) {
+        violation("startAcquisition called while acquiring");
+    }
+    m_acquiring = true;
+    m_interrupted = false;
+    m_interrupt_event.tryWait();
+    m_num_starts++;
+    m_burst_counter = 0;
+
+    return true;
+}
+
+bool TRArmStressDriver::readBurst ()
+{
+    // Wait for the next burst unless interrupted.
+    double deadline = TRPerfClock::now() + m_burst_period;
+    while (!isInterrupted()) {
+        double remaining = deadline - TRPerfClock::now();
+        if (remaining <= 0.0) {
+            break;
+        }
+        m_interrupt_event.wait(remaining);
+    }
+
+    epicsGuard<asynPortDriver> lock(*this);
+
+    if (!m_acquiring) {
+        violation("readBurst called while not acquiring");
+    }
+
+    // Randomly disarm on our own, as a driver-specific condition would.
+    if (m_driver_disarms_enabled && m_read_random.uniform() < m_driver_disarm_prob) {
+        m_num_driver_disarms++;
+        requestDisarmingFromDriver();
+    }
+
+    return true;
+}
+
+bool TRArmStressDriver::processBurstData ()
+{
+    {
+        epicsGuard<asynPortDriver> lock(*this);
+        if (!m_acquiring) {
+            violation("processBurstData called while not acquiring");
+        }
+    }
+
+    publishBurstMetaInfo(TRBurstMetaInfo(m_burst_counter));
+    m_burst_counter++;
+
+    return true;
+}
+
+void TRArmStressDriver::interruptReading ()
+{
+    m_interrupted = true;
+    m_interrupt_event.signal();
+}
+
+void TRArmStressDriver::stopAcquisition ()
+{
+    phaseDelay();
+
+    epicsGuard<asynPortDriver> lock(*this);
+
+    if (!m_acquiring) {
+        violation("stopAcquisition called while not acquiring");
+    }
+    m_acquiring = false;
+}
+
+void TRArmStressDriver::onDisarmed ()
+{
+    if (m_acquiring) {
+        violation("onDisarmed called while acquiring");
+    }
+}
+
+bool TRArmStressDriver::runStress (TRArmStressConfig const &cfg, FILE *fp)
+{
+    if (cfg.max_storm_size < 1 || !(cfg.burst_period > 0.0) || !(cfg.settle_timeout > 0.0)) {
+        errlogSevPrintf(errlogMajor, "TRArmStressDriver Error: Invalid stress settings.\n");
+        return false;
+    }
+
+    // Continuous acquisition with settings valid for both arm requests.
+    // The summary would be logged after every disarming.
+    if (!writeParam("DESIRED_NUM_BURSTS", 0) ||
+        !writeParam("DESIRED_NUM_POST_SAMPLES", 16) ||
+        !writeParam("DESIRED_NUM_PRE_POST_SAMPLES", 32) ||
+        !writeParam("ARMING_SUMMARY_LOG", 0))
+    {
+        return false;
+    }
+
+    asynUser *request_user = NULL;
+    asynUser *state_user = NULL;
+    if (pasynInt32SyncIO->connect(portName, 0, &request_user, "ARM_REQUEST") != asynSuccess ||
+        pasynInt32SyncIO->connect(portName, 0, &state_user, "ARM_STATE") != asynSuccess)
+    {
+        errlogSevPrintf(errlogMajor, "TRArmStressDriver Error: Failed to connect to port %s.\n", portName);
+        if (request_user != NULL) {
+            pasynInt32SyncIO->disconnect(request_user);
+        }
+        return false;
+    }
+
+    bool ok = true;
+    int last_state;
+
+    // Start from the disarmed state.
+    pasynInt32SyncIO->write(request_user, ArmValueDisarm, AsynTimeout);
+    if (!waitForArmState(state_user, ArmValueDisarm, cfg.settle_timeout, &last_state)) {
+        errlogSevPrintf(errlogMajor, "TRArmStressDriver Error: Failed to disarm before the run (state %d).\n",
+            last_state);
+        ok = false;
+    }
+
+    TRRandom request_random;
+    request_random.seed(cfg.seed);
+
+    int start_num_starts;
+    int start_num_driver_disarms;
+    int start_num_violations;
+    {
+        epicsGuard<asynPortDriver> lock(*this);
+        m_driver_disarm_prob = cfg.driver_disarm_prob;
+        m_max_phase_delay = cfg.max_phase_delay;
+        m_burst_period = cfg.burst_period;
+        m_read_random.seed(cfg.seed + 1);
+        start_num_starts = m_num_starts;
+        start_num_driver_disarms = m_num_driver_disarms;
+        start_num_violations = m_num_violations;
+    }
+
+    // Latencies from the last request of a storm to reaching the state.
+    TRPerfStat arm_latency;
+    TRPerfStat disarm_latency;
+    int num_requests = 0;
+    int num_storms = 0;
+
+    double start_time = TRPerfClock::now();
+    double end_time = start_time + cfg.duration;
+
+    while (ok && TRPerfClock::now() < end_time) {
+        // The storm, during which the driver may also disarm on its own.
+        {
+            epicsGuard<asynPortDriver> lock(*this);
+            m_driver_disarms_enabled = true;
+        }
+
+        int storm_size = 1 + request_random.below(cfg.max_storm_size);
+        for (int i = 0; i < storm_size; i++) {
+            pasynInt32SyncIO->write(request_user, request_random.below(3), AsynTimeout);
+            num_requests++;
+
+            double gap = request_random.uniform() * cfg.max_request_gap;
+            if (gap > 0.0) {
+                epicsThreadSleep(gap);
+            }
+        }
+
+        // The last request, which must be honored. Driver-initiated disarming
+        // is disabled first so that the expected state is deterministic.
+        {
+            epicsGuard<asynPortDriver> lock(*this);
+            m_driver_disarms_enabled = false;
+        }
+
+        int request = request_random.below(3);
+        double request_time = TRPerfClock::now();
+        if (pasynInt32SyncIO->write(request_user, request, AsynTimeout) != asynSuccess) {
+            errlogSevPrintf(errlogMajor, "TRArmStressDriver Error: Writing ARM_REQUEST failed.\n");
+            ok = false;
+            break;
+        }
+        num_requests++;
+        num_storms++;
+
+        if (!waitForArmState(state_user, request, cfg.settle_timeout, &last_state)) {
+            errlogSevPrintf(errlogMajor,
+                "TRArmStressDriver Error: Stalled: state %d not reached within %.3f s after storm %d (state %d).\n",
+                request, cfg.settle_timeout, num_storms, last_state);
+            ok = false;
+            break;
+        }
+
+        double latency = TRPerfClock::now() - request_time;
+        if (request == ArmValueDisarm) {
+            disarm_latency.add(latency);
+        } else {
+            arm_latency.add(latency);
+        }
+
+        checkSettledState(request);
+    }
+
+    double elapsed = TRPerfClock::now() - start_time;
+
+    // Leave the port disarmed.
+    pasynInt32SyncIO->write(request_user, ArmValueDisarm, AsynTimeout);
+    if (!waitForArmState(state_user, ArmValueDisarm, cfg.settle_timeout, &last_state)) {
+        errlogSevPrintf(errlogMajor, "TRArmStressDriver Error: Failed to disarm after the run (state %d).\n",
+            last_state);
+        ok = false;
+    }
+
+    pasynInt32SyncIO->disconnect(request_user);
+    pasynInt32SyncIO->disconnect(state_user);
+
+    int num_starts;
+    int num_driver_disarms;
+    int num_violations;
+    {
+        epicsGuard<asynPortDriver> lock(*this);
+        num_starts = m_num_starts - start_num_starts;
+        num_driver_disarms = m_num_driver_disarms - start_num_driver_disarms;
+        num_violations = m_num_violations - start_num_violations;
+    }
+
+    if (num_violations > 0) {
+        ok = false;
+    }
+
+    fprintf(fp, "TRArmStress %s: %d storms, %d requests, %d acquisition starts, %d driver disarms in %.3f s\n",
+        portName, num_storms, num_requests, num_starts, num_driver_disarms, elapsed);
+    if (elapsed > 0.0) {
+        fprintf(fp, "  throughput: %.1f requests/s, %.1f acquisition starts/s\n",
+            num_requests / elapsed, num_starts / elapsed);
+    }
+
+    struct { char const *name; TRPerfStat const *stat; } const latencies[] = {
+        {"arm", &arm_latency},
+        {"disarm", &disarm_latency}
+    };
+    for (int i = 0; i < 2; i++) {
+        TRPerfStat const &stat = *latencies[i].stat;
+        if (stat.getCount() == 0) {
+            continue;
+        }
+        fprintf(fp, "  %-6s latency [ms]: count %llu, mean %.3f, p50 %.3f, p99 %.3f, max %.3f\n",
+            latencies[i].name, (unsigned long long)stat.getCount(), 1000.0 * stat.getMean(),
+            1000.0 * stat.getPercentile(0.5), 1000.0 * stat.getPercentile(0.99),
+            1000.0 * stat.getMax());
+    }
+
+    fprintf(fp, "  invariant violations: %d\n", num_violations);
+    fprintf(fp, "TRArmStress %s: %s\n", portName, ok ? "PASSED" : "FAILED");
+
+    return ok;
+}
+
+void TRArmStressDriver::phaseDelay ()
+{
+    double delay;
+    {
+        epicsGuard<asynPortDriver> lock(*this);
+        delay = m_read_random.uniform() * m_max_phase_delay;
+    }
+    if (delay > 0.0) {
+        epicsThreadSleep(delay);
+    }
+}
+
+void TRArmStressDriver::violation (char const *what)
+{
+    m_num_violations++;
+    errlogSevPrintf(errlogMajor, "TRArmStressDriver Error: %s.\n", what);
+}
+
+bool TRArmStressDriver::writeParam (char const *name, int value)
+{
+    asynUser *user;
+    if (pasynInt32SyncIO->connect(portName, 0, &user, name) != asynSuccess) {
+        errlogSevPrintf(errlogMajor, "TRArmStressDriver Error: Failed to connect to %s of port %s.\n",
+            name, portName);
+        return false;
+    }
+
+    asynStatus status = pasynInt32SyncIO->write(user, value, AsynTimeout);
+    pasynInt32SyncIO->disconnect(user);
+
+    if (status != asynSuccess) {
+        errlogSevPrintf(errlogMajor, "TRArmStressDriver Error: Failed to write %s of port %s.\n",
+            name, portName);
+        return false;
+    }
+    return true;
+}
+
+bool TRArmStressDriver::isInterrupted ()
+{
+    epicsGuard<asynPortDriver> lock(*this);
+    return m_interrupted;
+}
+
+bool TRArmStressDriver::waitForArmState (asynUser *state_user, int expected, double timeout, int *last_state)
+{
+    double deadline = TRPerfClock::now() + timeout;
+    *last_state = -1;
+
+    while (true) {
+        epicsInt32 state;
+        if (pasynInt32SyncIO->read(state_user, &state, AsynTimeout) == asynSuccess) {
+            *last_state = state;
+            if (state == expected) {
+                return true;
+            }
+        }
+        if (TRPerfClock::now() >= deadline) {
+            return false;
+        }
+        epicsThreadSleep(StatePollInterval);
+    }
+}
+
+void TRArmStressDriver::checkSettledState (int state)
+{
+    epicsGuard<asynPortDriver> lock(*this);
+
+    bool armed = state != ArmValueDisarm;
+    if (m_acquiring != armed) {
+        violation(armed ? "Not acquiring in an armed state" : "Acquiring in the disarmed state");
+    }
+    if (isArmed() != armed) {
+        violation(armed ? "isArmed is false in an armed state" : "isArmed is true in the disarmed state");
+    }
+}
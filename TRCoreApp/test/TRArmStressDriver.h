@@ -0,0 +1,192 @@
+/* This file is part of the Transient Recorder Framework.
+ * It is subject to the license terms in the LICENSE.txt file found in the
+ * top-level directory of this distribution and at
+ * https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. No part
+ * of the Transient Recorder Framework, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ */
+
+/**
+ * @file
+ *
+ * Defines the TRArmStressDriver class, a simulated driver for stress testing
+ * arming and disarming.
+ */
+
+#ifndef TRANSREC_ARM_STRESS_DRIVER_H
+#define TRANSREC_ARM_STRESS_DRIVER_H
+
+#include <stdio.h>
+
+#include <epicsTypes.h>
+#include <epicsEvent.h>
+
+#include <asynDriver.h>
+
+#include "TRBaseDriver.h"
+#include "TRRandom.h"
+
+/**
+ * Settings of a stress run of TRArmStressDriver.
+ */
+struct TRArmStressConfig {
+    /**
+     * Duration of the run (s).
+     */
+    double duration;
+
+    /**
+     * Maximum number of random requests in a storm (at least 1).
+     */
+    int max_storm_size;
+
+    /**
+     * Maximum random delay between requests in a storm (s).
+     */
+    double max_request_gap;
+
+    /**
+     * Probability that the simulated driver requests disarming after
+     * a burst, during a storm.
+     */
+    double driver_disarm_prob;
+
+    /**
+     * Maximum random delay in the simulated driver functions (s).
+     */
+    double max_phase_delay;
+
+    /**
+     * Period of simulated bursts (s).
+     */
+    double burst_period;
+
+    /**
+     * Time allowed for reaching the requested state after a storm (s),
+     * after which the run fails as stalled.
+     */
+    double settle_timeout;
+
+    /**
+     * Seed of the pseudo-random generators, so that runs can be repeated.
+     */
+    unsigned int seed;
+
+    TRArmStressConfig ()
+    : duration(10.0),
+      max_storm_size(8),
+      max_request_gap(0.002),
+      driver_disarm_prob(0.05),
+      max_phase_delay(0.001),
+      burst_period(0.001),
+      settle_timeout(5.0),
+      seed(1)
+    {
+    }
+};
+
+/**
+ * Simulated driver for stress testing the arming and disarming logic
+ * of the framework.
+ *
+ * The driver produces bursts without channel data at a fixed period and
+ * adds random delays to its functions. A stress run (@ref runStress) drives
+ * the port through asyn like records would: it repeatedly writes storms of
+ * random ARM_REQUEST values (disarm, arm, arm with pre-samples) at high rate,
+ * while the driver randomly calls requestDisarmingFromDriver, and then
+ * checks that the last request is honored within a timeout.
+ *
+ * The following is verified:
+ * - The arm state reaches the last requested state (no lost request and
+ *   no deadlock or stall).
+ * - The driver functions are called in a consistent order (acquisition is
+ *   not started twice, bursts are only read while acquiring, stopping
+ *   matches starting) and acquisition is active exactly when armed.
+ *
+ * The latencies from the last request of each storm to reaching the
+ * requested state and the request and arming throughput are reported.
+ *
+ * The driver is used by the test program trArmStressTest (see
+ * trArmStressTest.cpp); it is not part of the trCore library.
+ * The run disables the arming summary log of the port.
+ */
+class TRArmStressDriver : public TRBaseDriver
+{
+public:
+    /**
+     * Constructor.
+     *
+     * @param cfg Configuration for TRBaseDriver.
+     */
+    TRArmStressDriver (TRBaseConfig const &cfg);
+
+    /**
+     * Perform a stress run, blocking until it is done.
+     *
+     * This MUST NOT be called with the port locked and only one run may be
+     * in progress at a time.
+     *
+     * @param cfg Settings of the run.
+     * @param fp File to print the results to.
+     * @return True if all checks passed, false otherwise.
+     */
+    bool runStress (TRArmStressConfig const &cfg, FILE *fp);
+
+protected:
+    void requestedSampleRateChanged ();
+    bool checkSettings (TRArmInfo &arm_info);
+    bool startAcquisition (bool overflow);
+    bool readBurst ();
+    bool processBurstData ();
+    void interruptReading ();
+    void stopAcquisition ();
+    void onDisarmed ();
+
+private:
+    // Values of ARM_REQUEST and ARM_STATE (see TRBase.db).
+    enum ArmValue {
+        ArmValueDisarm,
+        ArmValuePostTrigger,
+        ArmValuePrePostTrigger,
+        ArmValueBusy,
+        ArmValueError
+    };
+
+    // Settings of the current run (written only while disarmed).
+    double m_driver_disarm_prob;
+    double m_max_phase_delay;
+    double m_burst_period;
+    TRRandom m_read_random;
+
+    // State of the simulation (protected by the port lock).
+    bool m_driver_disarms_enabled;
+    bool m_acquiring;
+    bool m_interrupted;
+    int m_num_starts;
+    int m_num_driver_disarms;
+    int m_num_violations;
+    epicsEvent m_interrupt_event;
+
+    // Only accessed by the read thread.
+    epicsUInt64 m_burst_counter;
+
+    // Sleep a random time up to m_max_phase_delay.
+    void phaseDelay ();
+
+    // Count and log a violation of an expected invariant.
+    void violation (char const *what);
+
+    // Write an Int32 parameter of this port through asyn.
+    bool writeParam (char const *name, int value);
+
+    bool isInterrupted ();
+
+    // Wait until ARM_STATE is the given value or the timeout expires.
+    bool waitForArmState (asynUser *state_user, int expected, double timeout, int *last_state);
+
+    // Check the simulation state after the given state has been reached.
+    void checkSettledState (int state);
+};
+
+#endif
@@ -0,0 +1,63 @@
+/* This file is part of the Transient Recorder Framework.
+ * It is subject to the license terms in the LICENSE.txt file found in the
+ * top-level directory of this distribution and at
+ * https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. No part
+ * of the Transient Recorder Framework, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ */
+
+/*
+ * Tests of TRArmInfo::decimateSampleCounts.
+ */
+
+#include <epicsUnitTest.h>
+#include <testMain.h>
+
+#include "TRArmInfo.h"
+
+static int const MaxDecimation = 8;
+static int const MaxSamples = 40;
+
+// Check the sample counts against the samples at the full rate whose
+// index relative to the trigger is a multiple of the decimation ratio.
+static bool checkDecimation (int decimation)
+{
+    for (int num_pre = 0; num_pre <= MaxSamples; num_pre++) {
+        for (int num_post = 0; num_post <= MaxSamples; num_post++) {
+            int expected_pre = 0;
+            int expected_post = 0;
+            for (int i = -num_pre; i < num_post; i++) {
+                if (i % decimation == 0) {
+                    (i < 0) ? expected_pre++ : expected_post++;
+                }
+            }
+
+            int dec_num_pre, dec_num_post;
+            TRArmInfo::decimateSampleCounts(decimation, num_pre, num_post, &dec_num_pre, &dec_num_post);
+            if (dec_num_pre != expected_pre || dec_num_post != expected_post) {
+                testDiag("decimation %d, pre %d, post %d: got %d/%d, expected %d/%d",
+                    decimation, num_pre, num_post, dec_num_pre, dec_num_post,
+                    expected_pre, expected_post);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+MAIN(trArmInfoTest)
+{
+    testPlan(MaxDecimation + 1);
+
+    for (int decimation = 1; decimation <= MaxDecimation; decimation++) {
+        testOk(checkDecimation(decimation), "decimateSampleCounts with decimation %d", decimation);
+    }
+
+    // The sample at the trigger is always included.
+    int dec_num_pre, dec_num_post;
+    TRArmInfo::decimateSampleCounts(1000, 999, 1, &dec_num_pre, &dec_num_post);
+    testOk(dec_num_pre == 0 && dec_num_post == 1, "Trigger sample kept with large decimation");
+
+    return testDone();
+}
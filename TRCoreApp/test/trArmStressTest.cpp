@@ -0,0 +1,87 @@
+/* This file is part of the Transient Recorder Framework.
+ * It is subject to the license terms in the LICENSE.txt file found in the
+ * top-level directory of this distribution and at
+ * https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. No part
+ * of the Transient Recorder Framework, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ */
+
+/*
+ * Stress test of arming and disarming using TRArmStressDriver.
+ *
+ * Usage: trArmStressTest [duration [maxStormSize [maxRequestGapMs
+ *            [driverDisarmProb [maxPhaseDelayMs [seed [readThreadPriority]]]]]]]
+ *
+ * Zero or omitted arguments select the defaults (see TRArmStressConfig),
+ * except that the duration is short by default so that the test can be run
+ * by "make runtests". Longer runs can be used as a benchmark of the request
+ * and arming throughput.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <epicsUnitTest.h>
+#include <testMain.h>
+
+#include "TRArmStressDriver.h"
+
+// Duration of a run if not specified (s).
+static double const DefaultTestDuration = 2.0;
+
+static double doubleArg (int argc, char **argv, int index)
+{
+    return (index < argc) ? atof(argv[index]) : 0.0;
+}
+
+static int intArg (int argc, char **argv, int index)
+{
+    return (index < argc) ? atoi(argv[index]) : 0;
+}
+
+MAIN(trArmStressTest)
+{
+    if (argc > 8) {
+        fprintf(stderr, "Usage: %s [duration [maxStormSize [maxRequestGapMs [driverDisarmProb "
+            "[maxPhaseDelayMs [seed [readThreadPriority]]]]]]]\n", argv[0]);
+        return 1;
+    }
+
+    // Zero or negative arguments select the defaults.
+    TRArmStressConfig stress_cfg;
+    stress_cfg.duration = DefaultTestDuration;
+    if (doubleArg(argc, argv, 1) > 0.0) {
+        stress_cfg.duration = doubleArg(argc, argv, 1);
+    }
+    if (intArg(argc, argv, 2) > 0) {
+        stress_cfg.max_storm_size = intArg(argc, argv, 2);
+    }
+    if (doubleArg(argc, argv, 3) > 0.0) {
+        stress_cfg.max_request_gap = doubleArg(argc, argv, 3) / 1000.0;
+    }
+    if (doubleArg(argc, argv, 4) > 0.0) {
+        stress_cfg.driver_disarm_prob = doubleArg(argc, argv, 4);
+    }
+    if (doubleArg(argc, argv, 5) > 0.0) {
+        stress_cfg.max_phase_delay = doubleArg(argc, argv, 5) / 1000.0;
+    }
+    if (intArg(argc, argv, 6) > 0) {
+        stress_cfg.seed = (unsigned int)intArg(argc, argv, 6);
+    }
+
+    testPlan(1);
+
+    TRBaseConfig cfg;
+    cfg.port_name = "STRESS";
+    cfg.num_channels = 1;
+    cfg.supports_pre_samples = true;
+    cfg.read_thread_prio = intArg(argc, argv, 7);
+
+    TRArmStressDriver *driver = new TRArmStressDriver(cfg);
+    driver->completeInit();
+
+    testOk(driver->runStress(stress_cfg, stdout), "Arming stress run (seed %u)", stress_cfg.seed);
+
+    return testDone();
+}
@@ -0,0 +1,234 @@
+/* This file is part of the Transient Recorder Framework.
+ * It is subject to the license terms in the LICENSE.txt file found in the
+ * top-level directory of this distribution and at
+ * https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. No part
+ * of the Transient Recorder Framework, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ */
+
+/*
+ * Tests of TRBurstFile parsing of burst files and raw files.
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include <epicsTypes.h>
+#include <epicsTime.h>
+#include <epicsUnitTest.h>
+#include <testMain.h>
+
+#include "TRBurstFile.h"
+
+static int const NumChannels = 2;
+static size_t const NumSamples = 5;
+
+// Contents of a test file, written to a temporary file by writeFile.
+class FileData {
+public:
+    void addHeader (epicsUInt32 version, epicsUInt32 num_channels, epicsUInt64 num_samples,
+                    epicsUInt32 header_size = sizeof(TRBurstFileHeader))
+    {
+        TRBurstFileHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, TRBurstFile::Magic, sizeof(header.magic));
+        header.version = version;
+        header.header_size = header_size;
+        header.num_channels = num_channels;
+        header.data_type = NDInt16;
+        header.num_samples = num_samples;
+        header.sample_rate = 1e6;
+        append(&header, sizeof(header));
+    }
+
+    void addRecord (epicsUInt64 burst_id, epicsUInt32 sec_past_epoch, epicsUInt32 nsec)
+    {
+        TRBurstFileRecord record;
+        memset(&record, 0, sizeof(record));
+        record.burst_id = burst_id;
+        record.sec_past_epoch = sec_past_epoch;
+        record.nsec = nsec;
+        append(&record, sizeof(record));
+    }
+
+    // Add the data of all channels of a burst, sample values encode
+    // the burst, channel and sample index.
+    void addBurstData (int burst)
+    {
+        for (int channel = 0; channel < NumChannels; channel++) {
+            for (size_t i = 0; i < NumSamples; i++) {
+                epicsInt16 value = sampleValue(burst, channel, i);
+                append(&value, sizeof(value));
+            }
+        }
+    }
+
+    void truncate (size_t size)
+    {
+        m_data.resize(size);
+    }
+
+    bool writeFile (std::string *path) const
+    {
+        char name[] = "/tmp/trBurstFileTestXXXXXX";
+        int fd = mkstemp(name);
+        if (fd < 0) {
+            return false;
+        }
+        bool ok = m_data.empty() ||
+            write(fd, &m_data[0], m_data.size()) == (ssize_t)m_data.size();
+        close(fd);
+        *path = name;
+        return ok;
+    }
+
+    static epicsInt16 sampleValue (int burst, int channel, size_t i)
+    {
+        return (epicsInt16)(burst * 100 + channel * 10 + (int)i);
+    }
+
+private:
+    std::vector<char> m_data;
+
+    void append (void const *data, size_t size)
+    {
+        char const *bytes = (char const *)data;
+        m_data.insert(m_data.end(), bytes, bytes + size);
+    }
+};
+
+// Open a file with the given data, the file is removed immediately
+// since the mapping remains valid.
+static bool openData (TRBurstFile &file, FileData const &data, TRBurstFile::RawLayout const *raw_layout)
+{
+    std::string path;
+    if (!data.writeFile(&path)) {
+        testDiag("Failed to write a temporary file");
+        unlink(path.c_str());
+        return false;
+    }
+    bool ok = file.open(path, raw_layout);
+    unlink(path.c_str());
+    return ok;
+}
+
+static bool checkBurstData (TRBurstFile const &file, int burst)
+{
+    for (int channel = 0; channel < NumChannels; channel++) {
+        epicsInt16 const *samples = (epicsInt16 const *)file.getChannelData(burst, channel);
+        for (size_t i = 0; i < NumSamples; i++) {
+            if (samples[i] != FileData::sampleValue(burst, channel, i)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void testBurstFile ()
+{
+    FileData data;
+    data.addHeader(TRBurstFile::Version, NumChannels, NumSamples);
+    for (int burst = 0; burst < 3; burst++) {
+        data.addRecord(1000 + burst, 50 + burst, 7 * burst);
+        data.addBurstData(burst);
+    }
+    // An incomplete burst at the end is ignored.
+    data.addRecord(1003, 53, 21);
+
+    TRBurstFile file;
+    testOk(openData(file, data, NULL), "Open a burst file");
+    testOk(file.isBurstFile() && file.getNumChannels() == NumChannels &&
+           file.getNumSamples() == NumSamples && file.getDataType() == NDInt16 &&
+           file.getSampleRate() == 1e6 && file.getNumBursts() == 3,
+           "Layout of a burst file");
+
+    epicsUInt64 burst_id;
+    epicsTimeStamp timestamp;
+    file.getBurstInfo(2, &burst_id, &timestamp);
+    testOk(burst_id == 1002 && timestamp.secPastEpoch == 52 && timestamp.nsec == 14,
+           "Burst ID and timestamp");
+    testOk(checkBurstData(file, 0) && checkBurstData(file, 2), "Channel data of a burst file");
+}
+
+static void testRawFile ()
+{
+    FileData data;
+    for (int burst = 0; burst < 2; burst++) {
+        data.addBurstData(burst);
+    }
+
+    TRBurstFile::RawLayout layout;
+    layout.num_channels = NumChannels;
+    layout.num_samples = NumSamples;
+    layout.data_type = NDInt16;
+    layout.sample_rate = NAN;
+
+    TRBurstFile file;
+    testOk(!openData(file, data, NULL), "A raw file is rejected without a layout");
+    testOk(openData(file, data, &layout), "Open a raw file");
+    testOk(!file.isBurstFile() && file.getNumChannels() == NumChannels &&
+           file.getNumSamples() == NumSamples && std::isnan(file.getSampleRate()) &&
+           file.getNumBursts() == 2,
+           "Layout of a raw file");
+
+    epicsUInt64 burst_id;
+    epicsTimeStamp timestamp;
+    file.getBurstInfo(1, &burst_id, &timestamp);
+    testOk(burst_id == 1 && timestamp.secPastEpoch == 0 && timestamp.nsec == 0,
+           "Burst ID of a raw file is the index");
+    testOk(checkBurstData(file, 0) && checkBurstData(file, 1), "Channel data of a raw file");
+}
+
+static void testInvalid ()
+{
+    TRBurstFile file;
+
+    FileData bad_version;
+    bad_version.addHeader(TRBurstFile::Version + 1, NumChannels, NumSamples);
+    bad_version.addRecord(0, 0, 0);
+    bad_version.addBurstData(0);
+    testOk(!openData(file, bad_version, NULL), "Unsupported version is rejected");
+
+    FileData bad_header_size;
+    bad_header_size.addHeader(TRBurstFile::Version, NumChannels, NumSamples, 4);
+    bad_header_size.addRecord(0, 0, 0);
+    bad_header_size.addBurstData(0);
+    testOk(!openData(file, bad_header_size, NULL), "Invalid header size is rejected");
+
+    FileData no_channels;
+    no_channels.addHeader(TRBurstFile::Version, 0, NumSamples);
+    testOk(!openData(file, no_channels, NULL), "Zero channels are rejected");
+
+    FileData too_large;
+    too_large.addHeader(TRBurstFile::Version, NumChannels, (epicsUInt64)1 << 62);
+    too_large.addRecord(0, 0, 0);
+    too_large.addBurstData(0);
+    testOk(!openData(file, too_large, NULL), "A burst which does not fit is rejected");
+
+    FileData truncated;
+    truncated.addHeader(TRBurstFile::Version, NumChannels, NumSamples);
+    truncated.truncate(sizeof(TRBurstFileHeader) - 1);
+    testOk(!openData(file, truncated, NULL), "A truncated header is rejected");
+
+    FileData empty;
+    testOk(!openData(file, empty, NULL), "An empty file is rejected");
+}
+
+MAIN(trBurstFileTest)
+{
+    testPlan(15);
+
+    testBurstFile();
+    testRawFile();
+    testInvalid();
+
+    return testDone();
+}
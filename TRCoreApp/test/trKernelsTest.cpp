@@ -0,0 +1,77 @@
+/* This file is part of the Transient Recorder Framework.
+ * It is subject to the license terms in the LICENSE.txt file found in the
+ * top-level directory of this distribution and at
+ * https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. No part
+ * of the Transient Recorder Framework, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ */
+
+/*
+ * Tests of TRKernels: the active implementations against known results,
+ * and all implementations supported by the CPU against the scalar ones.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include <epicsTypes.h>
+#include <epicsUnitTest.h>
+#include <testMain.h>
+
+#include "TRKernels.h"
+
+static void testConvert ()
+{
+    epicsInt16 const in[5] = {-32768, -1, 0, 1, 32767};
+    double out[5];
+    TRKernels::convertInt16ToFloat64(in, out, 5, 0.5, 1.0);
+    testOk(out[0] == -16383.0 && out[1] == 0.5 && out[2] == 1.0 &&
+           out[3] == 1.5 && out[4] == 16384.5, "convertInt16ToFloat64");
+}
+
+static void testDeinterleave ()
+{
+    epicsInt16 const in[9] = {1, 2, 3, 4, 5, 6, 7, 8, 9};
+    epicsInt16 ch0[3], ch1[3], ch2[3];
+    epicsInt16 * const out[3] = {ch0, ch1, ch2};
+    TRKernels::deinterleaveInt16(in, 3, 3, out);
+    testOk(ch0[0] == 1 && ch0[1] == 4 && ch0[2] == 7 &&
+           ch1[0] == 2 && ch1[1] == 5 && ch1[2] == 8 &&
+           ch2[0] == 3 && ch2[1] == 6 && ch2[2] == 9, "deinterleaveInt16 with 3 channels");
+}
+
+static void testMinMaxSum ()
+{
+    epicsInt16 const in[6] = {5, -32768, 100, 32767, -7, 0};
+    epicsInt16 min, max;
+    epicsInt64 sum;
+    TRKernels::minMaxSumInt16(in, 6, &min, &max, &sum);
+    testOk(min == -32768 && max == 32767 && sum == 97, "minMaxSumInt16");
+
+    TRKernels::minMaxSumInt16(in, 0, &min, &max, &sum);
+    testOk(min == 0 && max == 0 && sum == 0, "minMaxSumInt16 of no samples");
+}
+
+static void testTimeArray ()
+{
+    double out[4];
+    TRKernels::timeArray(out, 4, -2.0, 0.25);
+    testOk(out[0] == -0.5 && out[1] == -0.25 && out[2] == 0.0 && out[3] == 0.25, "timeArray");
+}
+
+MAIN(trKernelsTest)
+{
+    testPlan(6);
+
+    testDiag("Active instruction set %s", TRKernels::isaName(TRKernels::activeIsa()));
+
+    testConvert();
+    testDeinterleave();
+    testMinMaxSum();
+    testTimeArray();
+
+    testOk(TRKernels::selfCheck(stdout), "All implementations supported by the CPU match the scalar ones");
+
+    return testDone();
+}
@@ -0,0 +1,171 @@
+/* This file is part of the Transient Recorder Framework.
+ * It is subject to the license terms in the LICENSE.txt file found in the
+ * top-level directory of this distribution and at
+ * https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. No part
+ * of the Transient Recorder Framework, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ */
+
+/*
+ * Tests of TRPerfStat: statistics, histogram buckets, percentiles
+ * and merging.
+ */
+
+#include <math.h>
+
+#include <epicsTypes.h>
+#include <epicsUnitTest.h>
+#include <testMain.h>
+
+#include "TRPerfStat.h"
+
+// Maximum ratio of a percentile estimate to the exact percentile
+// (the width of the widest bucket within an octave).
+static double const MaxEstimateRatio = 1.25;
+
+static void testEmpty ()
+{
+    TRPerfStat stat;
+    testOk(stat.getCount() == 0 && isnan(stat.getLast()) && isnan(stat.getMin()) &&
+           isnan(stat.getMean()) && isnan(stat.getMax()) && stat.getSum() == 0.0,
+           "Empty statistics");
+    testOk(isnan(stat.getPercentile(0.5)), "Percentile of no samples is NAN");
+}
+
+static void testBasic ()
+{
+    TRPerfStat stat;
+    stat.add(3e-3);
+    stat.add(1e-3);
+    stat.add(2e-3);
+    testOk(stat.getCount() == 3 && stat.getLast() == 2e-3 && stat.getMin() == 1e-3 &&
+           stat.getMax() == 3e-3 && fabs(stat.getMean() - 2e-3) < 1e-12,
+           "Count, last, min, mean and max");
+
+    stat.reset();
+    testOk(stat.getCount() == 0 && isnan(stat.getMin()), "Reset");
+}
+
+// Each sample must be counted in the bucket whose bounds contain it.
+static bool checkBucket (double value)
+{
+    TRPerfStat stat;
+    stat.add(value);
+
+    int index = 0;
+    while (index < TRPerfStat::NumBuckets && stat.getBucketCount(index) == 0) {
+        index++;
+    }
+    if (index == TRPerfStat::NumBuckets) {
+        return false;
+    }
+
+    bool ok;
+    if (index == TRPerfStat::NumBuckets - 1) {
+        ok = value >= TRPerfStat::bucketUpperBound(index - 1);
+    } else if (index == 0) {
+        ok = value < TRPerfStat::bucketUpperBound(0);
+    } else {
+        ok = value >= TRPerfStat::bucketUpperBound(index - 1) &&
+             value < TRPerfStat::bucketUpperBound(index);
+    }
+    if (!ok) {
+        testDiag("Value %g counted in bucket %d", value, index);
+    }
+    return ok;
+}
+
+static void testBuckets ()
+{
+    bool increasing = true;
+    for (int i = 1; i < TRPerfStat::NumBuckets; i++) {
+        if (!(TRPerfStat::bucketUpperBound(i) > TRPerfStat::bucketUpperBound(i - 1))) {
+            increasing = false;
+        }
+    }
+    testOk(increasing, "Bucket bounds are increasing");
+
+    bool ok = checkBucket(0.0) && checkBucket(-1.0) && checkBucket(1e6);
+    for (double value = 1e-7; value < 1e4; value *= 1.07) {
+        ok = checkBucket(value) && ok;
+    }
+    for (int i = 0; i < TRPerfStat::NumBuckets - 1; i++) {
+        ok = checkBucket(TRPerfStat::bucketUpperBound(i)) && ok;
+    }
+    testOk(ok, "Samples are counted in the right bucket");
+}
+
+static void testPercentiles ()
+{
+    // 10 us to 10 ms in steps of 10 us.
+    TRPerfStat stat;
+    for (int i = 1; i <= 1000; i++) {
+        stat.add(i * 1e-5);
+    }
+
+    double const fractions[4] = {0.1, 0.5, 0.9, 0.99};
+    bool ok = true;
+    for (int i = 0; i < 4; i++) {
+        double exact = fractions[i] * 1e-2;
+        double estimate = stat.getPercentile(fractions[i]);
+        if (!(estimate >= exact * (1 - 1e-9) && estimate <= exact * MaxEstimateRatio &&
+              estimate <= stat.getMax()))
+        {
+            testDiag("Percentile %g: estimate %g, exact %g", fractions[i], estimate, exact);
+            ok = false;
+        }
+    }
+    testOk(ok, "Percentiles within the bucket resolution");
+
+    testOk(stat.getPercentile(1.0) == stat.getMax() && stat.getPercentile(0.0) == stat.getMin(),
+           "Percentiles are limited to the range of samples");
+
+    TRPerfStat single;
+    single.add(3.3e-6);
+    testOk(single.getPercentile(0.01) == 3.3e-6 && single.getPercentile(0.99) == 3.3e-6,
+           "Percentiles of a single sample");
+}
+
+static void testMerge ()
+{
+    TRPerfStat a, b, all;
+    for (int i = 0; i < 100; i++) {
+        double value = (i + 1) * 3.7e-6;
+        ((i % 3 == 0) ? a : b).add(value);
+        all.add(value);
+    }
+
+    TRPerfStat merged;
+    merged.merge(a);
+    merged.merge(b);
+
+    bool buckets_equal = true;
+    for (int i = 0; i < TRPerfStat::NumBuckets; i++) {
+        if (merged.getBucketCount(i) != all.getBucketCount(i)) {
+            buckets_equal = false;
+        }
+    }
+    testOk(merged.getCount() == all.getCount() && merged.getMin() == all.getMin() &&
+           merged.getMax() == all.getMax() && fabs(merged.getSum() - all.getSum()) < 1e-12 &&
+           buckets_equal, "Merged statistics equal those of all samples");
+    testOk(merged.getLast() == b.getLast(), "Last sample taken from the merged statistics");
+
+    TRPerfStat empty;
+    merged.merge(empty);
+    testOk(merged.getCount() == all.getCount() && merged.getLast() == b.getLast(),
+           "Merging empty statistics has no effect");
+}
+
+MAIN(trPerfStatTest)
+{
+    testPlan(12);
+
+    testEmpty();
+    testBasic();
+    testBuckets();
+    testPercentiles();
+    testMerge();
+
+    return testDone();
+}
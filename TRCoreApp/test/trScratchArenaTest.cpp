@@ -0,0 +1,97 @@
+/* This file is part of the Transient Recorder Framework.
+ * It is subject to the license terms in the LICENSE.txt file found in the
+ * top-level directory of this distribution and at
+ * https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. No part
+ * of the Transient Recorder Framework, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ */
+
+/*
+ * Tests of TRScratchArena.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <epicsUnitTest.h>
+#include <testMain.h>
+
+#include "TRScratchArena.h"
+
+// Access to the functions used by the framework around an arming.
+class TRScratchArenaTest {
+public:
+    static bool prepare (TRScratchArena &arena, size_t size)
+    {
+        return arena.prepare(size);
+    }
+
+    static void reset (TRScratchArena &arena)
+    {
+        arena.reset();
+    }
+};
+
+static bool isAligned (void *ptr, size_t alignment)
+{
+    return ptr != NULL && (uintptr_t)ptr % alignment == 0;
+}
+
+static void testUnprepared ()
+{
+    TRScratchArena arena;
+    testOk(arena.alloc(1) == NULL && arena.getNumFailed() == 1, "Allocation fails before prepare");
+}
+
+static void testAlloc ()
+{
+    TRScratchArena arena;
+    testOk(TRScratchArenaTest::prepare(arena, 1000) && arena.getSize() == 1000, "Prepare");
+
+    char *a = (char *)arena.alloc(10);
+    char *b = (char *)arena.alloc(3, 1);
+    char *c = (char *)arena.alloc(8, 8);
+    char *d = (char *)arena.alloc(1);
+    testOk(isAligned(a, TRScratchArena::DefaultAlignment) && b == a + 10 &&
+           isAligned(c, 8) && c == a + 16 && isAligned(d, TRScratchArena::DefaultAlignment) &&
+           d == a + 64, "Allocations are aligned and consecutive");
+    testOk(arena.getPeakUsed() == 65, "Peak usage includes padding");
+
+    size_t mark = arena.getMark();
+    char *e = (char *)arena.alloc(100);
+    arena.releaseToMark(mark);
+    char *f = (char *)arena.alloc(100);
+    testOk(e != NULL && f == e && arena.getPeakUsed() == 228, "Release to mark reuses memory");
+
+    testOk(arena.alloc(1000) == NULL && arena.getNumFailed() == 1, "Allocation beyond the capacity fails");
+    arena.releaseToMark(mark);
+    testOk(arena.alloc(1000 - 128) != NULL && arena.alloc(1, 1) == NULL, "The whole capacity can be used");
+
+    TRScratchArenaTest::reset(arena);
+    testOk(arena.alloc(1) == NULL && arena.getSize() == 1000, "Allocation fails after reset, size is kept");
+
+    testOk(TRScratchArenaTest::prepare(arena, 500) && arena.getPeakUsed() == 0 &&
+           arena.getNumFailed() == 0 && arena.alloc(10) == a,
+           "Prepare for a smaller size keeps the buffer and clears the statistics");
+    TRScratchArenaTest::reset(arena);
+}
+
+static void testEmpty ()
+{
+    TRScratchArena arena;
+    testOk(TRScratchArenaTest::prepare(arena, 0) && arena.alloc(1) == NULL,
+           "Allocation fails with zero capacity");
+    TRScratchArenaTest::reset(arena);
+}
+
+MAIN(trScratchArenaTest)
+{
+    testPlan(10);
+
+    testUnprepared();
+    testAlloc();
+    testEmpty();
+
+    return testDone();
+}